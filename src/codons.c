@@ -0,0 +1,723 @@
+/* Program:     codons.c                                                     */
+/* Programmer:  Sean R. McCorkle                                             */
+/*              Biology Dept. Brookhaven National Laboratory                 */
+/* Language:    C                                                            */
+/*                                                                           */
+/* Description: counts codon usage in DNA or RNA coding sequences (a         */
+/*              compiled codon_freqs), overall or for each sequence, with    */
+/*              RSCU and, given a reference table, CAI                       */
+/*                                                                           */
+/* Notes:       Codons are counted from the first base of each sequence, in  */
+/*              steps of 3, in 64 counters indexed by the packed two-bit     */
+/*              encoding of the codon (A->0, C->1, G->2, T or U->3, as       */
+/*              kmers.c's twobit[]).  A codon with any other letter goes to  */
+/*              a 65th counter, which is ignored.                            */
+/*                                                                           */
+/*              RSCU (relative synonymous codon usage) of a codon is its     */
+/*              count over the mean count of the codons for its amino acid.  */
+/*              CAI (codon adaptation index, Sharp & Li 1987) is the         */
+/*              geometric mean over the codons of a sequence of w, the count */
+/*              of the codon in the reference over that of the most used     */
+/*              codon for its amino acid; codons for M, W and stops are left */
+/*              out, and codons absent from the reference get w = 0.5.  Both */
+/*              come from the counts, so everything is done in one pass.     */
+/*                                                                           */
+/*              Sequences are read a batch at a time and counted by -t       */
+/*              threads, each into its own table and output buffer; rows     */
+/*              (-s) are written out in input order.                         */
+/*                                                                           */
+/* Compiling:   cc -O3 -o codons codons.c -lm -lpthread                      */
+/*                                                                           */
+/*****************************************************************************/
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char rcsvers[] = "$Revision: 1.1 $";
+
+#define  MAX_THREADS     256
+#define  N_CODONS         64
+#define  BAD_CODON        64     /* the counter for codons with non ACGTU */
+#define  MAX_LINE       1024     /* in a reference table */
+#define  ABSENT_W        0.5     /* CAI w of codons not in the reference */
+
+/* globals set by command line options */
+
+int   report_by_sequence = 0;      /* set by -s */
+int   show_rscu          = 0;      /* set by -u */
+char *ref_file           = NULL;   /* set by -r */
+int   n_threads          = 1;      /* set by -t */
+
+/* the genetic code, as families of synonymous codons, in codon_freqs' */
+/* order (its report sorts them by amino acid)                          */
+
+typedef struct family {
+                        char         aa;
+                        const char  *codons[7];
+                      } FAMILY;
+
+FAMILY  families[] = {
+          { '*', { "TAA", "TGA", "TAG" } },
+          { 'A', { "GCT", "GCC", "GCA", "GCG" } },
+          { 'C', { "TGT", "TGC" } },
+          { 'D', { "GAT", "GAC" } },
+          { 'E', { "GAA", "GAG" } },
+          { 'F', { "TTT", "TTC" } },
+          { 'G', { "GGT", "GGC", "GGA", "GGG" } },
+          { 'H', { "CAT", "CAC" } },
+          { 'I', { "ATT", "ATC", "ATA" } },
+          { 'K', { "AAA", "AAG" } },
+          { 'L', { "TTA", "TTG", "CTT", "CTC", "CTA", "CTG" } },
+          { 'M', { "ATG" } },
+          { 'N', { "AAT", "AAC" } },
+          { 'P', { "CCT", "CCC", "CCA", "CCG" } },
+          { 'Q', { "CAA", "CAG" } },
+          { 'R', { "CGT", "CGC", "CGA", "CGG", "AGA", "AGG" } },
+          { 'S', { "TCT", "TCC", "TCA", "TCG", "AGT", "AGC" } },
+          { 'T', { "ACT", "ACC", "ACA", "ACG" } },
+          { 'V', { "GTT", "GTC", "GTA", "GTG" } },
+          { 'W', { "TGG" } },
+          { 'Y', { "TAT", "TAC" } },
+          { 0,   { NULL } }
+        };
+
+unsigned int  twobit[256];            /* maps nucleotide char to 2 bits */
+unsigned int  no_count[256];          /* 1 => char is not to be counted */
+unsigned char is_space[256];          /* 1 if whitespace */
+int           family_of[N_CODONS];    /* codon index -> families[] index */
+int           family_size[N_CODONS];  /* number of synonyms of codon */
+char          codon_name[N_CODONS][4];
+double        log_w[N_CODONS];        /* CAI: ln w of codon, from -r */
+int           in_cai[N_CODONS];       /* 1 if codon counts for CAI */
+
+
+/* version() - print program name and version */
+
+void  version( void )
+   {
+    char *v;
+    for ( v = rcsvers; *v && *v != ' '; v++ )
+        ;
+    v++;
+    v[strlen(v)-1] = '\0';
+    fprintf( stderr, "\ncodons       version %s\n", v );
+   }
+
+
+/* usage() - print help */
+
+void usage( void )
+   {
+    fprintf( stderr, " \n\
+Usage:       codons [-su] [-r<ref-table>] [-t<n>] [-hV] [seq-file ... ]   \n\
+                                                                          \n\
+             where [seq-files] are in FASTA format.  The name \"-\" means \n\
+             stdin.  stdin is scanned it no filemames are specified.      \n\
+                                                                          \n\
+             Prints, for each amino acid and codon, the codon's count,    \n\
+             percent of all codons, percent of the amino acid's codons    \n\
+             and RSCU, over all the sequences (codon_freqs' table, with   \n\
+             RSCU added).  Codons are read from the first base in steps   \n\
+             of 3; those with letters other than A, C, G, T or U are      \n\
+             ignored.                                                     \n\
+                                                                          \n\
+Options:     -s      instead print a table of counts for each sequence,   \n\
+                     tab separated: name (up to the first space), number  \n\
+                     of codons, CAI (with -r) and the counts of the 64    \n\
+                     codons, AAA, AAC, ... TTT                            \n\
+             -u      with -s, print RSCU instead of counts                \n\
+             -r<f>   compute CAI against the reference codon counts in    \n\
+                     <f>, a table printed by codons (or codon_freqs) for  \n\
+                     highly expressed genes, for each sequence with -s,   \n\
+                     or for all of them (last line)                       \n\
+             -t<n>   count with <n> threads                               \n\
+             -V      print version                                        \n\
+             -h      print help message                                   \n\
+                                                                          \n\
+" );
+
+   }
+
+
+/* extract command line arguments and options */
+
+void parse_args ( int argc, char **argv, int *nfiles, char ***filenames )
+   {
+    static char *stand_in[] = { "-", (char *) 0 };
+    int    c;
+
+    while ( (c = getopt( argc, argv, "hr:st:uV")) != -1 )
+        switch ( c )
+           {
+            case 'r':  ref_file = optarg;           break;
+            case 's':  report_by_sequence = 1;      break;
+            case 'u':  show_rscu = 1;               break;
+            case 't':  n_threads = atoi( optarg );
+                       if ( n_threads < 1 || n_threads > MAX_THREADS )
+                          {
+                           fprintf( stderr, "-t must be in range 1-%d\n",
+                                            MAX_THREADS );
+                           exit( 1 );
+                          }
+                       break;
+            case 'V':  version();               exit(0);
+            case 'h':  version();
+                       usage();
+                       exit(0);
+            default:   usage();                 exit(1);
+           }
+    argc -= optind;
+    argv += optind;
+    if ( argc > 0 )
+       {
+        *nfiles = argc;
+        *filenames = argv;
+       }
+    else
+       {
+        *nfiles = 1;
+        *filenames = stand_in;
+       }
+   }
+
+
+/*********************************************************************/
+/* open_file() opens a file or returns stdin if name is "-", or does */
+/* error exit if file can't be opened                                */
+/*********************************************************************/
+
+FILE *open_file( char *name )
+   {
+    FILE *f;
+
+    if ( strcmp( name, "-" ) == 0 )
+        return( stdin );
+    else
+        if ( (f = fopen( name, "r" ) ) )
+            return( f );
+        else
+           {
+            perror( name );
+            exit( errno );
+           }
+   }
+
+
+/* close_file() closes the file unless its stdin */
+
+void  close_file( FILE *f )
+   {
+    if ( f != stdin )
+        fclose( f );
+   }
+
+
+void  *malloc_safely( size_t n_bytes )   /* malloc() or error exit */
+   {
+    void  *p;
+
+    if ( !(p = malloc( n_bytes )) )
+       {
+        fprintf( stderr, "failed to malloc %lu bytes\n",
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+void  *realloc_safely( void *p, size_t n_bytes )   /* same for realloc() */
+   {
+    if ( !(p = realloc( p, n_bytes )) )
+       {
+        fprintf( stderr, "failed to realloc %lu bytes\n",
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+
+/* codon index of the triplet c (no check) */
+
+int  codon_index( const char *c )
+   {
+    return( ( twobit[ (unsigned char) c[0] ] << 4 )
+              | ( twobit[ (unsigned char) c[1] ] << 2 )
+              | twobit[ (unsigned char) c[2] ] );
+   }
+
+
+/* set up the character functions and the codon tables */
+
+void  init( void )
+   {
+    static const char  bases[] = "ACGT";
+    int                i, f, j, c;
+
+    for ( i = 0; i < 256; i++ )
+       {
+        twobit[i] = 0;
+        no_count[i] = 1;
+        is_space[i] = isspace( i ) != 0;
+       }
+    for ( i = 0; i < 4; i++ )
+       {
+        twobit[ (int) bases[i] ] = twobit[ tolower( bases[i] ) ] = i;
+        no_count[ (int) bases[i] ] = no_count[ tolower( bases[i] ) ] = 0;
+       }
+    twobit['U'] = twobit['u'] = 3;
+    no_count['U'] = no_count['u'] = 0;
+    for ( c = 0; c < N_CODONS; c++ )
+       {
+        codon_name[c][0] = bases[c >> 4];
+        codon_name[c][1] = bases[(c >> 2) & 3];
+        codon_name[c][2] = bases[c & 3];
+        codon_name[c][3] = '\0';
+       }
+    for ( f = 0; families[f].aa; f++ )
+       {
+        for ( j = 0; families[f].codons[j]; j++ )
+            ;
+        for ( i = 0; i < j; i++ )
+           {
+            c = codon_index( families[f].codons[i] );
+            family_of[c] = f;
+            family_size[c] = j;
+            in_cai[c] = j > 1 && families[f].aa != '*';
+           }
+       }
+   }
+
+
+/* read the reference codon counts from a codons (or codon_freqs) table: */
+/* lines of amino acid, codon, count, ...  and compute log_w[] from them */
+
+void  read_reference( void )
+   {
+    FILE           *f;
+    char            line[MAX_LINE], aa[8], cod[8];
+    unsigned long   n;
+    double          ref[N_CODONS], max;
+    int             c, d, i, found = 0;
+
+    if ( ! (f = fopen( ref_file, "r" )) )
+       {
+        perror( ref_file );
+        exit( errno );
+       }
+    for ( c = 0; c < N_CODONS; c++ )
+        ref[c] = 0.0;
+    while ( fgets( line, MAX_LINE, f ) )
+       {
+        if ( sscanf( line, "%7s %7s %lu", aa, cod, &n ) != 3
+                || strlen( cod ) != 3 )
+            continue;
+        for ( i = 0; i < 3 && ! no_count[ (unsigned char) cod[i] ]; i++ )
+            ;
+        if ( i < 3 )
+            continue;
+        ref[ codon_index( cod ) ] += n;
+        found++;
+       }
+    fclose( f );
+    if ( found == 0 )
+       {
+        fprintf( stderr, "no codon counts in reference table %s\n",
+                         ref_file );
+        exit( 1 );
+       }
+    for ( c = 0; c < N_CODONS; c++ )
+       {
+        for ( max = 0.0, d = 0; d < N_CODONS; d++ )
+            if ( family_of[d] == family_of[c] && ref[d] > max )
+                max = ref[d];
+        log_w[c] = log( ref[c] > 0.0 ? ref[c] / max : ABSENT_W );
+       }
+   }
+
+
+/* count the codons of sequence s (length n) into cnt[] */
+
+void  count_codons( const unsigned char *s, size_t n, uint64_t *cnt )
+   {
+    size_t  i;
+    int     c;
+
+    for ( i = 0; i + 3 <= n; i += 3 )
+       {
+        c = ( twobit[ s[i] ] << 4 ) | ( twobit[ s[i+1] ] << 2 )
+                                    | twobit[ s[i+2] ];
+        cnt[ no_count[ s[i] ] | no_count[ s[i+1] ] | no_count[ s[i+2] ]
+                   ? BAD_CODON : c ]++;
+       }
+   }
+
+
+/* CAI of codon counts cnt[], or NaN if none count */
+
+double  cai( const uint64_t *cnt )
+   {
+    double    sum = 0.0;
+    uint64_t  len = 0;
+    int       c;
+
+    for ( c = 0; c < N_CODONS; c++ )
+        if ( in_cai[c] )
+           {
+            sum += cnt[c] * log_w[c];
+            len += cnt[c];
+           }
+    return( len > 0 ? exp( sum / len ) : NAN );
+   }
+
+
+/* RSCU of each codon, from counts cnt[], into rscu[] */
+
+void  compute_rscu( const uint64_t *cnt, double *rscu )
+   {
+    uint64_t  fam_total[N_CODONS];
+    int       c;
+
+    for ( c = 0; c < N_CODONS; c++ )
+        fam_total[c] = 0;
+    for ( c = 0; c < N_CODONS; c++ )
+        fam_total[ family_of[c] ] += cnt[c];
+    for ( c = 0; c < N_CODONS; c++ )
+        rscu[c] = fam_total[ family_of[c] ] > 0
+                      ? (double) cnt[c] * family_size[c]
+                                / fam_total[ family_of[c] ]
+                      : 0.0;
+   }
+
+
+                       /******************************/
+                       /* Batches of sequences, and  */
+                       /* the threads counting them  */
+                       /******************************/
+
+#define  BATCH_SEQS        65536      /* max sequences in one batch */
+#define  BATCH_BYTES       (64 << 20) /* stop filling a batch after this */
+
+typedef struct buffer {                       /* growable byte buffer */
+                        char    *p;
+                        size_t   n;
+                        size_t   size;
+                      } BUFFER;
+
+typedef struct record {
+                        size_t   hdr;         /* offsets into batch data */
+                        size_t   hdr_len;
+                        size_t   seq;
+                        size_t   seq_len;
+                        size_t   out;         /* offset and length of the */
+                        size_t   out_len;     /* row (-s) in its thread's */
+                      } RECORD;               /* out                      */
+
+typedef struct batch {
+                       BUFFER   data;         /* headers and sequences */
+                       RECORD  *recs;
+                       int      n;
+                     } BATCH;
+
+typedef struct worker {
+                        pthread_t   thread;
+                        int         id;
+                        BATCH      *batch;
+                        uint64_t    counts[N_CODONS+1];  /* its share */
+                        BUFFER      out;      /* -s rows go here         */
+                      } WORKER;
+
+WORKER  workers[MAX_THREADS];
+
+
+void  buf_need( BUFFER *b, size_t n )          /* make room for n more */
+   {
+    if ( b->n + n <= b->size )
+        return;
+    if ( b->size == 0 )
+        b->size = 65536;
+    while ( b->n + n > b->size )
+        b->size *= 2;
+    b->p = realloc_safely( b->p, b->size );
+   }
+
+
+/* input is read a line at a time; line holds the next one to look at, */
+/* len its length (or -1 at end of file)                               */
+
+typedef struct reader {
+                        FILE     *f;
+                        char     *line;
+                        size_t    size;
+                        ssize_t   len;
+                      } READER;
+
+/* read up to BATCH_SEQS sequences (or about BATCH_BYTES) from rd; header */
+/* and sequence (with whitespace removed) go into b->data.  Returns the   */
+/* number read.  Anything before the first header is skipped.             */
+
+int  read_batch( READER *rd, BATCH *b )
+   {
+    RECORD  *r;
+    char    *d;
+    ssize_t  i, n;
+
+    b->n = 0;
+    b->data.n = 0;
+    while ( rd->len >= 0 && rd->line[0] != '>' )    /* find a header */
+        rd->len = getline( &rd->line, &rd->size, rd->f );
+    while ( rd->len >= 0 && b->n < BATCH_SEQS && b->data.n < BATCH_BYTES )
+       {
+        r = &b->recs[b->n++];
+        n = rd->len;
+        if ( n > 0 && rd->line[n-1] == '\n' )
+            n--;
+        buf_need( &b->data, n );
+        memcpy( b->data.p + b->data.n, rd->line + 1, n - 1 );
+        r->hdr = b->data.n;
+        r->hdr_len = n - 1;
+        b->data.n += n - 1;
+        r->seq = b->data.n;
+        while ( (rd->len = getline( &rd->line, &rd->size, rd->f )) >= 0
+                    && rd->line[0] != '>' )
+           {
+            buf_need( &b->data, rd->len );
+            d = b->data.p + b->data.n;
+            for ( i = 0; i < rd->len; i++ )
+               {
+                *d = rd->line[i];
+                d += ! is_space[ (unsigned char) rd->line[i] ];
+               }
+            b->data.n = d - b->data.p;
+           }
+        r->seq_len = b->data.n - r->seq;
+       }
+    return( b->n );
+   }
+
+
+/* write v in decimal at p.  Returns the end */
+
+char  *fmt_uint( char *p, uint64_t v )
+   {
+    char  digits[24];
+    int   n = 0;
+
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+       } while ( v > 0 );
+    while ( n > 0 )
+        *p++ = digits[--n];
+    return( p );
+   }
+
+
+/* count record r's codons into w's table and, with -s, format its row */
+
+void  count_record( WORKER *w, RECORD *r )
+   {
+    BUFFER    *o = &w->out;
+    uint64_t   cnt[N_CODONS+1];
+    uint64_t   total;
+    double     rscu[N_CODONS];
+    const char *h = w->batch->data.p + r->hdr;
+    size_t     name_len;
+    int        c;
+
+    memset( cnt, 0, sizeof( cnt ) );
+    count_codons( (unsigned char *) w->batch->data.p + r->seq, r->seq_len,
+                  cnt );
+    for ( c = 0; c <= N_CODONS; c++ )
+        w->counts[c] += cnt[c];
+    if ( ! report_by_sequence )
+        return;
+    r->out = o->n;
+    for ( name_len = 0; name_len < r->hdr_len
+                          && ! is_space[ (unsigned char) h[name_len] ];
+          name_len++ )
+        ;
+    for ( total = 0, c = 0; c < N_CODONS; c++ )
+        total += cnt[c];
+    buf_need( o, name_len + 32 + 32 + N_CODONS * 24 );
+    memcpy( o->p + o->n, h, name_len );
+    o->n += name_len;
+    o->p[o->n++] = '\t';
+    o->n = fmt_uint( o->p + o->n, total ) - o->p;
+    if ( ref_file )
+       {
+        if ( ! isnan( cai( cnt ) ) )
+            o->n += sprintf( o->p + o->n, "\t%.4f", cai( cnt ) );
+        else
+            o->n += sprintf( o->p + o->n, "\tNA" );
+       }
+    if ( show_rscu )
+       {
+        compute_rscu( cnt, rscu );
+        for ( c = 0; c < N_CODONS; c++ )
+            o->n += sprintf( o->p + o->n, "\t%.3f", rscu[c] );
+       }
+    else
+        for ( c = 0; c < N_CODONS; c++ )
+           {
+            o->p[o->n++] = '\t';
+            o->n = fmt_uint( o->p + o->n, cnt[c] ) - o->p;
+           }
+    o->p[o->n++] = '\n';
+    r->out_len = o->n - r->out;
+   }
+
+
+void  *worker( void *arg )
+   {
+    WORKER  *w = (WORKER *) arg;
+    BATCH   *b = w->batch;
+    int      i;
+
+    w->out.n = 0;
+    for ( i = w->id; i < b->n; i += n_threads )
+        count_record( w, &b->recs[i] );
+    return( NULL );
+   }
+
+
+/* count the codons of every sequence in file f */
+
+void  codons_file( FILE *f, BATCH *b )
+   {
+    static READER  rd;
+    int            i, n;
+
+    rd.f = f;
+    rd.len = getline( &rd.line, &rd.size, f );
+    while ( (n = read_batch( &rd, b )) > 0 )
+       {
+        for ( i = 0; i < n_threads; i++ )
+            workers[i].batch = b;
+        if ( n_threads == 1 )
+            worker( &workers[0] );
+        else
+           {
+            for ( i = 0; i < n_threads; i++ )
+                if ( pthread_create( &workers[i].thread, NULL, worker,
+                                     &workers[i] ) != 0 )
+                   {
+                    perror( "can't create thread" );
+                    exit( 1 );
+                   }
+            for ( i = 0; i < n_threads; i++ )
+                pthread_join( workers[i].thread, NULL );
+           }
+        if ( report_by_sequence )
+            for ( i = 0; i < n; i++ )            /* rows in input order */
+                if ( fwrite( workers[i % n_threads].out.p + b->recs[i].out,
+                             1, b->recs[i].out_len, stdout )
+                        != b->recs[i].out_len )
+                   {
+                    perror( "codons: write" );
+                    exit( errno );
+                   }
+       }
+    if ( ferror( f ) )
+       {
+        perror( "codons: read" );
+        exit( errno );
+       }
+   }
+
+
+/* print the header line of the -s table */
+
+void  print_row_header( void )
+   {
+    int  c;
+
+    printf( "#name\tcodons" );
+    if ( ref_file )
+        printf( "\tcai" );
+    for ( c = 0; c < N_CODONS; c++ )
+        printf( "\t%s", codon_name[c] );
+    printf( "\n" );
+   }
+
+
+/* print the table of codon usage over all sequences, as codon_freqs */
+/* does, with RSCU added, and the CAI of all of them with -r          */
+
+void  report( void )
+   {
+    uint64_t  cnt[N_CODONS+1];
+    uint64_t  total, aa_total;
+    double    rscu[N_CODONS];
+    int       t, c, f, j;
+
+    memset( cnt, 0, sizeof( cnt ) );
+    for ( t = 0; t < n_threads; t++ )
+        for ( c = 0; c <= N_CODONS; c++ )
+            cnt[c] += workers[t].counts[c];
+    compute_rscu( cnt, rscu );
+    for ( total = 0, c = 0; c < N_CODONS; c++ )
+        total += cnt[c];
+    for ( f = 0; families[f].aa; f++ )
+       {
+        for ( aa_total = 0, j = 0; families[f].codons[j]; j++ )
+            aa_total += cnt[ codon_index( families[f].codons[j] ) ];
+        for ( j = 0; families[f].codons[j]; j++ )
+           {
+            c = codon_index( families[f].codons[j] );
+            printf( "%c %s  %10llu  %8.3f  %8.3f  %8.3f\n", families[f].aa,
+                    codon_name[c], (unsigned long long) cnt[c],
+                    total > 0 ? 100.0 * cnt[c] / total : 0.0,
+                    aa_total > 0 ? 100.0 * cnt[c] / aa_total : 0.0,
+                    rscu[c] );
+           }
+       }
+    if ( ref_file )
+       {
+        if ( ! isnan( cai( cnt ) ) )
+            printf( "CAI %.4f\n", cai( cnt ) );
+        else
+            printf( "CAI NA\n" );
+       }
+   }
+
+
+                                /****************/
+                                /* Main Program */
+                                /****************/
+
+
+int main ( int argc, char **argv )
+   {
+    static BATCH   batch;
+    int            nfiles;
+    int            i;
+    static char  **filenames;
+    FILE          *f;
+
+    parse_args( argc, argv, &nfiles, &filenames );
+    init();
+    if ( ref_file )
+        read_reference();
+    batch.recs = malloc_safely( BATCH_SEQS * sizeof( RECORD ) );
+    for ( i = 0; i < n_threads; i++ )
+        workers[i].id = i;
+    if ( report_by_sequence )
+        print_row_header();
+    for ( i = 0; i < nfiles; i++ )
+       {
+        f = open_file( filenames[i] );
+        codons_file( f, &batch );
+        close_file( f );
+       }
+    if ( ! report_by_sequence )
+        report();
+    exit( 0 );
+   }
@@ -0,0 +1,606 @@
+/* Program:     extract.c                                                    */
+/* Programmer:  Sean R. McCorkle                                             */
+/*              Biology Dept. Brookhaven National Laboratory                 */
+/* Language:    C                                                            */
+/*                                                                           */
+/* Description: Reads a list of identifiers from a file, one per line, and   */
+/*              passes the FASTA (or FASTQ) records whose IDs are in it (a   */
+/*              compiled extract_sequences_list, with the same options and   */
+/*              output)                                                      */
+/*                                                                           */
+/* Notes:       The list file is mmap()ed and left as it is: the set of IDs  */
+/*              is an open addressing hash table of 64 bit slots, each the   */
+/*              offset of an ID in the mapped list (40 bits), 23 bits of its */
+/*              hash, to skip most compares, and a bit for "passed already"  */
+/*              for -u.  So 50M IDs need 1G of table and the list itself,    */
+/*              rather than a perl hash of tens of G.                        */
+/*                                                                           */
+/*              Input is read in large blocks, and the records passed are    */
+/*              written straight out of them, as runs of whole lines.        */
+/*                                                                           */
+/* Compiling:   cc -O3 -o extract extract.c                                  */
+/*                                                                           */
+/*****************************************************************************/
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static char rcsvers[] = "$Revision: 1.1 $";
+
+#define  READ_SIZE       (16 << 20)   /* input is read this much at a time */
+
+#define  OFF_BITS        40           /* slot: offset of ID + 1, */
+#define  OFF_MASK        ( ( (uint64_t) 1 << OFF_BITS ) - 1 )
+#define  TAG_MASK        ( ( (uint64_t) 0x7fffff ) << OFF_BITS )  /* hash */
+#define  PASSED          ( (uint64_t) 1 << 63 )                   /* -u */
+#define  TAG(h)          ( ( (h) >> 1 ) & TAG_MASK )    /* high hash bits */
+
+/* globals set by command line options */
+
+int   fastq              = 0;      /* set by -Q */
+int   unique             = 0;      /* set by -u */
+int   complement         = 0;      /* set by -v */
+
+unsigned char  is_space[256];      /* 1 if whitespace */
+
+
+/* version() - print program name and version */
+
+void  version( void )
+   {
+    char *v;
+    for ( v = rcsvers; *v && *v != ' '; v++ )
+        ;
+    v++;
+    v[strlen(v)-1] = '\0';
+    fprintf( stderr, "\nextract      version %s\n", v );
+   }
+
+
+/* usage() - print help */
+
+void usage( void )
+   {
+    fprintf( stderr, " \n\
+Usage:       extract [-Quv] [-hV] <wanted-list> [seq-file ...]            \n\
+                                                                          \n\
+             where <wanted-list> has one ID a line, and [seq-files] are   \n\
+             in FASTA format (FASTQ with -Q).  The name \"-\" means       \n\
+             stdin.  stdin is scanned if no filenames are specified.      \n\
+                                                                          \n\
+             A record is passed if its ID (the first word of its header,  \n\
+             with a trailing /1 or /2 removed for FASTQ) is in the list.  \n\
+             Records are copied as they are, except that blank lines are  \n\
+             left out of FASTA.                                           \n\
+                                                                          \n\
+Options:     -u      unique - don't pass the same ID more than once       \n\
+             -v      complementary sense - pass the records whose IDs     \n\
+                     are NOT in the list                                  \n\
+             -Q      input files are FASTQ, not FASTA (output FASTQ too)  \n\
+             -V      print version                                        \n\
+             -h      print help message                                   \n\
+                                                                          \n\
+" );
+
+   }
+
+
+/* extract command line arguments and options */
+
+void parse_args ( int argc, char **argv, char **list, int *nfiles,
+                  char ***filenames )
+   {
+    static char *stand_in[] = { "-", (char *) 0 };
+    int    c;
+
+    while ( (c = getopt( argc, argv, "hQuvV")) != -1 )
+        switch ( c )
+           {
+            case 'Q':  fastq = 1;                   break;
+            case 'u':  unique = 1;                  break;
+            case 'v':  complement = 1;              break;
+            case 'V':  version();               exit(0);
+            case 'h':  version();
+                       usage();
+                       exit(0);
+            default:   usage();                 exit(1);
+           }
+    argc -= optind;
+    argv += optind;
+    if ( argc < 1 )
+       {
+        usage();
+        exit( 1 );
+       }
+    *list = argv[0];
+    argc--;
+    argv++;
+    if ( argc > 0 )
+       {
+        *nfiles = argc;
+        *filenames = argv;
+       }
+    else
+       {
+        *nfiles = 1;
+        *filenames = stand_in;
+       }
+   }
+
+
+/*********************************************************************/
+/* open_file() opens a file or returns stdin if name is "-", or does */
+/* error exit if file can't be opened                                */
+/*********************************************************************/
+
+FILE *open_file( char *name )
+   {
+    FILE *f;
+
+    if ( strcmp( name, "-" ) == 0 )
+        return( stdin );
+    else
+        if ( (f = fopen( name, "r" ) ) )
+            return( f );
+        else
+           {
+            perror( name );
+            exit( errno );
+           }
+   }
+
+
+/* close_file() closes the file unless its stdin */
+
+void  close_file( FILE *f )
+   {
+    if ( f != stdin )
+        fclose( f );
+   }
+
+
+void  *malloc_safely( size_t n_bytes )   /* malloc() or error exit */
+   {
+    void  *p;
+
+    if ( !(p = malloc( n_bytes )) )
+       {
+        fprintf( stderr, "failed to malloc %lu bytes\n",
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+void  *realloc_safely( void *p, size_t n_bytes )   /* same for realloc() */
+   {
+    if ( !(p = realloc( p, n_bytes )) )
+       {
+        fprintf( stderr, "failed to realloc %lu bytes\n",
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+
+typedef struct buffer {                       /* growable byte buffer */
+                        char    *p;
+                        size_t   n;
+                        size_t   size;
+                      } BUFFER;
+
+void  buf_need( BUFFER *b, size_t n )          /* make room for n more */
+   {
+    if ( b->n + n <= b->size )
+        return;
+    if ( b->size == 0 )
+        b->size = 65536;
+    while ( b->n + n > b->size )
+        b->size *= 2;
+    b->p = realloc_safely( b->p, b->size );
+   }
+
+
+                             /*******************/
+                             /* Sets of IDs     */
+                             /*******************/
+
+typedef struct idset {
+                       const char  *text;     /* the IDs, each ending at */
+                       size_t       len;      /* whitespace or len       */
+                       uint64_t    *slots;
+                       size_t       mask;     /* slots - 1, a power of 2 */
+                       size_t       n;
+                     } IDSET;
+
+
+static inline uint64_t  hash_id( const char *s, size_t n )
+   {
+    uint64_t  h = 14695981039346656037ULL;      /* FNV-1a */
+
+    while ( n-- > 0 )
+        h = ( h ^ (unsigned char) *s++ ) * 1099511628211ULL;
+    return( h ^ ( h >> 29 ) );
+   }
+
+
+/* the slot of ID s (length n, hash h) in set t, or the empty slot */
+/* where it would go                                               */
+
+static inline uint64_t  *id_slot( IDSET *t, const char *s, size_t n,
+                                  uint64_t h )
+   {
+    uint64_t  tag = TAG( h );
+    uint64_t  v;
+    size_t    i, o;
+
+    for ( i = h & t->mask; (v = t->slots[i]); i = ( i + 1 ) & t->mask )
+        if ( ( v & TAG_MASK ) == tag )
+           {
+            o = ( v & OFF_MASK ) - 1;
+            if ( o + n <= t->len && memcmp( t->text + o, s, n ) == 0
+                    && ( o + n == t->len
+                            || is_space[ (unsigned char) t->text[o+n] ] ) )
+                return( &t->slots[i] );
+           }
+    return( &t->slots[i] );
+   }
+
+
+void  set_alloc( IDSET *t, size_t n )   /* empty, room for n (load <= 2/3) */
+   {
+    size_t  size = 1024;
+
+    while ( size < n + n / 2 )
+        size *= 2;
+    t->slots = malloc_safely( size * sizeof( uint64_t ) );
+    memset( t->slots, 0, size * sizeof( uint64_t ) );
+    t->mask = size - 1;
+    t->n = 0;
+   }
+
+
+/* length of the ID at offset o of t->text */
+
+size_t  id_len( const IDSET *t, size_t o )
+   {
+    size_t  e;
+
+    for ( e = o; e < t->len && ! is_space[ (unsigned char) t->text[e] ]; e++ )
+        ;
+    return( e - o );
+   }
+
+
+/* put the ID at offset o (length n, hash h) in slot p of t */
+
+static inline void  set_put( IDSET *t, uint64_t *p, size_t o, uint64_t h )
+   {
+    *p = TAG( h ) | ( o + 1 );
+    t->n++;
+   }
+
+
+/* double the slots of t */
+
+void  set_grow( IDSET *t )
+   {
+    uint64_t  *old = t->slots;
+    size_t     size = t->mask + 1;
+    size_t     i, o, n;
+    uint64_t   h;
+
+    set_alloc( t, 2 * size );
+    for ( i = 0; i < size; i++ )
+        if ( old[i] )
+           {
+            o = ( old[i] & OFF_MASK ) - 1;
+            n = id_len( t, o );
+            h = hash_id( t->text + o, n );
+            *id_slot( t, t->text + o, n, h ) = old[i];
+            t->n++;
+           }
+    free( old );
+   }
+
+
+IDSET   wanted;                    /* the list */
+IDSET   others;                    /* IDs passed with -u -v */
+BUFFER  others_text;
+
+
+/* map the list file, and put its IDs in wanted; as the perl, an ID is */
+/* a whole line less leading and trailing whitespace (so one with      */
+/* whitespace inside it could never be found, and is left out)         */
+
+void  read_list( char *name )
+   {
+    struct stat   st;
+    int           fd;
+    const char   *p, *e, *end, *s, *q;
+    size_t        lines, m;
+    char         *copy;
+    uint64_t     *slot, h;
+
+    if ( (fd = open( name, O_RDONLY )) < 0 || fstat( fd, &st ) < 0 )
+       {
+        perror( name );
+        exit( errno );
+       }
+    if ( S_ISREG( st.st_mode ) && st.st_size > 0 )
+       {
+        wanted.len = st.st_size;
+        wanted.text = mmap( NULL, wanted.len, PROT_READ, MAP_SHARED, fd, 0 );
+        if ( wanted.text == MAP_FAILED )
+           {
+            perror( name );
+            exit( errno );
+           }
+        madvise( (void *) wanted.text, wanted.len, MADV_SEQUENTIAL );
+       }
+    else                                 /* a pipe, say: read it in */
+       {
+        copy = NULL;
+        wanted.len = 0;
+        do {
+            copy = realloc_safely( copy, wanted.len + READ_SIZE );
+            m = read( fd, copy + wanted.len, READ_SIZE );
+            if ( m == (size_t) -1 )
+               {
+                perror( name );
+                exit( errno );
+               }
+            wanted.len += m;
+           } while ( m > 0 );
+        wanted.text = copy;
+       }
+    close( fd );
+    if ( wanted.len >= OFF_MASK )
+       {
+        fprintf( stderr, "%s is too big\n", name );
+        exit( 1 );
+       }
+    end = wanted.text + wanted.len;
+    for ( lines = 1, p = wanted.text; (p = memchr( p, '\n', end - p )); p++ )
+        lines++;
+    set_alloc( &wanted, lines );
+    for ( p = wanted.text; p < end; p = e + 1 )
+       {
+        if ( ! (e = memchr( p, '\n', end - p )) )
+            e = end;
+        for ( s = p; s < e && is_space[ (unsigned char) *s ]; s++ )
+            ;
+        for ( q = s; q < e && ! is_space[ (unsigned char) *q ]; q++ )
+            ;
+        if ( q == s )
+            continue;                                /* blank */
+        for ( m = q - s; q < e && is_space[ (unsigned char) *q ]; q++ )
+            ;
+        if ( q < e )
+            continue;                      /* whitespace inside */
+        h = hash_id( s, m );
+        if ( *(slot = id_slot( &wanted, s, m, h )) == 0 )
+            set_put( &wanted, slot, s - wanted.text, h );
+       }
+    madvise( (void *) wanted.text, wanted.len, MADV_RANDOM );
+   }
+
+
+/* whether to pass the record with ID s (length n) */
+
+int  pass_id( const char *s, size_t n )
+   {
+    uint64_t  h = hash_id( s, n );
+    uint64_t *slot = id_slot( &wanted, s, n, h );
+
+    if ( ! complement )
+       {
+        if ( *slot == 0 || ( *slot & PASSED ) )
+            return( 0 );
+        if ( unique )
+            *slot |= PASSED;
+        return( 1 );
+       }
+    if ( *slot != 0 )
+        return( 0 );
+    if ( unique )             /* remember the IDs not listed as passed */
+       {
+        if ( *(slot = id_slot( &others, s, n, h )) != 0 )
+            return( 0 );
+        buf_need( &others_text, n + 1 );
+        memcpy( others_text.p + others_text.n, s, n );
+        others_text.p[others_text.n + n] = '\n';
+        others.text = others_text.p;
+        set_put( &others, slot, others_text.n, h );
+        others_text.n += n + 1;
+        others.len = others_text.n;
+        if ( 3 * others.n > 2 * ( others.mask + 1 ) )
+            set_grow( &others );
+       }
+    return( 1 );
+   }
+
+
+                        /***********************************/
+                        /* Reading records, passing them   */
+                        /***********************************/
+
+int          passing = 0;          /* in a record being passed */
+long         fastq_line = 0;       /* line number in a FASTQ record */
+const char  *run = NULL;           /* start of lines to write */
+
+
+void  write_run( const char *e )    /* write lines from run to e */
+   {
+    if ( run && e > run && fwrite( run, 1, e - run, stdout )
+                                != (size_t) ( e - run ) )
+       {
+        perror( "extract: write" );
+        exit( errno );
+       }
+    run = NULL;
+   }
+
+
+/* FASTA line p..e (e after its newline, if it has one) */
+
+static inline void  fasta_line( const char *p, const char *e )
+   {
+    const char  *q;
+
+    if ( *p == '>' )
+       {
+        for ( q = p + 1; q < e && ! is_space[ (unsigned char) *q ]; q++ )
+            ;
+        if ( q > p + 1 )                 /* else as the line before */
+            passing = pass_id( p + 1, q - p - 1 );
+       }
+    else if ( is_space[ (unsigned char) *p ] )
+       {
+        for ( q = p; q < e && is_space[ (unsigned char) *q ]; q++ )
+            ;
+        if ( q == e )                            /* blank: left out */
+           {
+            write_run( p );
+            return;
+           }
+       }
+    if ( ! passing )
+        write_run( p );
+    else if ( ! run )
+        run = p;
+   }
+
+
+/* FASTQ line p..e, line fastq_line of its record */
+
+static inline void  fastq_line_at( const char *p, const char *e )
+   {
+    const char  *q;
+
+    switch ( fastq_line )
+       {
+        case 0:  if ( *p != '@' )
+                    {
+                     fprintf( stderr, "does not look like FASTQ header: "
+                                      "%.*s", (int) ( e - p ), p );
+                     exit( 1 );
+                    }
+                 for ( q = p + 1; q < e && ! is_space[ (unsigned char) *q ];
+                       q++ )
+                     ;
+                 if ( q - p >= 3 && q[-2] == '/'
+                                 && ( q[-1] == '1' || q[-1] == '2' ) )
+                     q -= 2;
+                 passing = pass_id( p + 1, q - p - 1 );
+                 break;
+        case 2:  if ( *p != '+' )
+                    {
+                     fprintf( stderr, "did not find FASTQ quality header "
+                                      "line\n" );
+                     exit( 1 );
+                    }
+                 break;
+       }
+    fastq_line = ( fastq_line + 1 ) & 3;
+    if ( ! passing )
+        write_run( p );
+    else if ( ! run )
+        run = p;
+   }
+
+
+/* pass the records of file f */
+
+void  extract_file( FILE *f, char *name )
+   {
+    static BUFFER  b;
+    const char    *p, *e, *end;
+    size_t         m, done;
+    int            eof = 0;
+
+    b.n = 0;
+    while ( ! eof )
+       {
+        buf_need( &b, READ_SIZE );
+        m = fread( b.p + b.n, 1, READ_SIZE, f );
+        b.n += m;
+        if ( m < READ_SIZE )
+           {
+            if ( ferror( f ) )
+               {
+                perror( name );
+                exit( errno );
+               }
+            eof = 1;
+           }
+        end = b.p + b.n;
+        if ( ! eof )                         /* whole lines only */
+            while ( end > b.p && end[-1] != '\n' )
+                end--;
+        for ( p = b.p; p < end; p = e )
+           {
+            if ( (e = memchr( p, '\n', end - p )) )
+                e++;
+            else
+                e = end;
+            if ( fastq )
+                fastq_line_at( p, e );
+            else
+                fasta_line( p, e );
+           }
+        write_run( end );
+        done = end - b.p;
+        memmove( b.p, end, b.n - done );
+        b.n -= done;
+       }
+   }
+
+
+                                /****************/
+                                /* Main Program */
+                                /****************/
+
+
+int main ( int argc, char **argv )
+   {
+    char          *list;
+    int            nfiles;
+    int            i;
+    static char  **filenames;
+    FILE          *f;
+
+    parse_args( argc, argv, &list, &nfiles, &filenames );
+    for ( i = 0; i < 256; i++ )
+        is_space[i] = isspace( i ) != 0;
+    read_list( list );
+    if ( complement && unique )
+        set_alloc( &others, 0 );
+    for ( i = 0; i < nfiles; i++ )
+       {
+        f = open_file( filenames[i] );
+        extract_file( f, filenames[i] );
+        close_file( f );
+       }
+    if ( fastq && fastq_line != 0 )
+       {
+        fprintf( stderr, "did not find the whole of the last FASTQ "
+                         "record\n" );
+        exit( 1 );
+       }
+    if ( fflush( stdout ) != 0 )
+       {
+        perror( "extract: write" );
+        exit( errno );
+       }
+    exit( 0 );
+   }
@@ -0,0 +1,546 @@
+/* Program:     fai.c                                                        */
+/* Programmer:  Sean R. McCorkle                                             */
+/*              Biology Dept. Brookhaven National Laboratory                 */
+/* Language:    C                                                            */
+/*                                                                           */
+/* Description: Reads FASTA sequences and reports their number and lengths   */
+/*              (as numseqs and seq_len do), and writes samtools compatible  */
+/*              .fai indexes of them, which later runs answer from           */
+/*                                                                           */
+/* Notes:       A file is mmap()ed (a pipe is read in large blocks) and its  */
+/*              lines found with memchr(), which is about as fast as the     */
+/*              disk.  A sequence's length is the bytes of its lines, less   */
+/*              newlines (and carriage returns), as samtools counts them.    */
+/*                                                                           */
+/*              The index has a line for each sequence of                    */
+/*                                                                           */
+/*                 <name> <length> <offset> <line bases> <line bytes>        */
+/*                                                                           */
+/*              tab separated, where offset is that of its first base in the */
+/*              file; so every line of a sequence but its last must be the   */
+/*              same length, or it can't be indexed.  For the options which  */
+/*              need no more than names and lengths, a <file>.fai no older   */
+/*              than <file> is read instead of <file>.                       */
+/*                                                                           */
+/* Compiling:   cc -O3 -o fai fai.c                                          */
+/*                                                                           */
+/*****************************************************************************/
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static char rcsvers[] = "$Revision: 1.1 $";
+
+#define  READ_SIZE       (16 << 20)   /* pipes are read this much at a time */
+
+#define  LENGTHS         0            /* what's reported: */
+#define  TERSE           1            /* -t */
+#define  NAMES           2            /* -l */
+#define  TOTAL           3            /* -T */
+#define  BY_FILE         4            /* -f */
+#define  COUNT           5            /* -n */
+#define  NOTHING         6            /* -i alone */
+
+/* globals set by command line options */
+
+int   report             = -1;     /* set by -t, -l, -T, -f, -n */
+int   make_index         = 0;      /* set by -i */
+int   scan_always        = 0;      /* set by -s */
+
+unsigned char  is_space[256];      /* 1 if whitespace */
+
+
+/* version() - print program name and version */
+
+void  version( void )
+   {
+    char *v;
+    for ( v = rcsvers; *v && *v != ' '; v++ )
+        ;
+    v++;
+    v[strlen(v)-1] = '\0';
+    fprintf( stderr, "\nfai          version %s\n", v );
+   }
+
+
+/* usage() - print help */
+
+void usage( void )
+   {
+    fprintf( stderr, " \n\
+Usage:       fai [-i] [-s] [-t|-l|-T|-f|-n] [-hV] [seq-file ...]          \n\
+                                                                          \n\
+             where [seq-files] are in FASTA format.  The name \"-\" means \n\
+             stdin.  stdin is scanned if no filenames are specified.      \n\
+                                                                          \n\
+             With no options, prints the length of each sequence and its  \n\
+             header, as seq_len does.                                     \n\
+                                                                          \n\
+Options:     -i      write the index <seq-file>.fai of each file (and     \n\
+                     nothing else, unless asked)                          \n\
+             -t      terse - print just the length of each sequence       \n\
+             -l      print the name and length of each sequence           \n\
+             -T      print the total length of all sequences              \n\
+             -f      print the total length of each file                  \n\
+             -n      print the number of sequences, as numseqs does       \n\
+             -s      scan files even if they have an index (which -t, -l, \n\
+                     -T, -f and -n otherwise use, if it's up to date)     \n\
+             -V      print version                                        \n\
+             -h      print help message                                   \n\
+                                                                          \n\
+" );
+
+   }
+
+
+/* extract command line arguments and options */
+
+void parse_args ( int argc, char **argv, int *nfiles, char ***filenames )
+   {
+    static char *stand_in[] = { "-", (char *) 0 };
+    int    c;
+
+    while ( (c = getopt( argc, argv, "fhilnstTV")) != -1 )
+        switch ( c )
+           {
+            case 'i':  make_index = 1;              break;
+            case 's':  scan_always = 1;             break;
+            case 't':  report = TERSE;              break;
+            case 'l':  report = NAMES;              break;
+            case 'T':  report = TOTAL;              break;
+            case 'f':  report = BY_FILE;            break;
+            case 'n':  report = COUNT;              break;
+            case 'V':  version();               exit(0);
+            case 'h':  version();
+                       usage();
+                       exit(0);
+            default:   usage();                 exit(1);
+           }
+    if ( report < 0 )
+        report = make_index ? NOTHING : LENGTHS;
+    argc -= optind;
+    argv += optind;
+    if ( argc > 0 )
+       {
+        *nfiles = argc;
+        *filenames = argv;
+       }
+    else
+       {
+        *nfiles = 1;
+        *filenames = stand_in;
+       }
+   }
+
+
+void  *realloc_safely( void *p, size_t n_bytes )   /* realloc() or error */
+   {                                                /* exit               */
+    if ( !(p = realloc( p, n_bytes )) )
+       {
+        fprintf( stderr, "failed to realloc %lu bytes\n",
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+
+typedef struct buffer {                       /* growable byte buffer */
+                        char    *p;
+                        size_t   n;
+                        size_t   size;
+                      } BUFFER;
+
+void  buf_need( BUFFER *b, size_t n )          /* make room for n more */
+   {
+    if ( b->n + n <= b->size )
+        return;
+    if ( b->size == 0 )
+        b->size = 65536;
+    while ( b->n + n > b->size )
+        b->size *= 2;
+    b->p = realloc_safely( b->p, b->size );
+   }
+
+
+char  *fmt_uint( char *p, uint64_t v )
+   {
+    char  digits[24];
+    int   n = 0;
+
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+       } while ( v > 0 );
+    while ( n > 0 )
+        *p++ = digits[--n];
+    return( p );
+   }
+
+
+                      /**************************************/
+                      /* Sequences found, and what's said   */
+                      /**************************************/
+
+typedef struct record {
+                        BUFFER    header;      /* less '>' and newline */
+                        size_t    name_len;    /* its first word */
+                        uint64_t  length;
+                        uint64_t  offset;      /* of its first base */
+                        int64_t   line_bases;  /* of its first line, */
+                        int64_t   line_bytes;  /* or -1 */
+                        int       short_line;  /* a line has been shorter */
+                        int       ragged;      /* can't be indexed */
+                      } RECORD;
+
+char      *file_name;              /* being read */
+BUFFER     index_text;             /* of the file */
+BUFFER     out;
+uint64_t   n_records = 0;
+uint64_t   total = 0;
+uint64_t   file_total;
+
+
+void  write_out( int force )
+   {
+    if ( out.n > 0 && ( force || out.n >= READ_SIZE ) )
+       {
+        if ( fwrite( out.p, 1, out.n, stdout ) != out.n )
+           {
+            perror( "fai: write" );
+            exit( errno );
+           }
+        out.n = 0;
+       }
+   }
+
+
+/* count, report and (-i) index the sequence r */
+
+void  end_record( RECORD *r )
+   {
+    char  *p;
+
+    n_records++;
+    total += r->length;
+    file_total += r->length;
+    if ( make_index )
+       {
+        if ( r->ragged )
+           {
+            fprintf( stderr, "%s: can't index, lines of sequence %.*s are "
+                             "not all the same length\n", file_name,
+                             (int) r->name_len, r->header.p );
+            exit( 1 );
+           }
+        buf_need( &index_text, r->name_len + 4 * 24 );
+        p = index_text.p + index_text.n;
+        memcpy( p, r->header.p, r->name_len );
+        p += r->name_len;
+        *p++ = '\t';
+        p = fmt_uint( p, r->length );
+        *p++ = '\t';
+        p = fmt_uint( p, r->offset );
+        *p++ = '\t';
+        p = fmt_uint( p, r->line_bases > 0 ? r->line_bases : 0 );
+        *p++ = '\t';
+        p = fmt_uint( p, r->line_bases > 0 ? r->line_bytes : 0 );
+        *p++ = '\n';
+        index_text.n = p - index_text.p;
+       }
+    switch ( report )
+       {
+        case LENGTHS:
+        case TERSE:    buf_need( &out, r->header.n + 32 );
+                       out.n += sprintf( out.p + out.n, "%10llu ",
+                                         (unsigned long long) r->length );
+                       if ( report == LENGTHS )
+                          {
+                           if ( r->header.n == 0 )
+                               out.p[out.n++] = ' ';
+                           memcpy( out.p + out.n, r->header.p, r->header.n );
+                           out.n += r->header.n;
+                          }
+                       out.p[out.n++] = '\n';
+                       break;
+        case NAMES:    buf_need( &out, r->name_len + 32 );
+                       memcpy( out.p + out.n, r->header.p, r->name_len );
+                       p = out.p + out.n + r->name_len;
+                       *p++ = '\t';
+                       p = fmt_uint( p, r->length );
+                       *p++ = '\n';
+                       out.n = p - out.p;
+                       break;
+        default:       return;
+       }
+    write_out( 0 );
+   }
+
+
+/* take line p..e-1 (e after its newline, if it has one) at offset o of */
+/* the file, into r                                                      */
+
+static inline void  scan_line( RECORD *r, int *in_record, const char *p,
+                               const char *e, uint64_t o )
+   {
+    int64_t      bytes = e - p;
+    int64_t      bases = bytes;
+    const char  *h;
+
+    if ( *p == '>' )
+       {
+        if ( *in_record )
+            end_record( r );
+        *in_record = 1;
+        for ( h = e; h > p + 1 && ( h[-1] == '\n' || h[-1] == '\r' ); h-- )
+            ;
+        r->header.n = 0;
+        buf_need( &r->header, h - p );
+        memcpy( r->header.p, p + 1, h - p - 1 );
+        r->header.n = h - p - 1;
+        for ( r->name_len = 0; r->name_len < r->header.n
+                     && ! is_space[ (unsigned char) r->header.p[r->name_len] ];
+              r->name_len++ )
+            ;
+        r->length = 0;
+        r->offset = o + bytes;
+        r->line_bases = r->line_bytes = -1;
+        r->short_line = r->ragged = 0;
+        return;
+       }
+    if ( ! *in_record )
+        return;                      /* before the first header */
+    if ( *p == ';' )                 /* comment, as seq_len has them */
+       {
+        r->ragged = 1;
+        return;
+       }
+    if ( bases > 0 && p[bases-1] == '\n' )
+        bases--;
+    if ( bases > 0 && p[bases-1] == '\r' )
+        bases--;
+    if ( bases == 0 )                /* blank: only at the end, to index */
+       {
+        r->short_line = 1;
+        return;
+       }
+    if ( r->short_line )
+        r->ragged = 1;
+    if ( r->line_bases < 0 )
+       {
+        r->line_bases = bases;
+        r->line_bytes = bytes;
+       }
+    else if ( bases > r->line_bases )
+        r->ragged = 1;
+    else if ( bases < r->line_bases )
+        r->short_line = 1;
+    r->length += bases;
+   }
+
+
+/* scan the lines of file name, mmap()ed if it can be */
+
+void  scan_file( char *name )
+   {
+    static BUFFER  b;
+    static RECORD  r;
+    struct stat    st;
+    const char    *base, *p, *e, *end;
+    uint64_t       o = 0;
+    size_t         done;
+    ssize_t        m;
+    int            fd, in_record = 0, eof = 0;
+
+    if ( strcmp( name, "-" ) == 0 )
+        fd = 0;
+    else if ( (fd = open( name, O_RDONLY )) < 0 )
+       {
+        perror( name );
+        exit( errno );
+       }
+    if ( fstat( fd, &st ) < 0 )
+       {
+        perror( name );
+        exit( errno );
+       }
+    if ( S_ISREG( st.st_mode ) && st.st_size > 0 )
+       {
+        base = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+        if ( base == MAP_FAILED )
+           {
+            perror( name );
+            exit( errno );
+           }
+        madvise( (void *) base, st.st_size, MADV_SEQUENTIAL );
+        end = base + st.st_size;
+        for ( p = base; p < end; p = e )
+           {
+            e = memchr( p, '\n', end - p );
+            e = e ? e + 1 : end;
+            scan_line( &r, &in_record, p, e, p - base );
+           }
+        munmap( (void *) base, st.st_size );
+       }
+    else
+       {
+        b.n = 0;
+        while ( ! eof )
+           {
+            buf_need( &b, READ_SIZE );
+            if ( (m = read( fd, b.p + b.n, READ_SIZE )) < 0 )
+               {
+                perror( name );
+                exit( errno );
+               }
+            b.n += m;
+            eof = m == 0;
+            end = b.p + b.n;
+            if ( ! eof )                     /* whole lines only */
+                while ( end > b.p && end[-1] != '\n' )
+                    end--;
+            for ( p = b.p; p < end; p = e )
+               {
+                e = memchr( p, '\n', end - p );
+                e = e ? e + 1 : end;
+                scan_line( &r, &in_record, p, e, o + ( p - b.p ) );
+               }
+            done = end - b.p;
+            o += done;
+            memmove( b.p, end, b.n - done );
+            b.n -= done;
+           }
+       }
+    if ( in_record )
+        end_record( &r );
+    if ( fd != 0 )
+        close( fd );
+   }
+
+
+/* write index_text to name.fai */
+
+void  write_index( char *name )
+   {
+    char   fai_name[strlen( name ) + 5];
+    FILE  *f;
+
+    if ( strcmp( name, "-" ) == 0 )
+       {
+        fprintf( stderr, "can't write an index for stdin\n" );
+        exit( 1 );
+       }
+    sprintf( fai_name, "%s.fai", name );
+    if ( ! (f = fopen( fai_name, "w" ))
+            || fwrite( index_text.p, 1, index_text.n, f ) != index_text.n
+            || fclose( f ) != 0 )
+       {
+        perror( fai_name );
+        exit( errno );
+       }
+   }
+
+
+/* report from name's index, if it has one up to date; returns 0 if not */
+
+int  read_index( char *name )
+   {
+    static RECORD  r;
+    static char   *line = NULL;
+    static size_t  size = 0;
+    char           fai_name[strlen( name ) + 5];
+    struct stat    st, fst;
+    ssize_t        n;
+    char          *p, *q;
+    FILE          *f;
+    long           line_no = 0;
+
+    if ( strcmp( name, "-" ) == 0 )
+        return( 0 );
+    sprintf( fai_name, "%s.fai", name );
+    if ( stat( name, &st ) < 0 || stat( fai_name, &fst ) < 0
+            || fst.st_mtime < st.st_mtime || ! (f = fopen( fai_name, "r" )) )
+        return( 0 );
+    while ( (n = getline( &line, &size, f )) > 0 )
+       {
+        line_no++;
+        if ( ! (p = memchr( line, '\t', n )) )
+           {
+            fprintf( stderr, "%s: bad index line %ld\n", fai_name, line_no );
+            exit( 1 );
+           }
+        r.header.n = 0;
+        buf_need( &r.header, p - line );
+        memcpy( r.header.p, line, p - line );
+        r.header.n = r.name_len = p - line;
+        r.length = strtoull( p + 1, &q, 10 );
+        if ( q == p + 1 || ( *q != '\t' && *q != '\n' ) )
+           {
+            fprintf( stderr, "%s: bad index line %ld\n", fai_name, line_no );
+            exit( 1 );
+           }
+        end_record( &r );
+       }
+    if ( ferror( f ) )
+       {
+        perror( fai_name );
+        exit( errno );
+       }
+    fclose( f );
+    return( 1 );
+   }
+
+
+                                /****************/
+                                /* Main Program */
+                                /****************/
+
+
+int main ( int argc, char **argv )
+   {
+    int            nfiles;
+    int            i;
+    static char  **filenames;
+
+    parse_args( argc, argv, &nfiles, &filenames );
+    for ( i = 0; i < 256; i++ )
+        is_space[i] = isspace( i ) != 0;
+    for ( i = 0; i < nfiles; i++ )
+       {
+        file_name = filenames[i];
+        file_total = 0;
+        index_text.n = 0;
+        if ( make_index || report == LENGTHS || scan_always
+                        || ! read_index( filenames[i] ) )
+            scan_file( filenames[i] );
+        if ( make_index )
+            write_index( filenames[i] );
+        if ( report == BY_FILE )
+           {
+            buf_need( &out, strlen( filenames[i] ) + 32 );
+            out.n += sprintf( out.p + out.n, "%10llu %s\n",
+                              (unsigned long long) file_total, filenames[i] );
+           }
+       }
+    if ( report == TOTAL )
+       {
+        buf_need( &out, 32 );
+        out.n += sprintf( out.p + out.n, "%llu\n", (unsigned long long) total );
+       }
+    else if ( report == COUNT )
+       {
+        buf_need( &out, 32 );
+        out.n += sprintf( out.p + out.n, "%llu\n",
+                          (unsigned long long) n_records );
+       }
+    write_out( 1 );
+    exit( 0 );
+   }
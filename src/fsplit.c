@@ -0,0 +1,701 @@
+/* Program:     fsplit.c                                                     */
+/* Programmer:  Sean R. McCorkle                                             */
+/*              Biology Dept. Brookhaven National Laboratory                 */
+/* Language:    C                                                            */
+/*                                                                           */
+/* Description: Splits a FASTA file into a number of chunk files of about    */
+/*              the same number of bases (as fasta_chunker, which splits by  */
+/*              number of sequences), or into shards by a hash of sequence   */
+/*              IDs, or into a file for each sequence (as splt)              */
+/*                                                                           */
+/* Notes:       The file is mmap()ed and scanned once, by -t threads, each   */
+/*              finding the headers ('>' at the start of a line) in its part */
+/*              of it; then the sequences' bases (bytes less newlines and    */
+/*              carriage returns) are counted, again in threads.             */
+/*                                                                           */
+/*              A sequence goes to chunk (bases before it + half of its own) */
+/*              * chunks / total bases, so each chunk is a run of whole      */
+/*              sequences, one range of bytes of the file.  With -H, to      */
+/*              chunk (hash of its ID) % chunks, so the same ID always goes  */
+/*              to the same shard.                                           */
+/*                                                                           */
+/*              The chunks are written by the threads, each its own files.   */
+/*              Long runs of bytes are copied with copy_file_range(), which  */
+/*              the kernel may do without reading them in at all (or with   */
+/*              write() straight from the map, where it can't); short ones   */
+/*              are gathered into a large buffer first.                      */
+/*                                                                           */
+/* Compiling:   cc -O3 -o fsplit fsplit.c -lpthread                          */
+/*                                                                           */
+/*****************************************************************************/
+
+#define _GNU_SOURCE                                  /* copy_file_range() */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static char rcsvers[] = "$Revision: 1.1 $";
+
+#define  MAX_THREADS     256
+#define  MAX_CHUNKS      1000000
+#define  WRITE_SIZE      (16 << 20)   /* output buffer, per thread */
+#define  COPY_MIN        (1 << 20)    /* copy_file_range() runs this long */
+
+/* globals set by command line options */
+
+char *prefix             = NULL;   /* set by -p */
+char *ext                = NULL;   /* set by -e */
+int   by_hash            = 0;      /* set by -H */
+int   by_record          = 0;      /* set by -r */
+int   field_sep          = -1;     /* set by -f */
+int   field_num          = 1;      /* set by -n */
+int   quiet              = 0;      /* set by -q */
+int   n_threads          = 1;      /* set by -t */
+
+unsigned char  is_space[256];      /* 1 if whitespace */
+int            use_copy_range = 1; /* till the kernel says no */
+
+
+/* version() - print program name and version */
+
+void  version( void )
+   {
+    char *v;
+    for ( v = rcsvers; *v && *v != ' '; v++ )
+        ;
+    v++;
+    v[strlen(v)-1] = '\0';
+    fprintf( stderr, "\nfsplit       version %s\n", v );
+   }
+
+
+/* usage() - print help */
+
+void usage( void )
+   {
+    fprintf( stderr, " \n\
+Usage:       fsplit [-H] [-p<prefix>] [-e<ext>] [-t<n>] [-q] [-hV]        \n\
+                    <nchunks> <seq-file>                                  \n\
+             fsplit -r [-f<c>] [-n<n>] [-p<prefix>] [-e<ext>] [-t<n>]     \n\
+                    [-q] [-hV] <seq-file> [...]                           \n\
+                                                                          \n\
+             where <seq-file> is in FASTA format (a file, not a pipe).    \n\
+                                                                          \n\
+             Splits the sequences into <nchunks> files <prefix><i><ext>,  \n\
+             i from 0, each of about the same number of bases, with the   \n\
+             sequences in the order of the file; or with -r, into a file  \n\
+             for each sequence.  Sequences are copied as they are.  Each  \n\
+             file made, with its number of sequences and bases, is        \n\
+             printed (just its name, with -r).                            \n\
+                                                                          \n\
+Options:     -H      shard by ID: each sequence goes to the chunk given   \n\
+                     by a hash of its ID (the first word of its header),  \n\
+                     rather than balancing bases                          \n\
+             -r      a file <prefix><name><ext> for each sequence, named  \n\
+                     by its ID                                            \n\
+             -f<c>   with -r, name files by a field of the header, split  \n\
+                     at character <c>                                     \n\
+             -n<n>   with -f, use the <n>th field (default 1)             \n\
+             -p<s>   file names start with <s> (default \"chunk_\", or    \n\
+                     nothing with -r)                                     \n\
+             -e<s>   file names end with <s> (default \".fasta\", or     \n\
+                     nothing with -r)                                     \n\
+             -t<n>   scan and write with <n> threads                      \n\
+             -q      quiet - print nothing                                \n\
+             -V      print version                                        \n\
+             -h      print help message                                   \n\
+                                                                          \n\
+" );
+
+   }
+
+
+/* extract command line arguments and options */
+
+void parse_args ( int argc, char **argv, long *n_chunks, int *nfiles,
+                  char ***filenames )
+   {
+    char  *e;
+    int    c;
+
+    while ( (c = getopt( argc, argv, "e:f:hHn:p:qrt:V")) != -1 )
+        switch ( c )
+           {
+            case 'e':  ext = optarg;                break;
+            case 'f':  if ( strlen( optarg ) != 1 )
+                          {
+                           fprintf( stderr, "-f takes one character\n" );
+                           exit( 1 );
+                          }
+                       field_sep = (unsigned char) optarg[0];
+                       break;
+            case 'H':  by_hash = 1;                 break;
+            case 'n':  field_num = atoi( optarg );
+                       if ( field_num < 1 )
+                          {
+                           fprintf( stderr, "-n must be 1 or more\n" );
+                           exit( 1 );
+                          }
+                       break;
+            case 'p':  prefix = optarg;             break;
+            case 'q':  quiet = 1;                   break;
+            case 'r':  by_record = 1;               break;
+            case 't':  n_threads = atoi( optarg );
+                       if ( n_threads < 1 || n_threads > MAX_THREADS )
+                          {
+                           fprintf( stderr, "-t must be in range 1-%d\n",
+                                            MAX_THREADS );
+                           exit( 1 );
+                          }
+                       break;
+            case 'V':  version();               exit(0);
+            case 'h':  version();
+                       usage();
+                       exit(0);
+            default:   usage();                 exit(1);
+           }
+    argc -= optind;
+    argv += optind;
+    if ( ! prefix )
+        prefix = by_record ? "" : "chunk_";
+    if ( ! ext )
+        ext = by_record ? "" : ".fasta";
+    if ( by_record )
+       {
+        if ( by_hash || argc < 1 )
+           {
+            usage();
+            exit( 1 );
+           }
+        *n_chunks = 0;
+       }
+    else
+       {
+        if ( argc != 2 )
+           {
+            usage();
+            exit( 1 );
+           }
+        *n_chunks = strtol( argv[0], &e, 10 );
+        if ( *e || *n_chunks < 1 || *n_chunks > MAX_CHUNKS )
+           {
+            fprintf( stderr, "<nchunks> must be a number 1-%d\n",
+                             MAX_CHUNKS );
+            exit( 1 );
+           }
+        argc--;
+        argv++;
+       }
+    *nfiles = argc;
+    *filenames = argv;
+   }
+
+
+void  *malloc_safely( size_t n_bytes )   /* malloc() or error exit */
+   {
+    void  *p;
+
+    if ( !(p = malloc( n_bytes )) )
+       {
+        fprintf( stderr, "failed to malloc %lu bytes\n",
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+void  *realloc_safely( void *p, size_t n_bytes )   /* same for realloc() */
+   {
+    if ( !(p = realloc( p, n_bytes )) )
+       {
+        fprintf( stderr, "failed to realloc %lu bytes\n",
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+
+typedef struct buffer {                       /* growable byte buffer */
+                        char    *p;
+                        size_t   n;
+                        size_t   size;
+                      } BUFFER;
+
+void  buf_need( BUFFER *b, size_t n )          /* make room for n more */
+   {
+    if ( b->n + n <= b->size )
+        return;
+    if ( b->size == 0 )
+        b->size = 65536;
+    while ( b->n + n > b->size )
+        b->size *= 2;
+    b->p = realloc_safely( b->p, b->size );
+   }
+
+
+                     /******************************************/
+                     /* The file, its sequences, and outputs   */
+                     /******************************************/
+
+typedef struct output {
+                        size_t    name;        /* in names */
+                        size_t    first;       /* in order[] */
+                        size_t    n;           /* sequences */
+                        uint64_t  bases;
+                      } OUTPUT;
+
+char      *file_name;
+int        in_fd;
+const char *base;                  /* the file, mapped */
+uint64_t   file_size;
+uint64_t  *starts;                 /* of each sequence, and the end */
+uint64_t  *vals;                   /* bases of each */
+uint64_t  *hashes;                 /* of their IDs, for -H */
+size_t     n_seqs;
+size_t    *order;                  /* sequences by output */
+OUTPUT    *outputs;
+size_t     n_outputs;
+BUFFER     names;                  /* of the output files */
+
+
+typedef struct worker {
+                        pthread_t   thread;
+                        int         id;
+                        uint64_t   *found;     /* header offsets */
+                        size_t      n_found;
+                        size_t      size;
+                        BUFFER      out;       /* write buffer */
+                      } WORKER;
+
+WORKER  workers[MAX_THREADS];
+
+
+/* run f in each worker thread (or just call it, for one) */
+
+void  run_threads( void *(*f)( void * ) )
+   {
+    int  t;
+
+    if ( n_threads == 1 )
+       {
+        f( &workers[0] );
+        return;
+       }
+    for ( t = 0; t < n_threads; t++ )
+        if ( pthread_create( &workers[t].thread, NULL, f, &workers[t] ) != 0 )
+           {
+            perror( "can't create thread" );
+            exit( 1 );
+           }
+    for ( t = 0; t < n_threads; t++ )
+        pthread_join( workers[t].thread, NULL );
+   }
+
+
+/* find the headers in w's part of the file */
+
+void  *find_headers( void *arg )
+   {
+    WORKER      *w = (WORKER *) arg;
+    const char  *p = base + file_size * w->id / n_threads;
+    const char  *end = base + file_size * ( w->id + 1 ) / n_threads;
+
+    w->n_found = 0;
+    for ( ; p < end && (p = memchr( p, '>', end - p )); p++ )
+        if ( p == base || p[-1] == '\n' )
+           {
+            if ( w->n_found >= w->size )
+               {
+                w->size = w->size == 0 ? 65536 : 2 * w->size;
+                w->found = realloc_safely( w->found,
+                                           w->size * sizeof( uint64_t ) );
+               }
+            w->found[w->n_found++] = p - base;
+           }
+    return( NULL );
+   }
+
+
+static inline uint64_t  hash_id( const char *s, size_t n )
+   {
+    uint64_t  h = 14695981039346656037ULL;      /* FNV-1a */
+
+    while ( n-- > 0 )
+        h = ( h ^ (unsigned char) *s++ ) * 1099511628211ULL;
+    return( h ^ ( h >> 29 ) );
+   }
+
+
+/* count the bases of w's share of the sequences into vals[] (and, */
+/* with -H, hash their IDs into hashes[])                           */
+
+void  *count_bases( void *arg )
+   {
+    WORKER         *w = (WORKER *) arg;
+    size_t          i = n_seqs * w->id / n_threads;
+    size_t          e = n_seqs * ( w->id + 1 ) / n_threads;
+    const unsigned char  *p, *q, *end;
+    uint64_t        n;
+
+    for ( ; i < e; i++ )
+       {
+        p = (const unsigned char *) base + starts[i] + 1;
+        end = (const unsigned char *) base + starts[i+1];
+        if ( by_hash )
+           {
+            for ( q = p; q < end && ! is_space[*q]; q++ )
+                ;
+            hashes[i] = hash_id( (const char *) p, q - p );
+           }
+        if ( (q = memchr( p, '\n', end - p )) )
+            p = q + 1;
+        else
+            p = end;
+        for ( n = 0, q = p; q < end; q++ )         /* vectorizes */
+            n += ( *q == '\n' ) + ( *q == '\r' );
+        vals[i] = ( end - p ) - n;
+       }
+    return( NULL );
+   }
+
+
+/* map file name and find its sequences */
+
+void  scan_file( char *name )
+   {
+    struct stat  st;
+    size_t       t, n;
+
+    file_name = name;
+    if ( (in_fd = open( name, O_RDONLY )) < 0 || fstat( in_fd, &st ) < 0 )
+       {
+        perror( name );
+        exit( errno );
+       }
+    if ( ! S_ISREG( st.st_mode ) )
+       {
+        fprintf( stderr, "%s is not a file\n", name );
+        exit( 1 );
+       }
+    file_size = st.st_size;
+    base = NULL;
+    if ( file_size > 0 )
+       {
+        base = mmap( NULL, file_size, PROT_READ, MAP_SHARED, in_fd, 0 );
+        if ( base == MAP_FAILED )
+           {
+            perror( name );
+            exit( errno );
+           }
+        madvise( (void *) base, file_size, MADV_SEQUENTIAL );
+       }
+    run_threads( find_headers );
+    for ( n_seqs = 0, t = 0; t < (size_t) n_threads; t++ )
+        n_seqs += workers[t].n_found;
+    starts = realloc_safely( starts, ( n_seqs + 1 ) * sizeof( uint64_t ) );
+    vals = realloc_safely( vals, ( n_seqs + 1 ) * sizeof( uint64_t ) );
+    if ( by_hash )
+        hashes = realloc_safely( hashes, ( n_seqs + 1 ) * sizeof( uint64_t ) );
+    for ( n = 0, t = 0; t < (size_t) n_threads; t++ )
+       {
+        memcpy( starts + n, workers[t].found,
+                workers[t].n_found * sizeof( uint64_t ) );
+        n += workers[t].n_found;
+       }
+    starts[n_seqs] = file_size;
+    run_threads( count_bases );
+   }
+
+
+/* add output file <prefix><s (n chars)><ext> */
+
+void  add_output( const char *s, size_t n )
+   {
+    size_t  lp = strlen( prefix ), le = strlen( ext );
+
+    outputs[n_outputs].name = names.n;
+    outputs[n_outputs].n = 0;
+    outputs[n_outputs].bases = 0;
+    buf_need( &names, lp + n + le + 1 );
+    memcpy( names.p + names.n, prefix, lp );
+    memcpy( names.p + names.n + lp, s, n );
+    memcpy( names.p + names.n + lp + n, ext, le + 1 );
+    names.n += lp + n + le + 1;
+    n_outputs++;
+   }
+
+
+/* the name of sequence i, for -r: its ID, or field field_num of its */
+/* header split at field_sep; *n is its length                        */
+
+const char  *record_name( size_t i, size_t *n )
+   {
+    const char  *p = base + starts[i] + 1;
+    const char  *end = base + starts[i+1];
+    const char  *q;
+    int          k;
+
+    if ( (q = memchr( p, '\n', end - p )) )
+        end = q;
+    if ( end > p && end[-1] == '\r' )
+        end--;
+    if ( field_sep < 0 )
+       {
+        for ( q = p; q < end && ! is_space[ (unsigned char) *q ]; q++ )
+            ;
+        *n = q - p;
+        return( p );
+       }
+    for ( k = 1; k < field_num && p < end; k++ )
+        if ( (q = memchr( p, field_sep, end - p )) )
+            p = q + 1;
+        else
+            p = end;
+    if ( k < field_num )
+        p = end;                           /* no such field */
+    if ( ! (q = memchr( p, field_sep, end - p )) )
+        q = end;
+    *n = q - p;
+    return( p );
+   }
+
+
+/* share the sequences out among the outputs */
+
+void  assign( long n_chunks )
+   {
+    uint64_t  total, before, b;
+    size_t   *count;
+    size_t    i, c, n;
+    char      num[24];
+    const char  *name;
+
+    outputs = realloc_safely( outputs,
+                        ( by_record ? n_seqs : (size_t) n_chunks )
+                                                   * sizeof( OUTPUT ) );
+    order = realloc_safely( order, ( n_seqs + 1 ) * sizeof( size_t ) );
+    n_outputs = 0;
+    names.n = 0;
+    if ( by_record )
+       {
+        for ( i = 0; i < n_seqs; i++ )
+           {
+            name = record_name( i, &n );
+            add_output( name, n );
+            outputs[i].first = i;
+            outputs[i].n = 1;
+            outputs[i].bases = vals[i];
+            order[i] = i;
+           }
+        return;
+       }
+    for ( c = 0; c < (size_t) n_chunks; c++ )
+        add_output( num, sprintf( num, "%lu", (unsigned long) c ) );
+    for ( total = 0, i = 0; i < n_seqs; i++ )
+        total += vals[i];
+    for ( before = 0, i = 0; i < n_seqs; i++ )    /* vals[] -> chunk */
+       {
+        b = vals[i];
+        if ( by_hash )
+            c = hashes[i] % n_chunks;
+        else if ( total > 0 )          /* empty ones at the end may */
+           {                           /* come out at n_chunks      */
+            c = ( before + b / 2 ) * n_chunks / total;
+            if ( c >= (size_t) n_chunks )
+                c = n_chunks - 1;
+           }
+        else                                  /* no bases: by number */
+            c = i * n_chunks / n_seqs;
+        outputs[c].bases += b;
+        vals[i] = c;
+        before += b;
+       }
+    count = malloc_safely( ( n_chunks + 1 ) * sizeof( size_t ) );
+    memset( count, 0, ( n_chunks + 1 ) * sizeof( size_t ) );
+    for ( i = 0; i < n_seqs; i++ )
+        count[ vals[i] + 1 ]++;
+    for ( c = 0; c < (size_t) n_chunks; c++ )
+       {
+        outputs[c].first = count[c];
+        outputs[c].n = count[c+1];
+        count[c+1] += count[c];
+       }
+    for ( i = 0; i < n_seqs; i++ )           /* in file order, in each */
+        order[ count[ vals[i] ]++ ] = i;
+    free( count );
+   }
+
+
+                            /*****************************/
+                            /* Writing, in threads       */
+                            /*****************************/
+
+void  write_all( int fd, const char *p, size_t n, const char *name )
+   {
+    ssize_t  m;
+
+    for ( ; n > 0; p += m, n -= m )
+        if ( (m = write( fd, p, n )) < 0 )
+           {
+            perror( name );
+            exit( errno );
+           }
+   }
+
+
+/* copy bytes [o, o + n) of the file to fd */
+
+void  copy_range( int fd, uint64_t o, uint64_t n, const char *name )
+   {
+    loff_t   off = o;
+    ssize_t  m;
+
+    while ( n > 0 && __atomic_load_n( &use_copy_range, __ATOMIC_RELAXED ) )
+       {
+        if ( (m = copy_file_range( in_fd, &off, fd, NULL, n, 0 )) > 0 )
+            n -= m;
+        else if ( m == 0 )
+            break;
+        else if ( errno == EXDEV || errno == ENOSYS || errno == EINVAL
+                     || errno == EOPNOTSUPP || errno == EBADF )
+            __atomic_store_n( &use_copy_range, 0, __ATOMIC_RELAXED );
+        else
+           {
+            perror( name );
+            exit( errno );
+           }
+       }
+    write_all( fd, base + off, n, name );   /* what's left, from the map */
+   }
+
+
+/* write w's outputs: those o with o % n_threads == w->id, except that */
+/* with -r the sequences of the same name go to the same thread, so    */
+/* the last written is the last in the file, as splt has it            */
+
+void  *write_outputs( void *arg )
+   {
+    WORKER      *w = (WORKER *) arg;
+    OUTPUT      *o;
+    const char  *name;
+    uint64_t     rs = 0, re = 0, s = 0, e = 0;
+    size_t       c, k, i;
+    int          fd;
+
+    buf_need( &w->out, WRITE_SIZE );
+    for ( c = 0; c < n_outputs; c++ )
+       {
+        o = &outputs[c];
+        name = names.p + o->name;
+        if ( ( by_record ? hash_id( name, strlen( name ) ) : c ) % n_threads
+                != (size_t) w->id )
+            continue;
+        if ( (fd = open( name, O_WRONLY | O_CREAT | O_TRUNC, 0666 )) < 0 )
+           {
+            perror( name );
+            exit( errno );
+           }
+        w->out.n = 0;
+        for ( rs = re = 0, k = 0; k <= o->n; k++ )
+           {
+            if ( k < o->n )
+               {
+                i = order[o->first + k];
+                s = starts[i];
+                e = starts[i+1];
+                if ( s == re && re > rs )          /* runs on */
+                   {
+                    re = e;
+                    continue;
+                   }
+               }
+            if ( re - rs >= COPY_MIN )
+               {
+                write_all( fd, w->out.p, w->out.n, name );
+                w->out.n = 0;
+                copy_range( fd, rs, re - rs, name );
+               }
+            else if ( re > rs )
+               {
+                if ( w->out.n + ( re - rs ) > WRITE_SIZE )
+                   {
+                    write_all( fd, w->out.p, w->out.n, name );
+                    w->out.n = 0;
+                   }
+                memcpy( w->out.p + w->out.n, base + rs, re - rs );
+                w->out.n += re - rs;
+               }
+            if ( k < o->n )
+               {
+                rs = s;
+                re = e;
+               }
+           }
+        write_all( fd, w->out.p, w->out.n, name );
+        if ( close( fd ) != 0 )
+           {
+            perror( name );
+            exit( errno );
+           }
+       }
+    return( NULL );
+   }
+
+
+/* print the files made */
+
+void  report( void )
+   {
+    size_t  c;
+
+    if ( quiet )
+        return;
+    for ( c = 0; c < n_outputs; c++ )
+        if ( by_record )
+            printf( "%s\n", names.p + outputs[c].name );
+        else
+            printf( "%s %lu %llu\n", names.p + outputs[c].name,
+                    (unsigned long) outputs[c].n,
+                    (unsigned long long) outputs[c].bases );
+   }
+
+
+                                /****************/
+                                /* Main Program */
+                                /****************/
+
+
+int main ( int argc, char **argv )
+   {
+    long           n_chunks;
+    int            nfiles;
+    int            i;
+    static char  **filenames;
+
+    parse_args( argc, argv, &n_chunks, &nfiles, &filenames );
+    for ( i = 0; i < 256; i++ )
+        is_space[i] = isspace( i ) != 0;
+    for ( i = 0; i < n_threads; i++ )
+        workers[i].id = i;
+    for ( i = 0; i < nfiles; i++ )
+       {
+        scan_file( filenames[i] );
+        assign( n_chunks );
+        run_threads( write_outputs );
+        report();
+        if ( file_size > 0 )
+            munmap( (void *) base, file_size );
+        close( in_fd );
+       }
+    exit( 0 );
+   }
@@ -0,0 +1,470 @@
+/* Program:     fwrap.c                                                      */
+/* Programmer:  Sean R. McCorkle                                             */
+/*              Biology Dept. Brookhaven National Laboratory                 */
+/* Language:    C                                                            */
+/*                                                                           */
+/* Description: Re-wraps FASTA sequences to any line length, or none (as     */
+/*              one_line_fasta), and optionally spaces and numbers the lines */
+/*              (as pp) or changes the case of the sequence                  */
+/*                                                                           */
+/* Notes:       Input is read in large blocks, each dealt with completely    */
+/*              (a line may run from one to the next), so memory use doesn't */
+/*              grow with the length of sequences or lines.                  */
+/*                                                                           */
+/*              Output is a list of pieces for writev(): pieces of the input */
+/*              block itself where the sequence goes out unchanged, and of a */
+/*              buffer for what's new (newlines where there were none, line  */
+/*              numbers, case changed sequence).  A piece running on from    */
+/*              the last is added to it, and a newline where the input has   */
+/*              one is taken from the input, so a file already wrapped to    */
+/*              the line length asked for goes out in a few large pieces.    */
+/*                                                                           */
+/*              Sequence lines are checked for whitespace (any byte up to    */
+/*              ' ') with a loop the compiler vectorizes; only lines with    */
+/*              some are copied out without it.                              */
+/*                                                                           */
+/* Compiling:   cc -O3 -o fwrap fwrap.c                                      */
+/*                                                                           */
+/*****************************************************************************/
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static char rcsvers[] = "$Revision: 1.1 $";
+
+#define  READ_SIZE       (16 << 20)   /* input is read this much at a time */
+#define  GLUE_SIZE       (1 << 20)    /* buffer for new output */
+#define  N_PIECES        1024         /* for a writev() */
+#define  SCRATCH_SIZE    65536        /* a line less whitespace, at a time */
+
+/* globals set by command line options */
+
+long  line_len           = 60;     /* set by -l */
+long  spacer_len         = 0;      /* set by -s */
+int   numbers            = 0;      /* set by -N */
+int   number_width       = 10;     /* set by -I */
+int   drop_digits        = 0;      /* set by -d */
+int   change_case        = 0;      /* set by -U (1), -L (2) */
+
+unsigned char  case_map[256];
+
+
+/* version() - print program name and version */
+
+void  version( void )
+   {
+    char *v;
+    for ( v = rcsvers; *v && *v != ' '; v++ )
+        ;
+    v++;
+    v[strlen(v)-1] = '\0';
+    fprintf( stderr, "\nfwrap        version %s\n", v );
+   }
+
+
+/* usage() - print help */
+
+void usage( void )
+   {
+    fprintf( stderr, " \n\
+Usage:       fwrap [-l<n>] [-s<n>] [-N] [-I<n>] [-d] [-U|-L] [-hV]        \n\
+                   [seq-file ...]                                         \n\
+                                                                          \n\
+             where [seq-files] are in FASTA format.  The name \"-\" means \n\
+             stdin.  stdin is scanned if no filenames are specified.      \n\
+                                                                          \n\
+             Writes the sequences with their whitespace removed and their \n\
+             lines re-wrapped; headers are left as they are.              \n\
+                                                                          \n\
+Options:     -l<n>   print <n> characters per line (default 60); 0 puts   \n\
+                     each sequence on one line, as one_line_fasta does    \n\
+             -s<n>   put a space after every <n> characters               \n\
+             -N      start each line with the position of its first       \n\
+                     character                                            \n\
+             -I<n>   print positions <n> wide (default 10)                \n\
+             -d      drop numbers at the start of sequence lines (so      \n\
+                     output of -N, or of pp, can be read back)            \n\
+             -U      upper case the sequence                              \n\
+             -L      lower case the sequence                              \n\
+             -V      print version                                        \n\
+             -h      print help message                                   \n\
+                                                                          \n\
+             pp's output is that of -l50 -s10 -N -d                       \n\
+                                                                          \n\
+" );
+
+   }
+
+
+/* extract command line arguments and options */
+
+void parse_args ( int argc, char **argv, int *nfiles, char ***filenames )
+   {
+    static char *stand_in[] = { "-", (char *) 0 };
+    int    c;
+
+    while ( (c = getopt( argc, argv, "dhI:l:LNs:UV")) != -1 )
+        switch ( c )
+           {
+            case 'd':  drop_digits = 1;             break;
+            case 'I':  number_width = atoi( optarg );
+                       if ( number_width < 1 || number_width > 20 )
+                          {
+                           fprintf( stderr, "-I must be in range 1-20\n" );
+                           exit( 1 );
+                          }
+                       break;
+            case 'l':  line_len = atol( optarg );
+                       if ( line_len < 0 )
+                          {
+                           fprintf( stderr, "-l must be 0 or more\n" );
+                           exit( 1 );
+                          }
+                       break;
+            case 'L':  change_case = 2;            break;
+            case 'N':  numbers = 1;                 break;
+            case 's':  spacer_len = atol( optarg );
+                       if ( spacer_len < 0 )
+                          {
+                           fprintf( stderr, "-s must be 0 or more\n" );
+                           exit( 1 );
+                          }
+                       break;
+            case 'U':  change_case = 1;            break;
+            case 'V':  version();               exit(0);
+            case 'h':  version();
+                       usage();
+                       exit(0);
+            default:   usage();                 exit(1);
+           }
+    argc -= optind;
+    argv += optind;
+    if ( argc > 0 )
+       {
+        *nfiles = argc;
+        *filenames = argv;
+       }
+    else
+       {
+        *nfiles = 1;
+        *filenames = stand_in;
+       }
+   }
+
+
+                            /****************************/
+                            /* Output, for writev()     */
+                            /****************************/
+
+struct iovec   pieces[N_PIECES];
+int            n_pieces = 0;
+char           glue[GLUE_SIZE];    /* new output */
+size_t         glue_n = 0;
+const char    *block;              /* the input block */
+const char    *block_end;
+
+
+/* write out the pieces */
+
+void  flush_out( void )
+   {
+    struct iovec  *v = pieces;
+    int            n = n_pieces;
+    ssize_t        m;
+
+    while ( n > 0 )
+       {
+        if ( (m = writev( 1, v, n )) < 0 )
+           {
+            if ( errno == EINTR )
+                continue;
+            perror( "fwrap: write" );
+            exit( errno );
+           }
+        for ( ; n > 0 && (size_t) m >= v->iov_len; v++, n-- )
+            m -= v->iov_len;
+        if ( n > 0 )                            /* part of v written */
+           {
+            v->iov_base = (char *) v->iov_base + m;
+            v->iov_len -= m;
+           }
+       }
+    n_pieces = 0;
+    glue_n = 0;
+   }
+
+
+/* add p..p+n-1 (which must stay put till flush_out()) to the output */
+
+static inline void  out_ref( const char *p, size_t n )
+   {
+    struct iovec  *v;
+
+    if ( n == 0 )
+        return;
+    if ( n_pieces > 0 )
+       {
+        v = &pieces[n_pieces-1];
+        if ( (const char *) v->iov_base + v->iov_len == p )
+           {
+            v->iov_len += n;                    /* runs on from the last */
+            return;
+           }
+       }
+    if ( n_pieces == N_PIECES )
+        flush_out();
+    pieces[n_pieces].iov_base = (void *) p;
+    pieces[n_pieces++].iov_len = n;
+   }
+
+
+/* add a copy of p..p+n-1 to the output, case changed if map */
+
+static inline void  out_copy( const char *p, size_t n, int map )
+   {
+    size_t  k, i;
+    char   *g;
+
+    while ( n > 0 )
+       {
+        if ( glue_n == GLUE_SIZE || n_pieces == N_PIECES )
+            flush_out();
+        k = GLUE_SIZE - glue_n < n ? GLUE_SIZE - glue_n : n;
+        g = glue + glue_n;
+        if ( map )
+            for ( i = 0; i < k; i++ )
+                g[i] = case_map[ (unsigned char) p[i] ];
+        else
+            memcpy( g, p, k );
+        glue_n += k;
+        out_ref( g, k );
+        p += k;
+        n -= k;
+       }
+   }
+
+
+/* add a newline: the input's own, if the last piece ends at one */
+
+static inline void  out_newline( void )
+   {
+    const char  *e;
+
+    if ( n_pieces > 0 )
+       {
+        e = (const char *) pieces[n_pieces-1].iov_base
+                                  + pieces[n_pieces-1].iov_len;
+        if ( e >= block && e < block_end && *e == '\n' )
+           {
+            pieces[n_pieces-1].iov_len++;
+            return;
+           }
+       }
+    out_copy( "\n", 1, 0 );
+   }
+
+
+                         /************************************/
+                         /* Sequences, a piece at a time     */
+                         /************************************/
+
+uint64_t  pos = 0;                 /* in the sequence */
+long      col = 0;                 /* in the output line */
+int       in_header = 0;           /* in a header line */
+int       line_start = 1;          /* at the start of an input line */
+int       digits_start = 0;        /* -d: still at the start of a line */
+
+
+/* end the sequence */
+
+void  end_sequence( void )
+   {
+    if ( col > 0 )
+        out_newline();
+    col = 0;
+    pos = 0;
+   }
+
+
+/* add sequence p..p+n-1 (no whitespace in it) to the output; copy it if */
+/* copy (it's not in the input block), or to change its case             */
+
+void  out_sequence( const char *p, size_t n, int copy )
+   {
+    char    num[32];
+    size_t  k;
+
+    while ( n > 0 )
+       {
+        if ( col == 0 && numbers )
+            out_copy( num, sprintf( num, "%*llu ", number_width,
+                                    (unsigned long long) pos + 1 ), 0 );
+        k = n;
+        if ( line_len > 0 && k > (size_t) ( line_len - col ) )
+            k = line_len - col;
+        if ( spacer_len > 0 && k > spacer_len - pos % spacer_len )
+            k = spacer_len - pos % spacer_len;
+        if ( copy || change_case )
+            out_copy( p, k, change_case );
+        else
+            out_ref( p, k );
+        p += k;
+        n -= k;
+        col += k;
+        pos += k;
+        if ( line_len > 0 && col == line_len )
+           {
+            out_newline();
+            col = 0;
+           }
+        else if ( spacer_len > 0 && pos % spacer_len == 0 )
+            out_copy( " ", 1, 0 );
+       }
+   }
+
+
+/* sequence line piece p..e-1 (e at its newline, or the block end) */
+
+void  sequence_piece( const char *p, const char *e )
+   {
+    static char  scratch[SCRATCH_SIZE];
+    const unsigned char  *q;
+    size_t       n, k;
+
+    if ( digits_start )                  /* -d: whitespace and digits */
+       {
+        while ( p < e && ( (unsigned char) *p <= ' '
+                              || ( *p >= '0' && *p <= '9' ) ) )
+            p++;
+        if ( p < e )
+            digits_start = 0;
+       }
+    if ( e > p && e < block_end && *e == '\n' && e[-1] == '\r' )
+        e--;
+    for ( n = 0, q = (const unsigned char *) p;
+          q < (const unsigned char *) e; q++ )
+        n += *q <= ' ';                               /* vectorizes */
+    if ( n == 0 )
+       {
+        out_sequence( p, e - p, 0 );
+        return;
+       }
+    while ( p < e )                           /* copy without it */
+       {
+        for ( k = 0; p < e && k < SCRATCH_SIZE; p++ )
+            if ( (unsigned char) *p > ' ' )
+                scratch[k++] = *p;
+        out_sequence( scratch, k, 1 );
+       }
+   }
+
+
+/* reformat the input in block..block_end-1 */
+
+void  reformat_block( void )
+   {
+    const char  *p, *q, *e;
+
+    for ( p = block; p < block_end; )
+       {
+        if ( line_start && *p == '>' )
+           {
+            end_sequence();
+            in_header = 1;
+           }
+        q = memchr( p, '\n', block_end - p );
+        e = q ? q : block_end;
+        if ( in_header )
+           {
+            out_ref( p, e - p );
+            if ( q )
+               {
+                out_newline();
+                in_header = 0;
+               }
+           }
+        else
+           {
+            if ( line_start )
+                digits_start = drop_digits;
+            sequence_piece( p, e );
+           }
+        line_start = q != NULL;
+        p = q ? q + 1 : block_end;
+       }
+   }
+
+
+/* reformat file name */
+
+void  reformat_file( char *name )
+   {
+    static char  *buf = NULL;
+    ssize_t       m;
+    int           fd;
+
+    if ( ! buf && ! (buf = malloc( READ_SIZE )) )
+       {
+        fprintf( stderr, "failed to malloc %d bytes\n", READ_SIZE );
+        exit( 1 );
+       }
+    if ( strcmp( name, "-" ) == 0 )
+        fd = 0;
+    else if ( (fd = open( name, O_RDONLY )) < 0 )
+       {
+        perror( name );
+        exit( errno );
+       }
+    while ( (m = read( fd, buf, READ_SIZE )) != 0 )
+       {
+        if ( m < 0 )
+           {
+            if ( errno == EINTR )
+                continue;
+            perror( name );
+            exit( errno );
+           }
+        block = buf;
+        block_end = buf + m;
+        reformat_block();
+        flush_out();                 /* before buf is read into again */
+       }
+    if ( in_header )                 /* header with no newline */
+       {
+        out_copy( "\n", 1, 0 );
+        in_header = 0;
+       }
+    line_start = 1;
+    if ( fd != 0 )
+        close( fd );
+   }
+
+
+                                /****************/
+                                /* Main Program */
+                                /****************/
+
+
+int main ( int argc, char **argv )
+   {
+    int            nfiles;
+    int            i;
+    static char  **filenames;
+
+    parse_args( argc, argv, &nfiles, &filenames );
+    for ( i = 0; i < 256; i++ )
+        case_map[i] = change_case == 1 ? toupper( i )
+                    : change_case == 2 ? tolower( i ) : i;
+    for ( i = 0; i < nfiles; i++ )
+        reformat_file( filenames[i] );
+    end_sequence();
+    flush_out();
+    exit( 0 );
+   }
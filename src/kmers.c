@@ -12,28 +12,75 @@
 /*              A further limitation, perhaps more severe, is the size of the*/
 /*              histogram, which is 4^k.  (see MAX_HIST_LEN)                 */
 /*                                                                           */
+/*              The abundance spectrum (-H) with -F doesn't use the 4^k      */
+/*              histogram, but counts (a hashed sample of) the canonical     */
+/*              k-mers in a hash table, so there k may be up to MAX_WORD_K.  */
+/*                                                                           */
+/*              So may it with -D, which counts inputs larger than memory    */
+/*              by writing super-k-mers (runs of k-mers sharing the same     */
+/*              minimizer) to partition files on disk, then counting each    */
+/*              partition in a hash table.  (see disk_count())               */
+/*                                                                           */
+/*              With -f, there is a count table for each reading frame,      */
+/*              kept from the same circular buffer word (cbuff_w, and        */
+/*              cbuff_rc for the bottom strand frames of -f6), and each is   */
+/*              reported in turn by report().                                */
+/*                                                                           */
+/*              -S writes bottom-s MinHash sketches of the canonical k-mers  */
+/*              (of each file, or record with -r) to a file, and -C compares */
+/*              sketch files all against all.  (see write_sketch_header())   */
+/*                                                                           */
+/*              -B writes the set of canonical k-mers to a file, and -Q      */
+/*              screens reads against such sets, by the fraction of each     */
+/*              read's k-mers in each set.  (see write_set())                */
+/*                                                                           */
+/*              -W saves the counts to a checkpoint file after each input    */
+/*              file, and -R loads one to add more input to it, skipping any */
+/*              files it has counted already.  (see write_checkpoint())      */
+/*                                                                           */
+/*              -U builds the compacted de Bruijn graph of the k-mers seen   */
+/*              at least -a times, and writes its unitigs as FASTA and GFA.  */
+/*              (see build_unitigs())                                        */
+/*                                                                           */
 /*              This is case insensitive. A=a, C=c, G=g, T=t at all times.   */
 /*                                                                           */
+/*              With -b or -d, each sequence is counted separately and       */
+/*              written as one row of a binary matrix (see write_matrix_     */
+/*              header() for the layout).  Records are read in batches and   */
+/*              counted by -t threads, each with its own count table, which  */
+/*              is reset by clearing only the k-mers the record touched.    */
+/*                                                                           */
 /*              Ignores k-mers with any ambiguity codes or any other         */
 /*              characters which are not nucleotides A, C, G, T.             */
 /*                                                                           */
 /*                                                                           */
-/* Compiling:   cc -O -o kmers kmers.c should do the job.                    */
+/* Compiling:   cc -O -o kmers kmers.c -lpthread should do the job.          */
 /*                 (or cc -O3 if you prefer)                                 */
 /*                                                                           */
 /*****************************************************************************/
 
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#ifdef __GLIBC__
+#include <malloc.h>                    /* mallopt(), for -D -M */
+#endif
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 static char rcsvers[] = "$Revision: 1.3 $";
 
 #define MAX_K              10  /* this is constrained by the limit on 4^k */
+#define MAX_WORD_K         31  /* largest k in a 64 bit word (hash tables) */
 #define MAX_HIST_LEN  1048576  /* must be 4^MAX_K */
 #define N_ASCII           128  /* size of ascii arrays (7 bits) */
                                /* hmm, not sure what will happen with 8 bits*/
@@ -45,6 +92,37 @@ int  word_size          = 2;  /* the k in k-mers; set by -k  */
 int  report_by_sequence = 0;  /* set by -s option */
 int  print_total        = 0;  /* set by -T */
 int  verbose            = 0;  /* set by -v */
+int  matrix_output      = 0;  /* MATRIX_SPARSE by -b, MATRIX_DENSE by -d */
+int  canonical          = 0;  /* set by -c */
+int  n_threads          = 1;  /* set by -t */
+int  suppress_zeros     = 0;  /* set by -z */
+int  top_n              = 0;  /* set by -n */
+int  spectrum           = 0;  /* set by -H */
+int  sample_shift       = -1; /* set by -F; -1 means use counts[] */
+char *tmp_dir           = NULL; /* set by -D */
+int  n_partitions       = 64; /* set by -P */
+long mem_limit_mb       = 1024; /* set by -M */
+int  n_frames           = 0;  /* set by -f: 3 or 6 */
+char *sketch_file       = NULL; /* set by -S */
+int  sketch_size        = 1000; /* set by -m */
+int  sketch_records     = 0;  /* set by -r */
+int  compare            = 0;  /* set by -C */
+char *set_file          = NULL; /* set by -B */
+int  n_sets             = 0;  /* number of -Q set files */
+double fail_fraction    = 0.5; /* set by -x */
+char *split_prefix      = NULL; /* set by -o */
+char *checkpoint_out    = NULL; /* set by -W */
+char *checkpoint_in     = NULL; /* set by -R */
+char *unitig_prefix     = NULL; /* set by -U */
+uint64_t min_solid      = 2;  /* set by -a */
+
+#define  MATRIX_SPARSE      1
+#define  MATRIX_DENSE       2
+#define  MAX_THREADS      256
+#define  MAX_PARTITIONS   512
+#define  MAX_SETS          16
+
+char *set_names[MAX_SETS];    /* set by -Q */
 
 #define  A          65       /* ASCII codes for nucleotides */
 #define  C          67
@@ -68,16 +146,21 @@ unsigned int  twobit[N_ASCII];            /* maps nucleotide char to 2 bits */
 unsigned int  no_count[N_ASCII];          /* 1 => char is not to be counted */
 unsigned int  is_not_space[N_ASCII];      /* 1 if whitespace */
 
-/* these arrays map k-mer (in compressed integer form) to a value. */
+/* these arrays map k-mer (in compressed integer form) to a value.  */
+/* (so do the count tables, counts and frame_counts[], see CTABLE) */
 
-unsigned long int  counts[MAX_HIST_LEN];
 char              *kmer_seq[MAX_HIST_LEN];
 unsigned long int  rc_map[MAX_HIST_LEN];  /* maps index to index of rc */
+unsigned int       column[MAX_HIST_LEN];  /* maps index to -b/-d column  */
 
 /* more globals */
 
 int                n_kmers;            /* determined by k:  4^k              */
 int                n_seqs = 0;         /* number of sequences processed      */
+int                n_columns;          /* -b/-d columns: n_kmers, or number  */
+                                       /* of canonical k-mers with -c        */
+unsigned int      *touched;            /* k-mers counted in this sequence    */
+int                n_touched = 0;      /* (-s), so only they need clearing   */
 
 /* these next 5 form the circular buffer apparatus, which is reset           */
 /* by reset_cbuff() and updated by insert_cbuff()                            */
@@ -89,9 +172,12 @@ unsigned long int  w_mask;             /* bit mask for controlling circular  */
 unsigned long int  cbuff_w;            /* circular buffer index; contains    */
                                        /* k-mer in a compressed two-bit form,*/
                                        /* i.e. 0x1e corresponds to 3-mer CTG */
-char               cbuff[MAX_K];       /* ASCII char circular buffer, for    */
+char               cbuff[MAX_WORD_K];  /* ASCII char circular buffer, for    */
                                        /* tracking outgoing characters       */
 int                next_cbuff = 0;     /* next position in cbuff to accept   */
+unsigned long int  cbuff_rc;           /* reverse complement of cbuff_w      */
+int                start_frame;        /* (-f) position mod 3 of the k-mer   */
+                                       /* in cbuff, from start of sequence   */
 
 
 /* version() - print program name and version */
@@ -112,14 +198,90 @@ void  version( void )
 void usage( void )
    {
     fprintf( stderr, " \n\
-Usage:       kmers [-k<n>] [-hsTvV]  [seq-file ... ]                      \n\
+Usage:       kmers [-k<n>] [-bcdhHsTvVz] [-f<n>] [-F<n>] [-n<n>] [-t<n>] \n\
+                   [-D<dir> [-P<n>] [-M<mb>]] [seq-file ... ]             \n\
+             kmers [-k<n>] -S<sketch-file> [-m<n>] [-r] [seq-file ... ]   \n\
+             kmers -C [-t<n>] sketch-file ...                             \n\
+             kmers [-k<n>] -B<set-file> [seq-file ... ]                   \n\
+             kmers -Q<set-file> [-Q<set-file> ...] [-t<n>] [-x<f>]        \n\
+                   [-o<prefix>] [seq-file ... ]                           \n\
+             kmers -k<n> -U<prefix> [-a<n>] [-t<n>] [seq-file ... ]       \n\
+             (and -W<file>, -R<file> with the first form, or -B)          \n\
                                                                           \n\
              where [seq-files] are in FASTA format.  The name \"-\" means \n\
              stdin.  stdin is scanned it no filemames are specified.      \n\
                                                                           \n\
 Options:     -k<n>   count k-mers of size <n>                             \n\
-             -s      print counts for each sequence                       \n\
+             -s      print counts for each sequence (with -z, only the    \n\
+                     k-mers seen in it, which is much faster for large k) \n\
+             -f<n>   print counts for each reading frame: -f3 for frames  \n\
+                     +1, +2, +3 of the top strand (by k-mer start, from   \n\
+                     the start of each sequence), -f6 for those and       \n\
+                     bottom strand frames -1, -2, -3 (from the end)       \n\
+             -b      write a sparse binary matrix of counts, one row per  \n\
+                     sequence (only nonzero (column, count) pairs)        \n\
+             -d      write a dense binary matrix of k-mer frequencies,    \n\
+                     one row per sequence                                 \n\
+             -c      with -b or -d, fold each k-mer together with its     \n\
+                     reverse complement (canonical k-mers)                \n\
+             -H      print the abundance spectrum of canonical k-mers:    \n\
+                     for each count c, the number of k-mers seen c times  \n\
+                     (the last line, c = 10000, includes all higher ones) \n\
+             -F<n>   with -H, count only a hashed 1/2^<n> sample of the   \n\
+                     k-mers in a hash table and scale the spectrum up by  \n\
+                     2^<n> (-F0 counts all of them); k may be up to 31    \n\
+             -t<n>   count sequences with <n> threads (-b, -d), or sum    \n\
+                     the spectrum with <n> threads (-H), or count         \n\
+                     partitions with <n> threads (-D)                     \n\
+             -D<dir> count on disk, for input too big for memory: split   \n\
+                     the k-mers into partitions (temporary files in       \n\
+                     <dir>), then count them one by one; k may be up to   \n\
+                     31.  Prints only the k-mers seen (as with -z), in    \n\
+                     order within each partition (or piece of one, see    \n\
+                     -M).  Also works with -H                             \n\
+             -P<n>   use <n> partitions with -D (default 64)              \n\
+             -M<mb>  with -D, keep memory use to about <mb> megabytes     \n\
+                     (default 1024, at least 16), splitting partitions    \n\
+                     too big for it                                       \n\
+             -S<f>   write a MinHash sketch (the <n> least hashes of the  \n\
+                     canonical k-mers) of each file to sketch file <f>;   \n\
+                     k may be up to 31                                    \n\
+             -m<n>   keep <n> hashes per sketch (default 1000)            \n\
+             -r      with -S, sketch each record, not each file           \n\
+             -C      compare the sketches in the given sketch files, all  \n\
+                     against all, printing (tab separated) both names,    \n\
+                     Jaccard index, containment of the first in the       \n\
+                     second and vice versa, and shared/union hashes; -t   \n\
+                     threads share the work                               \n\
+             -B<f>   write the set of canonical k-mers in the sequences   \n\
+                     to set file <f>, for -Q; k may be up to 31           \n\
+             -Q<f>   screen reads against the k-mer set in set file <f>   \n\
+                     (up to 16 -Q's, all with the same k), printing (tab  \n\
+                     separated) the name, number of k-mers and fraction   \n\
+                     of them in each set, for each read; -t threads share \n\
+                     the reads, which are written in input order          \n\
+             -o<p>   with -Q, instead write reads with at least -x of     \n\
+                     their k-mers in any set to <p>.fail.fa, and the rest \n\
+                     to <p>.pass.fa                                       \n\
+             -x<f>   the fraction for -o (default 0.5)                    \n\
+             -U<p>   build the compacted de Bruijn graph of the solid     \n\
+                     k-mers (k odd, up to 31) and write its unitigs to    \n\
+                     <p>.fa, and with their links to <p>.gfa; -t threads  \n\
+                     walk the unitigs                                     \n\
+             -a<n>   with -U, solid k-mers are those seen at least <n>    \n\
+                     times, counting both strands (default 2)             \n\
+             -W<f>   save the counts (and which files are done) to        \n\
+                     checkpoint <f> after each input file                 \n\
+             -R<f>   start from the counts in checkpoint <f> (made with   \n\
+                     the same -k, -f, -F, -B and -U), skipping input      \n\
+                     files it has counted; -R<f> -W<f> resumes an         \n\
+                     interrupted run or adds new files to it              \n\
              -T      print a total of dimer counts (1-direction)          \n\
+             -z      don't print k-mers which (with their reverse         \n\
+                     complements) weren't seen                            \n\
+             -n<n>   print only the <n> most abundant k-mers (counting    \n\
+                     both strands, one line per k-mer/rc pair), most      \n\
+                     abundant first                                       \n\
              -v      verbose mode                                         \n\
              -V      print version                                        \n\
              -h      print help message                                   \n\
@@ -135,9 +297,10 @@ void parse_args ( int argc, char **argv, int *nfiles, char ***filenames )
    {
     static char *stand_in[] = { "-", (char *) 0 };
     int    c;
+    int    large_k;
     char  *endptr;
 
-    while ( (c = getopt( argc, argv, "k:TsvVh")) != -1 )
+    while ( (c = getopt( argc, argv, "a:B:bcCdD:f:F:Hk:m:M:n:o:P:Q:rR:S:t:TsU:vVW:hx:z")) != -1 )
         switch ( c )
            {
             case 'k':  word_size = strtol( optarg, &endptr, 10 );
@@ -145,12 +308,6 @@ void parse_args ( int argc, char **argv, int *nfiles, char ***filenames )
                           {
                            if ( endptr == optarg )
                                usage();
-                           else if ( word_size<1 || word_size>MAX_K )
-                              {
-                               fprintf( stderr, 
-                                          "k must be in range 1-%d\n", MAX_K);
-                               exit( 1 );
-                              }
                           }
                        else
                           { 
@@ -159,6 +316,87 @@ void parse_args ( int argc, char **argv, int *nfiles, char ***filenames )
                           }
                        break;
             case 's':  report_by_sequence = 1;  break;
+            case 'b':  matrix_output = MATRIX_SPARSE;  break;
+            case 'd':  matrix_output = MATRIX_DENSE;   break;
+            case 'c':  canonical = 1;           break;
+            case 'z':  suppress_zeros = 1;      break;
+            case 'H':  spectrum = 1;            break;
+            case 'D':  tmp_dir = optarg;        break;
+            case 'S':  sketch_file = optarg;    break;
+            case 'B':  set_file = optarg;       break;
+            case 'Q':  if ( n_sets >= MAX_SETS )
+                          {
+                           fprintf( stderr, "at most %d -Q sets\n", MAX_SETS );
+                           exit( 1 );
+                          }
+                       set_names[n_sets++] = optarg;
+                       break;
+            case 'x':  fail_fraction = atof( optarg );  break;
+            case 'o':  split_prefix = optarg;   break;
+            case 'W':  checkpoint_out = optarg; break;
+            case 'U':  unitig_prefix = optarg;  break;
+            case 'a':  min_solid = atol( optarg );
+                       if ( min_solid < 1 )
+                          {
+                           fprintf( stderr, "-a must be at least 1\n" );
+                           exit( 1 );
+                          }
+                       break;
+            case 'R':  checkpoint_in = optarg;  break;
+            case 'r':  sketch_records = 1;      break;
+            case 'C':  compare = 1;             break;
+            case 'm':  sketch_size = atoi( optarg );
+                       if ( sketch_size < 1 )
+                          {
+                           fprintf( stderr, "-m must be at least 1\n" );
+                           exit( 1 );
+                          }
+                       break;
+            case 'f':  n_frames = atoi( optarg );
+                       if ( n_frames != 3 && n_frames != 6 )
+                          {
+                           fprintf( stderr, "-f must be 3 or 6\n" );
+                           exit( 1 );
+                          }
+                       break;
+            case 'P':  n_partitions = atoi( optarg );
+                       if ( n_partitions < 1 || n_partitions > MAX_PARTITIONS )
+                          {
+                           fprintf( stderr, "-P must be in range 1-%d\n",
+                                            MAX_PARTITIONS );
+                           exit( 1 );
+                          }
+                       break;
+            case 'M':  mem_limit_mb = atol( optarg );
+                       if ( mem_limit_mb < 16 )
+                          {
+                           fprintf( stderr, "-M must be at least 16 (MB)\n" );
+                           exit( 1 );
+                          }
+                       break;
+            case 'F':  sample_shift = atoi( optarg );
+                       if ( sample_shift < 0 || sample_shift > 32 )
+                          {
+                           fprintf( stderr, "-F must be in range 0-32\n" );
+                           exit( 1 );
+                          }
+                       break;
+            case 'n':  top_n = atoi( optarg );
+                       if ( top_n < 1 )
+                          {
+                           fprintf( stderr, "-n must be at least 1\n" );
+                           exit( 1 );
+                          }
+                       break;
+            case 't':  n_threads = atoi( optarg );
+                       if ( n_threads < 1 || n_threads > MAX_THREADS )
+                          {
+                           fprintf( stderr, 
+                                    "threads must be in range 1-%d\n",
+                                    MAX_THREADS );
+                           exit( 1 );
+                          }
+                       break;
             case 'T':  print_total = 1;         break;
             case 'v':  verbose = 1;             break;
             case 'V':  version();               exit(0);
@@ -167,6 +405,101 @@ void parse_args ( int argc, char **argv, int *nfiles, char ***filenames )
                        exit(0);
             default:   usage();                 exit(1);
            }
+    large_k = sample_shift >= 0 || tmp_dir || sketch_file || set_file 
+                  || unitig_prefix;
+    if ( word_size < 1 || word_size > ( large_k ? MAX_WORD_K : MAX_K ) )
+       {
+        fprintf( stderr, "k must be in range 1-%d\n",
+                 large_k ? MAX_WORD_K : MAX_K );
+        exit( 1 );
+       }
+    if ( ( sketch_file || compare ) 
+            && ( report_by_sequence || matrix_output || spectrum || tmp_dir
+                     || n_frames || top_n || sample_shift >= 0 ) )
+       {
+        fprintf( stderr, "-S and -C can't be combined with -s, -b, -d, -H, "
+                         "-D, -f, -n or -F\n" );
+        exit( 1 );
+       }
+    if ( ( set_file || n_sets ) 
+            && ( report_by_sequence || matrix_output || spectrum || tmp_dir
+                     || n_frames || top_n || sample_shift >= 0 
+                     || sketch_file || compare ) )
+       {
+        fprintf( stderr, "-B and -Q can't be combined with -s, -b, -d, -H, "
+                         "-D, -f, -n, -F, -S or -C\n" );
+        exit( 1 );
+       }
+    if ( set_file && n_sets )
+       {
+        fprintf( stderr, "-B and -Q can't be used together\n" );
+        exit( 1 );
+       }
+    if ( split_prefix && ! n_sets )
+       {
+        fprintf( stderr, "-o needs -Q\n" );
+        exit( 1 );
+       }
+    if ( unitig_prefix 
+            && ( report_by_sequence || matrix_output || spectrum || tmp_dir
+                     || n_frames || top_n || sample_shift >= 0 || sketch_file 
+                     || compare || set_file || n_sets ) )
+       {
+        fprintf( stderr, "-U can't be combined with -s, -b, -d, -H, -D, -f, "
+                         "-n, -F, -S, -C, -B or -Q\n" );
+        exit( 1 );
+       }
+    if ( unitig_prefix && word_size % 2 == 0 )
+       {
+        fprintf( stderr, "k must be odd for -U (so no k-mer is its own "
+                         "reverse complement)\n" );
+        exit( 1 );
+       }
+    if ( ( checkpoint_out || checkpoint_in )  
+            && ( report_by_sequence || matrix_output || tmp_dir || sketch_file
+                     || compare || n_sets ) )
+       {
+        fprintf( stderr, "-W and -R can't be combined with -s, -b, -d, -D, "
+                         "-S, -C or -Q\n" );
+        exit( 1 );
+       }
+    if ( sketch_file && compare )
+       {
+        fprintf( stderr, "-S and -C can't be used together\n" );
+        exit( 1 );
+       }
+    if ( sketch_records && ! sketch_file )
+       {
+        fprintf( stderr, "-r needs -S\n" );
+        exit( 1 );
+       }
+    if ( tmp_dir && ( report_by_sequence || matrix_output || top_n
+                          || sample_shift >= 0 ) )
+       {
+        fprintf( stderr, "-D can't be combined with -s, -b, -d, -n or -F\n" );
+        exit( 1 );
+       }
+    if ( sample_shift >= 0 && ! spectrum )
+       {
+        fprintf( stderr, "-F needs -H\n" );
+        exit( 1 );
+       }
+    if ( spectrum && ( report_by_sequence || matrix_output ) )
+       {
+        fprintf( stderr, "-H can't be combined with -s, -b or -d\n" );
+        exit( 1 );
+       }
+    if ( n_frames && ( report_by_sequence || matrix_output || spectrum 
+                           || tmp_dir ) )
+       {
+        fprintf( stderr, "-f can't be combined with -s, -b, -d, -H or -D\n" );
+        exit( 1 );
+       }
+    if ( canonical && ! matrix_output )
+       {
+        fprintf( stderr, "-c needs -b or -d\n" );
+        exit( 1 );
+       }
     argc -= optind;
     argv += optind;
     if ( argc > 0 )
@@ -182,6 +515,32 @@ void parse_args ( int argc, char **argv, int *nfiles, char ***filenames )
    }
 
 
+void  *malloc_safely( size_t n_bytes )         /* malloc(), or die trying */
+   {
+    void *p;
+
+    if ( !(p = malloc( n_bytes )) )
+       {
+        fprintf( stderr, "failed to malloc %lu bytes\n", 
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+
+void  *realloc_safely( void *p, size_t n_bytes )   /* same for realloc() */
+   {
+    if ( !(p = realloc( p, n_bytes )) )
+       {
+        fprintf( stderr, "failed to realloc %lu bytes\n", 
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+
 /*********************************************************************/
 /* open_file() opens a file or returns stdin if name is "-", or does */
 /* error exit if file can't be opened                                */
@@ -228,6 +587,308 @@ void  dumps( char *msg, unsigned int a[] )
 #endif
 
 
+                           /***********************/
+                           /* Hashed k-mer tables */
+                           /***********************/
+
+/*****************************************************************************/
+/* A KTABLE counts k-mers (up to MAX_WORD_K, two bits per base in a 64 bit   */
+/* key) by open addressing with linear probing.  It doubles when half full.  */
+/*                                                                           */
+/* Counts are kept compactly: 16 bits each, in the KTABLE and in the dense   */
+/* CTABLEs indexed by k-mer (counts[] and the -f frame tables), since        */
+/* nearly every k-mer is seen less than 65535 times.  A counter which gets   */
+/* there holds COUNT_SPILL instead, and the true count goes to the table's   */
+/* SPILL map, a KTABLE-like table with 64 bit counts.  That makes 10 bytes   */
+/* a KTABLE slot rather than 16, and 2 bytes a dense counter rather than 8.  */
+/*****************************************************************************/
+
+#define  EMPTY_KEY    (~ (uint64_t) 0)    /* can't be a k-mer, k <= 31 */
+#define  COUNT_SPILL  0xffff              /* count is in the spill map */
+
+typedef uint16_t  COUNT;
+
+typedef struct spill {
+                       uint64_t  *keys;
+                       uint64_t  *vals;
+                       size_t     size;   /* a power of 2 */
+                       size_t     n;      /* number of keys */
+                     } SPILL;
+
+typedef struct ktable {
+                        uint64_t  *keys;
+                        COUNT     *vals;
+                        size_t     size;  /* a power of 2 */
+                        size_t     n;     /* number of keys */
+                        SPILL      spill;
+                      } KTABLE;
+
+typedef struct ctable {
+                        COUNT     *c;     /* indexed by k-mer */
+                        SPILL      spill;
+                      } CTABLE;
+
+KTABLE  sample_table;                     /* for -F */
+KTABLE  set_table;                        /* for -B */
+KTABLE  graph_table;                      /* for -U */
+CTABLE  counts;                           /* indexed by k-mer, 4^k */
+CTABLE  frame_counts[6];                  /* -f: counts by reading frame */
+
+
+/* 64 bit hash finalizer (from MurmurHash3) */
+
+uint64_t  mix64( uint64_t h )
+   {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return( h );
+   }
+
+
+/* spill maps start small, and are only allocated when first needed */
+
+void  spill_init( SPILL *s, size_t size )
+   {
+    size_t  i;
+
+    s->size = 64;
+    while ( s->size < size )
+        s->size *= 2;
+    s->keys = malloc_safely( s->size * sizeof( uint64_t ) );
+    s->vals = malloc_safely( s->size * sizeof( uint64_t ) );
+    for ( i = 0; i < s->size; i++ )
+        s->keys[i] = EMPTY_KEY;
+    s->n = 0;
+   }
+
+
+void  spill_free( SPILL *s )
+   {
+    free( s->keys );
+    free( s->vals );
+    s->keys = s->vals = NULL;
+    s->size = s->n = 0;
+   }
+
+
+void  spill_clear( SPILL *s )
+   {
+    size_t  i;
+
+    if ( s->n > 0 )
+        for ( i = 0; i < s->size; i++ )
+            s->keys[i] = EMPTY_KEY;
+    s->n = 0;
+   }
+
+
+/* add n to key's count */
+
+void  spill_add( SPILL *s, uint64_t key, uint64_t n );
+
+void  spill_grow( SPILL *s )
+   {
+    SPILL   old = *s;
+    size_t  i;
+
+    spill_init( s, 2 * old.size );
+    for ( i = 0; i < old.size; i++ )
+        if ( old.keys[i] != EMPTY_KEY )
+            spill_add( s, old.keys[i], old.vals[i] );
+    spill_free( &old );
+   }
+
+
+void  spill_add( SPILL *s, uint64_t key, uint64_t n )
+   {
+    size_t  i;
+    size_t  mask;
+
+    if ( s->size == 0 )
+        spill_init( s, 0 );
+    mask = s->size - 1;
+    for ( i = mix64( key ) & mask; s->keys[i] != EMPTY_KEY; i = (i+1) & mask )
+        if ( s->keys[i] == key )
+           {
+            s->vals[i] += n;
+            return;
+           }
+    s->keys[i] = key;
+    s->vals[i] = n;
+    if ( ++s->n * 2 > s->size )
+        spill_grow( s );
+   }
+
+
+uint64_t  spill_get( const SPILL *s, uint64_t key )
+   {
+    size_t  i;
+    size_t  mask = s->size - 1;
+
+    if ( s->size == 0 )
+        return( 0 );
+    for ( i = mix64( key ) & mask; s->keys[i] != EMPTY_KEY; i = (i+1) & mask )
+        if ( s->keys[i] == key )
+            return( s->vals[i] );
+    return( 0 );
+   }
+
+
+/* add n to the compact counter *c of key, spilling it if it gets too big */
+
+void  count_add( COUNT *c, SPILL *s, uint64_t key, uint64_t n )
+   {
+    if ( *c == COUNT_SPILL )
+        spill_add( s, key, n );
+    else if ( *c + n < COUNT_SPILL )
+        *c += n;
+    else
+       {
+        spill_add( s, key, *c + n );
+        *c = COUNT_SPILL;
+       }
+   }
+
+
+uint64_t  count_value( COUNT c, const SPILL *s, uint64_t key )
+   {
+    return( c == COUNT_SPILL ? spill_get( s, key ) : c );
+   }
+
+
+void  ctable_init( CTABLE *t, size_t n )
+   {
+    if ( !( t->c = calloc( n > 0 ? n : 1, sizeof( COUNT ) ) ) )
+       {
+        perror( "can't allocate count table" );
+        exit( errno );
+       }
+    t->spill.keys = t->spill.vals = NULL;
+    t->spill.size = t->spill.n = 0;
+   }
+
+
+void  ctable_incr( CTABLE *t, uint64_t i )
+   {
+    if ( t->c[i] < COUNT_SPILL - 1 )
+        t->c[i]++;
+    else
+        count_add( &t->c[i], &t->spill, i, 1 );
+   }
+
+
+uint64_t  ctable_get( const CTABLE *t, uint64_t i )
+   {
+    return( count_value( t->c[i], &t->spill, i ) );
+   }
+
+
+void  ktable_init( KTABLE *t, size_t size )
+   {
+    size_t  i;
+
+    t->size = 1024;
+    while ( t->size < size )
+        t->size *= 2;
+    t->keys = malloc_safely( t->size * sizeof( uint64_t ) );
+    t->vals = malloc_safely( t->size * sizeof( COUNT ) );
+    for ( i = 0; i < t->size; i++ )
+        t->keys[i] = EMPTY_KEY;
+    t->n = 0;
+    t->spill.keys = t->spill.vals = NULL;
+    t->spill.size = t->spill.n = 0;
+   }
+
+
+void  ktable_free( KTABLE *t )
+   {
+    free( t->keys );
+    free( t->vals );
+    t->keys = NULL;
+    t->vals = NULL;
+    t->size = t->n = 0;
+    spill_free( &t->spill );
+   }
+
+
+/* slot for key: where it is, or the empty one where it would go */
+
+size_t  ktable_slot( const KTABLE *t, uint64_t key )
+   {
+    size_t  i;
+    size_t  mask = t->size - 1;
+
+    for ( i = mix64( key ) & mask; t->keys[i] != EMPTY_KEY; i = (i+1) & mask )
+        if ( t->keys[i] == key )
+            break;
+    return( i );
+   }
+
+
+/* doubling keeps the spill map: the keys, and so their counts, are */
+/* unchanged                                                        */
+
+void  ktable_grow( KTABLE *t )
+   {
+    KTABLE  old = *t;
+    size_t  i, j;
+
+    ktable_init( t, 2 * old.size );
+    for ( i = 0; i < old.size; i++ )
+        if ( old.keys[i] != EMPTY_KEY )
+           {
+            j = ktable_slot( t, old.keys[i] );
+            t->keys[j] = old.keys[i];
+            t->vals[j] = old.vals[i];
+           }
+    t->n = old.n;
+    t->spill = old.spill;
+    free( old.keys );
+    free( old.vals );
+   }
+
+
+/* add n to key's count */
+
+void  ktable_add( KTABLE *t, uint64_t key, uint64_t n )
+   {
+    size_t  i = ktable_slot( t, key );
+
+    if ( t->keys[i] == key )
+       {
+        count_add( &t->vals[i], &t->spill, key, n );
+        return;
+       }
+    t->keys[i] = key;
+    t->vals[i] = 0;
+    count_add( &t->vals[i], &t->spill, key, n );
+    if ( ++t->n * 2 > t->size )
+        ktable_grow( t );
+   }
+
+
+uint64_t  ktable_get( const KTABLE *t, uint64_t key )
+   {
+    size_t  i = ktable_slot( t, key );
+
+    if ( t->keys[i] == key )
+        return( count_value( t->vals[i], &t->spill, key ) );
+    return( 0 );
+   }
+
+
+/* count in slot i (which holds a key) */
+
+uint64_t  ktable_val( const KTABLE *t, size_t i )
+   {
+    return( count_value( t->vals[i], &t->spill, t->keys[i] ) );
+   }
+
+
+
 /* this returns as an ASCII string, the sequence corresponding to     */
 /* the given compressed 2-bit index.  This doesn't allocate any new   */
 /* memory - that must be handled in the calling routine               */
@@ -272,7 +933,8 @@ unsigned int  intcomp ( int n )
 
 void  init( void )
    {
-    int i;
+    int   i;
+    char *seq_block;
 
     /* fill twobits[] */
     bzero( twobit, N_ASCII * sizeof( unsigned int ) );
@@ -305,21 +967,27 @@ void  init( void )
 #endif
 
     w_mask = 0;
-    n_kmers = 1;
     for ( i = 0; i < word_size; i++ )
-       {
         w_mask = (w_mask << 2) | 0x3;
-        n_kmers *= 4;
+    if ( word_size > MAX_K )            /* no 4^k tables for large k */
+       {
+        n_kmers = 0;
+        ctable_init( &counts, 0 );
+        return;
        }
+    n_kmers = 1 << (2 * word_size);
+    ctable_init( &counts, n_kmers );
 
 #ifdef DEBUG
     printf( "word_size is %d, w_mask is %x, n_kmers is %d (0x%x)\n", 
              word_size, w_mask, n_kmers, n_kmers );
 #endif
 
-    for ( i = 0; i < n_kmers; i++ )
-       {
-        kmer_seq[i] = strdup( int2seq( i ) );
+    seq_block = malloc_safely( (size_t) n_kmers * (word_size + 1) );
+    for ( i = 0; i < n_kmers; i++ )             /* one block, not 4^k */
+       {                                        /* strdup()s          */
+        kmer_seq[i] = seq_block + (size_t) i * (word_size + 1);
+        memcpy( kmer_seq[i], int2seq( i ), word_size + 1 );
 #ifdef DEBUG
         printf( "%10d 0x%08x [%s]\n", i, i, kmer_seq[i] );
 #endif
@@ -332,14 +1000,40 @@ void  init( void )
             i, i, kmer_seq[i], rc_map[i], rc_map[i], kmer_seq[rc_map[i]] ); 
 #endif
        }    
+
+    /* matrix columns: every k-mer, or each canonical k-mer (the lesser */
+    /* of a k-mer and its reverse complement) in increasing order       */
+
+    n_columns = 0;
+    for ( i = 0; i < n_kmers; i++ )
+        if ( ! canonical || i <= rc_map[i] )
+            column[i] = n_columns++;
+        else
+            column[i] = column[rc_map[i]];
+
+    if ( report_by_sequence )
+        touched = malloc_safely( n_kmers * sizeof( unsigned int ) );
+    for ( i = 0; i < n_frames; i++ )
+        ctable_init( &frame_counts[i], n_kmers );
    }
 
 
-/* clear k-mer count histogram */
+/* clear k-mer count histogram.  With -s, only the k-mers the last */
+/* sequence touched can be nonzero                                  */
 
 void  clear_counts( void )
    {
-    bzero( counts, n_kmers * sizeof( unsigned long int ));
+    int  i;
+
+    if ( report_by_sequence )
+       {
+        for ( i = 0; i < n_touched; i++ )
+            counts.c[touched[i]] = 0;
+        n_touched = 0;
+       }
+    else
+        bzero( counts.c, n_kmers * sizeof( COUNT ));
+    spill_clear( &counts.spill );
    }
 
 
@@ -362,10 +1056,11 @@ void  reset_cbuff( void )
     printf( "reset cbuff\n" );
 #endif
     next_cbuff = 0;
-    for ( i = 0; i < MAX_K; i++ )
+    for ( i = 0; i < MAX_WORD_K; i++ )
        cbuff[i] = NIL;
     cbuff_w = w_mask & 0xffffffff;
     n_nocounts = word_size;   /* cbuff starts out filled with NILs */
+    start_frame = (3 - word_size % 3) % 3;     /* -k mod 3 */
    }
 
 
@@ -393,68 +1088,449 @@ void  enter_cbuff( char c )
     if ( next_cbuff >= word_size )
         next_cbuff = 0;
     cbuff_w = w_mask & ( (cbuff_w << 2) | twobit[c] );
+    cbuff_rc = (cbuff_rc >> 2) 
+                  | ( (unsigned long int) (3 ^ twobit[c]) << 2*(word_size-1) );
+    if ( ++start_frame == 3 )
+        start_frame = 0;
    }
 
 
-/* use the current circular buffer compressed index and increment */
-/* the counts for that index.  (note -this is only doing the top  */
-/* strand - we'll infer the bottom strand counts in report()      */
+/* with -F, count the canonical k-mer now in the circular buffer if its */
+/* hash falls in the bottom 1/2^sample_shift of the range (its top      */
+/* sample_shift bits are all zero)                                      */
 
-void incr_counts( void )
+void  incr_sample( void )
    {
-    if ( n_nocounts == 0 )
-       { 
-#ifdef DEBUG
-        printf( "incr counts[%d] (%x)\n", cbuff_w, cbuff_w ); 
-#endif
-        counts[cbuff_w]++; 
-       }
-    else if ( n_nocounts < 0 )
-       {
-        fprintf( stderr, "Yeow negative n_nocounts: %d\n", n_nocounts );
-        exit( 1 );
-       }
+    uint64_t  canon;
+
+    canon = ( cbuff_w < cbuff_rc ) ? cbuff_w : cbuff_rc;
+    if ( sample_shift == 0 || ( mix64( canon ) >> (64 - sample_shift) ) == 0 )
+        ktable_add( &sample_table, canon, 1 );
    }
 
-/* calculate total nt by adding up appropriate entries from array    */
-/* counts[].  For now, we will not include any ambiguities unless -a */
-/* set */
 
-unsigned long int  compute_total( void )
-   {
-    int  i;
-    unsigned long int  total = 0;
+/* -f6: a bottom strand k-mer's frame counts from the end of the sequence, */
+/* so its reverse complement word (and top strand frame) waits in rc_words */
+/* until the sequence ends                                                  */
 
-    for ( i = 0; i < n_kmers; i++ )
-        total += counts[i];
-    return( total );
+uint32_t  *rc_words = NULL;        /* cbuff_rc << 2 | start_frame */
+size_t     n_rc_words = 0;
+size_t     rc_words_size = 0;
+size_t     seq_len_ch = 0;         /* chars in this sequence so far */
+
+
+void  incr_frames( void )
+   {
+    ctable_incr( &frame_counts[start_frame], cbuff_w );
+    if ( n_frames == 6 )
+       {
+        if ( n_rc_words == rc_words_size )
+           {
+            rc_words_size = rc_words_size ? 2 * rc_words_size : 65536;
+            rc_words = realloc_safely( rc_words, 
+                                       rc_words_size * sizeof( uint32_t ) );
+           }
+        rc_words[n_rc_words++] = (cbuff_rc << 2) | start_frame;
+       }
+   }
+
+
+/* end of a sequence of len chars: count its bottom strand k-mers in frame */
+/* (len - k - start) mod 3, i.e. -1 is the one ending at the last base     */
+
+void  end_frames( size_t len )
+   {
+    size_t  i;
+    int     last = (len + 3 - word_size % 3) % 3;   /* (len - k) mod 3 */
+
+    for ( i = 0; i < n_rc_words; i++ )
+        ctable_incr( &frame_counts[ 3 + (last + 3 - (rc_words[i] & 3)) % 3 ],
+                     rc_words[i] >> 2 );
+    n_rc_words = 0;
+   }
+
+
+/* -S: the least distinct hashes of the canonical k-mers so far are among  */
+/* sketch_hashes[], which is cut back to the sketch_size least (sorted)    */
+/* whenever it fills.  Then only hashes below the largest of those can     */
+/* get in.                                                                 */
+
+FILE      *sketch_out;
+uint64_t  *sketch_hashes = NULL;     /* [2 * sketch_size] */
+size_t     n_sketch_hashes = 0;
+uint64_t   sketch_limit = ~ (uint64_t) 0;
+uint64_t   sketch_kmers = 0;         /* k-mers in this sketch */
+int        sketch_in_record = 0;     /* -r: a record is under way */
+
+
+int  uint64_cmp( const void *x, const void *y )
+   {
+    uint64_t a = *(const uint64_t *) x;
+    uint64_t b = *(const uint64_t *) y;
+
+    return( a < b ? -1 : (a > b) );
+   }
+
+
+void  compact_sketch( void )
+   {
+    size_t  i, n;
+
+    qsort( sketch_hashes, n_sketch_hashes, sizeof( uint64_t ), uint64_cmp );
+    for ( n = 0, i = 0; i < n_sketch_hashes; i++ )
+        if ( n == 0 || sketch_hashes[i] != sketch_hashes[n-1] )
+            sketch_hashes[n++] = sketch_hashes[i];
+    if ( n >= sketch_size )
+       {
+        n = sketch_size;
+        sketch_limit = sketch_hashes[n-1];
+       }
+    n_sketch_hashes = n;
+   }
+
+
+void  incr_sketch( void )
+   {
+    uint64_t  h;
+
+    h = mix64( ( cbuff_w < cbuff_rc ) ? cbuff_w : cbuff_rc );
+    sketch_kmers++;
+    if ( h >= sketch_limit )
+        return;
+    if ( sketch_hashes == NULL )
+        sketch_hashes = malloc_safely( 2 * sketch_size * sizeof( uint64_t ) );
+    sketch_hashes[n_sketch_hashes++] = h;
+    if ( n_sketch_hashes == 2 * sketch_size )
+        compact_sketch();
+   }
+
+
+/* write out the sketch under way, as name, and start another */
+
+void  end_sketch( char *name )
+   {
+    uint32_t  len = strlen( name );
+    uint32_t  n;
+
+    compact_sketch();
+    n = n_sketch_hashes;
+    fwrite( &len, sizeof( len ), 1, sketch_out );
+    fwrite( name, 1, len, sketch_out );
+    fwrite( &sketch_kmers, sizeof( sketch_kmers ), 1, sketch_out );
+    fwrite( &n, sizeof( n ), 1, sketch_out );
+    if ( fwrite( sketch_hashes, sizeof( uint64_t ), n, sketch_out ) != n )
+       {
+        perror( sketch_file );
+        exit( errno );
+       }
+    if ( verbose )
+        fprintf( stderr, "sketch %s: %lu k-mers, %u hashes\n", name, 
+                         (unsigned long) sketch_kmers, n );
+    n_sketch_hashes = 0;
+    sketch_kmers = 0;
+    sketch_limit = ~ (uint64_t) 0;
+   }
+
+
+/* use the current circular buffer compressed index and increment */
+/* the counts for that index.  (note -this is only doing the top  */
+/* strand - we'll infer the bottom strand counts in report()      */
+
+void incr_counts( void )
+   {
+    if ( n_nocounts == 0 )
+       { 
+#ifdef DEBUG
+        printf( "incr counts[%d] (%x)\n", cbuff_w, cbuff_w ); 
+#endif
+        if ( sketch_file )
+            incr_sketch();
+        else if ( unitig_prefix )
+            ktable_add( &graph_table, ( cbuff_w < cbuff_rc ) ? cbuff_w 
+                                                              : cbuff_rc, 1 );
+        else if ( set_file )
+            ktable_add( &set_table, ( cbuff_w < cbuff_rc ) ? cbuff_w 
+                                                            : cbuff_rc, 1 );
+        else if ( n_frames )
+            incr_frames();
+        else if ( sample_shift >= 0 )
+            incr_sample();
+        else
+           {
+            if ( counts.c[cbuff_w] == 0 && report_by_sequence )
+                touched[n_touched++] = cbuff_w;
+            ctable_incr( &counts, cbuff_w );
+           }
+       }
+    else if ( n_nocounts < 0 )
+       {
+        fprintf( stderr, "Yeow negative n_nocounts: %d\n", n_nocounts );
+        exit( 1 );
+       }
+   }
+
+/* calculate total nt by adding up appropriate entries from array    */
+/* counts[].  For now, we will not include any ambiguities unless -a */
+/* set */
+
+uint64_t  compute_total( void )
+   {
+    int       i;
+    uint64_t  total = 0;
+
+    for ( i = 0; i < n_kmers; i++ )
+        total += ctable_get( &counts, i );
+    return( total );
+   }
+
+
+                            /*****************/
+                            /* Report engine */
+                            /*****************/
+
+/*****************************************************************************/
+/* Report lines are formatted by hand into out_buff[], which is written out  */
+/* when full and at the end of each report.  fmt_uint() and fmt_fixed()      */
+/* produce exactly what printf()'s %<w>lu and %<w>.6f would.                 */
+/*****************************************************************************/
+
+#define  OUT_BUFF_LEN  (1 << 20)
+#define  MAX_LINE      (2 * MAX_WORD_K + 6 * 24 + 16)  /* longest line */
+
+static char    out_buff[OUT_BUFF_LEN];
+static size_t  out_n = 0;
+
+
+void  out_flush( void )
+   {
+    if ( out_n > 0 && fwrite( out_buff, 1, out_n, stdout ) != out_n )
+       {
+        perror( "kmers: write" );
+        exit( errno );
+       }
+    out_n = 0;
+   }
+
+
+/* write v in decimal, right justified in width, at p.  Returns the end */
+
+char  *fmt_uint( char *p, uint64_t v, int width )
+   {
+    char  digits[24];
+    int   n = 0;
+
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+       } while ( v > 0 );
+    while ( width-- > n )
+        *p++ = ' ';
+    while ( n > 0 )
+        *p++ = digits[--n];
+    return( p );
+   }
+
+
+/* same for v with 6 decimal places (%<width>.6f) */
+
+char  *fmt_fixed( char *p, double v, int width )
+   {
+    uint64_t  q;
+    double    x;
+    char     *d;
+    int       i;
+
+    if ( ! isfinite( v ) || v < 0.0 || v >= 1.0e6 )
+        return( p + sprintf( p, "%*.6f", width, v ) );
+    x = v * 1.0e6;              /* within 2^-53 * 1e12 (~1e-4) of exact */
+    q = (uint64_t) x;
+    if ( fabs( x - (double) q - 0.5 ) < 1.0e-3 )   /* too near a tie to */
+        return( p + sprintf( p, "%*.6f", width, v ) );   /* round here  */
+    if ( x - (double) q > 0.5 )
+        q++;
+    p = fmt_uint( p, q / 1000000, width - 7 );
+    *p++ = '.';
+    q %= 1000000;
+    for ( d = p + 5, i = 0; i < 6; i++, q /= 10 )
+        *d-- = '0' + q % 10;
+    return( p + 6 );
+   }
+
+
+/* format the report line for k-mer seq, seen ci times, whose reverse */
+/* complement rseq was seen cj times, at p.  Returns the end of line   */
+
+char  *format_line( char *p, const char *seq, const char *rseq,
+                    uint64_t ci, uint64_t cj, uint64_t total )
+   {
+    memcpy( p, seq, word_size );
+    p += word_size;
+    *p++ = '/';
+    memcpy( p, rseq, word_size );
+    p += word_size;
+    *p++ = ' ';
+    p = fmt_uint( p, ci, 10 );
+    *p++ = ' ';
+    p = fmt_uint( p, cj, 10 );
+    *p++ = ' ';
+    p = fmt_uint( p, ci + cj, 10 );
+    *p++ = ' ';
+    *p++ = ' ';
+    p = fmt_fixed( p, 100.0 * ( (double) ci / (double) total ), 10 );
+    *p++ = ' ';
+    p = fmt_fixed( p, 100.0 * ( (double) cj / (double) total ), 10 );
+    *p++ = ' ';
+    p = fmt_fixed( p, 50.0 * ( (double) ci + (double) cj )
+                                 / (double) total, 10 );
+    *p++ = '\n';
+    return( p );
+   }
+
+
+/* format report line for k-mer i */
+
+void  report_line( int i, uint64_t total )
+   {
+    int        j = rc_map[i];
+
+    if ( out_n + MAX_LINE > OUT_BUFF_LEN )
+        out_flush();
+    out_n = format_line( out_buff + out_n, kmer_seq[i], kmer_seq[j],
+                         ctable_get( &counts, i ), ctable_get( &counts, j ), 
+                         total ) - out_buff;
+   }
+
+
+/* ordering for -n: more abundant (both strands) first, then by index */
+
+int  more_abundant( int a, int b )
+   {
+    uint64_t  ca = ctable_get( &counts, a ) + ctable_get( &counts, rc_map[a] );
+    uint64_t  cb = ctable_get( &counts, b ) + ctable_get( &counts, rc_map[b] );
+
+    return( ca > cb || ( ca == cb && a < b ) );
+   }
+
+
+/* sift heap[k] down in a heap of n whose root is the least abundant */
+
+void  sift_down( int *heap, int n, int k )
+   {
+    int  c, t;
+
+    while ( (c = 2 * k + 1) < n )
+       {
+        if ( c + 1 < n && more_abundant( heap[c], heap[c+1] ) )
+            c++;
+        if ( ! more_abundant( heap[k], heap[c] ) )
+            break;
+        t = heap[k];
+        heap[k] = heap[c];
+        heap[c] = t;
+        k = c;
+       }
+   }
+
+
+/* report the top_n most abundant k-mer/rc pairs, keeping them in a heap */
+/* of top_n entries rather than sorting all 4^k                          */
+
+void  report_top( uint64_t total )
+   {
+    static int  *heap = NULL;
+    int          n = 0;
+    int          i, k, t;
+
+    if ( heap == NULL )
+        heap = malloc_safely( ( top_n < n_kmers ? top_n : n_kmers ) 
+                                * sizeof( int ) );
+    for ( i = 0; i < n_kmers; i++ )
+       {
+        if ( i > rc_map[i] )              /* each pair once */
+            continue;
+        if ( suppress_zeros && counts.c[i] == 0 && counts.c[rc_map[i]] == 0 )
+            continue;
+        if ( n < top_n )
+           {
+            heap[n++] = i;                /* sift the new leaf up */
+            for ( k = n - 1; k > 0 && more_abundant( heap[(k-1)/2], heap[k] ); 
+                  k = (k - 1) / 2 )
+               {
+                t = heap[k];
+                heap[k] = heap[(k-1)/2];
+                heap[(k-1)/2] = t;
+               }
+           }
+        else if ( more_abundant( i, heap[0] ) )
+           {
+            heap[0] = i;
+            sift_down( heap, n, 0 );
+           }
+       }
+    for ( k = n - 1; k > 0; k-- )         /* heapsort: least abundant goes */
+       {                                  /* to the end                    */
+        t = heap[0];
+        heap[0] = heap[k];
+        heap[k] = t;
+        sift_down( heap, k, 0 );
+       }
+    for ( k = 0; k < n; k++ )
+        report_line( heap[k], total );
    }
 
+
 /* here's the report.  HEre, we calculate the total (for percentages) */
 /* AND where we handle the bottom strand counts (making use of the    */
 /* rc_map[] array to guide us to each k-mer's reverse complement      */
 
+int  uint_cmp( const void *x, const void *y );
+
 void  report( void )
    {
-    int i;
-    unsigned long int  total;
+    static unsigned int  *rows = NULL;   /* -s: the k-mers seen, and rcs */
+    int       i, n;
+    uint64_t  total;
+    char     *p;
 
     if ( report_by_sequence )
-        printf( ">%s\n", header );
-    total = compute_total();
-    for ( i = 0; i < n_kmers; i++ )
        {
-        printf( "%s/%s %10d %10d %10d  %10.6f %10.6f %10.6f\n",
-                 kmer_seq[i], kmer_seq[rc_map[i]], 
-                 (int) counts[i], (int) counts[rc_map[i]], (int) (counts[i] + counts[rc_map[i]]),
-                 100.0 * ( (double) counts[i] / (double) total ),
-                 100.0 * ( (double) counts[rc_map[i]]  / (double) total ),
-                 50.0 * ( (double) counts[i] + (double) counts[rc_map[i]] )
-                         / (double) total
-                );
-       }    
+        out_flush();
+        printf( ">%s\n", header );
+        fflush( stdout );
+        for ( total = 0, i = 0; i < n_touched; i++ )
+            total += ctable_get( &counts, touched[i] );
+       }
+    else
+        total = compute_total();
+    if ( top_n > 0 )
+        report_top( total );
+    else if ( report_by_sequence && suppress_zeros )
+       {                                /* only the touched rows, in order */
+        if ( rows == NULL )
+            rows = malloc_safely( 2 * n_kmers * sizeof( unsigned int ) );
+        for ( n = 0, i = 0; i < n_touched; i++ )
+           {
+            rows[n++] = touched[i];
+            rows[n++] = rc_map[touched[i]];
+           }
+        qsort( rows, n, sizeof( unsigned int ), uint_cmp );
+        for ( i = 0; i < n; i++ )
+            if ( i == 0 || rows[i] != rows[i-1] )
+                report_line( rows[i], total );
+       }
+    else
+        for ( i = 0; i < n_kmers; i++ )
+            if ( ! suppress_zeros || counts.c[i] > 0 || counts.c[rc_map[i]] > 0 )
+                report_line( i, total );
     if ( print_total )
-        printf( "total: %12.0f\n", (double) total );
+       {
+        p = out_buff + out_n;
+        memcpy( p, "total: ", 7 );
+        p = fmt_uint( p + 7, total, 12 );
+        *p++ = '\n';
+        out_n = p - out_buff;
+       }
+    out_flush();
    }
 
 /* This routine is reponsible for processing one file, which has already */
@@ -477,6 +1553,12 @@ void  count_kmers( FILE *f )
                 }
             else                          /* in any case, we need to reset */
                 reset_cbuff();            /* the circular buffer apparatus */
+            if ( n_frames == 6 )
+                end_frames( seq_len_ch );
+            seq_len_ch = 0;
+            if ( sketch_records && sketch_in_record )
+                end_sketch( header );     /* header of the last record */
+            sketch_in_record = 1;
  
             i = 0;                        /* and grab the header in any case */
             while ( i < MAX_HEADER_LEN &&(c = fgetc( f )) != EOF && c != '\n' )
@@ -495,37 +1577,2635 @@ void  count_kmers( FILE *f )
            {                             /* then process, by inserting in  */
             enter_cbuff( c );            /* into the circular buffer, then */
             incr_counts();               /* updating the counters          */
+            seq_len_ch++;
            }
 
         last_c = c;                      /* don't forget this! */
        }
+    if ( n_frames == 6 )                 /* last sequence ends with file */
+        end_frames( seq_len_ch );
+    seq_len_ch = 0;
+    if ( sketch_records && sketch_in_record )
+        end_sketch( header );
+    sketch_in_record = 0;
    }
 
-                                /****************/
-                                /* Main Program */
-                                /****************/
 
+/* -f: report each frame's table in turn */
 
+void  report_frames( void )
+   {
+    static char *names[] = { "+1", "+2", "+3", "-1", "-2", "-3" };
+    int          f;
 
-int main ( int argc, char **argv )
+    for ( f = 0; f < n_frames; f++ )
+       {
+        counts = frame_counts[f];
+        printf( "frame %s\n", names[f] );
+        fflush( stdout );
+        report();
+       }
+   }
+
+                         /***************************/
+                         /* Abundance spectrum (-H) */
+                         /***************************/
+
+/*****************************************************************************/
+/* The spectrum is summed over slices of the count table (counts[] with the  */
+/* k-mer and its reverse complement folded together, or the -F hash table)   */
+/* by n_threads threads, each into its own histogram, which are then added.  */
+/*****************************************************************************/
+
+#define  SPECTRUM_MAX  10000     /* counts above this go in the last bin */
+
+typedef struct spec_job {
+                          pthread_t  thread;
+                          size_t     from;      /* slice of the table */
+                          size_t     to;
+                          uint64_t  *hist;      /* [SPECTRUM_MAX+1]   */
+                        } SPEC_JOB;
+
+
+/* canonical count at slot i of the table being summed (0 if none) */
+
+uint64_t  spectrum_count( size_t i )
    {
-    int           nfiles;
-    int           i;
-    static char **filenames;
-    FILE         *f;
+    if ( sample_shift >= 0 )
+        return( sample_table.keys[i] == EMPTY_KEY ? 0 
+                                                  : ktable_val( &sample_table, i ) );
+    else if ( i < rc_map[i] )
+        return( ctable_get( &counts, i ) + ctable_get( &counts, rc_map[i] ) );
+    else if ( i == rc_map[i] )        /* palindromes are on both strands */
+        return( ctable_get( &counts, i ) );
+    else
+        return( 0 );                  /* counted with its rc */
+   }
 
-    parse_args( argc, argv, &nfiles, &filenames );
-    init();
-    reset();
 
-    for ( i = 0; i < nfiles; i++ )     /* for each file */
-       { 
-        if ( verbose )
-            fprintf( stderr, "file: %s\n", filenames[i] );
-        f = open_file( filenames[i] );
-        count_kmers( f );
-        close_file( f );
+void  *spectrum_worker( void *arg )
+   {
+    SPEC_JOB  *j = (SPEC_JOB *) arg;
+    size_t     i;
+    uint64_t   c;
+
+    for ( i = j->from; i < j->to; i++ )
+        if ( (c = spectrum_count( i )) > 0 )
+            j->hist[ c < SPECTRUM_MAX ? c : SPECTRUM_MAX ]++;
+    return( NULL );
+   }
+
+
+void  print_spectrum( uint64_t *hist )
+   {
+    size_t  i;
+
+    for ( i = 1; i <= SPECTRUM_MAX; i++ )
+        if ( hist[i] > 0 )
+            printf( "%lu %llu\n", (unsigned long) i,
+                    (unsigned long long) hist[i]
+                         << ( sample_shift > 0 ? sample_shift : 0 ) );
+   }
+
+
+void  report_spectrum( void )
+   {
+    SPEC_JOB   jobs[MAX_THREADS];
+    uint64_t  *hist;
+    size_t     n, i;
+    int        t;
+
+    n = ( sample_shift >= 0 ) ? sample_table.size : n_kmers;
+    for ( t = 0; t < n_threads; t++ )
+       {
+        jobs[t].from = n * t / n_threads;
+        jobs[t].to = n * (t + 1) / n_threads;
+        if ( !( jobs[t].hist = calloc( SPECTRUM_MAX+1, sizeof( uint64_t ) ) ) )
+           {
+            perror( "can't allocate spectrum" );
+            exit( errno );
+           }
+       }
+    if ( n_threads == 1 )
+        spectrum_worker( &jobs[0] );
+    else
+       {
+        for ( t = 0; t < n_threads; t++ )
+            if ( pthread_create( &jobs[t].thread, NULL, spectrum_worker, 
+                                 &jobs[t] ) != 0 )
+               {
+                perror( "can't create thread" );
+                exit( 1 );
+               }
+        for ( t = 0; t < n_threads; t++ )
+            pthread_join( jobs[t].thread, NULL );
+       }
+    hist = jobs[0].hist;
+    for ( t = 1; t < n_threads; t++ )
+        for ( i = 1; i <= SPECTRUM_MAX; i++ )
+            hist[i] += jobs[t].hist[i];
+    print_spectrum( hist );
+    for ( t = 0; t < n_threads; t++ )
+        free( jobs[t].hist );
+   }
+
+
+                   /*********************************************/
+                   /* Per-sequence binary count matrix (-b, -d) */
+                   /*********************************************/
+
+/*****************************************************************************/
+/* Sequences are read a batch at a time into one buffer, then split among    */
+/* the threads (sequence i goes to thread i % n_threads).  Each thread       */
+/* counts a sequence into its own table, formats the matrix row into its own */
+/* output buffer, and clears only the entries it touched.  The rows are then */
+/* written in input order.                                                   */
+/*****************************************************************************/
+
+#define  MATRIX_MAGIC      "KMRM"
+#define  MATRIX_VERSION    1
+#define  BATCH_SEQS        65536      /* max sequences in one batch */
+#define  BATCH_BYTES       (64 << 20) /* stop filling a batch after this */
+
+typedef struct buffer {                       /* growable byte buffer */
+                        char    *p;
+                        size_t   n;
+                        size_t   size;
+                      } BUFFER;
+
+typedef struct record {
+                        size_t   hdr;         /* offsets into batch data */
+                        size_t   hdr_len;
+                        size_t   seq;
+                        size_t   seq_len;
+                        size_t   out;         /* offset and length of the */
+                        size_t   out_len;     /* row in its thread's out  */
+                        int      fail;        /* -Q -o: goes to fail file */
+                      } RECORD;
+
+typedef struct batch {
+                       BUFFER   data;         /* headers and sequences */
+                       RECORD  *recs;
+                       int      n;
+                     } BATCH;
+
+typedef struct worker {
+                        pthread_t      thread;
+                        int            id;
+                        BATCH         *batch;
+                        unsigned int  *counts;   /* indexed by column   */
+                        unsigned int  *touched;  /* nonzero columns     */
+                        int            n_touched;
+                        BUFFER         out;      /* rows formatted here */
+                      } WORKER;
+
+WORKER  workers[MAX_THREADS];
+
+
+void  buf_need( BUFFER *b, size_t n )          /* make room for n more */
+   {
+    if ( b->n + n <= b->size )
+        return;
+    if ( b->size == 0 )
+        b->size = 65536;
+    while ( b->n + n > b->size )
+        b->size *= 2;
+    b->p = realloc_safely( b->p, b->size );
+   }
+
+void  buf_add( BUFFER *b, const void *p, size_t n )
+   {
+    buf_need( b, n );
+    memcpy( b->p + b->n, p, n );
+    b->n += n;
+   }
+
+void  buf_add_u32( BUFFER *b, uint32_t v )
+   {
+    buf_add( b, &v, sizeof( v ) );
+   }
+
+
+/* matrix file header: "KMRM", then uint32 version, k, number of columns */
+/* and flags (1 = canonical, 2 = dense).  Each row follows as            */
+/*                                                                       */
+/*    uint32 name_len, char name[name_len], uint32 n_kmers counted, then */
+/*      sparse (-b):  uint32 n, and n (uint32 column, uint32 count) pairs*/
+/*                    in increasing column order                         */
+/*      dense  (-d):  float32 frequency[n_columns]                       */
+/*                                                                       */
+/* all in native byte order.  Columns are k-mer indices (A=0 C=1 G=2 T=3 */
+/* packed two bits per base), renumbered from 0 over the canonical ones  */
+/* with -c                                                               */
+
+void  write_matrix_header( void )
+   {
+    BUFFER  b = { NULL, 0, 0 };
+
+    buf_add( &b, MATRIX_MAGIC, 4 );
+    buf_add_u32( &b, MATRIX_VERSION );
+    buf_add_u32( &b, word_size );
+    buf_add_u32( &b, n_columns );
+    buf_add_u32( &b, (canonical ? 1 : 0) | 
+                     (matrix_output == MATRIX_DENSE ? 2 : 0) );
+    fwrite( b.p, 1, b.n, stdout );
+    free( b.p );
+   }
+
+
+/* read up to BATCH_SEQS sequences (or about BATCH_BYTES) from f; header */
+/* and sequence (with whitespace removed) go into b->data.  Returns the  */
+/* number read.  *pending holds the header char lookahead between calls. */
+
+int  read_batch( FILE *f, BATCH *b, int *pending )
+   {
+    int      c;
+    int      last_c = '\n';
+    RECORD  *r = NULL;
+
+    b->n = 0;
+    b->data.n = 0;
+    c = *pending;
+    while ( b->n < BATCH_SEQS && b->data.n < BATCH_BYTES )
+       {
+        if ( c != '>' )                  /* find the next header */
+           {
+            while ( (c = getc_unlocked( f )) != EOF 
+                        && !( last_c == '\n' && c == '>' ) )
+                last_c = c;
+            if ( c == EOF )
+                break;
+           }
+        r = &b->recs[b->n++];
+        r->hdr = b->data.n;
+        while ( (c = getc_unlocked( f )) != EOF && c != '\n' )
+           {
+            buf_need( &b->data, 1 );
+            b->data.p[b->data.n++] = c;
+           }
+        r->hdr_len = b->data.n - r->hdr;
+        r->seq = b->data.n;
+        last_c = '\n';
+        while ( (c = getc_unlocked( f )) != EOF 
+                    && !( last_c == '\n' && c == '>' ) )
+           {
+            if ( c < N_ASCII && is_not_space[c] )
+               {
+                buf_need( &b->data, 1 );
+                b->data.p[b->data.n++] = c;
+               }
+            else if ( c >= N_ASCII )   /* 8 bit chars: never counted */
+               {
+                buf_need( &b->data, 1 );
+                b->data.p[b->data.n++] = NIL;
+               }
+            last_c = c;
+           }
+        r->seq_len = b->data.n - r->seq;
+        if ( c == EOF )
+            break;
        }
-    report();
+    *pending = c;
+    return( b->n );
+   }
+
+
+/* count one sequence's k-mers, by column, into w's table */
+
+void  count_sequence( WORKER *w, const char *s, size_t n )
+   {
+    size_t             i;
+    int                c;
+    int                good = 0;     /* countable chars in a row */
+    unsigned long int  word = 0;
+    unsigned int       col;
+
+    for ( i = 0; i < n; i++ )
+       {
+        c = s[i];
+        word = w_mask & ( (word << 2) | twobit[c] );
+        if ( no_count[c] )
+            good = 0;
+        else if ( ++good >= word_size )
+           {
+            col = column[word];
+            if ( w->counts[col]++ == 0 )
+                w->touched[w->n_touched++] = col;
+           }
+       }
+   }
+
+
+int  uint_cmp( const void *x, const void *y )
+   {
+    unsigned int a = *(const unsigned int *) x;
+    unsigned int b = *(const unsigned int *) y;
+
+    return( a < b ? -1 : (a > b) );
+   }
+
+
+/* format one matrix row into w->out, then clear w's counts */
+
+void  format_row( WORKER *w, RECORD *r )
+   {
+    int       i;
+    uint32_t  total = 0;
+    float     fr;
+
+    r->out = w->out.n;
+    buf_add_u32( &w->out, r->hdr_len );
+    buf_add( &w->out, w->batch->data.p + r->hdr, r->hdr_len );
+    for ( i = 0; i < w->n_touched; i++ )
+        total += w->counts[w->touched[i]];
+    buf_add_u32( &w->out, total );
+    if ( matrix_output == MATRIX_SPARSE )
+       {
+        qsort( w->touched, w->n_touched, sizeof( unsigned int ), uint_cmp );
+        buf_add_u32( &w->out, w->n_touched );
+        for ( i = 0; i < w->n_touched; i++ )
+           {
+            buf_add_u32( &w->out, w->touched[i] );
+            buf_add_u32( &w->out, w->counts[w->touched[i]] );
+           }
+       }
+    else
+       {
+        buf_need( &w->out, n_columns * sizeof( float ) );
+        memset( w->out.p + w->out.n, 0, n_columns * sizeof( float ) );
+        for ( i = 0; i < w->n_touched; i++ )
+           {
+            fr = (float) w->counts[w->touched[i]] / (float) total;
+            memcpy( w->out.p + w->out.n + w->touched[i] * sizeof( float ),
+                    &fr, sizeof( float ) );
+           }
+        w->out.n += n_columns * sizeof( float );
+       }
+    r->out_len = w->out.n - r->out;
+
+    for ( i = 0; i < w->n_touched; i++ )       /* clear what we touched */
+        w->counts[w->touched[i]] = 0;
+    w->n_touched = 0;
+   }
+
+
+void  *matrix_worker( void *arg )
+   {
+    WORKER  *w = (WORKER *) arg;
+    BATCH   *b = w->batch;
+    int      i;
+
+    w->out.n = 0;
+    for ( i = w->id; i < b->n; i += n_threads )
+       {
+        count_sequence( w, b->data.p + b->recs[i].seq, b->recs[i].seq_len );
+        format_row( w, &b->recs[i] );
+       }
+    return( NULL );
+   }
+
+
+void  init_workers( void )
+   {
+    int  i;
+
+    for ( i = 0; i < n_threads; i++ )
+       {
+        workers[i].id = i;
+        workers[i].counts = calloc( n_columns, sizeof( unsigned int ) );
+        workers[i].touched = malloc_safely( n_columns * sizeof(unsigned int));
+        if ( workers[i].counts == NULL )
+           {
+            perror( "can't allocate thread count table" );
+            exit( errno );
+           }
+        workers[i].n_touched = 0;
+        workers[i].out.p = NULL;
+        workers[i].out.n = workers[i].out.size = 0;
+       }
+   }
+
+
+/* count and write the matrix rows for every sequence in file f */
+
+void  matrix_file( FILE *f, BATCH *b )
+   {
+    int  i, n;
+    int  pending = '\n';
+
+    while ( (n = read_batch( f, b, &pending )) > 0 )
+       {
+        n_seqs += n;
+        if ( verbose )
+            fprintf( stderr, "batch of %d sequences\n", n );
+        for ( i = 0; i < n_threads; i++ )
+            workers[i].batch = b;
+        if ( n_threads == 1 )
+            matrix_worker( &workers[0] );
+        else
+           {
+            for ( i = 0; i < n_threads; i++ )
+                if ( pthread_create( &workers[i].thread, NULL, 
+                                     matrix_worker, &workers[i] ) != 0 )
+                   {
+                    perror( "can't create thread" );
+                    exit( 1 );
+                   }
+            for ( i = 0; i < n_threads; i++ )
+                pthread_join( workers[i].thread, NULL );
+           }
+        for ( i = 0; i < n; i++ )            /* rows out in input order */
+            fwrite( workers[i % n_threads].out.p + b->recs[i].out, 1, 
+                    b->recs[i].out_len, stdout );
+        if ( pending == EOF )
+            break;
+       }
+   }
+
+
+                 /*********************************************/
+                 /* External memory (on disk) counting (-D) */
+                 /*********************************************/
+
+/*****************************************************************************/
+/* Pass one reads the input once, streaming (partition_file()), and cuts     */
+/* each run of countable bases into super-k-mers: maximal runs of            */
+/* consecutive k-mers with the same minimizer, the canonical m-mer of least  */
+/* hash in the k-mer.  Each super-k-mer, 2-bit packed behind a uint32        */
+/* length, goes into the write buffer of partition (minimizer hash %         */
+/* n_partitions).  Since a k-mer and its reverse complement have the same    */
+/* canonical m-mers, both are counted in the same partition.  Each partition */
+/* also keeps a HyperLogLog of its k-mers, to estimate how many distinct     */
+/* ones it holds.                                                            */
+/*                                                                           */
+/* Pass two counts the partitions, read back a block at a time, in KTABLEs   */
+/* sized from those estimates.  -t threads take them in turn, and each has   */
+/* an equal share of -M (less what the partition list takes), so no more    */
+/* threads are run than leaves each THREAD_MEM.  A partition which can't be  */
+/* counted within a thread's share is split into pieces (by hash of the      */
+/* canonical k-mer) which are counted one after another, and split again if */
+/* need be.  Each partition's report lines (or spectrum) go into a result    */
+/* file, and the result files are then copied to stdout in partition order. */
+/* Lines are in k-mer order within each partition, or piece of one.          */
+/*                                                                           */
+/* Pass one's write buffers share what -M leaves after the partition list   */
+/* and registers.  Blocks of MMAP_MIN bytes or more are mapped for each      */
+/* malloc(), so memory freed by one thread's tables is given back, and not   */
+/* kept in that thread's malloc arena while another thread's are made.       */
+/*****************************************************************************/
+
+#define  MINIMIZER_LEN     11          /* m, or k if that's smaller */
+#define  PART_BUFF_MAX     (1 << 20)
+#define  PART_BUFF_MIN     4096
+#define  RUN_LEN           (1 << 20)   /* pass one: bases of a run at a time */
+#define  HLL_BITS          12          /* distinct k-mer estimates: 2^12     */
+#define  HLL_SIZE          (1 << HLL_BITS)  /* registers, about 1.6% error   */
+#define  SLOT_BYTES        (sizeof( uint64_t ) + sizeof( COUNT ))
+#define  PART_WORDS        4096        /* k-mers decoded at a time */
+#define  PART_OVERHEAD     (4 * PART_BUFF_MAX)  /* reading and report buffers */
+#define  SPLIT_BUFF_LEN    65536       /* per sub-partition */
+#define  MAX_SPLIT         64          /* sub-partitions per split */
+#define  MIN_SPLIT         65536       /* distinct k-mers not worth splitting */
+#define  SPLIT_SALT        0x9e3779b97f4a7c15ULL
+#define  BASE_MEM          (4 << 20)   /* the program, stdio, thread stacks */
+#define  THREAD_MEM        (10 << 20)  /* least share of -M for a thread: */
+                                       /* room to split MAX_SPLIT ways,   */
+                                       /* or count MIN_SPLIT k-mers       */
+#define  MMAP_MIN          (1 << 17)
+
+typedef struct part {
+                      char      name[PATH_MAX];
+                      char      out_name[PATH_MAX+4];   /* name.out */
+                      FILE     *f;
+                      BUFFER    buf;       /* write buffer          */
+                      uint64_t  n_kmers;   /* k-mers written to it  */
+                      uint64_t  bytes;     /* size of the file      */
+                      int       level;     /* 0, or splits deep     */
+                      uint8_t  *hll;       /* while written: HyperLogLog  */
+                      uint64_t  distinct;  /* then: distinct k-mers, about */
+                    } PART;
+
+typedef struct part_in {                   /* reading a partition back */
+                         PART           *p;
+                         FILE           *f;
+                         unsigned char  *buf;        /* PART_BUFF_MAX */
+                         size_t          n, at;      /* bytes in buf, next */
+                         uint64_t       *words;      /* PART_WORDS     */
+                       } PART_IN;
+
+PART             *parts;
+size_t            part_buff_len;
+uint64_t          disk_total = 0;          /* all k-mers, for percentages */
+uint64_t          disk_hist[SPECTRUM_MAX+1];
+int               next_part;               /* pass two work queue ... */
+int               part_threads;            /* ... its threads ...     */
+uint64_t          thread_mem;              /* ... and each one's -M   */
+pthread_mutex_t   part_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* reverse complement of the two-bit packed k-mer w */
+
+uint64_t  rc_word( uint64_t w )
+   {
+    uint64_t  r = 0;
+    int       j;
+
+    for ( j = 0; j < word_size; j++, w >>= 2 )
+        r = (r << 2) | ( 3 ^ (w & 3) );
+    return( r );
+   }
+
+
+/* spell out the two-bit packed k-mer w in seq (word_size chars) */
+
+void  word2seq( uint64_t w, char *seq )
+   {
+    int  j;
+
+    for ( j = word_size - 1; j >= 0; j--, w >>= 2 )
+        seq[j] = real_nts[w & 3];
+   }
+
+
+/* HyperLogLog: register (top HLL_BITS of hash h) keeps the most leading */
+/* zeros (plus one) seen in the rest of h                                */
+
+void  hll_add( uint8_t *r, uint64_t h )
+   {
+    uint64_t  w = (h << HLL_BITS) | ( (uint64_t) 1 << (HLL_BITS - 1) );
+    int       rank = __builtin_clzll( w ) + 1;
+
+    if ( rank > r[h >> (64 - HLL_BITS)] )
+        r[h >> (64 - HLL_BITS)] = rank;
+   }
+
+
+/* estimate p's distinct k-mers from its registers (10% high, to be safe), */
+/* and free them                                                           */
+
+void  part_distinct( PART *p )
+   {
+    double  m = HLL_SIZE, sum = 0.0, e;
+    int     i, zeros = 0;
+
+    for ( i = 0; i < HLL_SIZE; i++ )
+       {
+        sum += ldexp( 1.0, - p->hll[i] );
+        zeros += ( p->hll[i] == 0 );
+       }
+    e = 0.7213 / ( 1.0 + 1.079 / m ) * m * m / sum;
+    if ( e <= 2.5 * m && zeros > 0 )             /* small range correction */
+        e = m * log( m / zeros );
+    p->distinct = (uint64_t) ( 1.1 * e ) + 16;
+    if ( p->distinct > p->n_kmers )
+        p->distinct = p->n_kmers;
+    free( p->hll );
+    p->hll = NULL;
+   }
+
+
+/* table slots for n distinct k-mers, so that the table needn't grow */
+
+size_t  part_slots( uint64_t n )
+   {
+    size_t  slots = 1024;
+
+    while ( slots <= 2 * n )
+        slots *= 2;
+    return( slots );
+   }
+
+
+/* memory to count a partition of n distinct k-mers and report them */
+
+uint64_t  part_memory( uint64_t n )
+   {
+    return( PART_OVERHEAD + part_slots( n ) * SLOT_BYTES
+               + ( spectrum ? 0 : 2 * n * sizeof( uint64_t ) ) );
+   }
+
+
+/* memory to split a partition n ways */
+
+uint64_t  split_memory( int n )
+   {
+    return( PART_OVERHEAD + n * ( SPLIT_BUFF_LEN + HLL_SIZE + sizeof( PART ) ) );
+   }
+
+
+/* open p for writing, with a len byte write buffer (and none of stdio's) */
+
+void  part_create( PART *p, size_t len )
+   {
+    if ( !( p->f = fopen( p->name, "w" ) ) )
+       {
+        perror( p->name );
+        exit( errno );
+       }
+    setvbuf( p->f, NULL, _IONBF, 0 );
+    p->buf.p = malloc_safely( len );
+    p->buf.size = len;
+    p->buf.n = 0;
+    p->hll = calloc( HLL_SIZE, 1 );
+    if ( p->hll == NULL )
+       {
+        perror( "can't allocate partitions" );
+        exit( errno );
+       }
+   }
+
+
+void  part_write( PART *p )
+   {
+    if ( p->buf.n > 0 && fwrite( p->buf.p, 1, p->buf.n, p->f ) != p->buf.n )
+       {
+        perror( p->name );
+        exit( errno );
+       }
+    p->bytes += p->buf.n;
+    p->buf.n = 0;
+   }
+
+
+/* flush and close p, free its buffer and estimate its distinct k-mers */
+
+void  part_finish( PART *p )
+   {
+    part_write( p );
+    free( p->buf.p );
+    p->buf.p = NULL;
+    p->buf.size = 0;
+    if ( fclose( p->f ) != 0 )
+       {
+        perror( p->name );
+        exit( errno );
+       }
+    part_distinct( p );
+   }
+
+
+/* write the super-k-mer of len bases (two-bit codes at s) to the */
+/* partition of its minimizer's hash                              */
+
+void  emit_super_kmer( const unsigned char *s, size_t len, uint64_t hash )
+   {
+    PART           *p = &parts[hash % n_partitions];
+    uint32_t        l = len;
+    size_t          i, n_bytes = (len + 3) / 4;
+    unsigned char  *q;
+    uint64_t        word = 0;
+
+    if ( p->buf.n + sizeof( l ) + n_bytes > p->buf.size )
+        part_write( p );
+    buf_add( &p->buf, &l, sizeof( l ) );
+    q = (unsigned char *) p->buf.p + p->buf.n;
+    memset( q, 0, n_bytes );
+    for ( i = 0; i < len; i++ )
+       {
+        q[i >> 2] |= s[i] << ((i & 3) << 1);
+        word = w_mask & ( (word << 2) | s[i] );
+        if ( i + 1 >= word_size )
+            hll_add( p->hll, mix64( word ) );
+       }
+    p->buf.n += n_bytes;
+    p->n_kmers += len - word_size + 1;
+    disk_total += len - word_size + 1;
+   }
+
+
+/* cut a run of n (>= k) two-bit codes into super-k-mers */
+
+void  partition_run( const unsigned char *s, size_t n )
+   {
+    uint64_t  mhash[MAX_WORD_K];     /* m-mer hashes, by end position */
+    int       m, w;                  /* m-mer length, m-mers per k-mer */
+    uint64_t  fw = 0, rv = 0;        /* m-mer and its reverse complement */
+    uint64_t  m_mask, min_hash = 0;
+    size_t    i, j, min_pos = 0, start = 0;
+    int       have_min = 0;
+
+    m = ( word_size < MINIMIZER_LEN ) ? word_size : MINIMIZER_LEN;
+    w = word_size - m + 1;
+    m_mask = ( (uint64_t) 1 << (2 * m) ) - 1;
+    for ( i = 0; i < n; i++ )
+       {
+        fw = ( (fw << 2) | s[i] ) & m_mask;
+        rv = ( rv >> 2 ) | ( (uint64_t) (3 ^ s[i]) << (2 * (m - 1)) );
+        if ( i + 1 < m )
+            continue;
+        mhash[i % MAX_WORD_K] = mix64( fw < rv ? fw : rv );
+        if ( i + 1 < word_size )
+            continue;
+
+        /* the k-mer ending at i holds the m-mers ending at i-w+1 .. i */
+
+        if ( have_min && min_pos + w > i )     /* minimizer still inside */
+           {
+            if ( mhash[i % MAX_WORD_K] < min_hash )
+               {
+                emit_super_kmer( s + start, i - start, min_hash );
+                start = i - word_size + 1;
+                min_hash = mhash[i % MAX_WORD_K];
+                min_pos = i;
+               }
+           }
+        else                                   /* rescan the window */
+           {
+            if ( have_min )
+                emit_super_kmer( s + start, i - start, min_hash );
+            start = i - word_size + 1;
+            min_pos = i - w + 1;
+            min_hash = mhash[min_pos % MAX_WORD_K];
+            for ( j = min_pos + 1; j <= i; j++ )
+                if ( mhash[j % MAX_WORD_K] < min_hash )
+                   {
+                    min_hash = mhash[j % MAX_WORD_K];
+                    min_pos = j;
+                   }
+            have_min = 1;
+           }
+       }
+    if ( have_min )
+        emit_super_kmer( s + start, n - start, min_hash );
+   }
+
+
+/* pass one: partition all the k-mers of file f, reading it a run of     */
+/* countable bases at a time.  A run longer than RUN_LEN is cut into      */
+/* pieces overlapping by k - 1 bases, so each k-mer is in exactly one     */
+
+void  partition_file( FILE *f )
+   {
+    static unsigned char  *codes = NULL;
+    size_t                 run = 0;
+    int                    c;
+    int                    last_c = '\n';
+    int                    in_seq = 0;
+
+    if ( codes == NULL )
+        codes = malloc_safely( RUN_LEN );
+    while ( (c = getc_unlocked( f )) != EOF )
+       {
+        if ( last_c == '\n' && c == '>' )          /* skip the header */
+           {
+            if ( run >= word_size )
+                partition_run( codes, run );
+            run = 0;
+            n_seqs++;
+            while ( (c = getc_unlocked( f )) != EOF && c != '\n' )
+                ;
+            in_seq = 1;
+            last_c = '\n';
+            continue;
+           }
+        last_c = c;
+        if ( ! in_seq || ( c < N_ASCII && ! is_not_space[c] ) )
+            continue;
+        if ( c >= N_ASCII || no_count[c] )
+           {
+            if ( run >= word_size )
+                partition_run( codes, run );
+            run = 0;
+           }
+        else
+           {
+            if ( run == RUN_LEN )
+               {
+                partition_run( codes, run );
+                memmove( codes, codes + run - (word_size - 1), word_size - 1 );
+                run = word_size - 1;
+               }
+            codes[run++] = twobit[c];
+           }
+       }
+    if ( run >= word_size )
+        partition_run( codes, run );
+   }
+
+
+/* open partition p to read its k-mers back, a block at a time */
+
+void  part_open( PART_IN *in, PART *p )
+   {
+    in->p = p;
+    if ( !( in->f = fopen( p->name, "r" ) ) )
+       {
+        perror( p->name );
+        exit( errno );
+       }
+    in->buf = malloc_safely( PART_BUFF_MAX );
+    in->words = malloc_safely( PART_WORDS * sizeof( uint64_t ) );
+    in->n = in->at = 0;
+   }
+
+
+/* close and remove the partition, and free the buffers */
+
+void  part_close( PART_IN *in )
+   {
+    fclose( in->f );
+    unlink( in->p->name );
+    free( in->buf );
+    free( in->words );
+   }
+
+
+/* make sure need bytes are buffered from in->at on; 0 if the file ends */
+
+int  part_fill( PART_IN *in, size_t need )
+   {
+    if ( in->n - in->at >= need )
+        return( 1 );
+    memmove( in->buf, in->buf + in->at, in->n - in->at );
+    in->n -= in->at;
+    in->at = 0;
+    in->n += fread( in->buf + in->n, 1, PART_BUFF_MAX - in->n, in->f );
+    if ( ferror( in->f ) )
+       {
+        perror( in->p->name );
+        exit( errno );
+       }
+    return( in->n >= need );
+   }
+
+
+/* decode the next (up to PART_WORDS) k-mers into in->words.  Returns how */
+/* many, 0 at the end.  Level 0 partitions hold super-k-mers (a uint32     */
+/* length, then two-bit codes), split ones uint64 k-mers                   */
+
+size_t  part_words( PART_IN *in )
+   {
+    uint64_t  *w = in->words;
+    size_t     n = 0;
+    uint32_t   len, i;
+    uint64_t   word;
+    const unsigned char  *q;
+
+    if ( in->p->level > 0 )
+       {
+        if ( part_fill( in, sizeof( uint64_t ) ) )
+           {
+            n = ( in->n - in->at ) / sizeof( uint64_t );
+            if ( n > PART_WORDS )
+                n = PART_WORDS;
+            memcpy( w, in->buf + in->at, n * sizeof( uint64_t ) );
+            in->at += n * sizeof( uint64_t );
+           }
+        return( n );
+       }
+    while ( n + MAX_WORD_K <= PART_WORDS && part_fill( in, sizeof( len ) ) )
+       {
+        memcpy( &len, in->buf + in->at, sizeof( len ) );
+        if ( len < word_size || len >= word_size + MAX_WORD_K
+                || ! part_fill( in, sizeof( len ) + (len + 3) / 4 ) )
+           {
+            fprintf( stderr, "kmers: %s is corrupt\n", in->p->name );
+            exit( 1 );
+           }
+        q = in->buf + in->at + sizeof( len );
+        for ( word = 0, i = 0; i < len; i++ )
+           {
+            word = w_mask & ( (word << 2) | ( (q[i >> 2] >> ((i & 3) << 1)) & 3 ) );
+            if ( i + 1 >= word_size )
+                w[n++] = word;
+           }
+        in->at += sizeof( len ) + (len + 3) / 4;
+       }
+    return( n );
+   }
+
+
+/* pass two: count partition p, then write its report lines, in k-mer */
+/* order, to out (or add it to the spectrum)                          */
+
+void  count_partition( PART *p, FILE *out )
+   {
+    KTABLE          t;
+    PART_IN         in;
+    uint64_t        word, rc, c;
+    uint64_t       *keys;
+    size_t          n_keys, j, n;
+    uint64_t        hist[SPECTRUM_MAX+1];
+    BUFFER          ob = { NULL, 0, 0 };
+    char            seq[MAX_WORD_K], rseq[MAX_WORD_K];
+
+    ktable_init( &t, part_slots( p->distinct ) );
+    part_open( &in, p );
+    while ( (n = part_words( &in )) > 0 )
+        for ( j = 0; j < n; j++ )
+            ktable_add( &t, in.words[j], 1 );
+    part_close( &in );
+
+    if ( spectrum )
+       {
+        memset( hist, 0, sizeof( hist ) );
+        for ( j = 0; j < t.size; j++ )
+            if ( (word = t.keys[j]) != EMPTY_KEY )
+               {
+                rc = rc_word( word );
+                if ( word == rc )             /* palindrome */
+                    c = ktable_val( &t, j );
+                else if ( word < rc )
+                    c = ktable_val( &t, j ) + ktable_get( &t, rc );
+                else if ( ktable_get( &t, rc ) == 0 )
+                    c = ktable_val( &t, j );  /* its rc never seen */
+                else
+                    continue;                 /* counted with its rc */
+                hist[ c < SPECTRUM_MAX ? c : SPECTRUM_MAX ]++;
+               }
+        pthread_mutex_lock( &part_lock );
+        for ( j = 1; j <= SPECTRUM_MAX; j++ )
+            disk_hist[j] += hist[j];
+        pthread_mutex_unlock( &part_lock );
+        ktable_free( &t );
+        return;
+       }
+
+    /* every k-mer seen, and every one whose reverse complement was */
+
+    keys = malloc_safely( 2 * t.n * sizeof( uint64_t ) + 1 );
+    for ( n_keys = j = 0; j < t.size; j++ )
+        if ( (word = t.keys[j]) != EMPTY_KEY )
+           {
+            keys[n_keys++] = word;
+            rc = rc_word( word );
+            if ( ktable_get( &t, rc ) == 0 )
+                keys[n_keys++] = rc;
+           }
+    qsort( keys, n_keys, sizeof( uint64_t ), uint64_cmp );
+    for ( j = 0; j < n_keys; j++ )
+       {
+        word = keys[j];
+        rc = rc_word( word );
+        word2seq( word, seq );
+        word2seq( rc, rseq );
+        buf_need( &ob, MAX_LINE );
+        ob.n = format_line( ob.p + ob.n, seq, rseq, ktable_get( &t, word ),
+                            ktable_get( &t, rc ), disk_total ) - ob.p;
+        if ( ob.n + MAX_LINE > PART_BUFF_MAX )
+           {
+            if ( fwrite( ob.p, 1, ob.n, out ) != ob.n )
+               {
+                perror( p->out_name );
+                exit( errno );
+               }
+            ob.n = 0;
+           }
+       }
+    if ( ob.n > 0 && fwrite( ob.p, 1, ob.n, out ) != ob.n )
+       {
+        perror( p->out_name );
+        exit( errno );
+       }
+    free( ob.p );
+    free( keys );
+    ktable_free( &t );
+   }
+
+
+void  count_part( PART *p, FILE *out, uint64_t mem );
+
+/* split partition p, too big to count in mem bytes, n ways by a hash of  */
+/* the canonical k-mer (so a k-mer and its reverse complement stay        */
+/* together), then count the pieces in turn, in what the list of them     */
+/* leaves of mem                                                          */
+
+void  split_partition( PART *p, FILE *out, uint64_t mem )
+   {
+    PART      *subs, *s;
+    PART_IN    in;
+    int        n_sub, i;
+    uint64_t   word, rc, salt;
+    size_t     n, j;
+
+    n_sub = part_memory( p->distinct ) / ( mem / 2 ) + 1;
+    if ( n_sub > MAX_SPLIT )
+        n_sub = MAX_SPLIT;
+    while ( n_sub > 2 && split_memory( n_sub ) > mem )
+        n_sub--;
+    if ( verbose )
+        fprintf( stderr, "splitting %s (about %lu k-mers) %d ways\n",
+                 p->name, (unsigned long) p->distinct, n_sub );
+    if ( !( subs = calloc( n_sub, sizeof( PART ) ) ) )
+       {
+        perror( "can't allocate partitions" );
+        exit( errno );
+       }
+    for ( i = 0; i < n_sub; i++ )
+       {
+        if ( snprintf( subs[i].name, sizeof( subs[i].name ), "%s.%d",
+                       p->name, i ) >= sizeof( subs[i].name ) )
+           {
+            fprintf( stderr, "kmers: %s: name too long\n", p->name );
+            exit( 1 );
+           }
+        subs[i].level = p->level + 1;
+        part_create( &subs[i], SPLIT_BUFF_LEN );
+       }
+
+    salt = SPLIT_SALT * ( p->level + 1 );
+    part_open( &in, p );
+    while ( (n = part_words( &in )) > 0 )
+        for ( j = 0; j < n; j++ )
+           {
+            word = in.words[j];
+            rc = rc_word( word );
+            s = &subs[ ( mix64( ( word < rc ? word : rc ) ^ salt ) >> 32 ) 
+                          % n_sub ];
+            if ( s->buf.n + sizeof( word ) > s->buf.size )
+                part_write( s );
+            buf_add( &s->buf, &word, sizeof( word ) );
+            s->n_kmers++;
+            hll_add( s->hll, mix64( word ) );
+           }
+    part_close( &in );
+    for ( i = 0; i < n_sub; i++ )
+        part_finish( &subs[i] );
+
+    for ( i = 0; i < n_sub; i++ )
+        count_part( &subs[i], out, mem - n_sub * sizeof( PART ) );
+    free( subs );
+   }
+
+
+/* count partition p into out in mem bytes, or split it if it won't fit */
+
+void  count_part( PART *p, FILE *out, uint64_t mem )
+   {
+    if ( part_memory( p->distinct ) > mem && p->distinct > MIN_SPLIT )
+       {
+        split_partition( p, out, mem );
+        return;
+       }
+    if ( verbose )
+        fprintf( stderr, "counting %s: %lu k-mers, about %lu distinct\n",
+                 p->name, (unsigned long) p->n_kmers,
+                 (unsigned long) p->distinct );
+    count_partition( p, out );
+   }
+
+
+/* pass two thread: count partitions, in turn, into their result files */
+
+void  *partition_worker( void *arg )
+   {
+    PART  *p;
+    FILE  *out = NULL;
+
+    for ( ;; )
+       {
+        pthread_mutex_lock( &part_lock );
+        p = ( next_part < n_partitions ) ? &parts[next_part++] : NULL;
+        pthread_mutex_unlock( &part_lock );
+        if ( p == NULL )
+            break;
+        if ( ! spectrum && !( out = fopen( p->out_name, "w" ) ) )
+           {
+            perror( p->out_name );
+            exit( errno );
+           }
+        count_part( p, out, thread_mem );
+        if ( ! spectrum && fclose( out ) != 0 )
+           {
+            perror( p->out_name );
+            exit( errno );
+           }
+       }
+    return( NULL );
+   }
+
+
+/* copy file name to stdout, then remove it */
+
+void  copy_out( char *name )
+   {
+    static char  block[PART_BUFF_MAX];
+    FILE        *f;
+    size_t       n;
+
+    if ( !( f = fopen( name, "r" ) ) )
+       {
+        perror( name );
+        exit( errno );
+       }
+    while ( (n = fread( block, 1, sizeof( block ), f )) > 0 )
+        if ( fwrite( block, 1, n, stdout ) != n )
+           {
+            perror( "kmers: write" );
+            exit( errno );
+           }
+    fclose( f );
+    unlink( name );
+   }
+
+
+void  disk_count( int nfiles, char **filenames )
+   {
+    pthread_t     threads[MAX_THREADS];
+    FILE         *f;
+    int           i;
+    char         *p;
+    uint64_t      mem = (uint64_t) mem_limit_mb << 20;
+
+#ifdef M_MMAP_THRESHOLD
+    mallopt( M_MMAP_THRESHOLD, MMAP_MIN );
+#endif
+    mem -= BASE_MEM + n_partitions * sizeof( PART );
+    part_buff_len = ( mem - RUN_LEN - n_partitions * HLL_SIZE ) / n_partitions;
+    if ( part_buff_len > PART_BUFF_MAX )
+        part_buff_len = PART_BUFF_MAX;
+    if ( part_buff_len < PART_BUFF_MIN )
+        part_buff_len = PART_BUFF_MIN;
+    if ( !( parts = calloc( n_partitions, sizeof( PART ) ) ) )
+       {
+        perror( "can't allocate partitions" );
+        exit( errno );
+       }
+    for ( i = 0; i < n_partitions; i++ )
+       {
+        snprintf( parts[i].name, PATH_MAX, "%s/kmers.%d.%d", tmp_dir,
+                  (int) getpid(), i );
+        snprintf( parts[i].out_name, sizeof( parts[i].out_name ), "%s.out",
+                  parts[i].name );
+        part_create( &parts[i], part_buff_len );
+       }
+
+    for ( i = 0; i < nfiles; i++ )
+       {
+        if ( verbose )
+            fprintf( stderr, "file: %s\n", filenames[i] );
+        f = open_file( filenames[i] );
+        partition_file( f );
+        close_file( f );
+       }
+    for ( i = 0; i < n_partitions; i++ )
+        part_finish( &parts[i] );
+
+    part_threads = mem / THREAD_MEM;
+    if ( part_threads > n_threads )
+        part_threads = n_threads;
+    if ( part_threads < 1 )
+        part_threads = 1;
+    thread_mem = mem / part_threads;
+    if ( verbose && part_threads < n_threads )
+        fprintf( stderr, "counting partitions with %d threads, to fit -M\n",
+                 part_threads );
+    next_part = 0;
+    if ( part_threads == 1 )
+        partition_worker( NULL );
+    else
+       {
+        for ( i = 0; i < part_threads; i++ )
+            if ( pthread_create( &threads[i], NULL, partition_worker, NULL ) )
+               {
+                perror( "can't create thread" );
+                exit( 1 );
+               }
+        for ( i = 0; i < part_threads; i++ )
+            pthread_join( threads[i], NULL );
+       }
+
+    if ( spectrum )
+        print_spectrum( disk_hist );
+    else
+       {
+        fflush( stdout );
+        for ( i = 0; i < n_partitions; i++ )
+            copy_out( parts[i].out_name );
+        if ( print_total )
+           {
+            p = fmt_uint( out_buff, disk_total, 12 );
+            *p++ = '\n';
+            fputs( "total: ", stdout );
+            fwrite( out_buff, 1, p - out_buff, stdout );
+           }
+       }
+    free( parts );
+   }
+
+
+                       /**************************************/
+                       /* MinHash sketch files (-S, and -C) */
+                       /**************************************/
+
+/*****************************************************************************/
+/* A sketch file is "KMSK", then uint32 version, k and sketch size s, then   */
+/* for each sketch (a file, or a record with -r) up to the end of the file   */
+/*                                                                           */
+/*    uint32 name_len, char name[name_len], uint64 k-mers counted,           */
+/*    uint32 n (<= s), uint64 hash[n] in increasing order                    */
+/*                                                                           */
+/* all in native byte order.  The hashes are the n least distinct mix64()   */
+/* values of the canonical k-mers.                                           */
+/*                                                                           */
+/* -C reads any number of sketch files (which must agree on k and s) and,    */
+/* with -t threads, compares each sketch with every later one.  For          */
+/* sketches A and B, Jaccard is estimated over the s least hashes of their   */
+/* union (as Mash does), and containment of A in B over A's hashes up to the */
+/* lesser of the two sketches' largest.                                      */
+/*****************************************************************************/
+
+#define  SKETCH_MAGIC      "KMSK"
+#define  SKETCH_VERSION    1
+#define  COMPARE_ROWS      256       /* rows formatted per round of threads */
+
+typedef struct sketch {
+                        char      *name;
+                        uint64_t   n_kmers;
+                        uint32_t   n;
+                        uint64_t  *h;
+                      } SKETCH;
+
+SKETCH   *sketches = NULL;           /* for -C */
+int       n_sketches = 0;
+BUFFER    row_out[COMPARE_ROWS];
+
+
+void  write_sketch_header( void )
+   {
+    uint32_t  v[3];
+
+    if ( !( sketch_out = fopen( sketch_file, "w" ) ) )
+       {
+        perror( sketch_file );
+        exit( errno );
+       }
+    v[0] = SKETCH_VERSION;
+    v[1] = word_size;
+    v[2] = sketch_size;
+    fwrite( SKETCH_MAGIC, 1, 4, sketch_out );
+    fwrite( v, sizeof( uint32_t ), 3, sketch_out );
+   }
+
+
+void  close_sketches( void )
+   {
+    if ( fclose( sketch_out ) != 0 )
+       {
+        perror( sketch_file );
+        exit( errno );
+       }
+   }
+
+
+/* add the sketches in file name to sketches[] */
+
+void  load_sketches( char *name, int *k, int *size )
+   {
+    FILE     *f;
+    char      magic[4];
+    uint32_t  v[3], len;
+    SKETCH   *s;
+
+    if ( !( f = fopen( name, "r" ) ) )
+       {
+        perror( name );
+        exit( errno );
+       }
+    if ( fread( magic, 1, 4, f ) != 4 || memcmp( magic, SKETCH_MAGIC, 4 ) 
+            || fread( v, sizeof( uint32_t ), 3, f ) != 3 
+            || v[0] != SKETCH_VERSION )
+       {
+        fprintf( stderr, "%s: not a kmers sketch file\n", name );
+        exit( 1 );
+       }
+    if ( *k == 0 )
+        *k = v[1];
+    else if ( *k != v[1] )
+       {
+        fprintf( stderr, "%s: k is %u, not %d as in the others\n", name, 
+                         v[1], *k );
+        exit( 1 );
+       }
+    if ( *size == 0 )
+        *size = v[2];
+    else if ( *size != v[2] )
+       {
+        fprintf( stderr, "%s: sketch size is %u, not %d as in the others\n",
+                         name, v[2], *size );
+        exit( 1 );
+       }
+    while ( fread( &len, sizeof( len ), 1, f ) == 1 )
+       {
+        sketches = realloc_safely( sketches, 
+                                   (n_sketches + 1) * sizeof( SKETCH ) );
+        s = &sketches[n_sketches++];
+        s->name = malloc_safely( len + 1 );
+        if ( fread( s->name, 1, len, f ) != len 
+                || fread( &s->n_kmers, sizeof( uint64_t ), 1, f ) != 1 
+                || fread( &s->n, sizeof( uint32_t ), 1, f ) != 1 )
+           {
+            fprintf( stderr, "%s: truncated sketch file\n", name );
+            exit( 1 );
+           }
+        if ( s->n > v[2] )
+           {
+            fprintf( stderr, "%s: sketch of %u hashes, more than its size "
+                             "%u\n", name, s->n, v[2] );
+            exit( 1 );
+           }
+        s->name[len] = '\0';
+        s->h = malloc_safely( s->n * sizeof( uint64_t ) + 1 );
+        if ( fread( s->h, sizeof( uint64_t ), s->n, f ) != s->n )
+           {
+            fprintf( stderr, "%s: truncated sketch file\n", name );
+            exit( 1 );
+           }
+       }
+    fclose( f );
+   }
+
+
+/* format the comparison of sketches a and b, as a line, into o */
+
+void  compare_pair( BUFFER *o, SKETCH *a, SKETCH *b )
+   {
+    uint32_t  i = 0, j = 0;
+    uint32_t  s = ( a->n > b->n ) ? a->n : b->n;
+    uint32_t  n_union = 0, shared = 0;
+    uint32_t  a_in = 0, b_in = 0, common = 0;
+    uint64_t  top;
+    double    jaccard, a_in_b, b_in_a;
+    char      line[64];
+
+    /* Jaccard: the s least of the union */
+
+    while ( n_union < s && ( i < a->n || j < b->n ) )
+       {
+        if ( j >= b->n || ( i < a->n && a->h[i] < b->h[j] ) )
+            i++;
+        else if ( i >= a->n || b->h[j] < a->h[i] )
+            j++;
+        else
+           {
+            i++;
+            j++;
+            shared++;
+           }
+        n_union++;
+       }
+
+    /* containment: each sketch's hashes below both sketches' largest */
+
+    top = ( a->n == 0 || b->n == 0 ) ? 0 
+             : ( a->h[a->n-1] < b->h[b->n-1] ? a->h[a->n-1] : b->h[b->n-1] );
+    for ( i = j = 0; i < a->n && a->h[i] <= top; i++ )
+       {
+        a_in++;
+        while ( j < b->n && b->h[j] < a->h[i] )
+            j++;
+        if ( j < b->n && b->h[j] == a->h[i] )
+            common++;
+       }
+    for ( j = 0; j < b->n && b->h[j] <= top; j++ )
+        b_in++;
+
+    jaccard = n_union ? (double) shared / n_union : 0.0;
+    a_in_b = a_in ? (double) common / a_in : 0.0;
+    b_in_a = b_in ? (double) common / b_in : 0.0;
+    buf_add( o, a->name, strlen( a->name ) );
+    buf_add( o, "\t", 1 );
+    buf_add( o, b->name, strlen( b->name ) );
+    buf_add( o, line, snprintf( line, sizeof( line ), "\t%.6f\t%.6f\t%.6f\t%u/%u\n", 
+                                jaccard, a_in_b, b_in_a, shared, n_union ) );
+   }
+
+
+typedef struct compare_job {
+                             pthread_t  thread;
+                             int        id;
+                             int        first;     /* rows first .. last-1 */
+                             int        last;
+                           } COMPARE_JOB;
+
+
+void  *compare_worker( void *arg )
+   {
+    COMPARE_JOB  *c = (COMPARE_JOB *) arg;
+    int           i, j;
+
+    for ( i = c->first + c->id; i < c->last; i += n_threads )
+       {
+        row_out[i - c->first].n = 0;
+        for ( j = i + 1; j < n_sketches; j++ )
+            compare_pair( &row_out[i - c->first], &sketches[i], &sketches[j] );
+       }
+    return( NULL );
+   }
+
+
+/* -C: compare every pair of sketches in the files, printing a line of */
+/*                                                                     */
+/*    name_a name_b jaccard a-in-b b-in-a shared/union                 */
+/*                                                                     */
+/* for each.  Rows (a) are done COMPARE_ROWS at a time, split among    */
+/* the threads, then written in order                                  */
+
+void  compare_sketches( int nfiles, char **filenames )
+   {
+    COMPARE_JOB  jobs[MAX_THREADS];
+    int          i, t, first;
+    int          k = 0, size = 0;
+
+    for ( i = 0; i < nfiles; i++ )
+        load_sketches( filenames[i], &k, &size );
+    if ( verbose )
+        fprintf( stderr, "%d sketches, k = %d, s = %d\n", n_sketches, k, 
+                         size );
+    for ( first = 0; first < n_sketches; first += COMPARE_ROWS )
+       {
+        for ( t = 0; t < n_threads; t++ )
+           {
+            jobs[t].id = t;
+            jobs[t].first = first;
+            jobs[t].last = ( first + COMPARE_ROWS < n_sketches ) 
+                                 ? first + COMPARE_ROWS : n_sketches;
+           }
+        if ( n_threads == 1 )
+            compare_worker( &jobs[0] );
+        else
+           {
+            for ( t = 0; t < n_threads; t++ )
+                if ( pthread_create( &jobs[t].thread, NULL, compare_worker, 
+                                     &jobs[t] ) != 0 )
+                   {
+                    perror( "can't create thread" );
+                    exit( 1 );
+                   }
+            for ( t = 0; t < n_threads; t++ )
+                pthread_join( jobs[t].thread, NULL );
+           }
+        for ( i = first; i < jobs[0].last; i++ )
+            fwrite( row_out[i - first].p, 1, row_out[i - first].n, stdout );
+       }
+   }
+
+
+                  /*********************************************/
+                  /* K-mer sets (-B) and read screening (-Q) */
+                  /*********************************************/
+
+/*****************************************************************************/
+/* A k-mer set file is "KMST", then uint32 version, k and index bits b,      */
+/* uint64 n, uint64 index[2^b + 1] and uint64 key[n]: the mix64() hashes of  */
+/* the set's canonical k-mers in increasing order, keys index[i] ..          */
+/* index[i+1]-1 being those whose top b bits are i.  mix64() is a bijection, */
+/* so the keys are exact, and they spread evenly over the buckets; b is      */
+/* chosen for about 4 keys (half a cache line) a bucket.  Screening mmap()s  */
+/* the set files and looks each canonical k-mer of a read up in its bucket.  */
+/*****************************************************************************/
+
+#define  SET_MAGIC        "KMST"
+#define  SET_VERSION      1
+#define  SET_HEADER_LEN   24
+#define  KEYS_PER_BUCKET  4
+
+typedef struct kmer_set {
+                          char            *name;
+                          int              bits;
+                          uint64_t         n;
+                          const uint64_t  *index;
+                          const uint64_t  *keys;
+                        } KMER_SET;
+
+KMER_SET  sets[MAX_SETS];
+FILE     *pass_out, *fail_out;      /* -o */
+
+
+uint64_t  bucket_of( uint64_t h, int bits )
+   {
+    return( bits > 0 ? h >> (64 - bits) : 0 );
+   }
+
+
+/* make s the set of the n sorted keys, indexing them */
+
+void  set_index( KMER_SET *s, const uint64_t *keys, uint64_t n )
+   {
+    uint64_t  *index;
+    size_t     i, j, n_buckets;
+    int        bits = 0;
+
+    while ( bits < 32 && ( (uint64_t) KEYS_PER_BUCKET << (bits + 1) ) <= n )
+        bits++;
+    n_buckets = (size_t) 1 << bits;
+    index = malloc_safely( (n_buckets + 1) * sizeof( uint64_t ) );
+    index[0] = 0;
+    for ( i = j = 0; i < n_buckets; i++ )
+       {
+        while ( j < n && bucket_of( keys[j], bits ) <= i )
+            j++;
+        index[i+1] = j;
+       }
+    s->bits = bits;
+    s->n = n;
+    s->index = index;
+    s->keys = keys;
+   }
+
+
+/* -B: write the k-mers in set_table out as a set file */
+
+void  write_set( void )
+   {
+    FILE      *f;
+    uint64_t  *keys, *index;
+    uint64_t   n = 0;
+    uint32_t   v[3];
+    size_t     i, n_buckets;
+    int        bits;
+    KMER_SET   s;
+
+    keys = malloc_safely( set_table.n * sizeof( uint64_t ) + 1 );
+    for ( i = 0; i < set_table.size; i++ )
+        if ( set_table.keys[i] != EMPTY_KEY )
+            keys[n++] = mix64( set_table.keys[i] );
+    ktable_free( &set_table );
+    qsort( keys, n, sizeof( uint64_t ), uint64_cmp );
+    set_index( &s, keys, n );
+    bits = s.bits;
+    n_buckets = (size_t) 1 << bits;
+    index = (uint64_t *) s.index;
+
+    if ( !( f = fopen( set_file, "w" ) ) )
+       {
+        perror( set_file );
+        exit( errno );
+       }
+    v[0] = SET_VERSION;
+    v[1] = word_size;
+    v[2] = bits;
+    fwrite( SET_MAGIC, 1, 4, f );
+    fwrite( v, sizeof( uint32_t ), 3, f );
+    fwrite( &n, sizeof( n ), 1, f );
+    fwrite( index, sizeof( uint64_t ), n_buckets + 1, f );
+    if ( fwrite( keys, sizeof( uint64_t ), n, f ) != n || fclose( f ) != 0 )
+       {
+        perror( set_file );
+        exit( errno );
+       }
+    if ( verbose )
+        fprintf( stderr, "%s: %lu k-mers, %d index bits\n", set_file, 
+                         (unsigned long) n, bits );
+    free( index );
+    free( keys );
+   }
+
+
+/* map set file sets[i].name; its k becomes word_size */
+
+void  load_set( int i )
+   {
+    KMER_SET     *s = &sets[i];
+    int           fd;
+    struct stat   st;
+    const char   *base;
+    uint32_t      v[3];
+
+    s->name = set_names[i];
+    if ( (fd = open( s->name, O_RDONLY )) < 0 || fstat( fd, &st ) < 0 )
+       {
+        perror( s->name );
+        exit( errno );
+       }
+    if ( st.st_size < SET_HEADER_LEN + (off_t) sizeof( uint64_t ) )
+       {
+        fprintf( stderr, "%s is not a kmers set file\n", s->name );
+        exit( 1 );
+       }
+    base = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    if ( base == MAP_FAILED )
+       {
+        perror( s->name );
+        exit( errno );
+       }
+    close( fd );
+    memcpy( v, base + 4, sizeof( v ) );
+    memcpy( &s->n, base + 16, sizeof( uint64_t ) );
+    s->bits = v[2];
+    if ( memcmp( base, SET_MAGIC, 4 ) != 0 || v[0] != SET_VERSION 
+            || s->bits > 32 || (uint64_t) st.st_size != SET_HEADER_LEN 
+                 + ( ((uint64_t) 1 << s->bits) + 1 + s->n ) * sizeof( uint64_t ) )
+       {
+        fprintf( stderr, "%s is not a kmers set file (or is damaged)\n", 
+                         s->name );
+        exit( 1 );
+       }
+    if ( i > 0 && v[1] != (uint32_t) word_size )
+       {
+        fprintf( stderr, "%s: k is %u, not %d as in %s\n", s->name, v[1], 
+                         word_size, sets[0].name );
+        exit( 1 );
+       }
+    word_size = v[1];
+    s->index = (const uint64_t *) ( base + SET_HEADER_LEN );
+    s->keys = s->index + ((size_t) 1 << s->bits) + 1;
+   }
+
+
+/* place of key h in set s, or -1 */
+
+int64_t  set_find( const KMER_SET *s, uint64_t h )
+   {
+    uint64_t  b = bucket_of( h, s->bits );
+    uint64_t  lo = s->index[b], hi = s->index[b+1], mid;
+
+    while ( hi - lo > 8 )
+       {
+        mid = lo + (hi - lo) / 2;
+        if ( s->keys[mid] <= h )
+            lo = mid;
+        else
+            hi = mid;
+       }
+    for ( ; lo < hi; lo++ )
+        if ( s->keys[lo] >= h )
+            return( s->keys[lo] == h ? (int64_t) lo : -1 );
+    return( -1 );
+   }
+
+
+int  in_set( const KMER_SET *s, uint64_t h )
+   {
+    return( set_find( s, h ) >= 0 );
+   }
+
+
+/* screen one read against the sets, into w->out: a line of name, k-mers */
+/* and the fraction of them in each set, or (-o) the read itself, with   */
+/* r->fail set if any fraction reaches fail_fraction                     */
+
+void  screen_read( WORKER *w, RECORD *r )
+   {
+    const char         *s = w->batch->data.p + r->seq;
+    const char         *hdr = w->batch->data.p + r->hdr;
+    size_t              i, name_len;
+    int                 c, j;
+    int                 good = 0;
+    unsigned long int   word = 0, rc = 0;
+    uint64_t            n = 0, h;
+    uint64_t            hits[MAX_SETS];
+    double              fr;
+    char                line[32];
+
+    for ( j = 0; j < n_sets; j++ )
+        hits[j] = 0;
+    for ( i = 0; i < r->seq_len; i++ )
+       {
+        c = s[i];
+        word = w_mask & ( (word << 2) | twobit[c] );
+        rc = (rc >> 2) 
+                | ( (unsigned long int) (3 ^ twobit[c]) << 2*(word_size-1) );
+        if ( no_count[c] )
+            good = 0;
+        else if ( ++good >= word_size )
+           {
+            n++;
+            h = mix64( word < rc ? word : rc );
+            for ( j = 0; j < n_sets; j++ )
+                hits[j] += in_set( &sets[j], h );
+           }
+       }
+
+    r->out = w->out.n;
+    if ( pass_out )
+       {
+        r->fail = 0;
+        for ( j = 0; j < n_sets; j++ )
+            if ( n > 0 && (double) hits[j] / n >= fail_fraction )
+                r->fail = 1;
+        buf_add( &w->out, ">", 1 );
+        buf_add( &w->out, hdr, r->hdr_len );
+        buf_add( &w->out, "\n", 1 );
+        buf_add( &w->out, s, r->seq_len );
+        buf_add( &w->out, "\n", 1 );
+       }
+    else
+       {
+        name_len = 0;                      /* first word of the header */
+        while ( name_len < r->hdr_len 
+                    && ! isspace( (unsigned char) hdr[name_len] ) )
+            name_len++;
+        buf_add( &w->out, hdr, name_len );
+        buf_add( &w->out, line, 
+                 snprintf( line, sizeof( line ), "\t%lu", (unsigned long) n ) );
+        for ( j = 0; j < n_sets; j++ )
+           {
+            fr = n > 0 ? (double) hits[j] / n : 0.0;
+            buf_add( &w->out, line, snprintf( line, sizeof( line ), "\t%.4f", 
+                                              fr ) );
+           }
+        buf_add( &w->out, "\n", 1 );
+       }
+    r->out_len = w->out.n - r->out;
+   }
+
+
+void  *screen_worker( void *arg )
+   {
+    WORKER  *w = (WORKER *) arg;
+    BATCH   *b = w->batch;
+    int      i;
+
+    w->out.n = 0;
+    for ( i = w->id; i < b->n; i += n_threads )
+        screen_read( w, &b->recs[i] );
+    return( NULL );
+   }
+
+
+/* screen every read in file f, writing the results in input order */
+
+void  screen_file( FILE *f, BATCH *b )
+   {
+    int      i, n;
+    int      pending = '\n';
+    RECORD  *r;
+
+    while ( (n = read_batch( f, b, &pending )) > 0 )
+       {
+        n_seqs += n;
+        for ( i = 0; i < n_threads; i++ )
+           {
+            workers[i].id = i;
+            workers[i].batch = b;
+           }
+        if ( n_threads == 1 )
+            screen_worker( &workers[0] );
+        else
+           {
+            for ( i = 0; i < n_threads; i++ )
+                if ( pthread_create( &workers[i].thread, NULL, 
+                                     screen_worker, &workers[i] ) != 0 )
+                   {
+                    perror( "can't create thread" );
+                    exit( 1 );
+                   }
+            for ( i = 0; i < n_threads; i++ )
+                pthread_join( workers[i].thread, NULL );
+           }
+        for ( i = 0; i < n; i++ )
+           {
+            r = &b->recs[i];
+            fwrite( workers[i % n_threads].out.p + r->out, 1, r->out_len, 
+                    pass_out ? ( r->fail ? fail_out : pass_out ) : stdout );
+           }
+        if ( pending == EOF )
+            break;
+       }
+   }
+
+
+FILE  *open_output( char *suffix )
+   {
+    char   name[PATH_MAX];
+    FILE  *f;
+
+    snprintf( name, PATH_MAX, "%s%s", split_prefix, suffix );
+    if ( !( f = fopen( name, "w" ) ) )
+       {
+        perror( name );
+        exit( errno );
+       }
+    return( f );
+   }
+
+
+void  screen( int nfiles, char **filenames )
+   {
+    static BATCH  batch;
+    FILE         *f;
+    int           i;
+
+    if ( split_prefix )
+       {
+        pass_out = open_output( ".pass.fa" );
+        fail_out = open_output( ".fail.fa" );
+       }
+    batch.recs = malloc_safely( BATCH_SEQS * sizeof( RECORD ) );
+    for ( i = 0; i < nfiles; i++ )
+       {
+        if ( verbose )
+            fprintf( stderr, "file: %s\n", filenames[i] );
+        f = open_file( filenames[i] );
+        screen_file( f, &batch );
+        close_file( f );
+       }
+    if ( pass_out && ( fclose( pass_out ) != 0 || fclose( fail_out ) != 0 ) )
+       {
+        perror( split_prefix );
+        exit( errno );
+       }
+   }
+
+
+                         /*********************************/
+                         /* Checkpoint files (-W and -R) */
+                         /*********************************/
+
+/*****************************************************************************/
+/* A checkpoint is "KMCK", then uint32 version, k, frames (-f), sample shift */
+/* + 1 (-F, 0 if none) and table kind (1 for -B, 2 for -U, else 0), uint64   */
+/* records seen, the names of the input files completed (uint32 count, then  */
+/* uint32 length and chars each), then the count tables: counts (or the      */
+/* frame tables in order) as COUNT[4^k] and a spill list, or the -F, -B or   */
+/* -U KTABLE as a list.  A list is uint64 n, then n (uint64 k-mer, uint64    */
+/* count) pairs.  All native byte order.  -W rewrites it (via a temporary    */
+/* and rename()) after each input file, so a run that dies can be picked up  */
+/* from the last one finished.                                               */
+/*****************************************************************************/
+
+#define  CKPT_MAGIC     "KMCK"
+#define  CKPT_VERSION   1
+
+char   **done_files = NULL;          /* input files counted so far */
+int      n_done = 0;
+
+
+/* the table kind field: which KTABLE, if any, holds the counts */
+
+uint32_t  ckpt_table_kind( void )
+   {
+    return( set_file ? 1 : ( unitig_prefix ? 2 : 0 ) );
+   }
+
+
+void  ckpt_write( FILE *f, const void *p, size_t n )
+   {
+    if ( n > 0 && fwrite( p, 1, n, f ) != n )
+       {
+        perror( checkpoint_out );
+        exit( errno );
+       }
+   }
+
+
+void  ckpt_write_u32( FILE *f, uint32_t v )
+   {
+    ckpt_write( f, &v, sizeof( v ) );
+   }
+
+
+void  ckpt_write_u64( FILE *f, uint64_t v )
+   {
+    ckpt_write( f, &v, sizeof( v ) );
+   }
+
+
+void  ckpt_write_spill( FILE *f, SPILL *s )
+   {
+    size_t  i;
+
+    ckpt_write_u64( f, s->n );
+    for ( i = 0; i < s->size; i++ )
+        if ( s->keys[i] != EMPTY_KEY )
+           {
+            ckpt_write_u64( f, s->keys[i] );
+            ckpt_write_u64( f, s->vals[i] );
+           }
+   }
+
+
+void  ckpt_write_ktable( FILE *f, KTABLE *t )
+   {
+    size_t  i;
+
+    ckpt_write_u64( f, t->n );
+    for ( i = 0; i < t->size; i++ )
+        if ( t->keys[i] != EMPTY_KEY )
+           {
+            ckpt_write_u64( f, t->keys[i] );
+            ckpt_write_u64( f, ktable_val( t, i ) );
+           }
+   }
+
+
+void  write_checkpoint( void )
+   {
+    char   tmp_name[PATH_MAX];
+    FILE  *f;
+    int    i;
+
+    snprintf( tmp_name, PATH_MAX, "%s.tmp", checkpoint_out );
+    if ( !( f = fopen( tmp_name, "w" ) ) )
+       {
+        perror( tmp_name );
+        exit( errno );
+       }
+    ckpt_write( f, CKPT_MAGIC, 4 );
+    ckpt_write_u32( f, CKPT_VERSION );
+    ckpt_write_u32( f, word_size );
+    ckpt_write_u32( f, n_frames );
+    ckpt_write_u32( f, sample_shift + 1 );
+    ckpt_write_u32( f, ckpt_table_kind() );
+    ckpt_write_u64( f, n_seqs );
+    ckpt_write_u32( f, n_done );
+    for ( i = 0; i < n_done; i++ )
+       {
+        ckpt_write_u32( f, strlen( done_files[i] ) );
+        ckpt_write( f, done_files[i], strlen( done_files[i] ) );
+       }
+    if ( sample_shift >= 0 )
+        ckpt_write_ktable( f, &sample_table );
+    else if ( set_file )
+        ckpt_write_ktable( f, &set_table );
+    else if ( unitig_prefix )
+        ckpt_write_ktable( f, &graph_table );
+    else if ( n_frames )
+        for ( i = 0; i < n_frames; i++ )
+           {
+            ckpt_write( f, frame_counts[i].c, n_kmers * sizeof( COUNT ) );
+            ckpt_write_spill( f, &frame_counts[i].spill );
+           }
+    else
+       {
+        ckpt_write( f, counts.c, n_kmers * sizeof( COUNT ) );
+        ckpt_write_spill( f, &counts.spill );
+       }
+    if ( fclose( f ) != 0 || rename( tmp_name, checkpoint_out ) != 0 )
+       {
+        perror( checkpoint_out );
+        exit( errno );
+       }
+   }
+
+
+void  ckpt_read( FILE *f, void *p, size_t n )
+   {
+    if ( n > 0 && fread( p, 1, n, f ) != n )
+       {
+        fprintf( stderr, "%s: truncated checkpoint\n", checkpoint_in );
+        exit( 1 );
+       }
+   }
+
+
+uint32_t  ckpt_read_u32( FILE *f )
+   {
+    uint32_t  v;
+
+    ckpt_read( f, &v, sizeof( v ) );
+    return( v );
+   }
+
+
+uint64_t  ckpt_read_u64( FILE *f )
+   {
+    uint64_t  v;
+
+    ckpt_read( f, &v, sizeof( v ) );
+    return( v );
+   }
+
+
+void  ckpt_read_spill( FILE *f, SPILL *s )
+   {
+    uint64_t  n, key;
+
+    for ( n = ckpt_read_u64( f ); n > 0; n-- )
+       {
+        key = ckpt_read_u64( f );
+        spill_add( s, key, ckpt_read_u64( f ) );
+       }
+   }
+
+
+void  ckpt_read_ktable( FILE *f, KTABLE *t )
+   {
+    uint64_t  n, key;
+
+    for ( n = ckpt_read_u64( f ); n > 0; n-- )
+       {
+        key = ckpt_read_u64( f );
+        ktable_add( t, key, ckpt_read_u64( f ) );
+       }
+   }
+
+
+/* -R: load the checkpoint, which must be for the same k and mode */
+
+void  read_checkpoint( void )
+   {
+    FILE      *f;
+    char       magic[4];
+    uint32_t   v[5], len;
+    int        i;
+
+    if ( !( f = fopen( checkpoint_in, "r" ) ) )
+       {
+        perror( checkpoint_in );
+        exit( errno );
+       }
+    ckpt_read( f, magic, 4 );
+    for ( i = 0; i < 5; i++ )
+        v[i] = ckpt_read_u32( f );
+    if ( memcmp( magic, CKPT_MAGIC, 4 ) != 0 || v[0] != CKPT_VERSION )
+       {
+        fprintf( stderr, "%s is not a kmers checkpoint\n", checkpoint_in );
+        exit( 1 );
+       }
+    if ( v[1] != (uint32_t) word_size || v[2] != (uint32_t) n_frames 
+            || v[3] != (uint32_t) (sample_shift + 1) 
+            || v[4] != ckpt_table_kind() )
+       {
+        fprintf( stderr, "%s was made with -k%u%s%s%s; use the same here\n", 
+                 checkpoint_in, v[1], v[2] ? ( v[2] == 3 ? " -f3" : " -f6" ) 
+                 : "", v[3] ? " -F" : "", 
+                 v[4] ? ( v[4] == 1 ? " -B" : " -U" ) : "" );
+        exit( 1 );
+       }
+    n_seqs = ckpt_read_u64( f );
+    n_done = ckpt_read_u32( f );
+    done_files = malloc_safely( (n_done + 1) * sizeof( char * ) );
+    for ( i = 0; i < n_done; i++ )
+       {
+        len = ckpt_read_u32( f );
+        done_files[i] = malloc_safely( len + 1 );
+        ckpt_read( f, done_files[i], len );
+        done_files[i][len] = '\0';
+       }
+    if ( sample_shift >= 0 )
+        ckpt_read_ktable( f, &sample_table );
+    else if ( set_file )
+        ckpt_read_ktable( f, &set_table );
+    else if ( unitig_prefix )
+        ckpt_read_ktable( f, &graph_table );
+    else if ( n_frames )
+        for ( i = 0; i < n_frames; i++ )
+           {
+            ckpt_read( f, frame_counts[i].c, n_kmers * sizeof( COUNT ) );
+            ckpt_read_spill( f, &frame_counts[i].spill );
+           }
+    else
+       {
+        ckpt_read( f, counts.c, n_kmers * sizeof( COUNT ) );
+        ckpt_read_spill( f, &counts.spill );
+       }
+    fclose( f );
+    if ( verbose )
+        fprintf( stderr, "%s: %d files, %d records\n", checkpoint_in, n_done, 
+                         n_seqs );
+   }
+
+
+/* has file name been counted already?  (stdin never has) */
+
+int  file_done( char *name )
+   {
+    int  i;
+
+    if ( strcmp( name, "-" ) != 0 )
+        for ( i = 0; i < n_done; i++ )
+            if ( strcmp( name, done_files[i] ) == 0 )
+                return( 1 );
+    return( 0 );
+   }
+
+
+void  mark_file_done( char *name )
+   {
+    if ( strcmp( name, "-" ) == 0 )
+        return;
+    done_files = realloc_safely( done_files, (n_done + 1) * sizeof( char * ) );
+    done_files[n_done++] = name;
+    if ( checkpoint_out )
+        write_checkpoint();
+   }
+
+
+                   /*******************************************/
+                   /* Compacted de Bruijn graph (unitigs, -U) */
+                   /*******************************************/
+
+/*****************************************************************************/
+/* The solid k-mers (canonical, seen at least -a times) go in a KMER_SET in  */
+/* memory, which numbers them 0..n-1 by their place in the sorted keys, and  */
+/* mix64() being invertible, gives each one back from its key.  An oriented */
+/* k-mer x joins its successor y if x has only that successor and y has      */
+/* only that predecessor.  A unitig is a maximal chain of joined k-mers.     */
+/* Each k-mer's neighbours are looked up once, into a byte of adj[], so      */
+/* walking then takes one lookup a step.                                     */
+/*                                                                           */
+/* Threads take slices of the k-mers, and from each k-mer (in each           */
+/* orientation) that doesn't join its predecessor, walk the unitig forward.  */
+/* Both ends of a unitig start a walk, so only the one whose first k-mer is  */
+/* not greater than the reverse complement of its last keeps it.  The k-mers */
+/* of each unitig are then marked with its number, again by threads, and any */
+/* left over are on cycles, which are walked (from anywhere) at the end.     */
+/* Unitigs are numbered in k-mer order, whatever the number of threads.      */
+/*****************************************************************************/
+
+#define  NO_UNITIG   (~ (uint32_t) 0)
+
+typedef struct unitig {
+                        uint64_t  first;       /* first and last k-mers, as */
+                        uint64_t  last;        /* in the sequence           */
+                        size_t    seq;         /* offset in walker's seqs   */
+                        size_t    len;
+                        uint64_t  kmer_count;  /* total of k-mers' counts   */
+                        char     *s;           /* the sequence, at the end  */
+                      } UNITIG;
+
+typedef struct walker {
+                        pthread_t  thread;
+                        uint64_t   from;       /* solid k-mers from .. to-1 */
+                        uint64_t   to;
+                        BUFFER     seqs;
+                        UNITIG    *u;
+                        size_t     n_u;
+                        size_t     size_u;
+                        uint32_t   base;       /* number of its first one */
+                      } WALKER;
+
+KMER_SET   graph;                    /* the solid k-mers */
+uint32_t  *graph_counts;
+uint8_t   *adj;                      /* solid neighbours, see adj_worker() */
+uint32_t  *unitig_of;
+WALKER     walkers[MAX_THREADS+1];   /* the last one is for cycles */
+UNITIG   **unitigs;                  /* by number */
+uint32_t   n_unitigs;
+
+
+/* inverse of mix64() */
+
+uint64_t  unmix64( uint64_t h )
+   {
+    h ^= h >> 33;
+    h *= 0x9cb4b2f8129337dbULL;
+    h ^= h >> 33;
+    h *= 0x4f74430c22a54005ULL;
+    h ^= h >> 33;
+    return( h );
+   }
+
+
+/* number of solid k-mer w (whose reverse complement is rw), or -1 */
+
+int64_t  graph_pos( uint64_t w, uint64_t rw )
+   {
+    return( set_find( &graph, mix64( w < rw ? w : rw ) ) );
+   }
+
+
+/* adj[i] has bit b set for each successor (c << 2 | b) of solid k-mer */
+/* i, c in its canonical form, and bit 4+b for each predecessor         */
+/* (b << 2(k-1) | c >> 2).  Read the other way, rx's successors are the */
+/* reverse complements of x's predecessors, with bases complemented,    */
+/* i.e. b <-> 3-b, which reverses the nibble.                           */
+
+static const int  rev4[16]   = { 0, 8, 4, 12, 2, 10, 6, 14, 
+                                 1, 9, 5, 13, 3, 11, 7, 15 };
+static const int  n_bits[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+static const int  bit_of[16] = { 0, 0, 1, 0, 2, 0, 0, 0, 3 };
+
+
+int  out_mask( int64_t p, uint64_t x, uint64_t rx )
+   {
+    return( x <= rx ? adj[p] & 15 : rev4[adj[p] >> 4] );
+   }
+
+
+int  in_mask( int64_t p, uint64_t x, uint64_t rx )
+   {
+    return( x <= rx ? adj[p] >> 4 : rev4[adj[p] & 15] );
+   }
+
+
+/* the 8 lookups for a k-mer are independent, so their buckets and */
+/* keys are prefetched first, to wait for the cache misses together  */
+
+void  *adj_worker( void *arg )
+   {
+    WALKER    *w = (WALKER *) arg;
+    uint64_t   i, c, rc, b, y, ry;
+    uint64_t   h[8], bucket[8];
+    int        a, j;
+
+    for ( i = w->from; i < w->to; i++ )
+       {
+        c = unmix64( graph.keys[i] );
+        rc = rc_word( c );
+        for ( b = 0; b < 4; b++ )
+           {
+            y = w_mask & ( (c << 2) | b );                     /* successor */
+            ry = ( rc >> 2 ) | ( (3 ^ b) << 2 * (word_size - 1) );
+            h[b] = mix64( y < ry ? y : ry );
+            y = ( c >> 2 ) | ( b << 2 * (word_size - 1) );   /* predecessor */
+            ry = w_mask & ( (rc << 2) | (3 ^ b) );
+            h[4+b] = mix64( y < ry ? y : ry );
+           }
+        for ( j = 0; j < 8; j++ )
+           {
+            bucket[j] = bucket_of( h[j], graph.bits );
+            __builtin_prefetch( &graph.index[bucket[j]] );
+           }
+        for ( j = 0; j < 8; j++ )
+            __builtin_prefetch( &graph.keys[ graph.index[bucket[j]] ] );
+        for ( a = 0, j = 0; j < 8; j++ )
+            if ( set_find( &graph, h[j] ) >= 0 )
+                a |= 1 << j;
+        adj[i] = a;
+       }
+    return( NULL );
+   }
+
+
+/* does x (rc rx, solid k-mer p) join its successor?  If so, that's y, */
+/* rc ry, solid k-mer *q                                               */
+
+int  joins( uint64_t x, uint64_t rx, int64_t p, 
+            uint64_t *y, uint64_t *ry, int64_t *q )
+   {
+    int       m = out_mask( p, x, rx );
+    uint64_t  b;
+
+    if ( n_bits[m] != 1 )
+        return( 0 );
+    b = bit_of[m];
+    *y = w_mask & ( (x << 2) | b );
+    *ry = ( rx >> 2 ) | ( (3 ^ b) << 2 * (word_size - 1) );
+    *q = graph_pos( *y, *ry );
+    if ( n_bits[ in_mask( *q, *y, *ry ) ] != 1 )
+        return( 0 );
+    return( *q != p );
+   }
+
+
+void  add_unitig( WALKER *w, uint64_t first, uint64_t last, size_t seq, 
+                  uint64_t kmer_count )
+   {
+    UNITIG  *u;
+
+    if ( w->n_u == w->size_u )
+       {
+        w->size_u = w->size_u ? 2 * w->size_u : 1024;
+        w->u = realloc_safely( w->u, w->size_u * sizeof( UNITIG ) );
+       }
+    u = &w->u[w->n_u++];
+    u->first = first;
+    u->last = last;
+    u->seq = seq;
+    u->len = w->seqs.n - seq;
+    u->kmer_count = kmer_count;
+   }
+
+
+/* walk the unitig from x (rc rx, solid k-mer p); keep it if it is ours */
+/* (or a cycle).  In a cycle, marking as we go stops the walk at the    */
+/* start                                                                */
+
+void  walk( WALKER *w, uint64_t x, uint64_t rx, int64_t p, int cycle )
+   {
+    uint64_t  cur = x, rcur = rx, y, ry;
+    uint64_t  kmer_count = graph_counts[p];
+    int64_t   p0 = p, q;
+    size_t    seq = w->seqs.n;
+
+    buf_need( &w->seqs, word_size );
+    word2seq( x, w->seqs.p + w->seqs.n );
+    w->seqs.n += word_size;
+    if ( cycle )
+        unitig_of[p] = n_unitigs;
+    while ( joins( cur, rcur, p, &y, &ry, &q ) && q != p0 )
+       {
+        if ( cycle && unitig_of[q] != NO_UNITIG )
+            break;
+        buf_need( &w->seqs, 1 );
+        w->seqs.p[w->seqs.n++] = real_nts[y & 3];
+        kmer_count += graph_counts[q];
+        if ( cycle )
+            unitig_of[q] = n_unitigs;
+        cur = y;
+        rcur = ry;
+        p = q;
+       }
+    if ( cycle || x <= rcur )
+        add_unitig( w, x, cur, seq, kmer_count );
+    else
+        w->seqs.n = seq;                      /* the other end keeps it */
+   }
+
+
+void  *walk_worker( void *arg )
+   {
+    WALKER    *w = (WALKER *) arg;
+    uint64_t   i, x, rx, y, ry;
+    int64_t    q;
+
+    for ( i = w->from; i < w->to; i++ )
+       {
+        x = unmix64( graph.keys[i] );
+        rx = rc_word( x );
+        if ( ! joins( rx, x, i, &ry, &y, &q ) )  /* x has no joined predecessor */
+            walk( w, x, rx, i, 0 );
+        if ( ! joins( x, rx, i, &y, &ry, &q ) )  /* nor has rx */
+            walk( w, rx, x, i, 0 );
+       }
+    return( NULL );
+   }
+
+
+/* number the k-mers of w's unitigs */
+
+void  *mark_worker( void *arg )
+   {
+    WALKER         *w = (WALKER *) arg;
+    size_t          i, j;
+    uint64_t        x, rx;
+    int             c;
+    const char     *s;
+
+    for ( i = 0; i < w->n_u; i++ )
+       {
+        s = w->seqs.p + w->u[i].seq;
+        x = rx = 0;
+        for ( j = 0; j < w->u[i].len; j++ )
+           {
+            c = twobit[(int) s[j]];
+            x = w_mask & ( (x << 2) | c );
+            rx = ( rx >> 2 ) | ( (uint64_t) (3 ^ c) << 2 * (word_size - 1) );
+            if ( j + 1 >= word_size )
+                unitig_of[ graph_pos( x, rx ) ] = w->base + i;
+           }
+       }
+    return( NULL );
+   }
+
+
+void  run_walkers( void *(*worker)( void * ) )
+   {
+    int  t;
+
+    if ( n_threads == 1 )
+        worker( &walkers[0] );
+    else
+       {
+        for ( t = 0; t < n_threads; t++ )
+            if ( pthread_create( &walkers[t].thread, NULL, worker, 
+                                 &walkers[t] ) != 0 )
+               {
+                perror( "can't create thread" );
+                exit( 1 );
+               }
+        for ( t = 0; t < n_threads; t++ )
+            pthread_join( walkers[t].thread, NULL );
+       }
+   }
+
+
+/* -U: add GFA links out of the end of unitig u, read in direction o */
+
+void  link_unitig( BUFFER *b, uint32_t u, int o )
+   {
+    static const char *sign = "+-";
+    UNITIG            *v;
+    uint64_t           e, re, w, rw, bs;
+    uint32_t           n;
+    int                ov;
+    char               line[96];
+
+    e = ( o == 0 ) ? unitigs[u]->last : rc_word( unitigs[u]->first );
+    re = rc_word( e );
+    for ( bs = 0; bs < 4; bs++ )
+       {
+        w = w_mask & ( (e << 2) | bs );
+        rw = ( re >> 2 ) | ( (3 ^ bs) << 2 * (word_size - 1) );
+        if ( graph_pos( w, rw ) < 0 )
+            continue;
+        n = unitig_of[ graph_pos( w, rw ) ];
+        v = unitigs[n];
+        if ( w == v->first )
+            ov = 0;
+        else if ( w == rc_word( v->last ) )
+            ov = 1;
+        else
+            continue;
+        if ( n < u || ( n == u && 1 - ov < o ) )   /* the other side has it */
+            continue;
+        buf_add( b, line, snprintf( line, sizeof( line ), 
+                                    "L\t%u\t%c\t%u\t%c\t%dM\n", u, sign[o], 
+                                    n, sign[ov], word_size - 1 ) );
+       }
+   }
+
+
+void  write_unitigs( void )
+   {
+    char      name[PATH_MAX];
+    FILE     *fa, *gfa;
+    BUFFER    b = { NULL, 0, 0 };
+    UNITIG   *u;
+    uint32_t  i;
+    int       o;
+
+    snprintf( name, PATH_MAX, "%s.fa", unitig_prefix );
+    if ( !( fa = fopen( name, "w" ) ) )
+       {
+        perror( name );
+        exit( errno );
+       }
+    snprintf( name, PATH_MAX, "%s.gfa", unitig_prefix );
+    if ( !( gfa = fopen( name, "w" ) ) )
+       {
+        perror( name );
+        exit( errno );
+       }
+    fprintf( gfa, "H\tVN:Z:1.0\n" );
+    for ( i = 0; i < n_unitigs; i++ )
+       {
+        u = unitigs[i];
+        fprintf( fa, ">%u LN:i:%lu KC:i:%llu km:f:%.1f\n", i, 
+                 (unsigned long) u->len, (unsigned long long) u->kmer_count,
+                 (double) u->kmer_count / (u->len - word_size + 1) );
+        fwrite( u->s, 1, u->len, fa );
+        putc( '\n', fa );
+        fprintf( gfa, "S\t%u\t", i );
+        fwrite( u->s, 1, u->len, gfa );
+        fprintf( gfa, "\tLN:i:%lu\tKC:i:%llu\n", (unsigned long) u->len, 
+                      (unsigned long long) u->kmer_count );
+       }
+    for ( i = 0; i < n_unitigs; i++ )
+       {
+        for ( o = 0; o < 2; o++ )
+            link_unitig( &b, i, o );
+        if ( b.n > OUT_BUFF_LEN )
+           {
+            fwrite( b.p, 1, b.n, gfa );
+            b.n = 0;
+           }
+       }
+    fwrite( b.p, 1, b.n, gfa );
+    if ( fclose( fa ) != 0 || fclose( gfa ) != 0 )
+       {
+        perror( unitig_prefix );
+        exit( errno );
+       }
+    free( b.p );
+   }
+
+
+/* -U: build the graph of the k-mers counted in graph_table, and write */
+/* out the unitigs                                                     */
+
+void  build_unitigs( void )
+   {
+    uint64_t  *keys;
+    uint64_t   n = 0, i, x;
+    uint32_t   id;
+    size_t     j;
+    int        t;
+    WALKER    *w, *cyc = &walkers[n_threads];
+
+    keys = malloc_safely( graph_table.n * sizeof( uint64_t ) + 1 );
+    for ( j = 0; j < graph_table.size; j++ )
+        if ( graph_table.keys[j] != EMPTY_KEY 
+                && ktable_val( &graph_table, j ) >= min_solid )
+            keys[n++] = mix64( graph_table.keys[j] );
+    qsort( keys, n, sizeof( uint64_t ), uint64_cmp );
+    set_index( &graph, keys, n );
+    graph_counts = malloc_safely( n * sizeof( uint32_t ) + 1 );
+    for ( i = 0; i < n; i++ )
+       {
+        x = ktable_get( &graph_table, unmix64( keys[i] ) );
+        graph_counts[i] = x < UINT32_MAX ? x : UINT32_MAX;
+       }
+    ktable_free( &graph_table );
+    unitig_of = malloc_safely( n * sizeof( uint32_t ) + 1 );
+    for ( i = 0; i < n; i++ )
+        unitig_of[i] = NO_UNITIG;
+    if ( verbose )
+        fprintf( stderr, "%lu solid k-mers\n", (unsigned long) n );
+
+    for ( t = 0; t < n_threads; t++ )
+       {
+        walkers[t].from = n * t / n_threads;
+        walkers[t].to = n * (t + 1) / n_threads;
+       }
+    adj = malloc_safely( n + 1 );
+    run_walkers( adj_worker );
+    run_walkers( walk_worker );
+    for ( n_unitigs = 0, t = 0; t < n_threads; t++ )
+       {
+        walkers[t].base = n_unitigs;
+        n_unitigs += walkers[t].n_u;
+       }
+    run_walkers( mark_worker );
+
+    cyc->base = n_unitigs;                  /* what's left is on cycles */
+    for ( i = 0; i < n; i++ )
+        if ( unitig_of[i] == NO_UNITIG )
+           {
+            x = unmix64( graph.keys[i] );
+            walk( cyc, x, rc_word( x ), i, 1 );
+            n_unitigs++;
+           }
+
+    unitigs = malloc_safely( n_unitigs * sizeof( UNITIG * ) + 1 );
+    for ( id = 0, t = 0; t <= n_threads; t++ )
+        for ( w = &walkers[t], j = 0; j < w->n_u; j++ )
+           {
+            w->u[j].s = w->seqs.p + w->u[j].seq;
+            unitigs[id++] = &w->u[j];
+           }
+    if ( verbose )
+        fprintf( stderr, "%u unitigs (%lu on cycles)\n", n_unitigs, 
+                         (unsigned long) cyc->n_u );
+    write_unitigs();
+   }
+
+
+                                /****************/
+                                /* Main Program */
+                                /****************/
+
+
+
+int main ( int argc, char **argv )
+   {
+    int           nfiles;
+    int           i;
+    static char **filenames;
+    FILE         *f;
+
+    parse_args( argc, argv, &nfiles, &filenames );
+    for ( i = 0; i < n_sets; i++ )     /* sets' k is the one */
+        load_set( i );
+    init();
+    reset();
+
+    if ( n_sets )
+       {
+        screen( nfiles, filenames );
+        exit( 0 );
+       }
+    if ( tmp_dir )
+       {
+        disk_count( nfiles, filenames );
+        exit( 0 );
+       }
+    if ( compare )
+       {
+        compare_sketches( nfiles, filenames );
+        exit( 0 );
+       }
+    if ( sketch_file )
+        write_sketch_header();
+    if ( matrix_output )
+       {
+        static BATCH  batch;
+
+        batch.recs = malloc_safely( BATCH_SEQS * sizeof( RECORD ) );
+        init_workers();
+        write_matrix_header();
+        for ( i = 0; i < nfiles; i++ )
+           {
+            if ( verbose )
+                fprintf( stderr, "file: %s\n", filenames[i] );
+            f = open_file( filenames[i] );
+            matrix_file( f, &batch );
+            close_file( f );
+           }
+        exit( 0 );
+       }
+    if ( sample_shift >= 0 )
+        ktable_init( &sample_table, 1 << 20 );
+    if ( set_file )
+        ktable_init( &set_table, 1 << 20 );
+    if ( unitig_prefix )
+        ktable_init( &graph_table, 1 << 20 );
+    if ( checkpoint_in )
+        read_checkpoint();
+
+    for ( i = 0; i < nfiles; i++ )     /* for each file */
+       { 
+        if ( file_done( filenames[i] ) )
+           {
+            if ( verbose )
+                fprintf( stderr, "file: %s (done already)\n", filenames[i] );
+            continue;
+           }
+        if ( verbose )
+            fprintf( stderr, "file: %s\n", filenames[i] );
+        f = open_file( filenames[i] );
+        count_kmers( f );
+        close_file( f );
+        if ( sketch_file && ! sketch_records )
+            end_sketch( filenames[i] );
+        mark_file_done( filenames[i] );
+       }
+    if ( checkpoint_out )              /* stdin isn't marked done */
+        write_checkpoint();
+    if ( sketch_file )
+        close_sketches();
+    else if ( set_file )
+        write_set();
+    else if ( unitig_prefix )
+        build_unitigs();
+    else if ( spectrum )
+        report_spectrum();
+    else if ( n_frames )
+        report_frames();
+    else
+        report();
    }
 
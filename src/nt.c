@@ -5,14 +5,25 @@
 /*                                                                           */
 /* Description: counts single nucleotide frequencies in DNA sequences        */
 /*                                                                           */
+/*              With -S (or -B) it prints a table of statistics for every    */
+/*              record instead, computed by several threads (-t) over large  */
+/*              blocks of input (see stats_file())                           */
 /*                                                                           */
-/* Compiling:   cc -O -o nt nt.c should do the job.                          */
+/*              With -r it also writes the positions of runs of N, of        */
+/*              lowercase and (-m) of single bases to a BED file, found in   */
+/*              the same pass (see count_runs())                             */
+/*                                                                           */
+/* Compiling:   cc -O -o nt nt.c -lpthread should do the job.                */
 /*                 (or cc -O3 if you prefer)                                 */
 /*                                                                           */
 /*****************************************************************************/
 
+#include <ctype.h>
 #include <errno.h>
 #include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,6 +40,15 @@ int  show_nts           = 1;  /* cleared by -n */
 int  show_counts        = 1;  /* cleared by -P */
 int  show_percents      = 0;  /* set by -p, or -P */
 int  show_total         = 0;  /* set by -T */
+int  record_stats       = 0;  /* set to 1 by -S option; to 2 by -B */
+int  n_threads          = 1;  /* set by -t */
+FILE *bed_file          = NULL; /* opened by -r */
+long min_run            = 1;  /* set by -l */
+long min_homopolymer    = 0;  /* set by -m */
+
+#define  STATS_TSV        1
+#define  STATS_BINARY     2
+#define  MAX_THREADS      256
 
 #define  MAX_HEADER_LEN   16384  /* was 1024, but encountered a big one once */
 char     header[MAX_HEADER_LEN+1];
@@ -55,6 +75,8 @@ void usage( void )
    {
     fprintf( stderr, " \n\
 Usage:       nt  [-aAcgnhpPsTVz]  [seq-file ... ]                         \n\
+             nt  -S|-B [-t<n>]  [seq-file ... ]                           \n\
+             nt  -r<bed-file> [-l<n>] [-m<n>] [other options] [seq-file...]\n\
                                                                           \n\
              where [seq-files] are in FASTA format.  The name \"-\" means \n\
              stdin.  stdin is scanned it no filemames are specified.      \n\
@@ -68,6 +90,25 @@ Options:     -a      treat all ambiguities as \"N\", count & display      \n\
              -P      print only percentags (not total counts)             \n\
              -s      print counts/percents for each fasta sequence        \n\
              -T      print total nucleotide count                         \n\
+             -S      print a table of statistics for each record, tab     \n\
+                     separated: name (up to the first space), length,     \n\
+                     counts of A, C, G, T, N and other ambiguity codes    \n\
+                     (all case insensitive) and G+C fraction of A+C+G+T   \n\
+                     (NA if none).  Other options are ignored             \n\
+             -B      same as -S, but written as fixed width binary rows:  \n\
+                     \"NTST\", uint32 version, uint32 row size, then for  \n\
+                     each record in order uint64 length, A, C, G, T, N,   \n\
+                     ambiguity counts and float64 G+C fraction (NaN if    \n\
+                     none), in native byte order                          \n\
+             -t<n>   compute -S or -B with <n> threads                    \n\
+             -r<bed> while counting, write the runs of N (or n) and of    \n\
+                     lowercase bases in each sequence to file <bed>, as   \n\
+                     BED lines: name, start (from 0), end, and \"N\" or   \n\
+                     \"lowercase\"                                         \n\
+             -l<n>   with -r, only write runs of at least <n> bases       \n\
+                     (default 1)                                          \n\
+             -m<n>   with -r, also write runs of one base (A, C, G or T,  \n\
+                     either case) at least <n> long, as \"polyA\" etc.     \n\
              -z      suppress counts zero in output                       \n\
              -V      print version                                        \n\
              -h      print help message                                   \n\
@@ -82,19 +123,52 @@ void parse_args ( int argc, char **argv, int *nfiles, char ***filenames )
    {
     static char *stand_in[] = { "-", (char *) 0 };
     int    c;
+    int    run_opts = 0;       /* -l or -m given */
 
-    while ( (c = getopt( argc, argv, "aAcghnpPsTVz")) != -1 )
+    while ( (c = getopt( argc, argv, "aAcBghl:m:npPr:sSt:TVz")) != -1 )
         switch ( c )
            {
             case 'a':  show_ambs = 1;           break;
             case 'A':  show_ambs = 2;           break;
             case 'c':  case_sensitive = 1;      break;
             case 'g':  gc_content = 1;          break;
+            case 'l':  min_run = atol( optarg );
+                       run_opts = 1;
+                       if ( min_run < 1 )
+                          {
+                           fprintf( stderr, "-l must be at least 1\n" );
+                           exit( 1 );
+                          }
+                       break;
+            case 'm':  min_homopolymer = atol( optarg );
+                       run_opts = 1;
+                       if ( min_homopolymer < 1 )
+                          {
+                           fprintf( stderr, "-m must be at least 1\n" );
+                           exit( 1 );
+                          }
+                       break;
+            case 'r':  if ( ! (bed_file = fopen( optarg, "w" )) )
+                          {
+                           perror( optarg );
+                           exit( errno );
+                          }
+                       break;
             case 'n':  show_nts = 0;            break;
             case 'p':  show_percents = 1;       break;
             case 'P':  show_percents = 1;       
                        show_counts = 0;         break;
             case 's':  report_by_sequence = 1;  break;
+            case 'S':  record_stats = STATS_TSV;     break;
+            case 'B':  record_stats = STATS_BINARY;  break;
+            case 't':  n_threads = atoi( optarg );
+                       if ( n_threads < 1 || n_threads > MAX_THREADS )
+                          {
+                           fprintf( stderr, "-t must be in range 1-%d\n",
+                                            MAX_THREADS );
+                           exit( 1 );
+                          }
+                       break;
             case 'T':  show_total = 1;          break;
             case 'z':  suppress_zeros = 1;      break;
             case 'V':  version();               exit(0);
@@ -103,6 +177,11 @@ void parse_args ( int argc, char **argv, int *nfiles, char ***filenames )
                        exit(0);
             default:   usage();                 exit(1);
            }
+    if ( run_opts && ! bed_file )
+       {
+        fprintf( stderr, "-l and -m only apply to the runs written by -r\n" );
+        exit( 1 );
+       }
     argc -= optind;
     argv += optind;
     if ( argc > 0 )
@@ -354,6 +433,581 @@ void  count_nts( FILE *f )
        }
    }
 
+                     /***************************************/
+                     /* Per-record statistics table (-S -B) */
+                     /***************************************/
+
+/*****************************************************************************/
+/* Input is read in large blocks (STATS_BLOCK bytes at a time) and only cut  */
+/* after the last complete record; the rest is carried over to the next      */
+/* block.  Each block is split into n_threads equal byte ranges, and each    */
+/* thread does the records whose ">" falls in its range, formatting their    */
+/* rows into its own output buffer.  The buffers are then written in thread  */
+/* order, which is input order.                                              */
+/*****************************************************************************/
+
+#define  STATS_MAGIC      "NTST"
+#define  STATS_VERSION    1
+#define  STATS_BLOCK      (64 << 20)
+#define  MAX_ROW          (MAX_HEADER_LEN + 8 * 24)
+
+#define  CL_A       0     /* classes of chars, for counting */
+#define  CL_C       1
+#define  CL_G       2
+#define  CL_T       3
+#define  CL_N       4
+#define  CL_AMB     5
+#define  CL_SPACE   6
+#define  CL_OTHER   7
+#define  N_CLASSES  8
+
+unsigned char  nt_class[256];
+
+typedef struct buffer {                       /* growable byte buffer */
+                        char    *p;
+                        size_t   n;
+                        size_t   size;
+                      } BUFFER;
+
+typedef struct stats_row {                    /* -B output row */
+                           uint64_t  length;
+                           uint64_t  count[6];   /* A C G T N ambiguities */
+                           double    gc;
+                         } STATS_ROW;
+
+typedef struct stats_worker {
+                              pthread_t    thread;
+                              const char  *data;    /* block, and range */
+                              size_t       n;       /* of it for this   */
+                              size_t       from;    /* thread           */
+                              size_t       to;
+                              BUFFER       out;
+                            } STATS_WORKER;
+
+STATS_WORKER  stats_workers[MAX_THREADS];
+
+
+void  buf_need( BUFFER *b, size_t n )          /* make room for n more */
+   {
+    if ( b->n + n <= b->size )
+        return;
+    if ( b->size == 0 )
+        b->size = 65536;
+    while ( b->n + n > b->size )
+        b->size *= 2;
+    if ( !(b->p = realloc( b->p, b->size )) )
+       {
+        fprintf( stderr, "failed to realloc %lu bytes\n",
+                         (unsigned long) b->size );
+        exit( errno );
+       }
+   }
+
+
+/* write v in decimal at p.  Returns the end */
+
+char  *fmt_uint( char *p, uint64_t v )
+   {
+    char  digits[24];
+    int   n = 0;
+
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+       } while ( v > 0 );
+    while ( n > 0 )
+        *p++ = digits[--n];
+    return( p );
+   }
+
+
+void  init_stats( void )
+   {
+    int  i;
+
+    for ( i = 0; i < 256; i++ )
+        nt_class[i] = CL_OTHER;
+    for ( i = 0; ambiguities[i]; i++ )
+        nt_class[ ambiguities[i] ] = nt_class[ ambiguities[i] + LOWER_OFF ]
+                                   = CL_AMB;
+    nt_class[A] = nt_class[A+LOWER_OFF] = CL_A;
+    nt_class[C] = nt_class[C+LOWER_OFF] = CL_C;
+    nt_class[G] = nt_class[G+LOWER_OFF] = CL_G;
+    nt_class[T] = nt_class[T+LOWER_OFF] = CL_T;
+    nt_class[N] = nt_class[N+LOWER_OFF] = CL_N;
+    nt_class[' '] = nt_class['\t'] = nt_class['\n'] = nt_class['\r']
+                  = nt_class['\v'] = nt_class['\f'] = CL_SPACE;
+    if ( record_stats == STATS_BINARY )
+       {
+        uint32_t  v[2] = { STATS_VERSION, sizeof( STATS_ROW ) };
+
+        fwrite( STATS_MAGIC, 1, 4, stdout );
+        fwrite( v, sizeof( uint32_t ), 2, stdout );
+       }
+    else
+        printf( "#name\tlength\tA\tC\tG\tT\tN\tambig\tgc\n" );
+   }
+
+
+/* does a record (its ">") start at position i of the block? */
+
+static inline int  record_start( const char *d, size_t i )
+   {
+    return( d[i] == '>' && ( i == 0 || d[i-1] == '\n' ) );
+   }
+
+
+/* count the chars in p[0..n-1] by class into cl[] (four sets of counters */
+/* interleaved, so successive increments don't wait on each other)       */
+
+void  count_classes( const unsigned char *p, size_t n, uint64_t *cl )
+   {
+    uint64_t  c4[4][N_CLASSES];
+    size_t    i;
+    int       j;
+
+    memset( c4, 0, sizeof( c4 ) );
+    for ( i = 0; i + 4 <= n; i += 4 )
+       {
+        c4[0][ nt_class[ p[i] ] ]++;
+        c4[1][ nt_class[ p[i+1] ] ]++;
+        c4[2][ nt_class[ p[i+2] ] ]++;
+        c4[3][ nt_class[ p[i+3] ] ]++;
+       }
+    for ( ; i < n; i++ )
+        c4[0][ nt_class[ p[i] ] ]++;
+    for ( j = 0; j < N_CLASSES; j++ )
+        cl[j] = c4[0][j] + c4[1][j] + c4[2][j] + c4[3][j];
+   }
+
+
+/* add the row for the record whose header line is d[h..s-1] and whose */
+/* sequence is d[s..e-1] to buffer b                                   */
+
+void  stats_row( BUFFER *b, const char *d, size_t h, size_t s, size_t e )
+   {
+    uint64_t   cl[N_CLASSES];
+    uint64_t   acgt, gc;
+    STATS_ROW  r;
+    size_t     i, id_len;
+    char      *p;
+    int        j;
+
+    count_classes( (const unsigned char *) d + s, e - s, cl );
+    r.length = 0;
+    for ( j = 0; j < N_CLASSES; j++ )
+        if ( j != CL_SPACE )
+            r.length += cl[j];
+    for ( j = 0; j < 6; j++ )
+        r.count[j] = cl[j];
+    acgt = cl[CL_A] + cl[CL_C] + cl[CL_G] + cl[CL_T];
+    gc = cl[CL_C] + cl[CL_G];
+    if ( record_stats == STATS_BINARY )
+       {
+        r.gc = acgt > 0 ? (double) gc / (double) acgt : NAN;
+        buf_need( b, sizeof( r ) );
+        memcpy( b->p + b->n, &r, sizeof( r ) );
+        b->n += sizeof( r );
+        return;
+       }
+    for ( i = h + 1; i < s && nt_class[ (unsigned char) d[i] ] != CL_SPACE;
+          i++ )
+        ;
+    id_len = i - h - 1;
+    if ( id_len > MAX_HEADER_LEN )
+        id_len = MAX_HEADER_LEN;
+    buf_need( b, MAX_ROW );
+    p = b->p + b->n;
+    memcpy( p, d + h + 1, id_len );
+    p += id_len;
+    *p++ = '\t';
+    p = fmt_uint( p, r.length );
+    for ( j = 0; j < 6; j++ )
+       {
+        *p++ = '\t';
+        p = fmt_uint( p, r.count[j] );
+       }
+    *p++ = '\t';
+    if ( acgt > 0 )                              /* 4 decimal places */
+       {
+        gc = ( gc * 10000 + acgt / 2 ) / acgt;
+        p = fmt_uint( p, gc / 10000 );
+        *p++ = '.';
+        gc %= 10000;
+        for ( j = 3; j >= 0; j--, gc /= 10 )
+            p[j] = '0' + gc % 10;
+        p += 4;
+       }
+    else
+       {
+        memcpy( p, "NA", 2 );
+        p += 2;
+       }
+    *p++ = '\n';
+    b->n = p - b->p;
+   }
+
+
+/* do the records starting in w's range of the block */
+
+void  *stats_worker( void *arg )
+   {
+    STATS_WORKER  *w = (STATS_WORKER *) arg;
+    const char    *d = w->data;
+    const char    *q;
+    size_t         h, s, e;
+
+    w->out.n = 0;
+    for ( h = w->from; h < w->to && ! record_start( d, h ); h++ )
+        if ( (q = memchr( d + h + 1, '>', w->to - h - 1 )) )
+            h = q - d - 1;
+        else
+            h = w->to - 1;
+    while ( h < w->to )
+       {
+        q = memchr( d + h, '\n', w->n - h );
+        s = q ? q - d + 1 : w->n;
+        for ( e = s; e < w->n && ! record_start( d, e ); e++ )
+            if ( (q = memchr( d + e + 1, '>', w->n - e - 1 )) )
+                e = q - d - 1;
+            else
+                e = w->n - 1;
+        stats_row( &w->out, d, h, s, e );
+        h = e;
+       }
+    return( NULL );
+   }
+
+
+/* compute and write the rows for records d[0..n-1] */
+
+void  stats_block( const char *d, size_t n )
+   {
+    int  t;
+
+    for ( t = 0; t < n_threads; t++ )
+       {
+        stats_workers[t].data = d;
+        stats_workers[t].n = n;
+        stats_workers[t].from = n * t / n_threads;
+        stats_workers[t].to = n * (t + 1) / n_threads;
+       }
+    if ( n_threads == 1 )
+        stats_worker( &stats_workers[0] );
+    else
+       {
+        for ( t = 0; t < n_threads; t++ )
+            if ( pthread_create( &stats_workers[t].thread, NULL,
+                                 stats_worker, &stats_workers[t] ) != 0 )
+               {
+                perror( "can't create thread" );
+                exit( 1 );
+               }
+        for ( t = 0; t < n_threads; t++ )
+            pthread_join( stats_workers[t].thread, NULL );
+       }
+    for ( t = 0; t < n_threads; t++ )
+        if ( stats_workers[t].out.n > 0 &&
+             fwrite( stats_workers[t].out.p, 1, stats_workers[t].out.n,
+                     stdout ) != stats_workers[t].out.n )
+           {
+            perror( "nt: write" );
+            exit( errno );
+           }
+   }
+
+
+/* print the statistics table rows for every record in file f.  Anything */
+/* before the first header is skipped.                                   */
+
+void  stats_file( FILE *f )
+   {
+    static BUFFER  b = { NULL, 0, 0 };
+    size_t         n, end, scanned;
+    int            eof = 0;
+
+    b.n = 0;
+    scanned = 1;             /* a record start at 0 doesn't end a block */
+    while ( ! eof )
+       {
+        buf_need( &b, STATS_BLOCK );
+        n = fread( b.p + b.n, 1, STATS_BLOCK, f );
+        if ( n < STATS_BLOCK )
+           {
+            if ( ferror( f ) )
+               {
+                perror( "nt: read" );
+                exit( errno );
+               }
+            eof = 1;
+           }
+        b.n += n;
+        if ( eof )
+            end = b.n;
+        else
+           {                 /* find the start of the last record read */
+            for ( end = b.n - 1; end >= scanned && ! record_start( b.p, end );
+                  end-- )
+                ;
+            if ( end < scanned )
+               {             /* only one (incomplete) record: read more */
+                scanned = b.n;
+                continue;
+               }
+           }
+        stats_block( b.p, end );
+        memmove( b.p, b.p + end, b.n - end );
+        b.n -= end;
+        scanned = b.n > 0 ? b.n : 1;
+       }
+   }
+
+
+                       /**********************************/
+                       /* Run detection, BED output (-r) */
+                       /**********************************/
+
+/*****************************************************************************/
+/* With -r the input is read in blocks, and each sequence line is counted    */
+/* (into counts[], just as count_nts() does) and then scanned for runs of    */
+/* N, of lowercase (soft-masked) bases and, with -m, of one base.  The scan  */
+/* takes 8 bytes at a time: one word test tells whether all 8 continue the   */
+/* current runs (nothing starts or ends there), and only words where         */
+/* something changes are looked at byte by byte.                             */
+/*****************************************************************************/
+
+#define  RUN_BLOCK   (1 << 20)
+
+#define  ONES        0x0101010101010101ULL
+#define  HIGHS       0x8080808080808080ULL
+#define  LOWS        0x7f7f7f7f7f7f7f7fULL
+
+static long           run_pos;          /* position in current sequence */
+static long           n_start  = -1;    /* start of current runs, or -1 */
+static long           lc_start = -1;
+static long           hp_start = -1;
+static int            hp_base  = -1;    /* base of current homopolymer  */
+static int            run_name_len = -1;   /* length of name in header, */
+                                           /* -1 before the first one   */
+
+
+/* print one BED line, if the run is long enough */
+
+static inline void  emit_run( long start, long end, long min,
+                              const char *what )
+   {
+    if ( end - start >= min && run_name_len >= 0 )
+        fprintf( bed_file, "%.*s\t%ld\t%ld\t%s\n", run_name_len, header,
+                           start, end, what );
+   }
+
+
+/* end any runs still open at the end of a sequence, and start again */
+
+void  end_runs( void )
+   {
+    char  what[8];
+
+    if ( n_start >= 0 )
+        emit_run( n_start, run_pos, min_run, "N" );
+    if ( lc_start >= 0 )
+        emit_run( lc_start, run_pos, min_run, "lowercase" );
+    if ( hp_base >= 0 )
+       {
+        sprintf( what, "poly%c", hp_base );
+        emit_run( hp_start, run_pos, min_homopolymer, what );
+       }
+    n_start = lc_start = hp_start = hp_base = -1;
+    run_pos = 0;
+   }
+
+
+/* the byte by byte version, for one char c */
+
+static void  run_char( int c )
+   {
+    char  what[8];
+    int   u;
+
+    if ( ( c | LOWER_OFF ) == N + LOWER_OFF )
+       {
+        if ( n_start < 0 )
+            n_start = run_pos;
+       }
+    else if ( n_start >= 0 )
+       {
+        emit_run( n_start, run_pos, min_run, "N" );
+        n_start = -1;
+       }
+    if ( c >= A + LOWER_OFF && c <= 'z' )
+       {
+        if ( lc_start < 0 )
+            lc_start = run_pos;
+       }
+    else if ( lc_start >= 0 )
+       {
+        emit_run( lc_start, run_pos, min_run, "lowercase" );
+        lc_start = -1;
+       }
+    if ( min_homopolymer > 0 )
+       {
+        u = c & ~LOWER_OFF;
+        if ( u != hp_base )
+           {
+            if ( hp_base >= 0 )
+               {
+                sprintf( what, "poly%c", hp_base );
+                emit_run( hp_start, run_pos, min_homopolymer, what );
+               }
+            if ( u == A || u == C || u == G || u == T )
+               {
+                hp_base = u;
+                hp_start = run_pos;
+               }
+            else
+                hp_base = -1;
+           }
+       }
+    run_pos++;
+   }
+
+
+/* the SWAR masks: high bit of each byte of w which is N or n, or which */
+/* is lowercase                                                        */
+
+static inline uint64_t  n_mask( uint64_t w )
+   {
+    uint64_t  y = ( w | ( ONES * LOWER_OFF ) ) ^ ( ONES * ( N + LOWER_OFF ) );
+
+    return( ~( ( ( y & LOWS ) + LOWS ) | y ) & HIGHS );
+   }
+
+static inline uint64_t  lc_mask( uint64_t w )
+   {
+    uint64_t  x = w & LOWS;
+
+    return( ( x + ONES * ( 0x80 - 'a' ) ) & ~( x + ONES * ( 0x80 - 'z' - 1 ) )
+                & ~w & HIGHS );
+   }
+
+
+/* scan the sequence chars p[0..n-1] for runs */
+
+void  scan_runs( const unsigned char *p, size_t n )
+   {
+    uint64_t  w, hp_word;
+    size_t    i, j;
+
+    for ( i = 0; i + 8 <= n; i += 8 )
+       {
+        memcpy( &w, p + i, 8 );
+        hp_word = hp_base >= 0 ? ONES * hp_base : 0;
+        if ( n_mask( w ) == ( n_start >= 0 ? HIGHS : 0 )
+               && lc_mask( w ) == ( lc_start >= 0 ? HIGHS : 0 )
+               && ( min_homopolymer == 0
+                      || ( w & ~( ONES * LOWER_OFF ) ) == hp_word ) )
+            run_pos += 8;                     /* nothing changes */
+        else
+            for ( j = 0; j < 8; j++ )
+                run_char( p[i+j] );
+       }
+    for ( ; i < n; i++ )
+        run_char( p[i] );
+   }
+
+
+/* length of the name (first word) of header line h */
+
+int  name_length( const char *h )
+   {
+    int  n;
+
+    for ( n = 0; h[n] && ! isspace( (unsigned char) h[n] ); n++ )
+        ;
+    return( n );
+   }
+
+
+/* like count_nts(), but also finds the runs in each sequence */
+
+void  count_runs( FILE *f )
+   {
+    static unsigned char  buff[RUN_BLOCK];
+    unsigned char        *p, *q, *e;
+    size_t                n, i, len;
+    int                   in_header = 0;
+    int                   line_start = 1;
+    int                   h = 0;
+
+    run_name_len = -1;
+    while ( (n = fread( buff, 1, RUN_BLOCK, f )) > 0 )
+        for ( p = buff, e = buff + n; p < e; p = q )
+           {
+            if ( in_header )
+               {
+                if ( ! (q = memchr( p, '\n', e - p )) )
+                    q = e;
+                if ( h + ( q - p ) > MAX_HEADER_LEN )
+                   {
+                    header[MAX_HEADER_LEN] = '\0';
+                    fprintf( stderr, "header too long: %s\n", header );
+                    exit( 1 );
+                   }
+                memcpy( header + h, p, q - p );
+                h += q - p;
+                if ( q < e )
+                   {
+                    header[h] = '\0';
+                    run_name_len = name_length( header );
+                    in_header = 0;
+                    line_start = 1;
+                    q++;
+                   }
+               }
+            else if ( line_start && *p == '>' )
+               {
+                end_runs();
+                if ( n_seqs++ > 0 && report_by_sequence  )
+                   {
+                    report();
+                    clear_counts();
+                   }
+                in_header = 1;
+                h = 0;
+                q = p + 1;
+               }
+            else
+               {
+                if ( ! (q = memchr( p, '\n', e - p )) )
+                    q = e;
+                len = q - p;
+                for ( i = 0; i < len; i++ )
+                    counts[ p[i] ]++;
+                if ( len > 0 && p[len-1] == '\r' )
+                    len--;
+                scan_runs( p, len );
+                line_start = ( q < e );
+                if ( q < e )
+                   {
+                    counts['\n']++;
+                    q++;
+                   }
+               }
+           }
+    if ( ferror( f ) )
+       {
+        perror( "nt: read" );
+        exit( errno );
+       }
+    if ( in_header )
+       {
+        header[h] = '\0';
+        run_name_len = name_length( header );
+       }
+    end_runs();
+   }
+
+
                              /****************/
                              /* Main Program */
                              /****************/
@@ -367,13 +1021,32 @@ int main ( int argc, char **argv )
     FILE         *f;
 
     parse_args( argc, argv, &nfiles, &filenames );
+    if ( record_stats )
+       {
+        init_stats();
+        for ( i = 0; i < nfiles; i++ )
+           {
+            f = open_file( filenames[i] );
+            stats_file( f );
+            close_file( f );
+           }
+        exit( 0 );
+       }
     clear_counts();
     for ( i = 0; i < nfiles; i++ )
        { 
         f = open_file( filenames[i] );
-        count_nts( f );
+        if ( bed_file )
+            count_runs( f );
+        else
+            count_nts( f );
         close_file( f );
        }
     report();
+    if ( bed_file && fclose( bed_file ) != 0 )
+       {
+        perror( "nt: bed file" );
+        exit( errno );
+       }
    }
 
@@ -0,0 +1,622 @@
+/* Program:     orfs.c                                                       */
+/* Programmer:  Sean R. McCorkle                                             */
+/*              Biology Dept. Brookhaven National Laboratory                 */
+/* Language:    C                                                            */
+/*                                                                           */
+/* Description: Read DNA sequences and report ORFs in all reading frames,    */
+/*              both directions (a compiled orfs.pl, with the same options   */
+/*              and output)                                                  */
+/*                                                                           */
+/* Notes:       Each base is coded in 3 bits (A->0, C->1, G->2, T->3, and    */
+/*              anything else ->4), so a codon is a 9 bit index into a table */
+/*              of codon classes (start, stop or neither); any codon with a  */
+/*              bit 4 code is neither.  The complement of a code is code ^ 3 */
+/*              (which leaves the 4 bit set), so bottom strand codons index  */
+/*              the same table.                                              */
+/*                                                                           */
+/*              One pass over each sequence runs all six frames' start/stop  */
+/*              state machines: step i takes the top strand codon at i       */
+/*              (frame F(i%3+1)) and the bottom strand codon at i from the   */
+/*              other end (frame R(i%3+1)).  The ORFs found are then written */
+/*              out frame by frame, F1 first, as orfs.pl does.               */
+/*                                                                           */
+/*              Sequences are read a batch at a time and searched by -t      */
+/*              threads, each into its own output buffer, then written out   */
+/*              in input order.                                              */
+/*                                                                           */
+/* Compiling:   cc -O3 -o orfs orfs.c -lpthread                              */
+/*                                                                           */
+/*****************************************************************************/
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char rcsvers[] = "$Revision: 1.1 $";
+
+#define  MAX_THREADS     256
+#define  MAX_STARTS       64     /* in a -s list */
+#define  LINE_LEN         50     /* for fasta output */
+
+/* globals set by command line options */
+
+long  nt_thresh          = 300;            /* set by -l */
+char *start_codons       = "ATG,GTG,TTG";  /* set by -s */
+int   open_ended         = 0;              /* set by -W */
+int   n_threads          = 1;              /* set by -t */
+
+#define  BAD_BASE    4
+#define  NEITHER     0           /* codon classes */
+#define  START       1
+#define  STOP        2
+
+unsigned char  base_code[256];        /* char -> 3 bit code */
+unsigned char  is_space[256];         /* 1 if whitespace */
+unsigned char  codon_class[512];      /* 9 bit codon index -> class */
+char           complement[256];       /* as orfs.pl's rc() */
+
+
+/* version() - print program name and version */
+
+void  version( void )
+   {
+    char *v;
+    for ( v = rcsvers; *v && *v != ' '; v++ )
+        ;
+    v++;
+    v[strlen(v)-1] = '\0';
+    fprintf( stderr, "\norfs         version %s\n", v );
+   }
+
+
+/* usage() - print help */
+
+void usage( void )
+   {
+    fprintf( stderr, " \n\
+Usage:       orfs [-l<n>] [-W] [-s<cod>[,...]] [-t<n>] [-hV] [seq-file ...]\n\
+                                                                          \n\
+             where [seq-files] are in FASTA format.  The name \"-\" means \n\
+             stdin.  stdin is scanned it no filemames are specified.      \n\
+                                                                          \n\
+Options:     -l<n>   report ORF only if length meets or exceeds length    \n\
+                     of <n> (default 300)                                 \n\
+             -s<cod>[,...]  use specified codons for starts, rather than  \n\
+                     ATG, GTG and TTG (comma-separated)                   \n\
+             -W      assume sequence is a subsequence - report possible   \n\
+                     ORFs on 5' ends without a start (assume a start      \n\
+                     occured past the end of the sequence), and report    \n\
+                     possible orfs on 3' ends without stops.              \n\
+             -t<n>   search with <n> threads                              \n\
+             -V      print version                                        \n\
+             -h      print help message                                   \n\
+                                                                          \n\
+Output:      fasta DNA sequences for each orf.  Input sequence header is  \n\
+             prepended by a string describing the orf,                    \n\
+                                                                          \n\
+                <frame>-<start pos>-<length nt>-<start codon>-<stop codon>\n\
+                                                                          \n\
+             where frame is one of F1, F2, F3, R1, R2, or R3, for example \n\
+             F2-33497-678-TTG-TGA or R3-4192-1029-ATG-TGA                 \n\
+                                                                          \n\
+" );
+
+   }
+
+
+/* codon index of the (uppercase ACGT) triplet c */
+
+int  codon_index( const char *c )
+   {
+    return( ( base_code[ (int) c[0] ] << 6 ) | ( base_code[ (int) c[1] ] << 3 )
+                                             | base_code[ (int) c[2] ] );
+   }
+
+
+/* check_codons() verifies that s is a comma-separated list of DNA     */
+/* triplets (uppercase), and marks them as starts.  Error exits if not */
+
+void  check_codons( const char *s )
+   {
+    const char  *p;
+    int          i, n;
+
+    for ( n = 0, p = s; ; p += 4, n++ )
+       {
+        for ( i = 0; i < 3 && ( p[i] == 'A' || p[i] == 'C' || p[i] == 'G'
+                                            || p[i] == 'T' ); i++ )
+            ;
+        if ( i < 3 || ( p[3] != ',' && p[3] != '\0' ) || n >= MAX_STARTS )
+           {
+            fprintf( stderr, "bad codon list \"%s\"; must be comma-separated "
+                             "list of DNA triplets, ala ATG,TTG,GTG\n", s );
+            exit( 1 );
+           }
+        codon_class[ codon_index( p ) ] = START;
+        if ( p[3] == '\0' )
+            break;
+       }
+   }
+
+
+/* extract command line arguments and options */
+
+void parse_args ( int argc, char **argv, int *nfiles, char ***filenames )
+   {
+    static char *stand_in[] = { "-", (char *) 0 };
+    int    c;
+
+    while ( (c = getopt( argc, argv, "hl:s:t:VW")) != -1 )
+        switch ( c )
+           {
+            case 'l':  nt_thresh = atol( optarg );  break;
+            case 's':  start_codons = optarg;       break;
+            case 'W':  open_ended = 1;              break;
+            case 't':  n_threads = atoi( optarg );
+                       if ( n_threads < 1 || n_threads > MAX_THREADS )
+                          {
+                           fprintf( stderr, "-t must be in range 1-%d\n",
+                                            MAX_THREADS );
+                           exit( 1 );
+                          }
+                       break;
+            case 'V':  version();               exit(0);
+            case 'h':  version();
+                       usage();
+                       exit(0);
+            default:   usage();                 exit(1);
+           }
+    argc -= optind;
+    argv += optind;
+    if ( argc > 0 )
+       {
+        *nfiles = argc;
+        *filenames = argv;
+       }
+    else
+       {
+        *nfiles = 1;
+        *filenames = stand_in;
+       }
+   }
+
+
+/*********************************************************************/
+/* open_file() opens a file or returns stdin if name is "-", or does */
+/* error exit if file can't be opened                                */
+/*********************************************************************/
+
+FILE *open_file( char *name )
+   {
+    FILE *f;
+
+    if ( strcmp( name, "-" ) == 0 )
+        return( stdin );
+    else
+        if ( (f = fopen( name, "r" ) ) )
+            return( f );
+        else
+           {
+            perror( name );
+            exit( errno );
+           }
+   }
+
+
+/* close_file() closes the file unless its stdin */
+
+void  close_file( FILE *f )
+   {
+    if ( f != stdin )
+        fclose( f );
+   }
+
+
+void  *malloc_safely( size_t n_bytes )   /* malloc() or error exit */
+   {
+    void  *p;
+
+    if ( !(p = malloc( n_bytes )) )
+       {
+        fprintf( stderr, "failed to malloc %lu bytes\n",
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+void  *realloc_safely( void *p, size_t n_bytes )   /* same for realloc() */
+   {
+    if ( !(p = realloc( p, n_bytes )) )
+       {
+        fprintf( stderr, "failed to realloc %lu bytes\n",
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+
+/* set up the code and class tables */
+
+void  init( void )
+   {
+    static const char  bases[] = "ACGT";
+    static const char  from[]  = "acgtmrwsykvhdbnACGTMRWSYKVHDBN";
+    static const char  to[]    = "tgcakywsrmbdhvnTGCAKYWSRMBDHVN";
+    static const char *stops[] = { "TAA", "TAG", "TGA", NULL };
+    int                i;
+
+    memset( base_code, BAD_BASE, sizeof( base_code ) );
+    for ( i = 0; i < 4; i++ )
+        base_code[ (int) bases[i] ] = base_code[ tolower( bases[i] ) ] = i;
+    for ( i = 0; i < 256; i++ )
+       {
+        is_space[i] = isspace( i ) != 0;
+        complement[i] = i;
+       }
+    for ( i = 0; from[i]; i++ )
+        complement[ (int) from[i] ] = to[i];
+    check_codons( start_codons );
+    for ( i = 0; stops[i]; i++ )              /* a stop wins over a start */
+        codon_class[ codon_index( stops[i] ) ] = STOP;
+   }
+
+
+                     /*********************************/
+                     /* Batches of sequences, and the */
+                     /* threads searching them        */
+                     /*********************************/
+
+#define  BATCH_SEQS        65536      /* max sequences in one batch */
+#define  BATCH_BYTES       (64 << 20) /* stop filling a batch after this */
+
+typedef struct buffer {                       /* growable byte buffer */
+                        char    *p;
+                        size_t   n;
+                        size_t   size;
+                      } BUFFER;
+
+typedef struct record {
+                        size_t   hdr;         /* offsets into batch data */
+                        size_t   hdr_len;
+                        size_t   seq;
+                        size_t   seq_len;
+                        size_t   out;         /* offset and length of the */
+                        size_t   out_len;     /* orfs in its thread's out */
+                      } RECORD;
+
+typedef struct batch {
+                       BUFFER   data;         /* headers and sequences */
+                       RECORD  *recs;
+                       int      n;
+                     } BATCH;
+
+typedef struct orf {
+                     int    frame;            /* 0-2 F1-F3, 3-5 R1-R3 */
+                     long   a;                /* start and stop codon  */
+                     long   b;                /* positions on strand   */
+                   } ORF;
+
+typedef struct worker {
+                        pthread_t   thread;
+                        int         id;
+                        BATCH      *batch;
+                        uint8_t    *code;     /* the coded sequence      */
+                        size_t      size;
+                        ORF        *orfs;     /* found in a record       */
+                        size_t      n_orfs;
+                        size_t      size_orfs;
+                        BUFFER      out;      /* fasta orfs go here      */
+                      } WORKER;
+
+WORKER  workers[MAX_THREADS];
+
+
+void  buf_need( BUFFER *b, size_t n )          /* make room for n more */
+   {
+    if ( b->n + n <= b->size )
+        return;
+    if ( b->size == 0 )
+        b->size = 65536;
+    while ( b->n + n > b->size )
+        b->size *= 2;
+    b->p = realloc_safely( b->p, b->size );
+   }
+
+
+/* input is read a line at a time; line holds the next one to look at, */
+/* len its length (or -1 at end of file)                               */
+
+typedef struct reader {
+                        FILE     *f;
+                        char     *line;
+                        size_t    size;
+                        ssize_t   len;
+                      } READER;
+
+/* read up to BATCH_SEQS sequences (or about BATCH_BYTES) from rd; header */
+/* and sequence (with whitespace removed) go into b->data.  Returns the   */
+/* number read.  Anything before the first header is skipped.             */
+
+int  read_batch( READER *rd, BATCH *b )
+   {
+    RECORD  *r;
+    char    *d;
+    ssize_t  i, n;
+
+    b->n = 0;
+    b->data.n = 0;
+    while ( rd->len >= 0 && rd->line[0] != '>' )    /* find a header */
+        rd->len = getline( &rd->line, &rd->size, rd->f );
+    while ( rd->len >= 0 && b->n < BATCH_SEQS && b->data.n < BATCH_BYTES )
+       {
+        r = &b->recs[b->n++];
+        n = rd->len;
+        if ( n > 0 && rd->line[n-1] == '\n' )
+            n--;
+        buf_need( &b->data, n );
+        memcpy( b->data.p + b->data.n, rd->line + 1, n - 1 );
+        r->hdr = b->data.n;
+        r->hdr_len = n - 1;
+        b->data.n += n - 1;
+        r->seq = b->data.n;
+        while ( (rd->len = getline( &rd->line, &rd->size, rd->f )) >= 0
+                    && rd->line[0] != '>' )
+           {
+            buf_need( &b->data, rd->len );
+            d = b->data.p + b->data.n;
+            for ( i = 0; i < rd->len; i++ )
+               {
+                *d = rd->line[i];
+                d += ! is_space[ (unsigned char) rd->line[i] ];
+               }
+            b->data.n = d - b->data.p;
+           }
+        r->seq_len = b->data.n - r->seq;
+       }
+    return( b->n );
+   }
+
+
+void  add_orf( WORKER *w, int frame, long a, long b )
+   {
+    ORF  *o;
+
+    if ( w->n_orfs == w->size_orfs )
+       {
+        w->size_orfs = w->size_orfs ? 2 * w->size_orfs : 1024;
+        w->orfs = realloc_safely( w->orfs, w->size_orfs * sizeof( ORF ) );
+       }
+    o = &w->orfs[w->n_orfs++];
+    o->frame = frame;
+    o->a = a;
+    o->b = b;
+   }
+
+
+/* find the ORFs of at least nt_thresh in sequence s (length n) in all */
+/* six frames, in one pass, into w->orfs[].  start[f] is where the ORF */
+/* frame f is inside of starts, or -1 when it is outside of one.       */
+/* Bottom strand positions count from the other end.                   */
+
+void  find_orfs( WORKER *w, const unsigned char *s, long n )
+   {
+    uint8_t  *c;
+    long      start[6];
+    long      i, q, end;
+    int       f, cl;
+
+    if ( (size_t) n > w->size )
+       {
+        w->size = n + n / 2;
+        w->code = realloc_safely( w->code, w->size );
+       }
+    c = w->code;
+    for ( i = 0; i < n; i++ )
+        c[i] = base_code[ s[i] ];
+    w->n_orfs = 0;
+    for ( f = 0; f < 6; f++ )
+        start[f] = open_ended ? f % 3 : -1;
+    for ( i = 0, f = 0; i + 3 <= n; i++, f = ( f == 2 ? 0 : f + 1 ) )
+       {
+        cl = codon_class[ ( c[i] << 6 ) | ( c[i+1] << 3 ) | c[i+2] ];
+        if ( cl == START )
+           {
+            if ( start[f] < 0 )
+                start[f] = i;
+           }
+        else if ( cl == STOP && start[f] >= 0 )
+           {
+            if ( i - start[f] >= nt_thresh )
+                add_orf( w, f, start[f], i );
+            start[f] = -1;
+           }
+        q = n - 3 - i;
+        cl = codon_class[ ( (c[q+2] ^ 3) << 6 ) | ( (c[q+1] ^ 3) << 3 )
+                                                | ( c[q] ^ 3 ) ];
+        if ( cl == START )
+           {
+            if ( start[f+3] < 0 )
+                start[f+3] = i;
+           }
+        else if ( cl == STOP && start[f+3] >= 0 )
+           {
+            if ( i - start[f+3] >= nt_thresh )
+                add_orf( w, f + 3, start[f+3], i );
+            start[f+3] = -1;
+           }
+       }
+    if ( open_ended )                /* ORFs running off the 3' end */
+        for ( f = 0; f < 6; f++ )
+            if ( start[f] >= 0 )
+               {
+                end = f % 3 + 3 * ( ( n - f % 3 ) / 3 );
+                if ( end - start[f] >= nt_thresh )
+                    add_orf( w, f, start[f], end );
+               }
+   }
+
+
+/* copy the bases j to j+len-1 of strand (0 top, 1 bottom) of sequence */
+/* s (length n) to p.  Returns the end                                  */
+
+char  *strand_copy( char *p, const char *s, long n, int strand, long j,
+                    long len )
+   {
+    long  k;
+
+    if ( strand == 0 )
+       {
+        memcpy( p, s + j, len );
+        return( p + len );
+       }
+    for ( k = 0; k < len; k++ )
+        *p++ = complement[ (unsigned char) s[n - 1 - j - k] ];
+    return( p );
+   }
+
+
+/* append ORF o of record r to w->out, in fasta, as orfs.pl does */
+
+void  output_orf( WORKER *w, RECORD *r, ORF *o )
+   {
+    BUFFER      *out = &w->out;
+    const char  *s = w->batch->data.p + r->seq;
+    long         n = r->seq_len;
+    long         len_nt = o->b - o->a;
+    long         i, k;
+    int          strand = o->frame / 3;
+    char        *p;
+
+    buf_need( out, r->hdr_len + 100 + len_nt + len_nt / LINE_LEN + 1 );
+    p = out->p + out->n;
+    p += sprintf( p, ">%c%d-%ld-%ld-", strand ? 'R' : 'F', o->frame % 3 + 1,
+                  ( strand ? n - o->b : o->a ) + 1, len_nt );
+    if ( open_ended && o->a < 3 )             /* (-W: no start codon) */
+        p = (char *) memcpy( p, "???", 3 ) + 3;
+    else
+        p = strand_copy( p, s, n, strand, o->a, 3 );
+    *p++ = '-';
+    if ( open_ended && o->b >= n - 3 )        /* (-W: no stop codon) */
+        p = (char *) memcpy( p, "???", 3 ) + 3;
+    else
+        p = strand_copy( p, s, n, strand, o->b, 3 );
+    *p++ = ' ';
+    memcpy( p, w->batch->data.p + r->hdr, r->hdr_len );
+    p += r->hdr_len;
+    *p++ = '\n';
+    for ( i = 0; i < len_nt; i += k )
+       {
+        k = len_nt - i < LINE_LEN ? len_nt - i : LINE_LEN;
+        p = strand_copy( p, s, n, strand, o->a + i, k );
+        *p++ = '\n';
+       }
+    out->n = p - out->p;
+   }
+
+
+/* find and output the ORFs of record r, frame by frame */
+
+void  report_orfs( WORKER *w, RECORD *r )
+   {
+    size_t  i;
+    int     f;
+
+    r->out = w->out.n;
+    find_orfs( w, (unsigned char *) w->batch->data.p + r->seq, r->seq_len );
+    for ( f = 0; f < 6; f++ )
+        for ( i = 0; i < w->n_orfs; i++ )
+            if ( w->orfs[i].frame == f )
+                output_orf( w, r, &w->orfs[i] );
+    r->out_len = w->out.n - r->out;
+   }
+
+
+void  *worker( void *arg )
+   {
+    WORKER  *w = (WORKER *) arg;
+    BATCH   *b = w->batch;
+    int      i;
+
+    w->out.n = 0;
+    for ( i = w->id; i < b->n; i += n_threads )
+        report_orfs( w, &b->recs[i] );
+    return( NULL );
+   }
+
+
+/* find and write the ORFs of every sequence in file f */
+
+void  orfs_file( FILE *f, BATCH *b )
+   {
+    static READER  rd;
+    int            i, n;
+
+    rd.f = f;
+    rd.len = getline( &rd.line, &rd.size, f );
+    while ( (n = read_batch( &rd, b )) > 0 )
+       {
+        for ( i = 0; i < n_threads; i++ )
+            workers[i].batch = b;
+        if ( n_threads == 1 )
+            worker( &workers[0] );
+        else
+           {
+            for ( i = 0; i < n_threads; i++ )
+                if ( pthread_create( &workers[i].thread, NULL, worker,
+                                     &workers[i] ) != 0 )
+                   {
+                    perror( "can't create thread" );
+                    exit( 1 );
+                   }
+            for ( i = 0; i < n_threads; i++ )
+                pthread_join( workers[i].thread, NULL );
+           }
+        for ( i = 0; i < n; i++ )            /* out in input order */
+            if ( fwrite( workers[i % n_threads].out.p + b->recs[i].out, 1,
+                         b->recs[i].out_len, stdout ) != b->recs[i].out_len )
+               {
+                perror( "orfs: write" );
+                exit( errno );
+               }
+       }
+    if ( ferror( f ) )
+       {
+        perror( "orfs: read" );
+        exit( errno );
+       }
+   }
+
+
+                                /****************/
+                                /* Main Program */
+                                /****************/
+
+
+int main ( int argc, char **argv )
+   {
+    static BATCH   batch;
+    int            nfiles;
+    int            i;
+    static char  **filenames;
+    FILE          *f;
+
+    parse_args( argc, argv, &nfiles, &filenames );
+    init();
+    batch.recs = malloc_safely( BATCH_SEQS * sizeof( RECORD ) );
+    for ( i = 0; i < n_threads; i++ )
+        workers[i].id = i;
+    for ( i = 0; i < nfiles; i++ )
+       {
+        f = open_file( filenames[i] );
+        orfs_file( f, &batch );
+        close_file( f );
+       }
+    exit( 0 );
+   }
@@ -0,0 +1,1053 @@
+/* Program:     overlapper.c                                                 */
+/* Programmer:  Sean R. McCorkle                                             */
+/*              Biology Dept. Brookhaven National Laboratory                 */
+/* Language:    C                                                            */
+/*                                                                           */
+/* Description: Reports overlaps between two tables of chromosome intervals  */
+/*              (a compiled new_overlapper), or picks out SAM reads that     */
+/*              overlap a table of intervals (a compiled sam_overlapper).    */
+/*              Neither input needs to be sorted, and intervals in either    */
+/*              may overlap one another.                                     */
+/*                                                                           */
+/* Notes:       One file (b, or the intervals with -s) is read into memory,  */
+/*              by chromosome, and each chromosome's intervals are sorted by */
+/*              start and made into an implicit interval tree, as in Heng    */
+/*              Li's cgranges: the sorted array is read as a balanced binary */
+/*              tree (node i at level k has its low k bits set), and each    */
+/*              node gets the largest end in its subtree, so a query visits  */
+/*              only subtrees that can hold an overlap.  Chromosomes are     */
+/*              indexed by -t threads, one chromosome per thread at a time.  */
+/*                                                                           */
+/*              The other file is then read in blocks of whole lines, and    */
+/*              each block is cut into -t pieces, queried by that many       */
+/*              threads.  Each thread sorts its lines by chromosome and      */
+/*              start (a radix sort, as for the intervals) and queries them  */
+/*              in that order, so each query finds most of the tree nodes    */
+/*              it needs still in the cache from the one before, then        */
+/*              writes the results into its own output buffer in input       */
+/*              order; the buffers are written out in order.                 */
+/*                                                                           */
+/*              Intervals are <start> to <stop> inclusive, as in the perl    */
+/*              scripts.                                                     */
+/*                                                                           */
+/* Compiling:   cc -O3 -o overlapper overlapper.c -lpthread                  */
+/*                                                                           */
+/*****************************************************************************/
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char rcsvers[] = "$Revision: 1.1 $";
+
+#define  MAX_THREADS     256
+#define  BLOCK_SIZE      (16 << 20)   /* queries are read this much at a time */
+#define  MAX_LEVELS       64          /* of an interval tree */
+
+/* globals set by command line options */
+
+int   sam_input          = 0;      /* set by -s */
+int   invert             = 0;      /* set by -v */
+int   n_threads          = 1;      /* set by -t */
+
+unsigned char  is_space[256];      /* 1 if whitespace */
+
+
+/* version() - print program name and version */
+
+void  version( void )
+   {
+    char *v;
+    for ( v = rcsvers; *v && *v != ' '; v++ )
+        ;
+    v++;
+    v[strlen(v)-1] = '\0';
+    fprintf( stderr, "\noverlapper   version %s\n", v );
+   }
+
+
+/* usage() - print help */
+
+void usage( void )
+   {
+    fprintf( stderr, " \n\
+Usage:       overlapper [-t<n>] [-hV] a-file b-file                       \n\
+             overlapper -s [-v] [-t<n>] [-hV] interval-file sam-file      \n\
+                                                                          \n\
+             where a-file, b-file and interval-file are tables of         \n\
+                                                                          \n\
+                   <chr>  <start> <stop>  [<dir> [...]]                   \n\
+                                                                          \n\
+             (intervals include <start> and <stop>; blank lines and lines \n\
+             starting with # are skipped, or copied from the a-file).     \n\
+             Neither file need be sorted, and intervals in either may     \n\
+             overlap.  The name \"-\" means stdin.                        \n\
+                                                                          \n\
+             Prints each a-file line with four numbers added,             \n\
+                                                                          \n\
+                   <a-line> n m u v                                       \n\
+                                                                          \n\
+             where n is the number of b intervals overlapping the a       \n\
+             interval and m the number of bases they overlap by, and u    \n\
+             and v are the same for only those b intervals entirely       \n\
+             within the a interval (as new_overlapper).                   \n\
+                                                                          \n\
+Options:     -s      instead print the sam-file reads which overlap an    \n\
+                     interval (as sam_overlapper); a read spans the       \n\
+                     reference bases of its CIGAR (M, D, N, = and X).     \n\
+                     Header lines are printed; unmapped reads never       \n\
+                     overlap.                                             \n\
+             -v      with -s, print the reads which overlap no interval   \n\
+             -t<n>   index and query with <n> threads                     \n\
+             -V      print version                                        \n\
+             -h      print help message                                   \n\
+                                                                          \n\
+" );
+
+   }
+
+
+/* extract command line arguments and options */
+
+void parse_args ( int argc, char **argv, char **index_file,
+                  char **query_file )
+   {
+    int    c;
+
+    while ( (c = getopt( argc, argv, "hst:vV")) != -1 )
+        switch ( c )
+           {
+            case 's':  sam_input = 1;               break;
+            case 'v':  invert = 1;                  break;
+            case 't':  n_threads = atoi( optarg );
+                       if ( n_threads < 1 || n_threads > MAX_THREADS )
+                          {
+                           fprintf( stderr, "-t must be in range 1-%d\n",
+                                            MAX_THREADS );
+                           exit( 1 );
+                          }
+                       break;
+            case 'V':  version();               exit(0);
+            case 'h':  version();
+                       usage();
+                       exit(0);
+            default:   usage();                 exit(1);
+           }
+    argc -= optind;
+    argv += optind;
+    if ( argc != 2 )
+       {
+        usage();
+        exit( 1 );
+       }
+    if ( invert && ! sam_input )
+       {
+        fprintf( stderr, "-v only goes with -s\n" );
+        exit( 1 );
+       }
+    if ( sam_input )             /* the intervals are indexed, reads not */
+       {
+        *index_file = argv[0];
+        *query_file = argv[1];
+       }
+    else                         /* b is indexed, a lines are queries */
+       {
+        *index_file = argv[1];
+        *query_file = argv[0];
+       }
+    if ( strcmp( argv[0], "-" ) == 0 && strcmp( argv[1], "-" ) == 0 )
+       {
+        fprintf( stderr, "only one file can be stdin\n" );
+        exit( 1 );
+       }
+   }
+
+
+/*********************************************************************/
+/* open_file() opens a file or returns stdin if name is "-", or does */
+/* error exit if file can't be opened                                */
+/*********************************************************************/
+
+FILE *open_file( char *name )
+   {
+    FILE *f;
+
+    if ( strcmp( name, "-" ) == 0 )
+        return( stdin );
+    else
+        if ( (f = fopen( name, "r" ) ) )
+            return( f );
+        else
+           {
+            perror( name );
+            exit( errno );
+           }
+   }
+
+
+/* close_file() closes the file unless its stdin */
+
+void  close_file( FILE *f )
+   {
+    if ( f != stdin )
+        fclose( f );
+   }
+
+
+void  *malloc_safely( size_t n_bytes )   /* malloc() or error exit */
+   {
+    void  *p;
+
+    if ( !(p = malloc( n_bytes )) )
+       {
+        fprintf( stderr, "failed to malloc %lu bytes\n",
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+void  *realloc_safely( void *p, size_t n_bytes )   /* same for realloc() */
+   {
+    if ( !(p = realloc( p, n_bytes )) )
+       {
+        fprintf( stderr, "failed to realloc %lu bytes\n",
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+
+typedef struct buffer {                       /* growable byte buffer */
+                        char    *p;
+                        size_t   n;
+                        size_t   size;
+                      } BUFFER;
+
+void  buf_need( BUFFER *b, size_t n )          /* make room for n more */
+   {
+    if ( b->n + n <= b->size )
+        return;
+    if ( b->size == 0 )
+        b->size = 65536;
+    while ( b->n + n > b->size )
+        b->size *= 2;
+    b->p = realloc_safely( b->p, b->size );
+   }
+
+
+char  *fmt_uint( char *p, uint64_t v )
+   {
+    char  digits[24];
+    int   n = 0;
+
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+       } while ( v > 0 );
+    while ( n > 0 )
+        *p++ = digits[--n];
+    return( p );
+   }
+
+
+/* parse the integer at p (before e) into *v; returns the position */
+/* after it, or NULL if there isn't one                             */
+
+const char  *parse_int( const char *p, const char *e, int64_t *v )
+   {
+    int64_t  x = 0;
+    int      neg = 0;
+    const char  *s;
+
+    if ( p < e && ( *p == '-' || *p == '+' ) )
+        neg = *p++ == '-';
+    for ( s = p; p < e && *p >= '0' && *p <= '9'; p++ )
+        x = x * 10 + ( *p - '0' );
+    if ( p == s )
+        return( NULL );
+    *v = neg ? -x : x;
+    return( p );
+   }
+
+
+/* the first word in p..e-1, and where it ends */
+
+static inline const char  *word( const char *p, const char *e,
+                                 const char **w )
+   {
+    while ( p < e && is_space[ (unsigned char) *p ] )
+        p++;
+    *w = p;
+    while ( p < e && ! is_space[ (unsigned char) *p ] )
+        p++;
+    return( p );
+   }
+
+
+/* parse the chromosome, start and stop of interval table line p..e-1; */
+/* returns 0 for a line to skip, 1 for an interval, and -1 if it's bad */
+
+int  parse_interval( const char *p, const char *e, const char **chr,
+                     size_t *chr_len, int64_t *start, int64_t *stop )
+   {
+    const char  *w, *q;
+
+    p = word( p, e, chr );
+    *chr_len = p - *chr;
+    if ( *chr_len == 0 || **chr == '#' )
+        return( 0 );
+    p = word( p, e, &w );
+    if ( ! (q = parse_int( w, p, start )) || q != p )
+        return( -1 );
+    p = word( p, e, &w );
+    if ( ! (q = parse_int( w, p, stop )) || q != p )
+        return( -1 );
+    return( 1 );
+   }
+
+
+                  /*****************************************/
+                  /* Chromosomes and their interval trees  */
+                  /*****************************************/
+
+typedef struct iv {
+                    int64_t  start;
+                    int64_t  end;           /* one past the stop */
+                    int64_t  max;           /* largest end in subtree */
+                  } IV;
+
+typedef struct chrom {
+                       char     *name;
+                       IV       *iv;
+                       size_t    n;
+                       size_t    size;
+                       int       levels;    /* of the tree */
+                     } CHROM;
+
+CHROM     *chroms = NULL;
+uint32_t   n_chroms = 0;
+uint32_t  *chrom_slots = NULL;     /* hash table: chroms index + 1 or 0 */
+size_t     n_chrom_slots = 0;      /* a power of 2 */
+
+
+static inline uint32_t  hash_name( const char *s, size_t n )
+   {
+    uint32_t  h = 2166136261U;                  /* FNV-1a */
+
+    while ( n-- > 0 )
+        h = ( h ^ (unsigned char) *s++ ) * 16777619U;
+    return( h );
+   }
+
+
+/* the chroms index of the chromosome named s (length n), or -1 */
+
+long  find_chrom( const char *s, size_t n )
+   {
+    size_t    i;
+    uint32_t  c;
+
+    if ( n_chrom_slots == 0 )
+        return( -1 );
+    for ( i = hash_name( s, n ) & ( n_chrom_slots - 1 ); (c = chrom_slots[i]);
+          i = ( i + 1 ) & ( n_chrom_slots - 1 ) )
+        if ( strncmp( chroms[c-1].name, s, n ) == 0
+                && chroms[c-1].name[n] == '\0' )
+            return( c - 1 );
+    return( -1 );
+   }
+
+
+/* the chroms index of the chromosome named s (length n), added if new */
+
+uint32_t  add_chrom( const char *s, size_t n )
+   {
+    long      c = find_chrom( s, n );
+    size_t    i, j;
+
+    if ( c >= 0 )
+        return( c );
+    if ( 2 * ( n_chroms + 1 ) > n_chrom_slots )       /* keep half empty */
+       {
+        n_chrom_slots = n_chrom_slots == 0 ? 1024 : 2 * n_chrom_slots;
+        free( chrom_slots );
+        chrom_slots = malloc_safely( n_chrom_slots * sizeof( uint32_t ) );
+        memset( chrom_slots, 0, n_chrom_slots * sizeof( uint32_t ) );
+        for ( j = 0; j < n_chroms; j++ )
+           {
+            for ( i = hash_name( chroms[j].name, strlen( chroms[j].name ) )
+                          & ( n_chrom_slots - 1 ); chrom_slots[i];
+                  i = ( i + 1 ) & ( n_chrom_slots - 1 ) )
+                ;
+            chrom_slots[i] = j + 1;
+           }
+        chroms = realloc_safely( chroms, n_chrom_slots / 2 * sizeof( CHROM ) );
+       }
+    memset( &chroms[n_chroms], 0, sizeof( CHROM ) );
+    chroms[n_chroms].name = malloc_safely( n + 1 );
+    memcpy( chroms[n_chroms].name, s, n );
+    chroms[n_chroms].name[n] = '\0';
+    for ( i = hash_name( s, n ) & ( n_chrom_slots - 1 ); chrom_slots[i];
+          i = ( i + 1 ) & ( n_chrom_slots - 1 ) )
+        ;
+    chrom_slots[i] = n_chroms + 1;
+    return( n_chroms++ );
+   }
+
+
+/* read the intervals of file f into chroms[] */
+
+void  read_index( FILE *f, char *name )
+   {
+    char        *line = NULL;
+    size_t       size = 0;
+    ssize_t      len;
+    const char  *chr;
+    size_t       chr_len;
+    int64_t      start, stop;
+    CHROM       *c = NULL;
+    uint32_t     k;
+    long         n_line = 0;
+
+    while ( (len = getline( &line, &size, f )) >= 0 )
+       {
+        n_line++;
+        switch ( parse_interval( line, line + len, &chr, &chr_len, &start,
+                                 &stop ) )
+           {
+            case 0:   continue;
+            case -1:  fprintf( stderr, "bad interval at line %ld of %s\n",
+                                       n_line, name );
+                      exit( 1 );
+           }
+        if ( stop < start )
+            continue;                 /* empty: can't overlap anything */
+        if ( ! c || strncmp( chr, c->name, chr_len ) != 0
+                 || c->name[chr_len] != '\0' )
+           {
+            k = add_chrom( chr, chr_len );   /* (may move chroms) */
+            c = &chroms[k];
+           }
+        if ( c->n >= c->size )
+           {
+            c->size = c->size == 0 ? 1024 : 2 * c->size;
+            c->iv = realloc_safely( c->iv, c->size * sizeof( IV ) );
+           }
+        c->iv[c->n].start = start;
+        c->iv[c->n].end = stop + 1;
+        c->n++;
+       }
+    if ( ferror( f ) )
+       {
+        perror( name );
+        exit( errno );
+       }
+    free( line );
+   }
+
+
+/* sort the n records of a (size bytes each) by the uint64_t at their */
+/* start: least significant digit radix sort, 16 bits at a time, with */
+/* tmp (as big as a) to copy between, as far as the highest key bit   */
+
+void  radix_sort( void *a, size_t n, size_t size, void *tmp )
+   {
+    size_t        *count = malloc_safely( 65536 * sizeof( size_t ) );
+    char          *from = (char *) a, *to = (char *) tmp, *t;
+    uint64_t       key, all = 0;
+    size_t         i, sum, c;
+    int            shift;
+
+    for ( i = 0; i < n; i++ )
+       {
+        memcpy( &key, from + i * size, sizeof( key ) );
+        all |= key;
+       }
+    for ( shift = 0; shift < 64 && ( all >> shift ) != 0; shift += 16 )
+       {
+        memset( count, 0, 65536 * sizeof( size_t ) );
+        for ( i = 0; i < n; i++ )
+           {
+            memcpy( &key, from + i * size, sizeof( key ) );
+            count[ ( key >> shift ) & 0xffff ]++;
+           }
+        for ( sum = 0, i = 0; i < 65536; i++ )
+           {
+            c = count[i];
+            count[i] = sum;
+            sum += c;
+           }
+        for ( i = 0; i < n; i++ )
+           {
+            memcpy( &key, from + i * size, sizeof( key ) );
+            memcpy( to + count[ ( key >> shift ) & 0xffff ]++ * size,
+                    from + i * size, size );
+           }
+        t = from;
+        from = to;
+        to = t;
+       }
+    if ( from != (char *) a )
+        memcpy( a, from, n * size );
+    free( count );
+   }
+
+
+int  by_start( const void *a, const void *b )
+   {
+    const IV  *x = (const IV *) a;
+    const IV  *y = (const IV *) b;
+
+    return( x->start < y->start ? -1 : x->start > y->start );
+   }
+
+
+/* sort c's intervals by start and fill in the max ends of the implicit */
+/* tree (cgranges' cr_index_core())                                      */
+
+void  index_chrom( CHROM *c )
+   {
+    IV       *a = c->iv;
+    int64_t   n = c->n;
+    int64_t   i, last_i = 0, last = 0, x, i0, step, e;
+    IV       *tmp;
+    int       k;
+
+    for ( i = 1; i < n && a[i-1].start <= a[i].start; i++ )
+        ;
+    if ( i < n )
+       {
+        for ( i = 0; i < n && a[i].start >= 0; i++ )
+            ;
+        if ( n < 4096 || i < n )         /* small, or negative starts */
+            qsort( a, n, sizeof( IV ), by_start );
+        else
+           {
+            tmp = malloc_safely( n * sizeof( IV ) );
+            radix_sort( a, n, sizeof( IV ), tmp );
+            free( tmp );
+           }
+       }
+    for ( i = 0; i < n; i += 2 )                /* leaves */
+       {
+        last_i = i;
+        last = a[i].max = a[i].end;
+       }
+    for ( k = 1; ( (int64_t) 1 << k ) <= n; k++ )
+       {
+        x = (int64_t) 1 << ( k - 1 );
+        i0 = ( x << 1 ) - 1;
+        step = x << 2;
+        for ( i = i0; i < n; i += step )
+           {
+            e = a[i].end;
+            if ( a[i-x].max > e )
+                e = a[i-x].max;
+            if ( ( i + x < n ? a[i+x].max : last ) > e )
+                e = i + x < n ? a[i+x].max : last;
+            a[i].max = e;
+           }
+        last_i = ( last_i >> k ) & 1 ? last_i - x : last_i + x;
+        if ( last_i < n && a[last_i].max > last )
+            last = a[last_i].max;
+       }
+    c->levels = k - 1;
+   }
+
+
+/* results of a query */
+
+typedef struct counts {
+                        uint64_t  n;        /* overlapping intervals */
+                        uint64_t  m;        /* bases overlapped */
+                        uint64_t  u;        /* same, for those within */
+                        uint64_t  v;
+                      } COUNTS;
+
+
+/* find the intervals of c overlapping [st, en) (cgranges'         */
+/* cr_overlap_int()) and count them into r; with r NULL, just return */
+/* 1 at the first                                                    */
+
+int  overlap( const CHROM *c, int64_t st, int64_t en, COUNTS *r )
+   {
+    struct { int64_t x; int k, w; }  stack[MAX_LEVELS+1];
+    const IV  *a = c->iv;
+    int64_t    n = c->n;
+    int64_t    i, i0, i1, y, x, lo, hi;
+    int        t = 0, k, w;
+
+    if ( n == 0 )
+        return( 0 );
+    stack[t].k = c->levels;
+    stack[t].x = ( (int64_t) 1 << c->levels ) - 1;
+    stack[t++].w = 0;
+    while ( t > 0 )
+       {
+        t--;
+        x = stack[t].x;
+        k = stack[t].k;
+        w = stack[t].w;
+        if ( k <= 3 )
+           {                     /* small subtree: look at them all */
+            i0 = x >> k << k;
+            i1 = i0 + ( (int64_t) 1 << ( k + 1 ) ) - 1;
+            if ( i1 > n )
+                i1 = n;
+            for ( i = i0; i < i1 && a[i].start < en; i++ )
+                if ( st < a[i].end )
+                   {
+                    if ( ! r )
+                        return( 1 );
+                    lo = a[i].start > st ? a[i].start : st;
+                    hi = a[i].end < en ? a[i].end : en;
+                    r->n++;
+                    r->m += hi - lo;
+                    if ( a[i].start >= st && a[i].end <= en )
+                       {
+                        r->u++;
+                        r->v += a[i].end - a[i].start;
+                       }
+                   }
+           }
+        else if ( w == 0 )
+           {                     /* left child not looked at yet */
+            y = x - ( (int64_t) 1 << ( k - 1 ) );
+            stack[t].x = x;
+            stack[t].k = k;
+            stack[t++].w = 1;
+            if ( y >= n || a[y].max > st )
+               {
+                stack[t].x = y;
+                stack[t].k = k - 1;
+                stack[t++].w = 0;
+               }
+           }
+        else if ( x < n && a[x].start < en )
+           {                     /* x itself, then the right child */
+            if ( st < a[x].end )
+               {
+                if ( ! r )
+                    return( 1 );
+                lo = a[x].start > st ? a[x].start : st;
+                hi = a[x].end < en ? a[x].end : en;
+                r->n++;
+                r->m += hi - lo;
+                if ( a[x].start >= st && a[x].end <= en )
+                   {
+                    r->u++;
+                    r->v += a[x].end - a[x].start;
+                   }
+               }
+            stack[t].x = x + ( (int64_t) 1 << ( k - 1 ) );
+            stack[t].k = k - 1;
+            stack[t++].w = 0;
+           }
+       }
+    return( r ? r->n > 0 : 0 );
+   }
+
+
+                   /*************************************/
+                   /* Threads: indexing chromosomes,    */
+                   /* and querying blocks of lines      */
+                   /*************************************/
+
+typedef struct worker {
+                        pthread_t   thread;
+                        const char *data;     /* block */
+                        size_t      from;     /* this thread's lines */
+                        size_t      to;
+                        struct query *queries;   /* its lines */
+                        size_t      n_queries;
+                        size_t      queries_size;
+                        struct key *keys;     /* to sort them by */
+                        size_t      n_keys;
+                        BUFFER      out;      /* output goes here */
+                      } WORKER;
+
+WORKER    workers[MAX_THREADS];
+uint32_t  next_chrom;              /* for the index threads to take */
+
+
+void  *index_worker( void *arg )
+   {
+    uint32_t  c;
+
+    (void) arg;
+    while ( (c = __atomic_fetch_add( &next_chrom, 1, __ATOMIC_RELAXED ))
+                < n_chroms )
+        index_chrom( &chroms[c] );
+    return( NULL );
+   }
+
+
+int  by_size( const void *a, const void *b )
+   {
+    const CHROM  *x = (const CHROM *) a;
+    const CHROM  *y = (const CHROM *) b;
+
+    return( x->n > y->n ? -1 : x->n < y->n );
+   }
+
+
+/* index every chromosome, biggest first so the threads finish together */
+
+void  index_all( void )
+   {
+    uint32_t  c;
+    size_t    i;
+    int       t;
+
+    qsort( chroms, n_chroms, sizeof( CHROM ), by_size );
+    memset( chrom_slots, 0, n_chrom_slots * sizeof( uint32_t ) );
+    for ( c = 0; c < n_chroms; c++ )           /* rehash in new order */
+       {
+        for ( i = hash_name( chroms[c].name, strlen( chroms[c].name ) )
+                      & ( n_chrom_slots - 1 ); chrom_slots[i];
+              i = ( i + 1 ) & ( n_chrom_slots - 1 ) )
+            ;
+        chrom_slots[i] = c + 1;
+       }
+    next_chrom = 0;
+    if ( n_threads == 1 )
+        index_worker( NULL );
+    else
+       {
+        for ( t = 0; t < n_threads; t++ )
+            if ( pthread_create( &workers[t].thread, NULL, index_worker,
+                                 NULL ) != 0 )
+               {
+                perror( "can't create thread" );
+                exit( 1 );
+               }
+        for ( t = 0; t < n_threads; t++ )
+            pthread_join( workers[t].thread, NULL );
+       }
+   }
+
+
+/* reference span of a SAM read at pos with CIGAR cigar (to e): M, D, */
+/* N, = and X ops; -1 if the CIGAR is bad                              */
+
+int64_t  cigar_span( const char *p, const char *e )
+   {
+    int64_t  span = 0, n;
+
+    while ( p < e )
+       {
+        if ( ! (p = parse_int( p, e, &n )) || p >= e )
+            return( -1 );
+        switch ( *p++ )
+           {
+            case 'M': case 'D': case 'N': case '=': case 'X':
+                      span += n;
+                      break;
+            case 'I': case 'S': case 'H': case 'P':
+                      break;
+            default:  return( -1 );
+           }
+       }
+    return( span );
+   }
+
+
+/* the chromosome (chroms index) and reference interval [*st, *en) of */
+/* the SAM read in p..e-1, or -1 if it's unmapped or on no chromosome */
+/* with intervals                                                       */
+
+long  sam_interval( const char *p, const char *e, int64_t *st, int64_t *en )
+   {
+    const char  *f[6];
+    const char  *q;
+    int64_t      flag, span;
+    int          i;
+
+    for ( i = 0; i < 6; i++ )                /* the first 6 fields */
+       {
+        f[i] = p;
+        if ( i < 5 )
+           {
+            if ( ! (q = memchr( p, '\t', e - p )) )
+                return( -1 );
+            p = q + 1;
+           }
+       }
+    if ( ! (q = memchr( p, '\t', e - p )) )
+        q = e;
+    if ( ! parse_int( f[1], f[2], &flag ) || ( flag & 4 )
+            || ! parse_int( f[3], f[4], st ) || *st <= 0
+            || (span = cigar_span( f[5], q )) <= 0 )
+        return( -1 );                        /* unmapped, or no CIGAR */
+    *en = *st + span;
+    return( find_chrom( f[2], f[3] - f[2] - 1 ) );
+   }
+
+
+/* a line of the block to query, or to pass through */
+
+typedef struct query {
+                       size_t    line;      /* offset in the block */
+                       size_t    len;
+                       long      chrom;     /* or -1 for no overlaps */
+                       int64_t   start;     /* [start, end) */
+                       int64_t   end;
+                       int       pass;      /* 1 to copy unchanged */
+                       COUNTS    r;
+                     } QUERY;
+
+typedef struct key {
+                     uint64_t  key;         /* chromosome, start */
+                     uint32_t  i;           /* index into queries */
+                   } KEY;
+
+
+int  by_key( const void *a, const void *b )
+   {
+    const KEY  *x = (const KEY *) a;
+    const KEY  *y = (const KEY *) b;
+
+    return( x->key < y->key ? -1 : x->key > y->key );
+   }
+
+
+/* read the lines in w's range of the block into w->queries */
+
+void  parse_queries( WORKER *w )
+   {
+    const char  *d = w->data;
+    const char  *q, *chr, *last = NULL;
+    size_t       i, e, chr_len, last_len = 0;
+    int64_t      stop;
+    long         c = -1;
+    QUERY       *u;
+
+    w->n_queries = 0;
+    w->n_keys = 0;
+    for ( i = w->from; i < w->to; i = e + 1 )
+       {
+        q = memchr( d + i, '\n', w->to - i );
+        e = q ? (size_t) ( q - d ) : w->to;
+        if ( w->n_queries >= w->queries_size )
+           {
+            w->queries_size = w->queries_size == 0 ? 65536
+                                                   : 2 * w->queries_size;
+            w->queries = realloc_safely( w->queries,
+                                         w->queries_size * sizeof( QUERY ) );
+            w->keys = realloc_safely( w->keys,             /* and tmp */
+                                      2 * w->queries_size * sizeof( KEY ) );
+           }
+        u = &w->queries[ w->n_queries ];
+        memset( u, 0, sizeof( QUERY ) );
+        u->line = i;
+        u->len = e - i;
+        u->chrom = -1;
+        if ( sam_input )
+           {
+            if ( d[i] == '@' )
+                u->pass = 1;
+            else
+                u->chrom = sam_interval( d + i, d + e, &u->start, &u->end );
+           }
+        else
+           {
+            switch ( parse_interval( d + i, d + e, &chr, &chr_len,
+                                     &u->start, &stop ) )
+               {
+                case 0:   u->pass = 1;
+                          break;
+                case -1:  fprintf( stderr, "bad interval: %.*s\n",
+                                           (int) ( e - i ), d + i );
+                          exit( 1 );
+                default:  if ( ! last || chr_len != last_len
+                                      || memcmp( chr, last, chr_len ) )
+                             {
+                              c = find_chrom( chr, chr_len );
+                              last = chr;
+                              last_len = chr_len;
+                             }
+                          u->end = stop + 1;
+                          u->chrom = stop >= u->start ? c : -1;
+               }
+           }
+        if ( u->chrom >= 0 )
+           {
+            w->keys[ w->n_keys ].key = ( (uint64_t) u->chrom << 40 )
+                                     | ( u->start > 0 ? u->start : 0 );
+            w->keys[ w->n_keys++ ].i = w->n_queries;
+           }
+        w->n_queries++;
+       }
+   }
+
+
+/* query the lines in w's range of the block: in order of chromosome */
+/* and start, so that one query finds the tree nodes the last one    */
+/* left in the cache; results are then written in input order        */
+
+void  *query_worker( void *arg )
+   {
+    WORKER      *w = (WORKER *) arg;
+    BUFFER      *o = &w->out;
+    const char  *d = w->data;
+    QUERY       *u;
+    size_t       k;
+    char        *p;
+
+    parse_queries( w );
+    if ( w->n_keys < 4096 )
+        qsort( w->keys, w->n_keys, sizeof( KEY ), by_key );
+    else
+        radix_sort( w->keys, w->n_keys, sizeof( KEY ),
+                    w->keys + w->queries_size );
+    for ( k = 0; k < w->n_keys; k++ )
+       {
+        u = &w->queries[ w->keys[k].i ];
+        if ( sam_input )
+            u->r.n = overlap( &chroms[u->chrom], u->start, u->end, NULL );
+        else
+            overlap( &chroms[u->chrom], u->start, u->end, &u->r );
+       }
+    o->n = 0;
+    for ( k = 0; k < w->n_queries; k++ )
+       {
+        u = &w->queries[k];
+        if ( sam_input && ! u->pass && ( u->r.n > 0 ) == invert )
+            continue;
+        buf_need( o, u->len + 4 * 24 );
+        memcpy( o->p + o->n, d + u->line, u->len );
+        p = o->p + o->n + u->len;
+        if ( ! sam_input && ! u->pass )
+           {
+            *p++ = ' ';
+            p = fmt_uint( p, u->r.n );
+            *p++ = ' ';
+            p = fmt_uint( p, u->r.m );
+            *p++ = ' ';
+            p = fmt_uint( p, u->r.u );
+            *p++ = ' ';
+            p = fmt_uint( p, u->r.v );
+           }
+        *p++ = '\n';
+        o->n = p - o->p;
+       }
+    return( NULL );
+   }
+
+
+/* query the lines d[0..n-1] and write out the results */
+
+void  query_block( char *d, size_t n )
+   {
+    const char  *q;
+    size_t       c;
+    int          t;
+
+    for ( t = 0; t < n_threads; t++ )
+       {
+        workers[t].data = d;
+        workers[t].from = t == 0 ? 0 : workers[t-1].to;
+        c = n * (t + 1) / n_threads;         /* to the end of a line */
+        if ( c < workers[t].from )
+            c = workers[t].from;
+        q = c < n ? memchr( d + c, '\n', n - c ) : NULL;
+        workers[t].to = q ? (size_t) ( q - d + 1 ) : n;
+       }
+    if ( n_threads == 1 )
+        query_worker( &workers[0] );
+    else
+       {
+        for ( t = 0; t < n_threads; t++ )
+            if ( pthread_create( &workers[t].thread, NULL, query_worker,
+                                 &workers[t] ) != 0 )
+               {
+                perror( "can't create thread" );
+                exit( 1 );
+               }
+        for ( t = 0; t < n_threads; t++ )
+            pthread_join( workers[t].thread, NULL );
+       }
+    for ( t = 0; t < n_threads; t++ )        /* out in input order */
+        if ( fwrite( workers[t].out.p, 1, workers[t].out.n, stdout )
+                != workers[t].out.n )
+           {
+            perror( "overlapper: write" );
+            exit( errno );
+           }
+   }
+
+
+/* query every line of file f, a block of whole lines at a time */
+
+void  query_file( FILE *f, char *name )
+   {
+    char        *b;
+    const char  *q;
+    size_t       n = 0, m, end, size = 2 * BLOCK_SIZE;
+    int          eof = 0;
+
+    b = malloc_safely( size );
+    while ( ! eof )
+       {
+        if ( n + BLOCK_SIZE > size )
+            b = realloc_safely( b, size = n + BLOCK_SIZE );
+        m = fread( b + n, 1, BLOCK_SIZE, f );
+        if ( m < BLOCK_SIZE )
+           {
+            if ( ferror( f ) )
+               {
+                perror( name );
+                exit( errno );
+               }
+            eof = 1;
+           }
+        n += m;
+        if ( eof )
+            end = n;
+        else
+           {
+            for ( q = b + n; q > b && q[-1] != '\n'; q-- )
+                ;
+            end = q - b;
+            if ( end == 0 )
+                continue;         /* a line longer than a block */
+           }
+        if ( end > 0 )
+            query_block( b, end );
+        memmove( b, b + end, n - end );
+        n -= end;
+       }
+    free( b );
+   }
+
+
+                                /****************/
+                                /* Main Program */
+                                /****************/
+
+
+int main ( int argc, char **argv )
+   {
+    char  *index_file, *query;
+    FILE  *f;
+    int    i;
+
+    parse_args( argc, argv, &index_file, &query );
+    for ( i = 0; i < 256; i++ )
+        is_space[i] = isspace( i ) != 0;
+    f = open_file( index_file );
+    read_index( f, index_file );
+    close_file( f );
+    index_all();
+    f = open_file( query );
+    query_file( f, query );
+    close_file( f );
+    exit( 0 );
+   }
@@ -6,7 +6,8 @@
 /* Description: Search DNA sequence files (FASTA format) for candidate       */
 /*              promoter sequences, with adjustable mismatch threshold       */
 /*                                                                           */
-/* Usage:       prosearch [-aBmNSFvhV] <pat> [<file> [...]]                  */
+/* Usage:       prosearch [-abBcCDemNSFvhV] <pat> [<file> [...]]             */
+/*              prosearch -W<cache> [<file> [...]]                           */
 /*                                                                           */
 /*              where <file>s are DNA sequence files (FASTA format).  If no  */
 /*              files are given, stdin is scanned.  "-" may also be used as  */
@@ -34,9 +35,20 @@
 /* Options:     -a<n>  accept up to <n> ambiguity codes in the search        */
 /*                     sequence for any match (either upper or lower case    */
 /*                     in the pattern is matched)                            */
+/*              -b     write hits as BED (name, start, end, direction,       */
+/*                     mismatches, strand) instead of the usual output       */
 /*              -B<n>  Bisulfite modify the DNA before matching              */
 /*                      -B1    change all C -> T except C's in CpGs          */
 /*                      -B2    change all C -> T including C's in CpGs       */
+/*              -e<n>  approximate search: accept matches within edit        */
+/*                     distance <n> (substitutions, insertions, deletions)   */
+/*                     in LOWER case positions of <pat>; replaces -m         */
+/*              -c     print only hit counts for each sequence: name, hits   */
+/*                     per direction (f r, or f r u v with -B) and total     */
+/*              -C<f>  search the bisulfite cache <f> (made by -W) instead   */
+/*                     of FASTA files.  Implies -B2 unless -B1 is given      */
+/*              -D<n>  print hit density, the number of hits starting in each*/
+/*                     <n> base bin of each sequence, as a bedGraph track    */
 /*              -m<n>  accept up to <n> mismatches in LOWER case bases in    */
 /*                     <pat>.  Default is 0 (exact matches).                 */
 /*              -N<n>   print neighborhood <n> on each side                  */
@@ -45,6 +57,8 @@
 /*              -v     verbose output                                        */
 /*              -h     print help, then exit                                 */
 /*              -V     print version, then exit                              */
+/*              -W<f>  convert the FASTA <file>s to a bisulfite cache <f>    */
+/*                     and exit (no <pat> is given in this case)             */
 /*                                                                           */
 /* Example:       prosearch -m1  GCAcct.ac                                   */
 /*                                                                           */
@@ -61,15 +75,48 @@
 /*             FIRST possible match is reported.  This may impact any        */
 /*             statistical analysis performed on the output of this program  */
 /*                                                                           */
+/*             Approximate search (-e):  Myers' bit-vector algorithm scans   */
+/*             <pat> and its reverse complement in one streaming pass, and   */
+/*             each candidate end position is then verified with a small     */
+/*             dynamic programming alignment in which uppercase positions    */
+/*             can't be substituted or deleted, and no bases can be inserted */
+/*             between two adjacent uppercase positions.  Of a run of        */
+/*             adjacent candidate end positions, only the best is reported.  */
+/*             <pat> is limited to 64 positions, -N is not available, and    */
+/*             ambiguity codes in the sequence always count as mismatches.   */
+/*                                                                           */
+/*             Only one of -b, -c and -D may be given, as each writes its    */
+/*             own table to stdout (-N can't be used with them either);      */
+/*             their output is written through one large buffer.             */
+/*                                                                           */
+/*             Bisulfite cache (-W, -C):  both converted strands (C->T of    */
+/*             the top strand, and G->A of the top strand, which is the      */
+/*             reverse complement of the converted bottom strand) are 2-bit  */
+/*             packed along with a CpG-context mask, so that -B1 can restore */
+/*             the protected C's (G's) at search time.  Ambiguity codes are  */
+/*             kept in a per-record exception list.  Cached searches enter   */
+/*             both strands in one pass and give the same hits, in the same  */
+/*             order, as searching the FASTA files, except that matched      */
+/*             bases are printed in uppercase.  The cache is written in      */
+/*             native byte order.                                            */
+/*                                                                           */
+/*             -B1 (FASTA or cache) leaves the C's of CpGs, and the G's      */
+/*             (the bottom strand's C's), unconverted.  Up to v1.9 it        */
+/*             converted them, exactly as -B2 does.                          */
 /*                                                                           */
 /*****************************************************************************/
 
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
 #define MAX_HDR_LEN      256
@@ -77,6 +124,8 @@
 #define MAX_STR_LEN      256
 #define MAX_NEIGHBOR_LEN 50
 #define MAX_BUFF_LEN     (MAX_NEIGHBOR_LEN  + MAX_PAT_LEN + MAX_NEIGHBOR_LEN)
+#define MAX_APPROX_LEN   64    /* max <pat> length for -e (bits in a word) */
+#define MAX_EDIT_DIST    (MAX_APPROX_LEN - 1)
 
 #ifndef NULL
 #define NULL        ((void *) 0)
@@ -91,11 +140,18 @@ int   buff_len;
 
 int   amb_thresh      = 0;   /* set by -a */
 int   bisulfite_level = 0;   /* set by -B */
+int   edit_thresh     = 0;   /* set by -e */
+int   count_hits      = 0;   /* set by -c */
+int   density_bin     = 0;   /* set by -D */
+int   bed_output      = 0;   /* set by -b */
+int   summary_mode    = 0;   /* any of -c, -D or -b */
 int   mis_thresh      = 0;   /* set by -m */
 int   neighbor_len    = 0;   /* set by -N */
 int   print_headers   = 0;   /* set by -S */
 int   print_filenames = 0;   /* set by -F */
 int   verbose         = 0;   /* set by -v */
+char *cache_in        = NULL; /* set by -C */
+char *cache_out       = NULL; /* set by -W */
 
 #ifdef SHOW_PERM_STATS
 size_t       num_perms = 0;
@@ -104,7 +160,7 @@ size_t       num_perms = 0;
 void  version( void )                      /* print version number */
    {
     char *v;
-    v = strdup("$Revision: 1.9 $"+11 );
+    v = strdup("$Revision: 1.10 $"+11 );
     v[strlen(v)-2] = '\0';
     printf( "prosearch v%s\n", v );
    }
@@ -117,7 +173,8 @@ void  help( void )
              Search DNA sequence files (FASTA format) for candidate         \n\
              promoter sequences, with adjustable mismatch threshold.        \n\
                                                                             \n\
-Usage:       prosearch [-aBmNSFvhV]  <pat> [<file> [...]]                   \n\
+Usage:       prosearch [-abBcCDemNSFvhV]  <pat> [<file> [...]]              \n\
+             prosearch -W<cache> [<file> [...]]                             \n\
                                                                             \n\
              where <file>s are DNA sequence files (FASTA format).  If no    \n\
              files are given, stdin is scanned.  \"-\" may also be used as  \n\
@@ -145,9 +202,22 @@ Usage:       prosearch [-aBmNSFvhV]  <pat> [<file> [...]]                   \n\
 Options:     -a<n>  accept up to <n> ambiguity codes in the search          \n\
                     sequence for any match (either upper or lower case      \n\
                     in the pattern is matched)                              \n\
+             -b     write hits as BED (name, start, end, direction,         \n\
+                    mismatches, strand) instead of the usual output         \n\
              -B<n>  Bisulfite modify the DNA before matching                \n\
                      -B1    change all C -> T except C's in CpGs            \n\
                      -B2    change all C -> T including C's in CpGs         \n\
+             -c     print only hit counts for each sequence: name, hits     \n\
+                    per direction (f r, or f r u v with -B) and total       \n\
+             -C<f>  search the bisulfite cache <f> (made by -W) instead     \n\
+                    of FASTA files.  Implies -B2 unless -B1 is given        \n\
+             -D<n>  print hit density, the number of hits starting in each  \n\
+                    <n> base bin of each sequence, as a bedGraph track.     \n\
+                    Only one of -b, -c and -D may be given                  \n\
+             -e<n>  accept matches within edit distance <n> (mismatches,    \n\
+                    insertions and deletions) in LOWER case bases in <pat>. \n\
+                    No bases may be inserted between two UPPER case bases.  \n\
+                    Replaces -m; <pat> may be at most 64 bases long         \n\
              -m<n>  accept up to <n> mismatches in LOWER case bases in      \n\
                     <pat>.  Default is 0 (exact matches).                   \n\
              -N<n>  print neighboring sequences of length <n>               \n\
@@ -156,6 +226,9 @@ Options:     -a<n>  accept up to <n> ambiguity codes in the search          \n\
              -v     verbose output                                          \n\
              -h     print help, then exit                                   \n\
              -V     print version, then exit                                \n\
+             -W<f>  convert the FASTA <file>s into the bisulfite cache <f>  \n\
+                    (both converted strands, 2-bit packed) and exit.        \n\
+                    No <pat> is given with -W                               \n\
                                                                             \n\
 Example:       prosearch -m1  GCAcct.ac                                     \n\
                                                                             \n\
@@ -195,7 +268,7 @@ void  parse_args( int argc, char **argv, int *nfiles, char ***filenames )
     int          c;
     static char *def_files[] = { "-", "" };
 
-    while ( (c = getopt( argc, argv, "a:B:hm:FN:SvV" ) ) != -1 )
+    while ( (c = getopt( argc, argv, "a:bB:cC:D:e:hm:FN:SvVW:" ) ) != -1 )
         switch( c )
            {
             case  'a':   amb_thresh = atoi( optarg );
@@ -205,6 +278,20 @@ void  parse_args( int argc, char **argv, int *nfiles, char ***filenames )
             case  'B':   bisulfite_level = atoi( optarg );
                          check_int_range( bisulfite_level, 0, 2, "-B value" );
                          break;
+            case  'b':   bed_output = 1;
+                         break;
+            case  'c':   count_hits = 1;
+                         break;
+            case  'C':   cache_in = optarg;
+                         break;
+            case  'D':   density_bin = atoi( optarg );
+                         check_int_range( density_bin, 1, INT_MAX, 
+                                          "-D value" );
+                         break;
+            case  'e':   edit_thresh = atoi( optarg );
+                         check_int_range( edit_thresh, 1, MAX_EDIT_DIST, 
+                                          "-e value" );
+                         break;
             case  'h':   help();
                          exit( 0 );
             case  'm':   mis_thresh = atoi( optarg );
@@ -223,21 +310,58 @@ void  parse_args( int argc, char **argv, int *nfiles, char ***filenames )
                          break;
             case  'V':   version();
                          exit( 0 );
+            case  'W':   cache_out = optarg;
+                         break;
             default:     help();
                          exit( 1 );
            }
     argc -= optind;
     argv += optind;
-    if ( argc <= 0 )
+    summary_mode = count_hits || density_bin > 0 || bed_output;
+    if ( count_hits + ( density_bin > 0 ) + bed_output > 1 )
+       {
+        fprintf( stderr, "-b, -c and -D are mutually exclusive\n" );
+        exit( 1 );
+       }
+    if ( summary_mode && neighbor_len > 0 )
        {
-        fprintf( stderr, "no pattern specified.  (prosearch -h for help)\n" );
+        fprintf( stderr, "-N can't be combined with -c, -D or -b\n" );
         exit( 1 );
        }
-    /* Note to self:  needed here is a length check and a check on allowable */
-    /* characters in pattern                                                 */
-    strncpy( templ, *argv, MAX_PAT_LEN );
-    argc--;
-    argv++;
+    if ( edit_thresh > 0 && ( mis_thresh > 0 || neighbor_len > 0 ) )
+       {
+        fprintf( stderr, "-e can't be combined with -m or -N\n" );
+        exit( 1 );
+       }
+    if ( cache_in != NULL && cache_out != NULL )
+       {
+        fprintf( stderr, "-C and -W are mutually exclusive\n" );
+        exit( 1 );
+       }
+    if ( cache_out == NULL )      /* -W takes only files, no pattern */
+       {
+        if ( argc <= 0 )
+           {
+            fprintf( stderr, 
+                     "no pattern specified.  (prosearch -h for help)\n" );
+            exit( 1 );
+           }
+        /* Note to self:  needed here is a length check and a check on   */
+        /* allowable characters in pattern                               */
+        strncpy( templ, *argv, MAX_PAT_LEN );
+        argc--;
+        argv++;
+       }
+    if ( cache_in != NULL )
+       {
+        if ( argc > 0 )
+           {
+            fprintf( stderr, "no sequence files may be given with -C\n" );
+            exit( 1 );
+           }
+        if ( bisulfite_level == 0 )
+            bisulfite_level = 2;
+       }
     if ( argc > 0 )
        {
         *nfiles = argc;
@@ -351,7 +475,12 @@ char nt[] = { 'A', 'C', 'G', 'T' };  /* reverse map of ind[] */
 
 typedef struct tnode {
                        struct tnode *ch[4];
-                       char         *desc;
+                       int           n_mis;  /* mismatches of the permutation*/
+                                             /* ending here, -1 if none      */
+                       char         *perm;   /* and the permutation itself   */
+                       struct tnode *rc;     /* a permutation whose reverse  */
+                                             /* complement ends here (its    */
+                                             /* n_mis and perm), or NULL     */
                      } TNODE;
 
 TNODE *t_root;            /* tree root */
@@ -366,7 +495,9 @@ TNODE *new_tnode( void )
         exit( errno );
        }
     t->ch[0] = t->ch[1] = t->ch[2] = t->ch[3] = NULL;
-    t->desc = NULL;
+    t->n_mis = -1;
+    t->perm = NULL;
+    t->rc = NULL;
     return( t );
    }
 
@@ -392,11 +523,11 @@ void  init_tree( void )
 
 
 /************************************************************************/
-/* search tree for string.  If found, return value string for the match */
-/* match, otherwise return NULL                                         */
+/* search tree for string.  If found, return the node for the match,    */
+/* otherwise return NULL                                                */
 /************************************************************************/
 
-char *tree_lookup( char *s, int len )
+TNODE *tree_lookup( char *s, int len )
    {
     TNODE *t;
 
@@ -410,7 +541,7 @@ char *tree_lookup( char *s, int len )
        }
 
     if ( len == 0 )
-        return( t->desc );
+        return( t->n_mis >= 0 ? t : NULL );
     else if ( ind[*s] < 0 )
         return( NULL );       /* 'X' or anything else in s fails */
     else
@@ -418,15 +549,15 @@ char *tree_lookup( char *s, int len )
    }
 
 
-char  *tree_rlookup( TNODE *t, char *s, int len, int allowed_ambs )
+TNODE *tree_rlookup( TNODE *t, char *s, int len, int allowed_ambs )
    {
     TNODE  *r;
     int     i, k, n;
     char   *matches;
-    char   *res;
+    TNODE  *res;
     
     if ( len <= 0 )                           /* end of string, so we're done*/
-        return( t->desc );                    /* return the result           */
+        return( t->n_mis >= 0 ? t : NULL );   /* return the result           */
     else if ( (i = ind[*s]) >= 0 )            /* is this a nucl.? (a,c,g,t)? */
        {                                      /* if so,  is this nucleotide  */
         if ( (r = t->ch[i]) != NULL )         /* present here in the tree?   */
@@ -455,15 +586,24 @@ char  *tree_rlookup( TNODE *t, char *s, int len, int allowed_ambs )
 
 /********************************************/
 /* make one entry into the permutation tree */
+/* (of perm itself, or if rc, of its        */
+/* reverse complement s)                    */
 /********************************************/
 
-void  tree_enter( TNODE *t, char *s, char *desc )
+void  tree_enter( TNODE *t, char *s, char *perm, int n_mis, int rc )
    {
     if ( verbose ) printf( "insert [%s]\n", s );
     if ( *s == '\0' )
        {
-        t->desc = strdup( desc );
-        /* printf( "inserted: %s\n", desc );  */
+        if ( rc )
+           {
+            if ( t->rc == NULL )
+                t->rc = new_tnode();
+            t = t->rc;
+           }
+        t->n_mis = n_mis;
+        t->perm = strdup( perm );
+        /* printf( "inserted: %s\n", perm );  */
        }
     else
        {
@@ -472,7 +612,7 @@ void  tree_enter( TNODE *t, char *s, char *desc )
             /* printf( "need new node\n" );  */
             t->ch[ind[*s]] = new_tnode();
            }
-        tree_enter( t->ch[ind[*s]], s+1, desc );
+        tree_enter( t->ch[ind[*s]], s+1, perm, n_mis, rc );
        }
    }
 
@@ -483,12 +623,12 @@ void  tree_enter( TNODE *t, char *s, char *desc )
 
 void  enter_pat( char *pat, int n_mis )
    {
-    static  char  rpat[MAX_PAT_LEN];
-    static  char  desc[MAX_STR_LEN];
+    static char  r[MAX_PAT_LEN+1];
 
     if ( verbose ) printf( "enter table [%s] %d\n", pat, n_mis );
-    sprintf( desc, "%2d %s", n_mis, pat );
-    tree_enter( t_root, pat, desc );
+    tree_enter( t_root, pat, pat, n_mis, 0 );
+    rc( r, pat );
+    tree_enter( t_root, r, pat, n_mis, 1 );
    }
 
 
@@ -628,10 +768,21 @@ void  close_file( FILE *f )
                        /* comparision buffer */
                        /**********************/
 
+/*****************************************************************************/
+/* Only the strands read 5' to 3' along the top are kept: f, the (possibly   */
+/* bisulfite modified) top strand, and with -B, v, the complement of the     */
+/* modified bottom strand.  The other directions, r (the bottom strand) and  */
+/* u (the complement of the modified top), read one of those backwards and   */
+/* complemented, so each is found in the same walk of the tree as its        */
+/* partner, from the reverse complements of the permutations.  Their text    */
+/* is made in r_buff and u_buff only when a hit needs it.                    */
+/*****************************************************************************/
+
 static char  f_buff[MAX_BUFF_LEN+1];  /* top strand - possibly bisulf. mod. */
-static char  r_buff[MAX_BUFF_LEN+1];  /* bottom strand   "        "     "   */
-static char  u_buff[MAX_BUFF_LEN+1];  /* complement of top strand (after mod)*/
-static char  v_buff[MAX_BUFF_LEN+1];  /* complement of bottom strand "    " */
+static char  v_buff[MAX_BUFF_LEN+1];  /* complement of bottom strand (after */
+                                      /* mod)                               */
+static char  r_buff[MAX_BUFF_LEN+1];  /* rc of v (of f without -B) */
+static char  u_buff[MAX_BUFF_LEN+1];  /* rc of f */
 
 
 void  init_buff( void )
@@ -647,15 +798,8 @@ void  init_buff( void )
        }
     
     for ( i = 0; i < buff_len; i++ )
-        r_buff[i] = f_buff[i] = 'X';
-    r_buff[buff_len] = f_buff[buff_len] = '\0';
-
-    if ( bisulfite_level > 0 )
-       {
-        for ( i = 0; i < buff_len; i++ )
-            v_buff[i] = u_buff[i] = 'X';
-        v_buff[buff_len] = u_buff[buff_len] = '\0';
-       }
+        v_buff[i] = f_buff[i] = 'X';
+    v_buff[buff_len] = f_buff[buff_len] = '\0';
 
     if ( verbose )
         printf( "buffer initialized: %d + %d + %d = %d\n",
@@ -685,91 +829,659 @@ char bisulfite_mod[] = {
                   /* 170 */  'X',  'y',  'X',  'X',  'X',  'X',  'X',  'X',
                  };
 
-void  enter_base( int c )
-   {
-    size_t i;
-    char   d;
-
-    d = comp_char[c];
+/* enter_converted() shifts c, the (possibly converted) top strand base, */
+/* and d, the (possibly converted) bottom strand base, into the buffers   */
 
+void  enter_converted( int c, int d )
+   {
     if ( bisulfite_level > 0 )
        {
-        c = bisulfite_mod[c];
-        d = bisulfite_mod[d];
-
-        memmove( u_buff+1, u_buff, buff_len-1 );
-        u_buff[0] = comp_char[c];
-
         memmove( v_buff, v_buff+1, buff_len-1 );
         v_buff[buff_len-1] = comp_char[d];
        }
+
     memmove( f_buff, f_buff+1, buff_len-1 );   /* left shift f tag buffer */
     f_buff[buff_len-1] = c;
-
-    memmove( r_buff+1, r_buff, buff_len-1 );
-    r_buff[0] = d;
 #ifdef DEBUG
     printf( "f %s\n", f_buff );
-    printf( "u %s\n", u_buff );
     printf( "v %s\n", v_buff );
-    printf( "r %s\n", r_buff );
     printf( "\n" );
 #endif
    }
 
 
-void  neighbor_output( char *desc, int pos, char *buf, char dir, 
+/* rc_buff() - r gets the reverse complement of buffer s */
+
+void  rc_buff( char *r, char *s )
+   {
+    int  i;
+
+    for ( i = 0; i < buff_len; i++ )
+        r[i] = comp_char[ (unsigned char) s[buff_len-1-i] ];
+    r[buff_len] = '\0';
+   }
+
+
+/* enter_base() enters top strand base c, bisulfite modified unless keep */
+/* (a CpG base with -B1)                                                  */
+
+void  enter_base( int c, int keep )
+   {
+    char   d;
+
+    d = comp_char[c];
+
+    if ( bisulfite_level > 0 && ! keep )
+       {
+        c = bisulfite_mod[c];
+        d = bisulfite_mod[d];
+       }
+    enter_converted( c, d );
+   }
+
+
+                  /***************************************/
+                  /* Summary, density and BED hit output */
+                  /***************************************/
+
+/*****************************************************************************/
+/* With -c, -D or -b hits aren't formatted one by one.  -c counts hits per   */
+/* sequence and direction, -D counts them in fixed-size bins of the sequence */
+/* (as a bedGraph density track), and -b writes one BED line per hit.  All   */
+/* of these go through out_buff[], which is flushed at the end of each       */
+/* sequence and whenever it fills up.                                        */
+/*****************************************************************************/
+
+#define OUT_BUFF_LEN   (1 << 20)
+#define MAX_NUM_LEN    24
+
+static char    out_buff[OUT_BUFF_LEN];
+static size_t  out_n = 0;
+
+int           *bins = NULL;           /* hit counts per -D bin */
+size_t         n_bins_alloc = 0;
+size_t         n_bins_used = 0;
+unsigned long  dir_hits[4];           /* hits per direction (f,r,u,v) */
+static char    seq_name[MAX_HDR_LEN+1];
+static int     seq_name_len;
+
+
+void  out_flush( void )
+   {
+    if ( out_n > 0 && fwrite( out_buff, 1, out_n, stdout ) != out_n )
+       {
+        perror( "prosearch: write" );
+        exit( errno );
+       }
+    out_n = 0;
+   }
+
+void  out_room( size_t n )       /* make sure n more bytes will fit */
+   {
+    if ( out_n + n > OUT_BUFF_LEN )
+        out_flush();
+   }
+
+void  out_char( int c )
+   {
+    out_buff[out_n++] = c;
+   }
+
+void  out_mem( const char *p, size_t n )
+   {
+    memcpy( out_buff + out_n, p, n );
+    out_n += n;
+   }
+
+void  out_ulong( unsigned long v )      /* decimal, no padding */
+   {
+    char  digits[MAX_NUM_LEN];
+    int   n = 0;
+
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+       } while ( v > 0 );
+    while ( n > 0 )
+        out_buff[out_n++] = digits[--n];
+   }
+
+
+int  dir_index( char dir )
+   {
+    switch ( dir )
+       {
+        case 'f':  return( 0 );
+        case 'r':  return( 1 );
+        case 'u':  return( 2 );
+        default:   return( 3 );
+       }
+   }
+
+
+/* the name for summary output is the first word of the header */
+
+void  summary_begin_seq( char *hdr )
+   {
+    int  i;
+
+    for ( i = 0; hdr[i] != '\0' && ! isspace( hdr[i] ); i++ )
+        seq_name[i] = hdr[i];
+    seq_name[i] = '\0';
+    seq_name_len = i;
+    memset( dir_hits, 0, sizeof( dir_hits ) );
+    n_bins_used = 0;
+   }
+
+
+/* record one hit of length len starting at pos (counting from one) */
+
+void  summary_hit( char dir, int pos, int len, int n_mis )
+   {
+    size_t  b;
+
+    dir_hits[dir_index( dir )]++;
+    if ( density_bin > 0 )
+       {
+        b = (pos - 1) / density_bin;
+        if ( b >= n_bins_alloc )
+           {
+            n_bins_alloc = ( n_bins_alloc == 0 ) ? 1024 : n_bins_alloc;
+            while ( n_bins_alloc <= b )
+                n_bins_alloc *= 2;
+            if ( !( bins = realloc( bins, n_bins_alloc * sizeof( int ) ) ) )
+               {
+                perror( "can't allocate density bins" );
+                exit( errno );
+               }
+           }
+        if ( b >= n_bins_used )
+           {
+            memset( bins + n_bins_used, 0, (b + 1 - n_bins_used) * sizeof(int) );
+            n_bins_used = b + 1;
+           }
+        bins[b]++;
+       }
+    if ( bed_output )
+       {                                      /* name start end dir score +- */
+        out_room( seq_name_len + 4 * MAX_NUM_LEN + 8 );
+        out_mem( seq_name, seq_name_len );
+        out_char( '\t' );
+        out_ulong( pos - 1 );
+        out_char( '\t' );
+        out_ulong( pos - 1 + len );
+        out_char( '\t' );
+        out_char( dir );
+        out_char( '\t' );
+        out_ulong( n_mis );
+        out_char( '\t' );
+        out_char( ( dir == 'f' || dir == 'v' ) ? '+' : '-' );
+        out_char( '\n' );
+       }
+   }
+
+
+/* write the -c and -D lines for a sequence of len bases */
+
+void  summary_end_seq( unsigned long len )
+   {
+    int            i, n_dirs;
+    unsigned long  total, b, start, end;
+
+    if ( count_hits )
+       {
+        n_dirs = ( bisulfite_level > 0 ) ? 4 : 2;
+        total = 0;
+        out_room( seq_name_len + 5 * (MAX_NUM_LEN + 1) + 1 );
+        out_mem( seq_name, seq_name_len );
+        for ( i = 0; i < n_dirs; i++ )
+           {
+            out_char( '\t' );
+            out_ulong( dir_hits[i] );
+            total += dir_hits[i];
+           }
+        out_char( '\t' );
+        out_ulong( total );
+        out_char( '\n' );
+       }
+    if ( density_bin > 0 )
+        for ( b = 0, start = 0; start < len; b++, start = end )
+           {
+            end = start + density_bin;
+            if ( end > len )
+                end = len;
+            out_room( seq_name_len + 3 * (MAX_NUM_LEN + 1) + 1 );
+            out_mem( seq_name, seq_name_len );
+            out_char( '\t' );
+            out_ulong( start );
+            out_char( '\t' );
+            out_ulong( end );
+            out_char( '\t' );
+            out_ulong( b < n_bins_used ? bins[b] : 0 );
+            out_char( '\n' );
+           }
+    out_flush();
+   }
+
+
+void  neighbor_output( TNODE *rec, int pos, char *buf, char dir, 
                        char *filename )
    {
-    static char pbuff[MAX_BUFF_LEN+1];
-    static char left[MAX_NEIGHBOR_LEN+1];
-    static char mat[MAX_PAT_LEN+1];
-    static char fmt[MAX_STR_LEN+1];
-    int   n_mis;
+    /* left neighbors, match and right neighbors straight out of buf */
+
+    printf( "%10d  %c  %.*s %-*.*s %-10.*s %2d", pos, dir, 
+             neighbor_len, buf, 
+             templ_len, templ_len, buf + neighbor_len,
+             neighbor_len, buf + neighbor_len + templ_len,
+             rec->n_mis );
+   }
+
+
+/*****************************************************************************/
+/* lookup_strand() walks the tree once along the window of buf, setting *fwd */
+/* to a permutation found there and *rev to one whose reverse complement is  */
+/* there, or NULL.  Only a window with ambiguity codes, under -a, needs the  */
+/* full search, done on the window and on its reverse complement in rbuf so  */
+/* the first match is the same as when each direction was searched alone     */
+/*****************************************************************************/
+
+void  lookup_strand( char *buf, char *rbuf, TNODE **fwd, TNODE **rev )
+   {
+    TNODE  *t;
+    char   *s;
+    int     i, len;
+
+    t = t_root;
+    s = buf + neighbor_len;
+    for ( len = templ_len; len > 0; len--, s++ )
+       {
+        if ( (i = ind[(unsigned char) *s]) < 0 )
+            break;
+        if ( (t = t->ch[i]) == NULL )
+           {
+            *fwd = *rev = NULL;
+            return;
+           }
+       }
+    if ( len == 0 )
+       {
+        *fwd = t->n_mis >= 0 ? t : NULL;
+        *rev = t->rc;
+       }
+    else if ( amb_thresh == 0 )
+        *fwd = *rev = NULL;
+    else
+       {
+        *fwd = tree_rlookup( t_root, buf + neighbor_len, templ_len,
+                             amb_thresh );
+        rc_buff( rbuf, buf );
+        *rev = tree_rlookup( t_root, rbuf + neighbor_len, templ_len,
+                             amb_thresh );
+       }
+   }
+
+
+/* hit() reports permutation rec found in direction dir; buf holds that   */
+/* direction's text for -N, fbuf the top strand                           */
+
+void  hit( TNODE *rec, char *buf, char *fbuf, char dir, int pos, 
+           char *filename, char *hdr )
+   {
+    if ( summary_mode )
+       {
+        summary_hit( dir, pos, templ_len, rec->n_mis );
+        return;
+       }
+    if ( neighbor_len > 0 )
+        neighbor_output( rec, pos, buf, dir,
+                        (print_filenames ? filename : hdr ));
+    else
+        printf( "%.*s %c %2d %s %10d", templ_len, fbuf + neighbor_len, 
+                                        dir, rec->n_mis, rec->perm, pos );
+    if ( print_headers )
+        printf( " %s\n", hdr );    /* hdr has a \n in it */
+    else
+        putchar( '\n' );
+   }
+
+
+/* lookup() reports the hits in f, r, u and v ending at position pos */
 
-    /* TO FIX- don't scan dir from desc - get dir from dir,  */
-    /*         use buf instead of buff, don't rc() */
+void  lookup( int pos, char *filename, char *hdr )
+   {
+    TNODE  *f, *r, *u, *v;
 
-    /* printf( "neigh %d [%s] [%s]\n", pos, buff, desc );  return; */
+    lookup_strand( f_buff, u_buff, &f, &u );
+    if ( bisulfite_level > 0 )
+        lookup_strand( v_buff, r_buff, &v, &r );
+    else
+       {
+        r = u;
+        u = v = NULL;
+       }
 
-    sscanf( desc, "%d", &n_mis );
-    strncpy( pbuff, buf, buff_len );
-     
-    strncpy( left, pbuff, neighbor_len );
-    strncpy( mat,  pbuff + neighbor_len, templ_len );
-    sprintf( fmt, "%%10d  %%c  %%s %%-%d.%ds %%-10s %%2d", 
-                             templ_len, templ_len );
-    printf( fmt,
-             pos, dir, left, mat, pbuff+neighbor_len+templ_len, n_mis );
+    if ( f )
+        hit( f, f_buff, f_buff, 'f', pos, filename, hdr );
+    if ( r )
+       {
+        if ( neighbor_len > 0 && ! summary_mode )
+            rc_buff( r_buff, bisulfite_level > 0 ? v_buff : f_buff );
+        hit( r, r_buff, f_buff, 'r', pos, filename, hdr );
+       }
+    if ( u )
+       {
+        if ( neighbor_len > 0 && ! summary_mode )
+            rc_buff( u_buff, f_buff );
+        hit( u, u_buff, f_buff, 'u', pos, filename, hdr );
+       }
+    if ( v )
+        hit( v, v_buff, f_buff, 'v', pos, filename, hdr );
    }
 
+                 /*******************************************/
+                 /* Approximate (edit distance) search (-e) */
+                 /*******************************************/
 
-void  lookup( char *buf, char *fbuf, char dir, int pos, 
-              char *filename, char *hdr )
+/*****************************************************************************/
+/* Each searcher runs Myers' bit-parallel edit distance recurrence for one   */
+/* pattern (<pat> or its reverse complement) over one text stream: stream 0  */
+/* is the (possibly bisulfite modified) top strand, stream 1, used only with */
+/* -B, is the complement of the modified bottom strand in top strand order.  */
+/* Myers' distance ignores the conserved positions, so it can only be lower  */
+/* than the constrained distance; whenever it is within edit_thresh the end  */
+/* position is verified by verify_approx() on the recent text kept in ring[].*/
+/*****************************************************************************/
+
+#define RING_LEN   256         /* >= MAX_APPROX_LEN + MAX_EDIT_DIST, 2^n */
+#define INF_COST   (MAX_PAT_LEN + RING_LEN)
+
+typedef struct myers {
+                       uint64_t  peq[128];  /* bit i set if base matches pat[i]*/
+                       uint64_t  pv, mv;    /* vertical +1/-1 delta vectors    */
+                       uint64_t  hibit;     /* bit of the last pattern position*/
+                       int       score;     /* distance of pat ending here     */
+                       char      pat[MAX_APPROX_LEN+1];
+                       int       stream;    /* which text stream it scans      */
+                       char      dir;       /* f, r, u or v as in lookup()     */
+                       int       in_hit;    /* 1 while in a run of candidates  */
+                       int       best_cost; /* best hit of the current run     */
+                       int       best_start;
+                       int       best_len;
+                       char      best_text[MAX_APPROX_LEN+MAX_EDIT_DIST+1];
+                     } MYERS;
+
+MYERS   searchers[4];
+int     n_searchers;
+char    ring[2][RING_LEN];     /* last RING_LEN bases of each text stream  */
+int     approx_n;              /* number of bases entered in this sequence */
+char   *approx_hdr;
+char   *approx_filename;
+
+
+void  init_searcher( MYERS *m, char *pat, int stream )
+   {
+    int  i, len;
+    char *matches;
+
+    strcpy( m->pat, pat );
+    m->stream = stream;
+    len = strlen( pat );
+    memset( m->peq, 0, sizeof( m->peq ) );
+    for ( i = 0; i < len; i++ )
+        for ( matches = allowed_matches[pat[i]]; *matches; matches++ )
+           {
+            m->peq[*matches] |= (uint64_t) 1 << i;
+            m->peq[tolower(*matches)] |= (uint64_t) 1 << i;
+           }
+    m->hibit = (uint64_t) 1 << (len - 1);
+   }
+
+
+/* set up the searchers for <pat> and its reverse complement on each stream */
+
+void  init_approx( int n_streams )
    {
-    char        *rec;
-    static char  pbuff[MAX_PAT_LEN+1];
+    static char  rpat[MAX_APPROX_LEN+1];
+    char        *t;
+    int          s;
 
-    if ( (rec = tree_rlookup( t_root, buf + neighbor_len, templ_len,
-                            amb_thresh ) ) )
+    unify_wildcards( templ );
+    init_tree();                       /* for ind[] */
+    fill_allowed_matches();
+    if ( templ_len > MAX_APPROX_LEN || edit_thresh >= templ_len )
        {
-        if ( neighbor_len > 0 )
-            neighbor_output( rec, pos, buf, dir,
-                            (print_filenames ? filename : hdr ));
-        else
+        fprintf( stderr, "with -e, <pat> must be longer than the edit "
+                         "distance and at most %d long\n", MAX_APPROX_LEN );
+        exit( 1 );
+       }
+    for ( t = templ; *t; t++ )
+        if ( *t < 0 || allowed_matches[*t] == NULL )
+           {
+            fprintf( stderr, "bad character '%c' in pattern\n", *t );
+            exit( 1 );
+           }
+    rc( rpat, templ );
+    n_searchers = 0;
+    for ( s = 0; s < n_streams; s++ )
+       {
+        init_searcher( &searchers[n_searchers++], templ, s );
+        init_searcher( &searchers[n_searchers++], rpat, s );
+       }
+   }
+
+
+/* start a new sequence.  dirs gives the direction label of each searcher */
+
+void  approx_begin_seq( char *dirs, char *filename, char *hdr )
+   {
+    int     i;
+    MYERS  *m;
+
+    for ( i = 0; i < n_searchers; i++ )
+       {
+        m = &searchers[i];
+        m->dir = dirs[i];
+        m->pv = ~(uint64_t) 0;
+        m->mv = 0;
+        m->score = templ_len;
+        m->in_hit = 0;
+       }
+    approx_n = 0;
+    approx_filename = filename;
+    approx_hdr = hdr;
+   }
+
+
+/***************************************************************************/
+/* verify_approx() aligns m->pat against the text of its stream which ends */
+/* at the current position, honoring the conserved (uppercase) positions.  */
+/* The alignment may start anywhere in the text window.  Returns the cost  */
+/* (INF_COST if none is possible) and leaves the alignment start, as an    */
+/* offset back from the current position, in *back                         */
+/***************************************************************************/
+
+int  verify_approx( MYERS *m, int *back )
+   {
+    static int  d[MAX_APPROX_LEN+1][RING_LEN+1];   /* costs             */
+    static int  st[MAX_APPROX_LEN+1][RING_LEN+1];  /* alignment starts  */
+    char       *p = m->pat;
+    char       *text = ring[m->stream];
+    int         len, w, i, x;
+    int         c, cost, first;
+    int         can_insert;
+
+    len = templ_len;
+    w = len + edit_thresh;
+    if ( w > approx_n )
+        w = approx_n;
+    first = approx_n - w;          /* text index (from 0) of window start */
+
+    for ( x = 0; x <= w; x++ )
+       {
+        d[0][x] = 0;
+        st[0][x] = x;
+       }
+    for ( i = 1; i <= len; i++ )
+       {
+        /* deleting a pattern base is only allowed if it isn't conserved */
+        d[i][0] = ( d[i-1][0] < INF_COST && ! is_conserved( p[i-1] ) )
+                       ? d[i-1][0] + 1 : INF_COST;
+        st[i][0] = 0;
+        can_insert = i < len && 
+                        !( is_conserved( p[i-1] ) && is_conserved( p[i] ) );
+        for ( x = 1; x <= w; x++ )
+           {
+            c = text[(first + x - 1) & (RING_LEN - 1)];
+            if ( ind[c] >= 0 && match( c, p[i-1] ) )
+                cost = d[i-1][x-1];
+            else if ( is_conserved( p[i-1] ) )
+                cost = INF_COST;
+            else
+                cost = d[i-1][x-1] + 1;
+            st[i][x] = st[i-1][x-1];
+            if ( ! is_conserved( p[i-1] ) && d[i-1][x] + 1 < cost )
+               {
+                cost = d[i-1][x] + 1;
+                st[i][x] = st[i-1][x];
+               }
+            if ( can_insert && d[i][x-1] + 1 < cost )
+               {
+                cost = d[i][x-1] + 1;
+                st[i][x] = st[i][x-1];
+               }
+            d[i][x] = ( cost < INF_COST ) ? cost : INF_COST;
+           }
+       }
+    *back = w - st[len][w];
+    return( d[len][w] );
+   }
+
+
+void  approx_output( MYERS *m )
+   {
+    if ( summary_mode )
+       {
+        summary_hit( m->dir, m->best_start, m->best_len, m->best_cost );
+        return;
+       }
+    printf( "%s %c %2d %s %10d", m->best_text, m->dir, m->best_cost, 
+                                  templ, m->best_start );
+    if ( print_headers )
+        printf( " %s\n", approx_hdr );
+    else
+        putchar( '\n' );
+   }
+
+
+/* a new candidate hit: keep it if it is the best of the current run */
+
+void  approx_candidate( MYERS *m, int cost, int back )
+   {
+    int  i;
+
+    if ( m->in_hit && cost >= m->best_cost )
+        return;
+    m->in_hit = 1;
+    m->best_cost = cost;
+    m->best_start = approx_n - back + 1;            /* counting from one */
+    m->best_len = back;
+    for ( i = 0; i < back; i++ )
+        m->best_text[i] = 
+            ring[m->stream][(approx_n - back + i) & (RING_LEN - 1)];
+    m->best_text[back] = '\0';
+   }
+
+
+/* enter base c of each text stream (c1 is ignored with only one stream) */
+
+void  approx_base( int c0, int c1 )
+   {
+    int       i;
+    int       cost, back;
+    MYERS    *m;
+    uint64_t  eq, xv, xh, ph, mh;
+
+    ring[0][approx_n & (RING_LEN - 1)] = c0;
+    ring[1][approx_n & (RING_LEN - 1)] = c1;
+    approx_n++;
+    for ( i = 0; i < n_searchers; i++ )
+       {
+        m = &searchers[i];
+        eq = m->peq[ ( m->stream ? c1 : c0 ) & 0x7f ];
+        xv = eq | m->mv;
+        xh = (((eq & m->pv) + m->pv) ^ m->pv) | eq;
+        ph = m->mv | ~(xh | m->pv);
+        mh = m->pv & xh;
+        if ( ph & m->hibit )
+            m->score++;
+        else if ( mh & m->hibit )
+            m->score--;
+        ph <<= 1;
+        mh <<= 1;
+        m->pv = mh | ~(xv | ph);
+        m->mv = ph & xv;
+
+        if ( m->score <= edit_thresh 
+                && (cost = verify_approx( m, &back )) <= edit_thresh )
+            approx_candidate( m, cost, back );
+        else if ( m->in_hit )
+           {
+            approx_output( m );          /* the run of candidates is over */
+            m->in_hit = 0;
+           }
+       }
+   }
+
+
+/* flush any hits still pending at the end of a sequence */
+
+void  approx_end_seq( void )
+   {
+    int  i;
+
+    for ( i = 0; i < n_searchers; i++ )
+        if ( searchers[i].in_hit )
            {
-            strncpy( pbuff, fbuf+neighbor_len, templ_len );
-            printf( "%s %c %s %10d", pbuff, dir, rec, pos );
+            approx_output( &searchers[i] );
+            searchers[i].in_hit = 0;
            }
-        if ( print_headers )
-            printf( " %s\n", hdr );    /* hdr has a \n in it */
+   }
+
+
+/* search_base() enters top strand base c, bisulfite modified unless keep */
+/* (a CpG base with -B1), at position pos and looks for hits ending there */
+
+void  search_base( int c, int keep, int pos, char *filename, char *hdr )
+   {
+    if ( edit_thresh > 0 )
+       {
+        if ( bisulfite_level > 0 && ! keep )
+            approx_base( bisulfite_mod[c], 
+                         comp_char[bisulfite_mod[comp_char[c]]] );
         else
-            putchar( '\n' );
+            approx_base( c, c );
+        return;
        }
+    enter_base( c, keep );
+    lookup( pos, filename, hdr );
    }
 
+
+/* is_cpg() - 1 if base b, between bases a and c, is in a CpG */
+
+int  is_cpg( int a, int b, int c )
+   {
+    b = toupper( b );
+    return( ( b == 'C' && toupper( c ) == 'G' ) 
+                 || ( b == 'G' && toupper( a ) == 'C' ) );
+   }
+
+
 /*****************************************************/
 /* scan_file() - open file and process its sequences */
+/*                                                   */
+/* With -B1 each base is held back until the next    */
+/* one is read, to know whether it is in a CpG       */
 /*****************************************************/
 
 void  scan_file( char *filename )
@@ -779,7 +1491,10 @@ void  scan_file( char *filename )
     int          last;
     static char  hdr[MAX_HDR_LEN+1];
     int          l;     /* header length */
-    int          pos;   /* position within string */
+    int          pos = 0;   /* position within string */
+    int          in_seq = 0;
+    int          held = 0;     /* -B1: base not yet searched, and the one */
+    int          before = 0;   /* before it                               */
 
     if ( verbose )
         printf( "file %s\n", filename );
@@ -791,6 +1506,14 @@ void  scan_file( char *filename )
        {
         if ( last == '\n' && c == '>' )
            {
+            if ( held )
+                search_base( held, is_cpg( before, held, 0 ), ++pos,
+                             filename, hdr );
+            held = before = 0;
+            if ( edit_thresh > 0 )
+                approx_end_seq();       /* before hdr is overwritten */
+            if ( summary_mode && in_seq )
+                summary_end_seq( pos + templ_len + neighbor_len - 1 );
             fgets( hdr, MAX_HDR_LEN, f );
             if ( verbose )
                 printf( "seq: %s", hdr );
@@ -799,30 +1522,419 @@ void  scan_file( char *filename )
                 hdr[l-1] = '\0';
             init_buff();
             pos = 1 - (templ_len + neighbor_len);  /* counting from one */
+            if ( edit_thresh > 0 )
+                approx_begin_seq( bisulfite_level > 0 ? "fuvr" : "fr", 
+                                  filename, hdr );
+            if ( summary_mode )
+                summary_begin_seq( hdr );
+            in_seq = 1;
             last = '\n';
            }
         else if ( isalpha( c ) )
            {
-            enter_base( c );
-            ++pos;
-            /* if ( rec = tree_lookup( buff + neighbor_len, templ_len ) ) */
-            lookup( f_buff, f_buff, 'f', pos, filename, hdr );
-            lookup( r_buff, f_buff, 'r', pos, filename, hdr );
-            if ( bisulfite_level > 0 )
+            if ( bisulfite_level == 1 )
                {
-                lookup( u_buff, f_buff, 'u', pos, filename, hdr );
-                lookup( v_buff, f_buff, 'v', pos, filename, hdr );
+                if ( held )
+                    search_base( held, is_cpg( before, held, c ), ++pos,
+                                 filename, hdr );
+                before = held;
+                held = c;
                }
+            else
+                search_base( c, 0, ++pos, filename, hdr );
             last = c;
            }
         else
             last = c;
        }
+    if ( held )
+        search_base( held, is_cpg( before, held, 0 ), ++pos, filename, hdr );
+    if ( edit_thresh > 0 )
+        approx_end_seq();
+    if ( summary_mode && in_seq )
+        summary_end_seq( pos + templ_len + neighbor_len - 1 );
     close_file( f );
    }
 
 
 
+                           /*******************/
+                           /* Bisulfite cache */
+                           /*******************/
+
+/*****************************************************************************/
+/* The cache file starts with CACHE_MAGIC and then holds, for each sequence: */
+/*                                                                           */
+/*    uint32  hdr_len          uint8  top[(len+3)/4]   C->T strand, 2 bits   */
+/*    char    hdr[hdr_len]     uint8  ga[(len+3)/4]    G->A strand, 2 bits   */
+/*    uint64  len              uint8  cpg[(len+7)/8]   1 => base is in a CpG */
+/*    uint64  n_amb            uint8  amb[(len+7)/8]   1 => ambiguity code   */
+/*                             char   top_amb[n_amb]   converted amb. codes  */
+/*                             char   ga_amb[n_amb]       "       "     "    */
+/*                                                                           */
+/* len counts every alphabetic character of the sequence, just as the pos    */
+/* counter in scan_file() does, so cached positions agree with FASTA ones.   */
+/*****************************************************************************/
+
+#define CACHE_MAGIC      "PSBISUL1"
+#define CACHE_MAGIC_LEN  8
+
+char  twobit_nt[128];    /* maps A,C,G,T to 0-3, anything else to -1 */
+
+typedef struct gbuf {                      /* growable byte buffer */
+                      unsigned char *p;
+                      size_t         n;
+                      size_t         size;
+                    } GBUF;
+
+void  gbuf_need( GBUF *g, size_t n )       /* make room for n bytes total */
+   {
+    size_t  old = g->size;
+
+    if ( n <= g->size )
+        return;
+    if ( g->size == 0 )
+        g->size = 65536;
+    while ( g->size < n )
+        g->size *= 2;
+    if ( !( g->p = realloc( g->p, g->size ) ) )
+       {
+        perror( "can't grow cache buffer" );
+        exit( errno );
+       }
+    memset( g->p + old, 0, g->size - old );
+   }
+
+void  gbuf_reset( GBUF *g, size_t used )  /* clear the used bytes only */
+   {
+    if ( g->p != NULL )
+        memset( g->p, 0, used < g->size ? used : g->size );
+    g->n = 0;
+   }
+
+void  gbuf_push( GBUF *g, int c )
+   {
+    gbuf_need( g, g->n + 1 );
+    g->p[g->n++] = c;
+   }
+
+void  set_2bit( GBUF *g, size_t i, int code )
+   {
+    gbuf_need( g, (i >> 2) + 1 );
+    g->p[i >> 2] |= code << ((i & 3) << 1);
+   }
+
+void  set_bit( GBUF *g, size_t i )
+   {
+    gbuf_need( g, (i >> 3) + 1 );
+    g->p[i >> 3] |= 1 << (i & 7);
+   }
+
+int  get_2bit( const unsigned char *p, size_t i )
+   {  return( (p[i >> 2] >> ((i & 3) << 1)) & 3 );  }
+
+int  get_bit( const unsigned char *p, size_t i )
+   {  return( (p[i >> 3] >> (i & 7)) & 1 );  }
+
+void  init_twobit_nt( void )
+   {
+    int i;
+
+    for ( i = 0; i < 128; i++ )
+        twobit_nt[i] = -1;
+    twobit_nt['A'] = 0;
+    twobit_nt['C'] = 1;
+    twobit_nt['G'] = 2;
+    twobit_nt['T'] = 3;
+   }
+
+
+/* cache writer state for the sequence currently being converted */
+
+static GBUF    top_g, ga_g, cpg_g, amb_g, top_amb_g, ga_amb_g;
+static size_t  cache_len;
+static int     cache_last;     /* previous base (uppercase) of the sequence */
+static char    cache_hdr[MAX_HDR_LEN+1];
+
+
+void  cache_begin_seq( char *hdr )
+   {
+    size_t  n2, n1;
+
+    n2 = (cache_len + 3) >> 2;               /* what the last sequence used */
+    n1 = (cache_len + 7) >> 3;
+    gbuf_reset( &top_g, n2 );
+    gbuf_reset( &ga_g, n2 );
+    gbuf_reset( &cpg_g, n1 );
+    gbuf_reset( &amb_g, n1 );
+    top_amb_g.n = ga_amb_g.n = 0;
+    cache_len = 0;
+    cache_last = 'X';
+    snprintf( cache_hdr, sizeof( cache_hdr ), "%s", hdr );
+   }
+
+
+/* convert one base of both strands, and mark CpGs as they complete */
+
+void  cache_add_base( int c )
+   {
+    int  t, g;
+
+    t = toupper( bisulfite_mod[c] );                    /* C -> T of top    */
+    g = toupper( comp_char[bisulfite_mod[comp_char[c]]] ); /* G -> A of top */
+    if ( twobit_nt[t] >= 0 && twobit_nt[g] >= 0 )
+       {
+        set_2bit( &top_g, cache_len, twobit_nt[t] );
+        set_2bit( &ga_g, cache_len, twobit_nt[g] );
+       }
+    else
+       {
+        set_bit( &amb_g, cache_len );
+        gbuf_push( &top_amb_g, t );
+        gbuf_push( &ga_amb_g, g );
+       }
+    c = toupper( c );
+    if ( c == 'G' && cache_last == 'C' )
+       {
+        set_bit( &cpg_g, cache_len - 1 );
+        set_bit( &cpg_g, cache_len );
+       }
+    cache_last = c;
+    cache_len++;
+   }
+
+
+void  cache_write( FILE *f, void *p, size_t n )
+   {
+    if ( n > 0 && fwrite( p, 1, n, f ) != n )
+       {
+        perror( cache_out );
+        exit( errno );
+       }
+   }
+
+
+void  cache_end_seq( FILE *f )
+   {
+    unsigned int  hdr_len;
+    size_t        n2, n1;
+    uint64_t      v;
+
+    n2 = (cache_len + 3) >> 2;
+    n1 = (cache_len + 7) >> 3;
+    gbuf_need( &top_g, n2 );                 /* short or all-ambiguity seqs */
+    gbuf_need( &ga_g, n2 );                  /* may not have touched these  */
+    gbuf_need( &cpg_g, n1 );
+    gbuf_need( &amb_g, n1 );
+
+    hdr_len = strlen( cache_hdr );
+    cache_write( f, &hdr_len, sizeof( hdr_len ) );
+    cache_write( f, cache_hdr, hdr_len );
+    v = cache_len;
+    cache_write( f, &v, sizeof( v ) );
+    v = top_amb_g.n;
+    cache_write( f, &v, sizeof( v ) );
+    cache_write( f, top_g.p, n2 );
+    cache_write( f, ga_g.p, n2 );
+    cache_write( f, cpg_g.p, n1 );
+    cache_write( f, amb_g.p, n1 );
+    cache_write( f, top_amb_g.p, top_amb_g.n );
+    cache_write( f, ga_amb_g.p, ga_amb_g.n );
+    if ( verbose )
+        printf( "cached %s: %lu bases, %lu ambiguities\n", cache_hdr, 
+                (unsigned long) cache_len, (unsigned long) top_amb_g.n );
+   }
+
+
+/* read FASTA files, write both bisulfite converted strands to the cache */
+
+void  write_cache( int nfiles, char **filenames )
+   {
+    FILE        *out, *f;
+    int          i, c, l;
+    int          last;
+    int          in_seq = 0;
+    static char  hdr[MAX_HDR_LEN+1];
+
+    init_twobit_nt();
+    if ( !( out = fopen( cache_out, "w" ) ) )
+       {
+        perror( cache_out );
+        exit( errno );
+       }
+    cache_write( out, CACHE_MAGIC, CACHE_MAGIC_LEN );
+    for ( i = 0; i < nfiles; i++ )
+       {
+        f = open_file( filenames[i] );
+        last = '\n';
+        while ( (c = fgetc( f ) ) != EOF )
+           {
+            if ( last == '\n' && c == '>' )
+               {
+                if ( in_seq )
+                    cache_end_seq( out );
+                if ( ! fgets( hdr, MAX_HDR_LEN, f ) )
+                    hdr[0] = '\0';
+                l = strlen( hdr );
+                if ( l > 0 && hdr[l-1] == '\n' )
+                    hdr[l-1] = '\0';
+                cache_begin_seq( hdr );
+                in_seq = 1;
+                last = '\n';
+               }
+            else
+               {
+                if ( in_seq && isalpha( c ) )
+                    cache_add_base( c );
+                last = c;
+               }
+           }
+        close_file( f );
+       }
+    if ( in_seq )
+        cache_end_seq( out );
+    if ( fclose( out ) != 0 )
+       {
+        perror( cache_out );
+        exit( errno );
+       }
+   }
+
+
+/* search a cached sequence in one pass: each base of the C->T strand and */
+/* of the G->A strand is entered into the f and v buffers just as        */
+/* enter_base() would have, so hits come out in the same order as in a   */
+/* FASTA search.  -B1 puts the C's (G's) of CpGs back                     */
+
+void  scan_record( const unsigned char *top, const unsigned char *ga,
+                   const unsigned char *cpg, const unsigned char *amb, 
+                   const char *top_amb, const char *ga_amb, size_t len, 
+                   char *hdr )
+   {
+    size_t  i;
+    int     t, g;
+    int     pos;
+
+    init_buff();
+    pos = 1 - (templ_len + neighbor_len);
+    if ( edit_thresh > 0 )
+        approx_begin_seq( "fuvr", cache_in, hdr );
+    for ( i = 0; i < len; i++ )
+       {
+        if ( get_bit( amb, i ) )
+           {
+            t = *top_amb++;
+            g = *ga_amb++;
+           }
+        else
+           {
+            t = nt[get_2bit( top, i )];
+            g = nt[get_2bit( ga, i )];
+            if ( bisulfite_level == 1 && get_bit( cpg, i ) )
+               {
+                if ( t == 'T' )
+                    t = 'C';
+                if ( g == 'A' )
+                    g = 'G';
+               }
+           }
+        ++pos;
+        if ( edit_thresh > 0 )
+            approx_base( t, g );
+        else
+           {
+            enter_converted( t, comp_char[g] );
+            lookup( pos, cache_in, hdr );
+           }
+       }
+    if ( edit_thresh > 0 )
+        approx_end_seq();
+   }
+
+
+/* map the cache and search each sequence */
+
+void  scan_cache( void )
+   {
+    int                   fd;
+    struct stat           st;
+    const unsigned char  *base, *p, *end;
+    const unsigned char  *top, *ga, *cpg, *amb;
+    const char           *top_amb, *ga_amb;
+    unsigned int          hdr_len;
+    uint64_t              len, n_amb;
+    size_t                n2, n1;
+    static char           hdr[MAX_HDR_LEN+1];
+
+    if ( (fd = open( cache_in, O_RDONLY )) < 0 || fstat( fd, &st ) < 0 )
+       {
+        perror( cache_in );
+        exit( errno );
+       }
+    if ( st.st_size < CACHE_MAGIC_LEN )
+       {
+        fprintf( stderr, "%s is not a prosearch bisulfite cache\n", cache_in );
+        exit( 1 );
+       }
+    base = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if ( base == MAP_FAILED )
+       {
+        perror( cache_in );
+        exit( errno );
+       }
+    if ( memcmp( base, CACHE_MAGIC, CACHE_MAGIC_LEN ) != 0 )
+       {
+        fprintf( stderr, "%s is not a prosearch bisulfite cache\n", cache_in );
+        exit( 1 );
+       }
+    madvise( (void *) base, st.st_size, MADV_SEQUENTIAL );
+
+    end = base + st.st_size;
+    for ( p = base + CACHE_MAGIC_LEN; p < end; )
+       {
+        if ( end - p < sizeof( hdr_len ) )
+            break;
+        memcpy( &hdr_len, p, sizeof( hdr_len ) );
+        p += sizeof( hdr_len );
+        if ( hdr_len > MAX_HDR_LEN || end - p < hdr_len + 2 * sizeof(len) )
+            break;
+        memcpy( hdr, p, hdr_len );
+        hdr[hdr_len] = '\0';
+        p += hdr_len;
+        memcpy( &len, p, sizeof( len ) );
+        p += sizeof( len );
+        memcpy( &n_amb, p, sizeof( n_amb ) );
+        p += sizeof( n_amb );
+        n2 = (len + 3) >> 2;
+        n1 = (len + 7) >> 3;
+        if ( end - p < 2 * n2 + 2 * n1 + 2 * n_amb )
+            break;
+        top = p;                  p += n2;
+        ga  = p;                  p += n2;
+        cpg = p;                  p += n1;
+        amb = p;                  p += n1;
+        top_amb = (const char *) p;  p += n_amb;
+        ga_amb  = (const char *) p;  p += n_amb;
+
+        if ( verbose )
+            printf( "seq: %s\n", hdr );
+        if ( summary_mode )
+            summary_begin_seq( hdr );
+        scan_record( top, ga, cpg, amb, top_amb, ga_amb, len, hdr );
+        if ( summary_mode )
+            summary_end_seq( len );
+       }
+    if ( p != end )
+       {
+        fprintf( stderr, "%s: truncated or corrupt bisulfite cache\n", 
+                          cache_in );
+        exit( 1 );
+       }
+    munmap( (void *) base, st.st_size );
+    close( fd );
+   }
+
+
                               /****************/
                               /* Main Program */
                               /****************/
@@ -835,13 +1947,24 @@ int  main( int argc, char **argv )
     int     i;
 
     parse_args( argc, argv, &nfiles, &filenames );
+    if ( cache_out != NULL )
+       {
+        write_cache( nfiles, filenames );
+        exit( 0 );
+       }
     templ_len = strlen( templ );
 
     if ( verbose )
         printf( "mismatch threshold: %d\n", mis_thresh );
 
-    generate_permutations();
+    if ( edit_thresh > 0 )
+        init_approx( bisulfite_level > 0 ? 2 : 1 );
+    else
+        generate_permutations();
 
-    for ( i = 0; i < nfiles; i++ )
-        scan_file( filenames[i] );
+    if ( cache_in != NULL )
+        scan_cache();
+    else
+        for ( i = 0; i < nfiles; i++ )
+            scan_file( filenames[i] );
    }
@@ -0,0 +1,1722 @@
+/* Program:     samcount.c                                                   */
+/* Programmer:  Sean R. McCorkle                                             */
+/*              Biology Dept. Brookhaven National Laboratory                 */
+/* Language:    C                                                            */
+/*                                                                           */
+/* Description: Reads SAM or BAM alignments and reports read counts for a    */
+/*              table of features (genes, transcripts ...) and/or the read   */
+/*              depth along the reference, as a bedGraph                     */
+/*                                                                           */
+/* Notes:       Input may be SAM, gzipped SAM, BGZF SAM or BAM; which is     */
+/*              found from the data.  BGZF (BAM and bgzipped files) is a     */
+/*              series of independent deflate blocks of at most 64k, so a    */
+/*              run of blocks is read and then inflated by -t threads at     */
+/*              once, each block to its own place in the output.             */
+/*                                                                           */
+/*              The inflated alignments are then taken a batch at a time and */
+/*              split among the threads.  Only the fields needed (FLAG,      */
+/*              RNAME, POS, MAPQ and CIGAR) are looked at: in SAM by finding */
+/*              the first six tabs, in BAM at their fixed offsets.  A read's */
+/*              aligned blocks are the runs of M, D, = and X in its CIGAR    */
+/*              (N, a spliced intron, separates blocks), as bedtools         */
+/*              genomecov -split has them.                                   */
+/*                                                                           */
+/*              Depth is kept as a difference array for each reference: +1   */
+/*              where a block starts and -1 where it ends, added atomically  */
+/*              by the threads; a running sum then gives the depth.  The     */
+/*              array is in pages of 64k positions, made only when a read    */
+/*              lands in them.  For input sorted by coordinate (@HD SO:      */
+/*              coordinate), pages behind the current position are written   */
+/*              out and freed as reading goes on, so memory stays small.     */
+/*                                                                           */
+/*              SAM with no @SQ header lines (as samtools view writes by     */
+/*              default) is taken to be on the references its reads name,   */
+/*              in the order they first come, each as long as the furthest   */
+/*              a read on it reaches.  They're added a batch at a time,      */
+/*              before the threads count it.                                 */
+/*                                                                           */
+/*              Features are kept in an implicit interval tree for each      */
+/*              chromosome (see overlapper.c); a read counts once for each   */
+/*              feature that any of its blocks overlap.                      */
+/*                                                                           */
+/*              BAM data is taken to be little endian, as the host is.       */
+/*                                                                           */
+/* Compiling:   cc -O3 -o samcount samcount.c -lz -lpthread                  */
+/*                                                                           */
+/*****************************************************************************/
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+static char rcsvers[] = "$Revision: 1.1 $";
+
+#define  MAX_THREADS     256
+#define  READ_SIZE       (16 << 20)   /* input is read this much at a time */
+#define  MAX_LEVELS       64          /* of an interval tree */
+#define  PAGE_BITS        16          /* depth pages of 64k positions */
+#define  PAGE_SIZE       ( 1 << PAGE_BITS )
+#define  SKIP_FLAGS      0xb04        /* unmapped, secondary, QC fail, */
+                                      /* supplementary reads */
+
+/* globals set by command line options */
+
+char *features_file      = NULL;   /* set by -f */
+char *bedgraph_file      = NULL;   /* set by -b */
+int   min_mapq           = 0;      /* set by -q */
+int   n_threads          = 1;      /* set by -t */
+
+int   depth_wanted;                /* write a bedGraph */
+FILE *bedgraph;
+
+unsigned char  is_space[256];      /* 1 if whitespace */
+signed char    cigar_op[256];      /* CIGAR letter -> BAM op, or -1 */
+
+#define  OP_M    0                 /* BAM CIGAR ops */
+#define  OP_D    2
+#define  OP_N    3
+#define  OP_EQ   7
+#define  OP_X    8
+
+
+/* version() - print program name and version */
+
+void  version( void )
+   {
+    char *v;
+    for ( v = rcsvers; *v && *v != ' '; v++ )
+        ;
+    v++;
+    v[strlen(v)-1] = '\0';
+    fprintf( stderr, "\nsamcount     version %s\n", v );
+   }
+
+
+/* usage() - print help */
+
+void usage( void )
+   {
+    fprintf( stderr, " \n\
+Usage:       samcount [-f<features>] [-b<bedgraph>] [-q<n>] [-t<n>] [-hV] \n\
+                      [alignment-file]                                    \n\
+                                                                          \n\
+             where alignment-file is SAM or BAM (plain, gzipped or        \n\
+             bgzipped SAM, or BAM: which is found from the data).  The    \n\
+             name \"-\" means stdin, which is read if no file is given.   \n\
+                                                                          \n\
+             Unmapped, secondary, supplementary and QC-failed reads are   \n\
+             left out.  The aligned blocks of a read are its runs of M,   \n\
+             D, = and X CIGAR operations (N separates them).  SAM with    \n\
+             no @SQ header lines is taken to be on the references its     \n\
+             reads name, each as long as they reach.                      \n\
+                                                                          \n\
+Options:     -f<f>   count reads on the features in <f>, a table of       \n\
+                                                                          \n\
+                        <chr>  <start> <stop>  [<dir> [...]]              \n\
+                                                                          \n\
+                     (start and stop 1-based and included, any order, may \n\
+                     overlap), and print each line of it with two numbers \n\
+                     added: the reads with a block overlapping the        \n\
+                     feature, and those of them overlapping no other      \n\
+                     feature                                              \n\
+             -b<f>   write the read depth to bedGraph file <f> (\"-\" for   \n\
+                     stdout, but not with -f, whose table goes there):    \n\
+                     runs of positions with the same depth, as <chr>      \n\
+                     <start> <end> <depth>, 0-based and end not included, \n\
+                     depth 0 left out.  Without -f, this goes to stdout   \n\
+             -q<n>   leave out reads with mapping quality below <n>       \n\
+             -t<n>   inflate and count with <n> threads                   \n\
+             -V      print version                                        \n\
+             -h      print help message                                   \n\
+                                                                          \n\
+" );
+
+   }
+
+
+/* extract command line arguments and options */
+
+void parse_args ( int argc, char **argv, char **filename )
+   {
+    int    c;
+
+    while ( (c = getopt( argc, argv, "b:f:hq:t:V")) != -1 )
+        switch ( c )
+           {
+            case 'b':  bedgraph_file = optarg;      break;
+            case 'f':  features_file = optarg;      break;
+            case 'q':  min_mapq = atoi( optarg );   break;
+            case 't':  n_threads = atoi( optarg );
+                       if ( n_threads < 1 || n_threads > MAX_THREADS )
+                          {
+                           fprintf( stderr, "-t must be in range 1-%d\n",
+                                            MAX_THREADS );
+                           exit( 1 );
+                          }
+                       break;
+            case 'V':  version();               exit(0);
+            case 'h':  version();
+                       usage();
+                       exit(0);
+            default:   usage();                 exit(1);
+           }
+    argc -= optind;
+    argv += optind;
+    if ( argc > 1 )
+       {
+        usage();
+        exit( 1 );
+       }
+    *filename = argc > 0 ? argv[0] : "-";
+    if ( features_file && bedgraph_file && strcmp( bedgraph_file, "-" ) == 0 )
+       {
+        fprintf( stderr, "-b - can't be used with -f: the feature table "
+                         "goes to stdout\n" );
+        exit( 1 );
+       }
+    depth_wanted = bedgraph_file || ! features_file;
+   }
+
+
+/*********************************************************************/
+/* open_file() opens a file or returns stdin if name is "-", or does */
+/* error exit if file can't be opened                                */
+/*********************************************************************/
+
+FILE *open_file( char *name )
+   {
+    FILE *f;
+
+    if ( strcmp( name, "-" ) == 0 )
+        return( stdin );
+    else
+        if ( (f = fopen( name, "r" ) ) )
+            return( f );
+        else
+           {
+            perror( name );
+            exit( errno );
+           }
+   }
+
+
+/* close_file() closes the file unless its stdin */
+
+void  close_file( FILE *f )
+   {
+    if ( f != stdin )
+        fclose( f );
+   }
+
+
+void  *malloc_safely( size_t n_bytes )   /* malloc() or error exit */
+   {
+    void  *p;
+
+    if ( !(p = malloc( n_bytes )) )
+       {
+        fprintf( stderr, "failed to malloc %lu bytes\n",
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+void  *realloc_safely( void *p, size_t n_bytes )   /* same for realloc() */
+   {
+    if ( !(p = realloc( p, n_bytes )) )
+       {
+        fprintf( stderr, "failed to realloc %lu bytes\n",
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+
+typedef struct buffer {                       /* growable byte buffer */
+                        char    *p;
+                        size_t   n;
+                        size_t   size;
+                      } BUFFER;
+
+void  buf_need( BUFFER *b, size_t n )          /* make room for n more */
+   {
+    if ( b->n + n <= b->size )
+        return;
+    if ( b->size == 0 )
+        b->size = 65536;
+    while ( b->n + n > b->size )
+        b->size *= 2;
+    b->p = realloc_safely( b->p, b->size );
+   }
+
+
+char  *fmt_uint( char *p, uint64_t v )
+   {
+    char  digits[24];
+    int   n = 0;
+
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+       } while ( v > 0 );
+    while ( n > 0 )
+        *p++ = digits[--n];
+    return( p );
+   }
+
+
+/* parse the integer at p (before e) into *v; returns the position */
+/* after it, or NULL if there isn't one                             */
+
+const char  *parse_int( const char *p, const char *e, int64_t *v )
+   {
+    int64_t  x = 0;
+    int      neg = 0;
+    const char  *s;
+
+    if ( p < e && ( *p == '-' || *p == '+' ) )
+        neg = *p++ == '-';
+    for ( s = p; p < e && *p >= '0' && *p <= '9'; p++ )
+        x = x * 10 + ( *p - '0' );
+    if ( p == s )
+        return( NULL );
+    *v = neg ? -x : x;
+    return( p );
+   }
+
+
+static inline uint32_t  get32( const char *p )     /* little endian */
+   {
+    uint32_t  v;
+
+    memcpy( &v, p, 4 );
+    return( v );
+   }
+
+
+static inline uint16_t  get16( const char *p )
+   {
+    return( (unsigned char) p[0] | ( (unsigned char) p[1] << 8 ) );
+   }
+
+
+                            /********************/
+                            /* Tables of names  */
+                            /********************/
+
+typedef struct names {
+                       char     **name;
+                       uint32_t   n;
+                       uint32_t  *slots;    /* name index + 1, or 0 */
+                       size_t     n_slots;  /* a power of 2 */
+                     } NAMES;
+
+
+static inline uint32_t  hash_name( const char *s, size_t n )
+   {
+    uint32_t  h = 2166136261U;                  /* FNV-1a */
+
+    while ( n-- > 0 )
+        h = ( h ^ (unsigned char) *s++ ) * 16777619U;
+    return( h );
+   }
+
+
+/* index of name s (length n) in t, or -1 */
+
+long  find_name( const NAMES *t, const char *s, size_t n )
+   {
+    size_t    i;
+    uint32_t  c;
+
+    if ( t->n_slots == 0 )
+        return( -1 );
+    for ( i = hash_name( s, n ) & ( t->n_slots - 1 ); (c = t->slots[i]);
+          i = ( i + 1 ) & ( t->n_slots - 1 ) )
+        if ( strncmp( t->name[c-1], s, n ) == 0 && t->name[c-1][n] == '\0' )
+            return( c - 1 );
+    return( -1 );
+   }
+
+
+/* index of name s (length n) in t, added if new */
+
+uint32_t  add_name( NAMES *t, const char *s, size_t n )
+   {
+    long      c = find_name( t, s, n );
+    size_t    i, j;
+
+    if ( c >= 0 )
+        return( c );
+    if ( 2 * ( t->n + 1 ) > t->n_slots )              /* keep half empty */
+       {
+        t->n_slots = t->n_slots == 0 ? 1024 : 2 * t->n_slots;
+        free( t->slots );
+        t->slots = malloc_safely( t->n_slots * sizeof( uint32_t ) );
+        memset( t->slots, 0, t->n_slots * sizeof( uint32_t ) );
+        for ( j = 0; j < t->n; j++ )
+           {
+            for ( i = hash_name( t->name[j], strlen( t->name[j] ) )
+                          & ( t->n_slots - 1 ); t->slots[i];
+                  i = ( i + 1 ) & ( t->n_slots - 1 ) )
+                ;
+            t->slots[i] = j + 1;
+           }
+        t->name = realloc_safely( t->name, t->n_slots / 2 * sizeof( char * ) );
+       }
+    t->name[t->n] = malloc_safely( n + 1 );
+    memcpy( t->name[t->n], s, n );
+    t->name[t->n][n] = '\0';
+    for ( i = hash_name( s, n ) & ( t->n_slots - 1 ); t->slots[i];
+          i = ( i + 1 ) & ( t->n_slots - 1 ) )
+        ;
+    t->slots[i] = t->n + 1;
+    return( t->n++ );
+   }
+
+
+                     /***************************************/
+                     /* Features, and their interval trees  */
+                     /***************************************/
+
+typedef struct iv {
+                    int64_t   start;        /* 0-based */
+                    int64_t   end;          /* not included */
+                    int64_t   max;          /* largest end in subtree */
+                    uint32_t  id;           /* feature number */
+                  } IV;
+
+typedef struct chrom {
+                       IV       *iv;
+                       size_t    n;
+                       size_t    size;
+                       int       levels;    /* of the tree */
+                     } CHROM;
+
+typedef struct fline {
+                       size_t    off;       /* in feature_text */
+                       size_t    len;
+                       long      id;        /* feature number, or -1 */
+                     } FLINE;
+
+NAMES      chrom_names;            /* feature chromosomes */
+CHROM     *chroms = NULL;
+size_t     chroms_size = 0;
+BUFFER     feature_text;           /* the features file */
+FLINE     *flines;
+size_t     n_flines = 0;
+uint32_t   n_features = 0;
+uint64_t  *feature_reads;          /* reads on each feature */
+uint64_t  *feature_unique;         /* those on no other feature */
+
+
+/* parse the chromosome, start and stop of feature line p..e-1; returns */
+/* 0 for a line to skip, 1 for a feature, and -1 if it's bad            */
+
+int  parse_interval( const char *p, const char *e, const char **chr,
+                     size_t *chr_len, int64_t *start, int64_t *stop )
+   {
+    const char  *q;
+    int          k;
+    int64_t     *v;
+
+    while ( p < e && is_space[ (unsigned char) *p ] )
+        p++;
+    for ( *chr = p; p < e && ! is_space[ (unsigned char) *p ]; p++ )
+        ;
+    *chr_len = p - *chr;
+    if ( *chr_len == 0 || **chr == '#' )
+        return( 0 );
+    for ( k = 0; k < 2; k++ )
+       {
+        v = k == 0 ? start : stop;
+        while ( p < e && is_space[ (unsigned char) *p ] )
+            p++;
+        if ( ! (q = parse_int( p, e, v ))
+                || ( q < e && ! is_space[ (unsigned char) *q ] ) )
+            return( -1 );
+        p = q;
+       }
+    return( 1 );
+   }
+
+
+int  by_start( const void *a, const void *b )
+   {
+    const IV  *x = (const IV *) a;
+    const IV  *y = (const IV *) b;
+
+    return( x->start < y->start ? -1 : x->start > y->start );
+   }
+
+
+/* sort c's intervals by start and fill in the max ends of the implicit */
+/* tree (cgranges' cr_index_core(), as in overlapper.c)                  */
+
+void  index_chrom( CHROM *c )
+   {
+    IV       *a = c->iv;
+    int64_t   n = c->n;
+    int64_t   i, last_i = 0, last = 0, x, i0, step, e;
+    int       k;
+
+    qsort( a, n, sizeof( IV ), by_start );
+    for ( i = 0; i < n; i += 2 )                /* leaves */
+       {
+        last_i = i;
+        last = a[i].max = a[i].end;
+       }
+    for ( k = 1; ( (int64_t) 1 << k ) <= n; k++ )
+       {
+        x = (int64_t) 1 << ( k - 1 );
+        i0 = ( x << 1 ) - 1;
+        step = x << 2;
+        for ( i = i0; i < n; i += step )
+           {
+            e = a[i].end;
+            if ( a[i-x].max > e )
+                e = a[i-x].max;
+            if ( ( i + x < n ? a[i+x].max : last ) > e )
+                e = i + x < n ? a[i+x].max : last;
+            a[i].max = e;
+           }
+        last_i = ( last_i >> k ) & 1 ? last_i - x : last_i + x;
+        if ( last_i < n && a[last_i].max > last )
+            last = a[last_i].max;
+       }
+    c->levels = k - 1;
+   }
+
+
+/* read the features file into chroms[], and index them */
+
+void  read_features( char *name )
+   {
+    FILE        *f = open_file( name );
+    const char  *p, *e, *chr;
+    size_t       chr_len, i;
+    int64_t      start, stop;
+    uint32_t     c, n_chroms;
+    CHROM       *ch;
+    size_t       m;
+
+    do {
+        buf_need( &feature_text, READ_SIZE );
+        m = fread( feature_text.p + feature_text.n, 1, READ_SIZE, f );
+        feature_text.n += m;
+       } while ( m > 0 );
+    if ( ferror( f ) )
+       {
+        perror( name );
+        exit( errno );
+       }
+    close_file( f );
+    for ( i = 0, p = feature_text.p; p < feature_text.p + feature_text.n;
+          p = e + 1 )
+        if ( ! (e = memchr( p, '\n', feature_text.p + feature_text.n - p )) )
+            e = feature_text.p + feature_text.n;
+        else
+            i++;
+    flines = malloc_safely( ( i + 1 ) * sizeof( FLINE ) );
+    for ( p = feature_text.p; p < feature_text.p + feature_text.n;
+          p = e + 1 )
+       {
+        if ( ! (e = memchr( p, '\n', feature_text.p + feature_text.n - p )) )
+            e = feature_text.p + feature_text.n;
+        flines[n_flines].off = p - feature_text.p;
+        flines[n_flines].len = e - p;
+        flines[n_flines].id = -1;
+        switch ( parse_interval( p, e, &chr, &chr_len, &start, &stop ) )
+           {
+            case -1:  fprintf( stderr, "bad feature at line %lu of %s\n",
+                                       (unsigned long) n_flines + 1, name );
+                      exit( 1 );
+            case 1:   n_chroms = chrom_names.n;
+                      c = add_name( &chrom_names, chr, chr_len );
+                      if ( c >= chroms_size )
+                         {
+                          chroms_size = chrom_names.n_slots;
+                          chroms = realloc_safely( chroms,
+                                             chroms_size * sizeof( CHROM ) );
+                         }
+                      if ( c == n_chroms )                   /* new one */
+                          memset( &chroms[c], 0, sizeof( CHROM ) );
+                      ch = &chroms[c];
+                      if ( ch->n >= ch->size )
+                         {
+                          ch->size = ch->size == 0 ? 64 : 2 * ch->size;
+                          ch->iv = realloc_safely( ch->iv,
+                                                   ch->size * sizeof( IV ) );
+                         }
+                      ch->iv[ch->n].start = start - 1;
+                      ch->iv[ch->n].end = stop;
+                      ch->iv[ch->n].id = n_features;
+                      if ( stop >= start )        /* else it's empty */
+                          ch->n++;
+                      flines[n_flines].id = n_features++;
+           }
+        n_flines++;
+       }
+    for ( c = 0; c < chrom_names.n; c++ )
+        index_chrom( &chroms[c] );
+    feature_reads = malloc_safely( ( n_features + 1 ) * sizeof( uint64_t ) );
+    feature_unique = malloc_safely( ( n_features + 1 ) * sizeof( uint64_t ) );
+    memset( feature_reads, 0, ( n_features + 1 ) * sizeof( uint64_t ) );
+    memset( feature_unique, 0, ( n_features + 1 ) * sizeof( uint64_t ) );
+   }
+
+
+/* print the features file, with the counts added */
+
+void  report_features( void )
+   {
+    BUFFER  o = { NULL, 0, 0 };
+    size_t  i;
+    char   *p;
+
+    for ( i = 0; i < n_flines; i++ )
+       {
+        buf_need( &o, flines[i].len + 48 );
+        memcpy( o.p + o.n, feature_text.p + flines[i].off, flines[i].len );
+        p = o.p + o.n + flines[i].len;
+        if ( flines[i].id >= 0 )
+           {
+            *p++ = ' ';
+            p = fmt_uint( p, feature_reads[ flines[i].id ] );
+            *p++ = ' ';
+            p = fmt_uint( p, feature_unique[ flines[i].id ] );
+           }
+        *p++ = '\n';
+        o.n = p - o.p;
+        if ( o.n >= READ_SIZE || i == n_flines - 1 )
+           {
+            if ( fwrite( o.p, 1, o.n, stdout ) != o.n )
+               {
+                perror( "samcount: write" );
+                exit( errno );
+               }
+            o.n = 0;
+           }
+       }
+    free( o.p );
+   }
+
+
+                  /*********************************************/
+                  /* References, and their depth pages         */
+                  /*********************************************/
+
+typedef struct ref {
+                     int64_t    len;
+                     int32_t  **pages;      /* difference array pages, */
+                     size_t     n_pages;    /* NULL till a read lands  */
+                     long       chrom;      /* features, or -1 */
+                     size_t     written;    /* pages written out */
+                     int64_t    depth;      /* running sum there */
+                     int64_t    run_start;  /* the run of that depth */
+                   } REF;
+
+NAMES   ref_names;
+REF    *refs = NULL;
+size_t  refs_size = 0;
+int     sorted_input = 0;          /* header says SO:coordinate */
+int     add_refs = 0;              /* SAM with no @SQ lines */
+BUFFER  bedgraph_out;
+
+
+/* add reference s (length n) of length len, from the header; its index */
+
+uint32_t  add_ref( const char *s, size_t n, int64_t len )
+   {
+    uint32_t  r;
+
+    if ( find_name( &ref_names, s, n ) >= 0 )
+       {
+        fprintf( stderr, "reference %.*s appears twice in header\n",
+                         (int) n, s );
+        exit( 1 );
+       }
+    r = add_name( &ref_names, s, n );
+    if ( r >= refs_size )
+       {
+        refs_size = ref_names.n_slots;
+        refs = realloc_safely( refs, refs_size * sizeof( REF ) );
+       }
+    memset( &refs[r], 0, sizeof( REF ) );
+    refs[r].len = len > 0 ? len : 0;
+    refs[r].chrom = features_file
+                          ? find_name( &chrom_names, s, n ) : -1;
+    if ( depth_wanted )
+       {          /* room for the -1 at len */
+        refs[r].n_pages = ( refs[r].len >> PAGE_BITS ) + 1;
+        refs[r].pages = malloc_safely( refs[r].n_pages * sizeof( int32_t * ) );
+        memset( refs[r].pages, 0, refs[r].n_pages * sizeof( int32_t * ) );
+       }
+    return( r );
+   }
+
+
+/* make reference r (not in a header) len long */
+
+void  grow_ref( uint32_t r, int64_t len )
+   {
+    REF     *ref = &refs[r];
+    size_t   n = ( len >> PAGE_BITS ) + 1;
+
+    ref->len = len;
+    if ( depth_wanted && n > ref->n_pages )
+       {
+        ref->pages = realloc_safely( ref->pages, n * sizeof( int32_t * ) );
+        memset( ref->pages + ref->n_pages, 0,
+                ( n - ref->n_pages ) * sizeof( int32_t * ) );
+        ref->n_pages = n;
+       }
+   }
+
+
+/* add v to the difference array of ref at position p */
+
+static inline void  diff_add( REF *ref, int64_t p, int32_t v )
+   {
+    int32_t  **slot = &ref->pages[ p >> PAGE_BITS ];
+    int32_t   *page = __atomic_load_n( slot, __ATOMIC_ACQUIRE );
+    int32_t   *new;
+
+    if ( ! page )
+       {
+        new = malloc_safely( PAGE_SIZE * sizeof( int32_t ) );
+        memset( new, 0, PAGE_SIZE * sizeof( int32_t ) );
+        if ( __atomic_compare_exchange_n( slot, &page, new, 0,
+                                          __ATOMIC_ACQ_REL,
+                                          __ATOMIC_ACQUIRE ) )
+            page = new;
+        else
+            free( new );                  /* another thread made it */
+       }
+    __atomic_fetch_add( &page[ p & ( PAGE_SIZE - 1 ) ], v, __ATOMIC_RELAXED );
+   }
+
+
+void  write_bedgraph( int force )
+   {
+    if ( bedgraph_out.n > 0 && ( force || bedgraph_out.n >= READ_SIZE ) )
+       {
+        if ( fwrite( bedgraph_out.p, 1, bedgraph_out.n, bedgraph )
+                != bedgraph_out.n )
+           {
+            perror( bedgraph_file ? bedgraph_file : "samcount: write" );
+            exit( errno );
+           }
+        bedgraph_out.n = 0;
+       }
+   }
+
+
+/* bedGraph line for positions [s, e) of reference r at depth d */
+
+void  emit_run( uint32_t r, int64_t s, int64_t e, int64_t d )
+   {
+    const char  *name = ref_names.name[r];
+    size_t       n = strlen( name );
+    char        *p;
+
+    buf_need( &bedgraph_out, n + 3 * 24 );
+    p = bedgraph_out.p + bedgraph_out.n;
+    memcpy( p, name, n );
+    p += n;
+    *p++ = '\t';
+    p = fmt_uint( p, s );
+    *p++ = '\t';
+    p = fmt_uint( p, e );
+    *p++ = '\t';
+    p = fmt_uint( p, d );
+    *p++ = '\n';
+    bedgraph_out.n = p - bedgraph_out.p;
+    write_bedgraph( 0 );
+   }
+
+
+/* write the depth of reference r from where it was left to the start */
+/* of page upto (all of it, if upto is n_pages), freeing the pages    */
+
+void  write_depth( uint32_t r, size_t upto )
+   {
+    REF      *ref = &refs[r];
+    int32_t  *page;
+    int64_t   p, e, d;
+    size_t    g;
+    int       i;
+
+    for ( g = ref->written; g < upto; g++ )
+       {
+        if ( ! (page = ref->pages[g]) )
+            continue;                        /* no change in depth */
+        p = (int64_t) g << PAGE_BITS;
+        e = p + PAGE_SIZE <= ref->len + 1 ? PAGE_SIZE : ref->len + 1 - p;
+        for ( i = 0; i < e; i++ )
+            if ( page[i] != 0 )
+               {
+                d = ref->depth + page[i];
+                if ( ref->depth > 0 )
+                    emit_run( r, ref->run_start, p + i, ref->depth );
+                ref->depth = d;
+                ref->run_start = p + i;
+               }
+        free( page );
+        ref->pages[g] = NULL;
+       }
+    if ( upto > ref->written )
+        ref->written = upto;
+    if ( upto == ref->n_pages && ref->depth > 0 )  /* reads off the end */
+       {
+        emit_run( r, ref->run_start, ref->len, ref->depth );
+        ref->depth = 0;
+       }
+   }
+
+
+                      /*************************************/
+                      /* Input: plain, gzip and BGZF       */
+                      /*************************************/
+
+#define  PLAIN       0
+#define  GZIP        1
+#define  BGZF        2
+
+typedef struct block {                 /* a BGZF block to inflate */
+                       size_t   in;    /* offset of deflate data */
+                       size_t   in_len;
+                       size_t   out;   /* offset of its output */
+                       size_t   out_len;
+                     } BLOCK;
+
+typedef struct stream {
+                        FILE     *f;
+                        char     *name;
+                        int       kind;
+                        int       eof;      /* of f */
+                        BUFFER    in;       /* compressed data */
+                        size_t    in_off;   /* taken so far */
+                        z_stream  z;        /* for GZIP */
+                        BLOCK    *blocks;
+                        size_t    n_blocks;
+                        size_t    blocks_size;
+                      } STREAM;
+
+
+/* read more of s's file into s->in (after what's been taken) */
+
+void  read_in( STREAM *s )
+   {
+    size_t  m;
+
+    if ( s->in_off > 0 )
+       {
+        memmove( s->in.p, s->in.p + s->in_off, s->in.n - s->in_off );
+        s->in.n -= s->in_off;
+        s->in_off = 0;
+       }
+    buf_need( &s->in, READ_SIZE );
+    m = fread( s->in.p + s->in.n, 1, READ_SIZE, s->f );
+    s->in.n += m;
+    if ( m < READ_SIZE )
+       {
+        if ( ferror( s->f ) )
+           {
+            perror( s->name );
+            exit( errno );
+           }
+        s->eof = 1;
+       }
+   }
+
+
+/* 1 if a BGZF block header starts at p (n bytes there) */
+
+int  bgzf_header( const unsigned char *p, size_t n )
+   {
+    return( n >= 18 && p[0] == 31 && p[1] == 139 && p[2] == 8 && ( p[3] & 4 )
+               && get16( (const char *) p + 10 ) >= 6
+               && p[12] == 'B' && p[13] == 'C' && get16( (const char *) p + 14 )
+                                                                        == 2 );
+   }
+
+
+void  stream_open( STREAM *s, FILE *f, char *name )
+   {
+    memset( s, 0, sizeof( STREAM ) );
+    s->f = f;
+    s->name = name;
+    read_in( s );
+    if ( s->in.n >= 2 && (unsigned char) s->in.p[0] == 31
+                      && (unsigned char) s->in.p[1] == 139 )
+       {
+        if ( bgzf_header( (unsigned char *) s->in.p, s->in.n ) )
+            s->kind = BGZF;
+        else
+           {
+            s->kind = GZIP;
+            if ( inflateInit2( &s->z, 15 + 32 ) != Z_OK )
+               {
+                fprintf( stderr, "inflateInit2 failed\n" );
+                exit( 1 );
+               }
+           }
+       }
+   }
+
+
+typedef struct worker {
+                        pthread_t   thread;
+                        int         id;
+                        z_stream    z;        /* for BGZF blocks */
+                        int         z_ready;
+                        STREAM     *s;
+                        char       *out;      /* where they inflate to */
+                        const char *data;     /* SAM lines, or BAM records */
+                        size_t      from;
+                        size_t      to;
+                        uint32_t   *cigar;    /* as BAM ops */
+                        size_t      cigar_size;
+                        uint32_t   *hits;     /* features of a read */
+                        size_t      n_hits;
+                        size_t      hits_size;
+                        int         any;      /* read order, for sorted */
+                        int         unsorted; /* input */
+                        uint64_t    first;
+                        uint64_t    last;
+                        uint64_t    missing;  /* reads on no header ref */
+                      } WORKER;
+
+WORKER  workers[MAX_THREADS];
+
+
+void  *inflate_worker( void *arg )
+   {
+    WORKER  *w = (WORKER *) arg;
+    STREAM  *s = w->s;
+    BLOCK   *b;
+    size_t   i;
+
+    if ( ! w->z_ready )
+       {
+        if ( inflateInit2( &w->z, -15 ) != Z_OK )
+           {
+            fprintf( stderr, "inflateInit2 failed\n" );
+            exit( 1 );
+           }
+        w->z_ready = 1;
+       }
+    for ( i = w->id; i < s->n_blocks; i += n_threads )
+       {
+        b = &s->blocks[i];
+        inflateReset( &w->z );
+        w->z.next_in = (unsigned char *) s->in.p + b->in;
+        w->z.avail_in = b->in_len;
+        w->z.next_out = (unsigned char *) w->out + b->out;
+        w->z.avail_out = b->out_len;
+        if ( inflate( &w->z, Z_FINISH ) != Z_STREAM_END
+                || w->z.avail_out != 0 )
+           {
+            fprintf( stderr, "%s: bad BGZF block\n", s->name );
+            exit( 1 );
+           }
+       }
+    return( NULL );
+   }
+
+
+/* inflate the BGZF blocks complete in s->in onto the end of b, in */
+/* threads; returns the number of bytes added                      */
+
+size_t  fill_bgzf( STREAM *s, BUFFER *b )
+   {
+    const unsigned char  *p;
+    size_t                o, n, bsize, total = 0;
+    int                   t;
+
+    for ( ; ; )
+       {
+        s->n_blocks = 0;
+        for ( o = s->in_off; ; o += bsize )
+           {
+            p = (unsigned char *) s->in.p + o;
+            n = s->in.n - o;
+            if ( n < 18 )
+                break;
+            if ( ! bgzf_header( p, n ) )
+               {
+                fprintf( stderr, "%s: bad BGZF block header\n", s->name );
+                exit( 1 );
+               }
+            bsize = get16( (const char *) p + 16 ) + 1;
+            if ( n < bsize )
+                break;
+            if ( s->n_blocks >= s->blocks_size )
+               {
+                s->blocks_size = s->blocks_size == 0 ? 1024
+                                                     : 2 * s->blocks_size;
+                s->blocks = realloc_safely( s->blocks,
+                                            s->blocks_size * sizeof( BLOCK ) );
+               }
+            s->blocks[s->n_blocks].in = o + 12 + get16( (const char *) p + 10 );
+            s->blocks[s->n_blocks].in_len = o + bsize - 8
+                                                - s->blocks[s->n_blocks].in;
+            s->blocks[s->n_blocks].out = total;
+            s->blocks[s->n_blocks].out_len = get32( (const char *) p
+                                                    + bsize - 4 );
+            total += s->blocks[s->n_blocks++].out_len;
+           }
+        if ( s->n_blocks > 0 || s->eof )
+            break;
+        read_in( s );                  /* not even one block yet */
+       }
+    if ( s->n_blocks == 0 )
+       {
+        if ( o < s->in.n )
+           {
+            fprintf( stderr, "%s: truncated BGZF file\n", s->name );
+            exit( 1 );
+           }
+        return( 0 );
+       }
+    buf_need( b, total );
+    for ( t = 0; t < n_threads; t++ )
+       {
+        workers[t].s = s;
+        workers[t].out = b->p + b->n;
+       }
+    if ( n_threads == 1 )
+        inflate_worker( &workers[0] );
+    else
+       {
+        for ( t = 0; t < n_threads; t++ )
+            if ( pthread_create( &workers[t].thread, NULL, inflate_worker,
+                                 &workers[t] ) != 0 )
+               {
+                perror( "can't create thread" );
+                exit( 1 );
+               }
+        for ( t = 0; t < n_threads; t++ )
+            pthread_join( workers[t].thread, NULL );
+       }
+    b->n += total;
+    s->in_off = o;
+    if ( ! s->eof )
+        read_in( s );
+    if ( total == 0 )                 /* only empty (EOF marker) blocks */
+        return( fill_bgzf( s, b ) );
+    return( total );
+   }
+
+
+/* inflate (plain gzip, one thread) onto the end of b */
+
+size_t  fill_gzip( STREAM *s, BUFFER *b )
+   {
+    size_t  before = b->n;
+    int     r;
+
+    buf_need( b, 4 * READ_SIZE );
+    while ( b->n == before )
+       {
+        if ( s->in_off == s->in.n )
+           {
+            if ( s->eof )
+                break;
+            read_in( s );
+            continue;
+           }
+        s->z.next_in = (unsigned char *) s->in.p + s->in_off;
+        s->z.avail_in = s->in.n - s->in_off;
+        s->z.next_out = (unsigned char *) b->p + b->n;
+        s->z.avail_out = b->size - b->n;
+        r = inflate( &s->z, Z_NO_FLUSH );
+        s->in_off = s->in.n - s->z.avail_in;
+        b->n = b->size - s->z.avail_out;
+        if ( r == Z_STREAM_END )
+            inflateReset( &s->z );         /* another member may follow */
+        else if ( r != Z_OK && r != Z_BUF_ERROR )
+           {
+            fprintf( stderr, "%s: bad gzip data\n", s->name );
+            exit( 1 );
+           }
+        else if ( r == Z_BUF_ERROR && s->eof && s->in_off == s->in.n )
+           {
+            fprintf( stderr, "%s: truncated gzip file\n", s->name );
+            exit( 1 );
+           }
+       }
+    return( b->n - before );
+   }
+
+
+/* add the next piece of (uncompressed) input onto the end of b; */
+/* returns the number of bytes added, 0 at the end               */
+
+size_t  stream_fill( STREAM *s, BUFFER *b )
+   {
+    size_t  n;
+
+    switch ( s->kind )
+       {
+        case BGZF:  return( fill_bgzf( s, b ) );
+        case GZIP:  return( fill_gzip( s, b ) );
+       }
+    if ( s->in_off == s->in.n && ! s->eof )
+        read_in( s );
+    n = s->in.n - s->in_off;
+    buf_need( b, n );
+    memcpy( b->p + b->n, s->in.p + s->in_off, n );
+    b->n += n;
+    s->in_off = s->in.n;
+    return( n );
+   }
+
+
+/* fill b until it has at least n bytes, or error exit */
+
+void  stream_need( STREAM *s, BUFFER *b, size_t n )
+   {
+    while ( b->n < n )
+        if ( stream_fill( s, b ) == 0 )
+           {
+            fprintf( stderr, "%s: truncated\n", s->name );
+            exit( 1 );
+           }
+   }
+
+
+                         /*********************************/
+                         /* Counting reads, in threads    */
+                         /*********************************/
+
+/* add the features overlapping [st, en) on chromosome c to w->hits */
+
+void  feature_hits( WORKER *w, const CHROM *c, int64_t st, int64_t en )
+   {
+    struct { int64_t x; int k, w; }  stack[MAX_LEVELS+1];
+    const IV  *a = c->iv;
+    int64_t    n = c->n;
+    int64_t    i, i0, i1, y, x;
+    int        t = 0, k, wd;
+
+    if ( n == 0 )
+        return;
+    stack[t].k = c->levels;
+    stack[t].x = ( (int64_t) 1 << c->levels ) - 1;
+    stack[t++].w = 0;
+    while ( t > 0 )
+       {
+        t--;
+        x = stack[t].x;
+        k = stack[t].k;
+        wd = stack[t].w;
+        i0 = i1 = 0;
+        if ( k <= 3 )
+           {                     /* small subtree: look at them all */
+            i0 = x >> k << k;
+            i1 = i0 + ( (int64_t) 1 << ( k + 1 ) ) - 1;
+            if ( i1 > n )
+                i1 = n;
+           }
+        else if ( wd == 0 )
+           {                     /* left child not looked at yet */
+            y = x - ( (int64_t) 1 << ( k - 1 ) );
+            stack[t].x = x;
+            stack[t].k = k;
+            stack[t++].w = 1;
+            if ( y >= n || a[y].max > st )
+               {
+                stack[t].x = y;
+                stack[t].k = k - 1;
+                stack[t++].w = 0;
+               }
+           }
+        else if ( x < n && a[x].start < en )
+           {                     /* x itself, then the right child */
+            i0 = x;
+            i1 = x + 1;
+            stack[t].x = x + ( (int64_t) 1 << ( k - 1 ) );
+            stack[t].k = k - 1;
+            stack[t++].w = 0;
+           }
+        for ( i = i0; i < i1 && a[i].start < en; i++ )
+            if ( st < a[i].end )
+               {
+                if ( w->n_hits >= w->hits_size )
+                   {
+                    w->hits_size = w->hits_size == 0 ? 64
+                                                     : 2 * w->hits_size;
+                    w->hits = realloc_safely( w->hits,
+                                           w->hits_size * sizeof( uint32_t ) );
+                   }
+                w->hits[w->n_hits++] = a[i].id;
+               }
+       }
+   }
+
+
+/* an aligned block [s, e) of a read on reference r */
+
+static inline void  read_block( WORKER *w, REF *ref, int64_t s, int64_t e )
+   {
+    if ( s < 0 )
+        s = 0;
+    if ( e > ref->len )
+        e = ref->len;
+    if ( s >= e )
+        return;
+    if ( depth_wanted )
+       {
+        diff_add( ref, s, 1 );
+        diff_add( ref, e, -1 );
+       }
+    if ( ref->chrom >= 0 )
+        feature_hits( w, &chroms[ref->chrom], s, e );
+   }
+
+
+int  by_id( const void *a, const void *b )
+   {
+    uint32_t  x = *(const uint32_t *) a;
+    uint32_t  y = *(const uint32_t *) b;
+
+    return( x < y ? -1 : x > y );
+   }
+
+
+/* count a read on reference r at (0-based) pos with n CIGAR ops */
+
+void  count_read( WORKER *w, uint32_t r, int64_t pos, const uint32_t *cigar,
+                  int n )
+   {
+    REF      *ref = &refs[r];
+    int64_t   p = pos, bs = -1;
+    uint32_t  len, op;
+    size_t    i, j;
+    int       k;
+
+    w->n_hits = 0;
+    for ( k = 0; k < n; k++ )
+       {
+        len = cigar[k] >> 4;
+        op = cigar[k] & 0xf;
+        if ( op == OP_M || op == OP_D || op == OP_EQ || op == OP_X )
+           {
+            if ( bs < 0 )
+                bs = p;
+            p += len;
+           }
+        else if ( op == OP_N )
+           {
+            if ( bs >= 0 )
+                read_block( w, ref, bs, p );
+            bs = -1;
+            p += len;
+           }
+       }
+    if ( bs >= 0 )
+        read_block( w, ref, bs, p );
+    if ( w->n_hits == 0 )
+        return;
+    if ( w->n_hits > 1 )                     /* each feature once */
+       {
+        qsort( w->hits, w->n_hits, sizeof( uint32_t ), by_id );
+        for ( i = 1, j = 1; i < w->n_hits; i++ )
+            if ( w->hits[i] != w->hits[j-1] )
+                w->hits[j++] = w->hits[i];
+        w->n_hits = j;
+       }
+    for ( i = 0; i < w->n_hits; i++ )
+        __atomic_fetch_add( &feature_reads[ w->hits[i] ], 1,
+                            __ATOMIC_RELAXED );
+    if ( w->n_hits == 1 )
+        __atomic_fetch_add( &feature_unique[ w->hits[0] ], 1,
+                            __ATOMIC_RELAXED );
+   }
+
+
+/* note the position of a mapped read, for checking sorted input */
+
+static inline void  read_order( WORKER *w, uint32_t r, int64_t pos )
+   {
+    uint64_t  key = ( (uint64_t) r << 40 ) | (uint64_t) ( pos & 0xffffffffffLL );
+
+    if ( ! w->any )
+       {
+        w->any = 1;
+        w->first = key;
+       }
+    else if ( key < w->last )
+        w->unsorted = 1;
+    w->last = key;
+   }
+
+
+/* count the SAM read in line p..e-1 */
+
+void  sam_read( WORKER *w, const char *p, const char *e )
+   {
+    const char  *f[7];
+    const char  *q;
+    int64_t      flag, pos, mapq, len;
+    long         r;
+    int          i, n, op;
+
+    if ( *p == '@' )
+        return;
+    for ( i = 0; i < 6; i++ )                /* the first 6 fields */
+       {
+        f[i] = p;
+        if ( ! (q = memchr( p, '\t', e - p )) )
+            return;
+        p = q + 1;
+       }
+    f[6] = p;
+    if ( ! parse_int( f[1], f[2], &flag ) || ( flag & 4 )
+            || ! parse_int( f[3], f[4], &pos ) || pos <= 0
+            || ( f[2][0] == '*' && f[3] - f[2] == 2 ) )
+        return;                              /* unmapped */
+    if ( (r = find_name( &ref_names, f[2], f[3] - f[2] - 1 )) < 0 )
+       {
+        w->missing++;
+        return;
+       }
+    read_order( w, r, pos - 1 );
+    if ( ( flag & SKIP_FLAGS ) || ! parse_int( f[4], f[5], &mapq )
+            || mapq < min_mapq )
+        return;
+    for ( n = 0, p = f[5]; p < f[6] - 1; n++ )
+       {
+        if ( ! (q = parse_int( p, f[6] - 1, &len )) || q >= f[6] - 1
+                || (op = cigar_op[ (unsigned char) *q ]) < 0 )
+            return;                          /* no CIGAR, or bad */
+        if ( (size_t) n >= w->cigar_size )
+           {
+            w->cigar_size = w->cigar_size == 0 ? 64 : 2 * w->cigar_size;
+            w->cigar = realloc_safely( w->cigar,
+                                       w->cigar_size * sizeof( uint32_t ) );
+           }
+        w->cigar[n] = ( (uint32_t) len << 4 ) | op;
+        p = q + 1;
+       }
+    count_read( w, r, pos - 1, w->cigar, n );
+   }
+
+
+/* count the BAM record at p */
+
+void  bam_read( WORKER *w, const char *p )
+   {
+    int32_t   r = (int32_t) get32( p + 4 );
+    int32_t   pos = (int32_t) get32( p + 8 );
+    int       l_name = (unsigned char) p[12];
+    int       mapq = (unsigned char) p[13];
+    int       n = get16( p + 16 );
+    int       flag = get16( p + 18 );
+    int       i;
+
+    if ( 32 + l_name + 4 * (size_t) n > get32( p ) )
+        return;                              /* CIGAR past the end */
+    if ( r < 0 || pos < 0 || ( flag & 4 ) )
+        return;                              /* unmapped */
+    if ( (uint32_t) r >= ref_names.n )
+       {
+        w->missing++;
+        return;
+       }
+    read_order( w, r, pos );
+    if ( ( flag & SKIP_FLAGS ) || mapq < min_mapq )
+        return;
+    if ( (size_t) n > w->cigar_size )
+       {
+        w->cigar_size = n;
+        w->cigar = realloc_safely( w->cigar, n * sizeof( uint32_t ) );
+       }
+    for ( i = 0; i < n; i++ )
+        w->cigar[i] = get32( p + 36 + l_name + 4 * i );
+    count_read( w, r, pos, w->cigar, n );
+   }
+
+
+/* count the reads in w's range: lines of SAM, or (bam) records given */
+/* by their offsets in recs[]                                          */
+
+int      bam_input = 0;
+size_t  *recs;                     /* BAM record offsets in a batch */
+size_t   recs_size = 0;
+
+void  *count_worker( void *arg )
+   {
+    WORKER      *w = (WORKER *) arg;
+    const char  *d = w->data;
+    const char  *q;
+    size_t       i, e;
+
+    w->any = w->unsorted = 0;
+    if ( bam_input )
+        for ( i = w->from; i < w->to; i++ )
+            bam_read( w, d + recs[i] );
+    else
+        for ( i = w->from; i < w->to; i = e + 1 )
+           {
+            q = memchr( d + i, '\n', w->to - i );
+            e = q ? (size_t) ( q - d ) : w->to;
+            sam_read( w, d + i, d + e );
+           }
+    return( NULL );
+   }
+
+
+/* for SAM without @SQ lines: add the references the reads in lines     */
+/* d[0..n-1] are on, and make each reach the furthest end of a read on  */
+/* it, before the threads count them                                    */
+
+void  sam_refs( const char *d, size_t n )
+   {
+    const char  *f[7];
+    const char  *p, *q, *e;
+    int64_t      flag, pos, len, end;
+    long         r;
+    int          i, op;
+
+    for ( p = d; p < d + n; p = e + 1 )
+       {
+        if ( ! (e = memchr( p, '\n', d + n - p )) )
+            e = d + n;
+        if ( *p == '@' )
+            continue;
+        for ( i = 0; i < 6; i++ )            /* the first 6 fields */
+           {
+            f[i] = p;
+            if ( ! (q = memchr( p, '\t', e - p )) )
+                break;
+            p = q + 1;
+           }
+        if ( i < 6 )
+            continue;
+        f[6] = p;
+        if ( ! parse_int( f[1], f[2], &flag ) || ( flag & 4 )
+                || ! parse_int( f[3], f[4], &pos ) || pos <= 0
+                || ( f[2][0] == '*' && f[3] - f[2] == 2 ) )
+            continue;                        /* unmapped */
+        for ( end = pos - 1, p = f[5]; p < f[6] - 1; p = q + 1 )
+           {
+            if ( ! (q = parse_int( p, f[6] - 1, &len )) || q >= f[6] - 1
+                    || (op = cigar_op[ (unsigned char) *q ]) < 0 )
+                break;
+            if ( op == OP_M || op == OP_D || op == OP_N || op == OP_EQ
+                    || op == OP_X )
+                end += len;
+           }
+        if ( (r = find_name( &ref_names, f[2], f[3] - f[2] - 1 )) < 0 )
+            r = add_ref( f[2], f[3] - f[2] - 1, 0 );
+        if ( end > refs[r].len )
+            grow_ref( r, end );
+       }
+   }
+
+
+/* count n SAM lines (bytes), or BAM records, in d, and write out the */
+/* depth that can't change any more                                    */
+
+void  count_batch( const char *d, size_t n )
+   {
+    static uint64_t  last = 0;
+    static int       any = 0;
+    static uint32_t  next_ref = 0;     /* to write the depth of */
+    const char      *q;
+    size_t           c;
+    uint32_t         r;
+    int              t;
+
+    if ( add_refs )
+        sam_refs( d, n );
+    for ( t = 0; t < n_threads; t++ )
+       {
+        workers[t].data = d;
+        workers[t].from = t == 0 ? 0 : workers[t-1].to;
+        c = n * (t + 1) / n_threads;
+        if ( c < workers[t].from )
+            c = workers[t].from;
+        if ( bam_input )
+            workers[t].to = c;
+        else                                 /* to the end of a line */
+           {
+            q = c < n ? memchr( d + c, '\n', n - c ) : NULL;
+            workers[t].to = q ? (size_t) ( q - d + 1 ) : n;
+           }
+       }
+    if ( n_threads == 1 )
+        count_worker( &workers[0] );
+    else
+       {
+        for ( t = 0; t < n_threads; t++ )
+            if ( pthread_create( &workers[t].thread, NULL, count_worker,
+                                 &workers[t] ) != 0 )
+               {
+                perror( "can't create thread" );
+                exit( 1 );
+               }
+        for ( t = 0; t < n_threads; t++ )
+            pthread_join( workers[t].thread, NULL );
+       }
+    if ( ! ( sorted_input && depth_wanted ) )
+        return;
+    for ( t = 0; t < n_threads; t++ )
+        if ( workers[t].any )
+           {
+            if ( workers[t].unsorted || ( any && workers[t].first < last ) )
+               {
+                fprintf( stderr, "input isn't sorted by coordinate, though "
+                                 "its header says so\n" );
+                exit( 1 );
+               }
+            any = 1;
+            last = workers[t].last;
+           }
+    if ( ! any )
+        return;
+    r = last >> 40;           /* reads to come start at last or after */
+    for ( ; next_ref < r; next_ref++ )
+        write_depth( next_ref, refs[next_ref].n_pages );
+    write_depth( r, ( last & 0xffffffffffULL ) >> PAGE_BITS );
+   }
+
+
+                       /*********************************/
+                       /* SAM and BAM headers, batches  */
+                       /*********************************/
+
+/* the value of tag (2 letters and ':') in header line p..e-1, and its */
+/* length in *n; NULL if there isn't one                                */
+
+const char  *header_tag( const char *p, const char *e, const char *tag,
+                         size_t *n )
+   {
+    const char  *q;
+
+    for ( ; p < e; p = q + 1 )
+       {
+        if ( ! (q = memchr( p, '\t', e - p )) )
+            q = e;
+        if ( q - p >= 3 && memcmp( p, tag, 3 ) == 0 )
+           {
+            *n = q - p - 3;
+            return( p + 3 );
+           }
+       }
+    return( NULL );
+   }
+
+
+/* take in the header text p..e-1 (@HD and @SQ lines) */
+
+void  sam_header( const char *p, const char *e, int with_refs )
+   {
+    const char  *q, *sn, *ln, *so;
+    size_t       sn_len, ln_len, so_len;
+    int64_t      len;
+
+    for ( ; p < e; p = q + 1 )
+       {
+        if ( ! (q = memchr( p, '\n', e - p )) )
+            q = e;
+        if ( q - p >= 3 && memcmp( p, "@HD", 3 ) == 0
+                && (so = header_tag( p, q, "SO:", &so_len ))
+                && so_len >= 10 && memcmp( so, "coordinate", 10 ) == 0 )
+            sorted_input = 1;
+        if ( with_refs && q - p >= 3 && memcmp( p, "@SQ", 3 ) == 0 )
+           {
+            if ( ! (sn = header_tag( p, q, "SN:", &sn_len ))
+                    || ! (ln = header_tag( p, q, "LN:", &ln_len ))
+                    || ! parse_int( ln, ln + ln_len, &len ) )
+               {
+                fprintf( stderr, "bad @SQ header line: %.*s\n",
+                                 (int) ( q - p ), p );
+                exit( 1 );
+               }
+            add_ref( sn, sn_len, len );
+           }
+       }
+   }
+
+
+/* count the reads of SAM text (b holds what's been read so far) */
+
+void  count_sam( STREAM *s, BUFFER *b )
+   {
+    const char  *q;
+    size_t       h = 0, end;
+    int          more = 1;
+
+    for ( ; ; )                       /* header lines, up to a read */
+       {
+        if ( h < b->n && b->p[h] != '@' )
+            break;
+        if ( h < b->n && (q = memchr( b->p + h, '\n', b->n - h )) )
+            h = q - b->p + 1;
+        else if ( ! more )
+           {
+            h = b->n;
+            break;
+           }
+        else
+            more = stream_fill( s, b ) > 0;
+       }
+    sam_header( b->p, b->p + h, 1 );
+    add_refs = ref_names.n == 0;
+    while ( more || b->n > h )
+       {
+        if ( more )
+            more = stream_fill( s, b ) > 0;
+        if ( ! more )
+            end = b->n;                            /* the rest */
+        else
+           {
+            for ( q = b->p + b->n; q > b->p + h && q[-1] != '\n'; q-- )
+                ;
+            end = q - b->p;
+            if ( end == h )
+                continue;                 /* no whole line yet */
+           }
+        count_batch( b->p + h, end - h );
+        memmove( b->p, b->p + end, b->n - end );
+        b->n -= end;
+        h = 0;
+       }
+   }
+
+
+/* count the reads of BAM data (b holds what's been read so far) */
+
+void  count_bam( STREAM *s, BUFFER *b )
+   {
+    size_t    h, o, n_recs;
+    uint32_t  l_text, n_ref, l_name, i;
+    int       more = 1;
+
+    stream_need( s, b, 12 );
+    l_text = get32( b->p + 4 );
+    stream_need( s, b, 12 + (size_t) l_text );
+    sam_header( b->p + 8, b->p + 8 + l_text, 0 );
+    n_ref = get32( b->p + 8 + l_text );
+    for ( h = 12 + l_text, i = 0; i < n_ref; i++ )
+       {
+        stream_need( s, b, h + 4 );
+        l_name = get32( b->p + h );
+        stream_need( s, b, h + 8 + l_name );
+        add_ref( b->p + h + 4, l_name > 0 ? l_name - 1 : 0,
+                 (int32_t) get32( b->p + h + 4 + l_name ) );
+        h += 8 + l_name;
+       }
+    while ( more )
+       {
+        more = stream_fill( s, b ) > 0;
+        for ( n_recs = 0, o = h; o + 4 <= b->n
+                                 && o + 4 + get32( b->p + o ) <= b->n;
+              o += 4 + get32( b->p + o ) )
+           {
+            if ( get32( b->p + o ) < 32 )
+               {
+                fprintf( stderr, "%s: bad BAM record\n", s->name );
+                exit( 1 );
+               }
+            if ( n_recs >= recs_size )
+               {
+                recs_size = recs_size == 0 ? 65536 : 2 * recs_size;
+                recs = realloc_safely( recs, recs_size * sizeof( size_t ) );
+               }
+            recs[n_recs++] = o - h;
+           }
+        if ( ! more && o < b->n )
+           {
+            fprintf( stderr, "%s: truncated BAM record\n", s->name );
+            exit( 1 );
+           }
+        if ( n_recs > 0 )
+            count_batch( b->p + h, n_recs );
+        memmove( b->p, b->p + o, b->n - o );
+        b->n -= o;
+        h = 0;
+       }
+   }
+
+
+                                /****************/
+                                /* Main Program */
+                                /****************/
+
+
+int main ( int argc, char **argv )
+   {
+    static const char  ops[] = "MIDNSHP=X";
+    static STREAM      s;
+    BUFFER             b = { NULL, 0, 0 };
+    char              *name;
+    FILE              *f;
+    uint64_t           missing;
+    uint32_t           r;
+    int                i;
+
+    parse_args( argc, argv, &name );
+    for ( i = 0; i < 256; i++ )
+       {
+        is_space[i] = isspace( i ) != 0;
+        cigar_op[i] = -1;
+       }
+    for ( i = 0; ops[i]; i++ )
+        cigar_op[ (int) ops[i] ] = i;
+    for ( i = 0; i < n_threads; i++ )
+        workers[i].id = i;
+    if ( features_file )
+        read_features( features_file );
+    if ( depth_wanted )
+       {
+        if ( ! bedgraph_file || strcmp( bedgraph_file, "-" ) == 0 )
+            bedgraph = stdout;        /* only without -f */
+        else if ( ! (bedgraph = fopen( bedgraph_file, "w" )) )
+           {
+            perror( bedgraph_file );
+            exit( errno );
+           }
+       }
+    f = open_file( name );
+    stream_open( &s, f, name );
+    while ( b.n < 4 && stream_fill( &s, &b ) > 0 )
+        ;
+    bam_input = b.n >= 4 && memcmp( b.p, "BAM\1", 4 ) == 0;
+    if ( bam_input )
+        count_bam( &s, &b );
+    else
+        count_sam( &s, &b );
+    close_file( f );
+    if ( depth_wanted )
+       {
+        for ( r = 0; r < ref_names.n; r++ )
+            write_depth( r, refs[r].n_pages );
+        write_bedgraph( 1 );
+        if ( bedgraph != stdout && fclose( bedgraph ) != 0 )
+           {
+            perror( bedgraph_file );
+            exit( errno );
+           }
+       }
+    if ( features_file )
+        report_features();
+    for ( missing = 0, i = 0; i < n_threads; i++ )
+        missing += workers[i].missing;
+    if ( missing > 0 )
+        fprintf( stderr, "%llu reads on references not in the header were "
+                         "left out\n", (unsigned long long) missing );
+    exit( 0 );
+   }
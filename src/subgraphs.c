@@ -0,0 +1,943 @@
+/* Program:     subgraphs.c                                                  */
+/* Programmer:  Sean R. McCorkle                                             */
+/*              Biology Dept. Brookhaven National Laboratory                 */
+/* Language:    C                                                            */
+/*                                                                           */
+/* Description: Reads pairwise edges (node node) and outputs connected       */
+/*              subgraphs (a compiled connected_subgraphs, with the same     */
+/*              options and output forms)                                    */
+/*                                                                           */
+/* Notes:       Node names are copied once into a string arena and looked up */
+/*              in an open addressing hash table of node numbers; each node  */
+/*              then costs about 32 bytes plus its name.  Components come    */
+/*              from a union-find forest (union by rank, path halving), so   */
+/*              edges need not be kept unless -e or -d print them.           */
+/*                                                                           */
+/*              Input is read in blocks of whole lines, and each block is    */
+/*              cut into -t pieces, read by that many threads at once.  They */
+/*              share the hash table and the forest: a new name claims its   */
+/*              slot with a compare-and-swap, and a union links one root to  */
+/*              another with a compare-and-swap of the parent and rank word  */
+/*              of the first, retrying if it is no longer a root.  Roots are */
+/*              linked in order of (rank, node number), which can't make a  */
+/*              cycle.  Room for every name a block could add is made before */
+/*              it is read, so nothing moves while threads run.  Names are   */
+/*              hashed a group of lines at a time, and their slots           */
+/*              prefetched, so the table's cache misses overlap.             */
+/*                                                                           */
+/*              connected_subgraphs lists the members of a subgraph in the   */
+/*              order of its depth first search; here they are in name       */
+/*              order.  Subgraphs come in the same order (by first member).  */
+/*              Edges (-e, -d) come as they do there: the same search is     */
+/*              made, and each member in turn, in the order it finds them,   */
+/*              gives its edges not yet printed, by name of the other end.   */
+/*                                                                           */
+/* Compiling:   cc -O3 -o subgraphs subgraphs.c -lpthread                    */
+/*                                                                           */
+/*****************************************************************************/
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char rcsvers[] = "$Revision: 1.1 $";
+
+#define  MAX_THREADS     256
+#define  BLOCK_SIZE      (16 << 20)   /* input is read this much at a time */
+#define  ARENA_CHUNK     (1 << 20)    /* names are copied into these */
+#define  MAX_NODES       0x7fffffffU
+
+/* globals set by command line options */
+
+int   print_edges        = 0;      /* set by -e */
+int   edge_comments      = 0;      /* set by -c */
+int   dotty              = 0;      /* set by -d */
+long  min_members        = 1;      /* set by -m */
+int   n_threads          = 1;      /* set by -t */
+
+unsigned char  is_space[256];      /* 1 if whitespace */
+
+
+/* version() - print program name and version */
+
+void  version( void )
+   {
+    char *v;
+    for ( v = rcsvers; *v && *v != ' '; v++ )
+        ;
+    v++;
+    v[strlen(v)-1] = '\0';
+    fprintf( stderr, "\nsubgraphs    version %s\n", v );
+   }
+
+
+/* usage() - print help */
+
+void usage( void )
+   {
+    fprintf( stderr, " \n\
+Usage:       subgraphs [-cde] [-m<n>] [-t<n>] [-hV] [edge-file ...]       \n\
+                                                                          \n\
+             where edge-files (or stdin) are lines of the form            \n\
+                                                                          \n\
+                        a  b                                              \n\
+                        a  c                                              \n\
+                        b  d                                              \n\
+                        e  f                                              \n\
+                                                                          \n\
+             where the pairs indicate edges between nodes a, b, c, d, e,  \n\
+             and f (this is assumed to be an undirected graph).  Anything \n\
+             after the pair (less a leading # word) is the edge's comment.\n\
+                                                                          \n\
+             By default, subgraphs are printed one per line, all node     \n\
+             members on one line, in name order.                          \n\
+                                                                          \n\
+Options:     -d      produce dotty or neato output (Bell Labs graphviz    \n\
+                     package)                                             \n\
+             -e      print edges on separate lines                        \n\
+             -c      carry along edge comments in the case of -e          \n\
+             -m<n>   report no subgraphs with number of members < n       \n\
+             -t<n>   read edges with <n> threads                          \n\
+             -V      print version                                        \n\
+             -h      print help message                                   \n\
+                                                                          \n\
+" );
+
+   }
+
+
+/* extract command line arguments and options */
+
+void parse_args ( int argc, char **argv, int *nfiles, char ***filenames )
+   {
+    static char *stand_in[] = { "-", (char *) 0 };
+    int    c;
+
+    while ( (c = getopt( argc, argv, "cdehm:t:V")) != -1 )
+        switch ( c )
+           {
+            case 'c':  edge_comments = 1;           break;
+            case 'd':  dotty = 1;                   break;
+            case 'e':  print_edges = 1;             break;
+            case 'm':  min_members = atol( optarg );  break;
+            case 't':  n_threads = atoi( optarg );
+                       if ( n_threads < 1 || n_threads > MAX_THREADS )
+                          {
+                           fprintf( stderr, "-t must be in range 1-%d\n",
+                                            MAX_THREADS );
+                           exit( 1 );
+                          }
+                       break;
+            case 'V':  version();               exit(0);
+            case 'h':  version();
+                       usage();
+                       exit(0);
+            default:   usage();                 exit(1);
+           }
+    argc -= optind;
+    argv += optind;
+    if ( argc > 0 )
+       {
+        *nfiles = argc;
+        *filenames = argv;
+       }
+    else
+       {
+        *nfiles = 1;
+        *filenames = stand_in;
+       }
+   }
+
+
+/*********************************************************************/
+/* open_file() opens a file or returns stdin if name is "-", or does */
+/* error exit if file can't be opened                                */
+/*********************************************************************/
+
+FILE *open_file( char *name )
+   {
+    FILE *f;
+
+    if ( strcmp( name, "-" ) == 0 )
+        return( stdin );
+    else
+        if ( (f = fopen( name, "r" ) ) )
+            return( f );
+        else
+           {
+            perror( name );
+            exit( errno );
+           }
+   }
+
+
+/* close_file() closes the file unless its stdin */
+
+void  close_file( FILE *f )
+   {
+    if ( f != stdin )
+        fclose( f );
+   }
+
+
+void  *malloc_safely( size_t n_bytes )   /* malloc() or error exit */
+   {
+    void  *p;
+
+    if ( !(p = malloc( n_bytes )) )
+       {
+        fprintf( stderr, "failed to malloc %lu bytes\n",
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+void  *realloc_safely( void *p, size_t n_bytes )   /* same for realloc() */
+   {
+    if ( !(p = realloc( p, n_bytes )) )
+       {
+        fprintf( stderr, "failed to realloc %lu bytes\n",
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+
+                         /***************************/
+                         /* Nodes: names and forest */
+                         /***************************/
+
+/* A hash slot is 0 (empty), or the name's 32 bit hash in the high half */
+/* and node number + 1 in the low, or BUSY in the low while the thread  */
+/* that claimed it is setting up the node.  A forest word is the rank   */
+/* in the high half and the parent in the low (itself for a root).      */
+
+#define  BUSY        0xffffffffULL
+#define  LOW(w)      ( (uint32_t) (w) )
+#define  HIGH(w)     ( (uint32_t) ( (w) >> 32 ) )
+
+char     **names;                  /* node number -> name */
+uint64_t  *forest;                 /* node number -> rank, parent */
+uint32_t   n_nodes = 0;
+size_t     nodes_size = 0;
+uint64_t  *slots;                  /* the hash table */
+size_t     n_slots = 0;            /* a power of 2 */
+
+/* edges are only kept for -e and -d */
+
+typedef struct edge {
+                      uint32_t  a;
+                      uint32_t  b;
+                      char     *comment;    /* or NULL */
+                    } EDGE;
+
+EDGE      *edges;
+size_t     n_edges = 0;
+size_t     edges_size = 0;
+
+
+static inline uint32_t  hash_name( const char *s, size_t n )
+   {
+    uint64_t  h = n * 0x9e3779b97f4a7c15ULL;
+    uint64_t  w;
+
+    for ( ; n >= 8; s += 8, n -= 8 )
+       {
+        memcpy( &w, s, 8 );
+        h = ( h ^ w ) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+       }
+    if ( n > 0 )
+       {
+        w = 0;
+        memcpy( &w, s, n );
+        h = ( h ^ w ) * 0xff51afd7ed558ccdULL;
+       }
+    h ^= h >> 29;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 32;
+    return( (uint32_t) h );
+   }
+
+
+/* make room for n more nodes, in the node arrays and the hash table; */
+/* only while no thread is reading                                    */
+
+void  nodes_need( size_t n )
+   {
+    uint64_t  *old = slots;
+    size_t     old_n = n_slots;
+    size_t     i, j;
+
+    n += n_nodes;
+    if ( n > MAX_NODES )
+       {
+        fprintf( stderr, "too many nodes (more than %u)\n", MAX_NODES );
+        exit( 1 );
+       }
+    if ( n > nodes_size )
+       {
+        nodes_size = nodes_size == 0 ? 65536 : nodes_size;
+        while ( nodes_size < n )
+            nodes_size *= 2;
+        names = realloc_safely( names, nodes_size * sizeof( char * ) );
+        forest = realloc_safely( forest, nodes_size * sizeof( uint64_t ) );
+       }
+    if ( 2 * n <= n_slots )                  /* kept at most half full */
+        return;
+    n_slots = n_slots == 0 ? 131072 : n_slots;
+    while ( n_slots < 2 * n )
+        n_slots *= 2;
+    slots = malloc_safely( n_slots * sizeof( uint64_t ) );
+    memset( slots, 0, n_slots * sizeof( uint64_t ) );
+    for ( i = 0; i < old_n; i++ )
+        if ( old[i] )
+           {
+            for ( j = HIGH( old[i] ) & ( n_slots - 1 ); slots[j];
+                  j = ( j + 1 ) & ( n_slots - 1 ) )
+                ;
+            slots[j] = old[i];
+           }
+    free( old );
+   }
+
+
+/* root of node x's tree, halving the path to it on the way */
+
+static inline uint32_t  find( uint32_t x )
+   {
+    uint64_t  w, pw;
+    uint32_t  p;
+
+    for ( ; ; )
+       {
+        w = __atomic_load_n( &forest[x], __ATOMIC_ACQUIRE );
+        p = LOW( w );
+        if ( p == x )
+            return( x );
+        pw = __atomic_load_n( &forest[p], __ATOMIC_ACQUIRE );
+        if ( LOW( pw ) != p )          /* point x at its grandparent */
+            __atomic_compare_exchange_n( &forest[x], &w,
+                                         ( w & ~0xffffffffULL ) | LOW( pw ),
+                                         0, __ATOMIC_RELEASE,
+                                         __ATOMIC_RELAXED );
+        x = LOW( pw );
+       }
+   }
+
+
+/* join the trees of nodes a and b */
+
+static inline void  unite( uint32_t a, uint32_t b )
+   {
+    uint64_t  wa, wb, t;
+    uint32_t  ra, rb, tn;
+
+    for ( ; ; )
+       {
+        a = find( a );
+        b = find( b );
+        if ( a == b )
+            return;
+        wa = __atomic_load_n( &forest[a], __ATOMIC_ACQUIRE );
+        wb = __atomic_load_n( &forest[b], __ATOMIC_ACQUIRE );
+        if ( LOW( wa ) != a || LOW( wb ) != b )
+            continue;                         /* one was just linked */
+        ra = HIGH( wa );
+        rb = HIGH( wb );
+        if ( ra > rb || ( ra == rb && a > b ) )
+           {                                  /* link a under b */
+            tn = a;   a = b;    b = tn;
+            t = wa;   wa = wb;  wb = t;
+            tn = ra;  ra = rb;  rb = tn;
+           }
+        if ( __atomic_compare_exchange_n( &forest[a], &wa,
+                                          ( (uint64_t) ra << 32 ) | b, 0,
+                                          __ATOMIC_ACQ_REL,
+                                          __ATOMIC_RELAXED ) )
+           {
+            if ( ra == rb )                   /* fails harmlessly if b */
+                __atomic_compare_exchange_n( &forest[b], &wb,  /* moved */
+                                          ( (uint64_t) ( rb + 1 ) << 32 ) | b,
+                                          0, __ATOMIC_ACQ_REL,
+                                          __ATOMIC_RELAXED );
+            return;
+           }
+       }
+   }
+
+
+                     /**********************************/
+                     /* Blocks of edges, and the       */
+                     /* threads reading them           */
+                     /**********************************/
+
+typedef struct worker {
+                        pthread_t   thread;
+                        const char *data;     /* block */
+                        size_t      from;     /* this thread's lines */
+                        size_t      to;
+                        char       *arena;    /* where names go */
+                        size_t      arena_left;
+                        EDGE       *edges;    /* for -e, -d */
+                        size_t      n_edges;
+                        size_t      edges_size;
+                      } WORKER;
+
+WORKER  workers[MAX_THREADS];
+
+
+/* n bytes from w's arena */
+
+char  *arena_get( WORKER *w, size_t n )
+   {
+    char  *p;
+
+    if ( n > w->arena_left )
+       {
+        w->arena_left = n > ARENA_CHUNK ? n : ARENA_CHUNK;
+        w->arena = malloc_safely( w->arena_left );
+       }
+    p = w->arena;
+    w->arena += n;
+    w->arena_left -= n;
+    return( p );
+   }
+
+
+/* copy s (length n) and a '\0' into w's arena */
+
+char  *arena_copy( WORKER *w, const char *s, size_t n )
+   {
+    char  *p = arena_get( w, n + 1 );
+
+    memcpy( p, s, n );
+    p[n] = '\0';
+    return( p );
+   }
+
+
+/* node number of name s (length n, hash h), adding it if new */
+
+uint32_t  intern( WORKER *w, const char *s, size_t n, uint32_t h )
+   {
+    uint64_t  mask = n_slots - 1;
+    uint64_t  i = h & mask;
+    uint64_t  v, busy;
+    uint32_t  id;
+    char     *nm;
+
+    for ( ; ; )
+       {
+        v = __atomic_load_n( &slots[i], __ATOMIC_ACQUIRE );
+        if ( v == 0 )
+           {
+            busy = ( (uint64_t) h << 32 ) | BUSY;
+            if ( ! __atomic_compare_exchange_n( &slots[i], &v, busy, 0,
+                                                __ATOMIC_ACQ_REL,
+                                                __ATOMIC_ACQUIRE ) )
+                continue;                     /* lost it; look again */
+            id = __atomic_fetch_add( &n_nodes, 1, __ATOMIC_RELAXED );
+            names[id] = arena_copy( w, s, n );
+            forest[id] = id;
+            __atomic_store_n( &slots[i], ( (uint64_t) h << 32 ) | ( id + 1 ),
+                              __ATOMIC_RELEASE );
+            return( id );
+           }
+        if ( HIGH( v ) == h )
+           {
+            if ( LOW( v ) == BUSY )
+                continue;                     /* wait till it's set up */
+            nm = names[ LOW( v ) - 1 ];
+            if ( memcmp( nm, s, n ) == 0 && nm[n] == '\0' )
+                return( LOW( v ) - 1 );
+           }
+        i = ( i + 1 ) & mask;
+       }
+   }
+
+
+/* the comment in d[i..e-1], the rest of an edge line: its words, less */
+/* a first one starting with #, joined by single spaces; NULL if none   */
+
+char  *comment( WORKER *w, const char *d, size_t i, size_t e )
+   {
+    size_t  j, k, n;
+    char   *c, *p;
+
+    while ( i < e && is_space[ (unsigned char) d[i] ] )
+        i++;
+    if ( i < e && d[i] == '#' )
+        while ( i < e && ! is_space[ (unsigned char) d[i] ] )
+            i++;
+    for ( n = 0, j = i; j < e; j++ )          /* room for it */
+        if ( ! is_space[ (unsigned char) d[j] ] )
+            n++;
+        else if ( ! is_space[ (unsigned char) d[j-1] ] )
+            n++;
+    if ( n == 0 )
+        return( NULL );
+    c = p = arena_get( w, n + 1 );
+    for ( j = i; j < e; j = k )
+       {
+        while ( j < e && is_space[ (unsigned char) d[j] ] )
+            j++;
+        for ( k = j; k < e && ! is_space[ (unsigned char) d[k] ]; k++ )
+            ;
+        if ( k == j )
+            break;
+        if ( p > c )
+            *p++ = ' ';
+        memcpy( p, d + j, k - j );
+        p += k - j;
+       }
+    *p = '\0';
+    return( c );
+   }
+
+
+/* read the edge lines in w's range of the block, GROUP at a time: the */
+/* names of a group are hashed and their slots prefetched before any   */
+/* is looked up, so the cache misses overlap.  Blank lines, and lines  */
+/* with only one name, are skipped                                      */
+
+#define  GROUP   16
+
+void  *worker( void *arg )
+   {
+    WORKER      *w = (WORKER *) arg;
+    const char  *d = w->data;
+    const char  *q;
+    const char  *f[GROUP][2];
+    size_t       fl[GROUP][2];
+    uint32_t     h[GROUP][2];
+    size_t       rest[GROUP], eol[GROUP];
+    size_t       i, j, e;
+    uint32_t     a, b;
+    int          g, n, k;
+
+    w->n_edges = 0;
+    for ( i = w->from; i < w->to; )
+       {
+        for ( n = 0; n < GROUP && i < w->to; i = e + 1 )
+           {
+            q = memchr( d + i, '\n', w->to - i );
+            e = q ? q - d : w->to;
+            for ( k = 0; k < 2; k++ )
+               {
+                while ( i < e && is_space[ (unsigned char) d[i] ] )
+                    i++;
+                for ( j = i; j < e && ! is_space[ (unsigned char) d[j] ];
+                      j++ )
+                    ;
+                f[n][k] = d + i;
+                fl[n][k] = j - i;
+                i = j;
+                if ( fl[n][k] == 0 )
+                    break;
+                h[n][k] = hash_name( f[n][k], fl[n][k] );
+                __builtin_prefetch( &slots[ h[n][k] & ( n_slots - 1 ) ] );
+               }
+            if ( k < 2 )
+                continue;
+            rest[n] = i;
+            eol[n] = e;
+            n++;
+           }
+        for ( g = 0; g < n; g++ )
+           {
+            a = intern( w, f[g][0], fl[g][0], h[g][0] );
+            b = intern( w, f[g][1], fl[g][1], h[g][1] );
+            unite( a, b );
+            if ( ! ( print_edges || dotty ) )
+                continue;
+            if ( w->n_edges >= w->edges_size )
+               {
+                w->edges_size = w->edges_size == 0 ? 65536
+                                                   : 2 * w->edges_size;
+                w->edges = realloc_safely( w->edges,
+                                           w->edges_size * sizeof( EDGE ) );
+               }
+            w->edges[w->n_edges].a = a;
+            w->edges[w->n_edges].b = b;
+            w->edges[w->n_edges].comment = comment( w, d, rest[g], eol[g] );
+            w->n_edges++;
+           }
+       }
+    return( NULL );
+   }
+
+
+/* read the edges in lines d[0..n-1] */
+
+void  read_block( char *d, size_t n )
+   {
+    const char  *q;
+    size_t       lines, c;
+    int          t;
+
+    if ( n_edges + n / 4 + 1 > 0xffffffffU )  /* a line is 4 bytes or more */
+       {
+        fprintf( stderr, "too many edges to keep for -e or -d\n" );
+        exit( 1 );
+       }
+    for ( lines = 1, q = d; (q = memchr( q, '\n', d + n - q )); q++ )
+        lines++;
+    nodes_need( 2 * lines );
+    for ( t = 0; t < n_threads; t++ )
+       {
+        workers[t].data = d;
+        workers[t].from = t == 0 ? 0 : workers[t-1].to;
+        c = n * (t + 1) / n_threads;         /* to the end of a line */
+        if ( c < workers[t].from )
+            c = workers[t].from;
+        q = c < n ? memchr( d + c, '\n', n - c ) : NULL;
+        workers[t].to = q ? q - d + 1 : n;
+       }
+    if ( n_threads == 1 )
+        worker( &workers[0] );
+    else
+       {
+        for ( t = 0; t < n_threads; t++ )
+            if ( pthread_create( &workers[t].thread, NULL, worker,
+                                 &workers[t] ) != 0 )
+               {
+                perror( "can't create thread" );
+                exit( 1 );
+               }
+        for ( t = 0; t < n_threads; t++ )
+            pthread_join( workers[t].thread, NULL );
+       }
+    for ( t = 0; t < n_threads; t++ )        /* keep edges in input order */
+        if ( workers[t].n_edges > 0 )
+           {
+            if ( n_edges + workers[t].n_edges > edges_size )
+               {
+                edges_size = edges_size == 0 ? 65536 : edges_size;
+                while ( n_edges + workers[t].n_edges > edges_size )
+                    edges_size *= 2;
+                edges = realloc_safely( edges, edges_size * sizeof( EDGE ) );
+               }
+            memcpy( edges + n_edges, workers[t].edges,
+                    workers[t].n_edges * sizeof( EDGE ) );
+            n_edges += workers[t].n_edges;
+           }
+   }
+
+
+/* read the edges in file f, a block of whole lines at a time */
+
+void  read_edges( FILE *f )
+   {
+    static char   *b = NULL;
+    const char    *q;
+    size_t         n = 0, m, end;
+    int            eof = 0;
+
+    if ( ! b )
+        b = malloc_safely( 2 * BLOCK_SIZE );
+    while ( ! eof )
+       {
+        m = fread( b + n, 1, BLOCK_SIZE, f );
+        if ( m < BLOCK_SIZE )
+           {
+            if ( ferror( f ) )
+               {
+                perror( "subgraphs: read" );
+                exit( errno );
+               }
+            eof = 1;
+           }
+        n += m;
+        if ( eof )
+            end = n;
+        else
+           {
+            for ( q = b + n; q > b && q[-1] != '\n'; q-- )
+                ;
+            end = q - b;
+            if ( end == 0 )
+               {                  /* a line longer than a block */
+                b = realloc_safely( b, n + 2 * BLOCK_SIZE );
+                continue;
+               }
+           }
+        if ( end > 0 )
+            read_block( b, end );
+        memmove( b, b + end, n - end );
+        n -= end;
+       }
+   }
+
+
+                          /*************************/
+                          /* Output of subgraphs   */
+                          /*************************/
+
+uint32_t  *place;         /* node number -> position in name order, */
+                          /* then in depth first order (for -e, -d) */
+
+#define  UNSEEN    0xffffffffU
+
+typedef struct adj {
+                     uint32_t  to;      /* the other end */
+                     uint32_t  edge;    /* index into edges[] */
+                   } ADJ;
+
+
+int  by_name( const void *a, const void *b )
+   {
+    return( strcmp( names[ *(const uint32_t *) a ],
+                    names[ *(const uint32_t *) b ] ) );
+   }
+
+
+int  by_place( const void *a, const void *b )
+   {
+    const ADJ  *x = (const ADJ *) a;
+    const ADJ  *y = (const ADJ *) b;
+
+    if ( place[x->to] != place[y->to] )
+        return( place[x->to] < place[y->to] ? -1 : 1 );
+    return( x->edge < y->edge ? -1 : x->edge > y->edge );
+   }
+
+
+void  print_node( uint32_t x )
+   {
+    if ( dotty )
+       {
+        putchar( '"' );
+        fputs( names[x], stdout );
+        putchar( '"' );
+       }
+    else
+        fputs( names[x], stdout );
+   }
+
+
+/* print the edges from member a to those after it in depth first     */
+/* order, with the comment of the last input line for them, as         */
+/* connected_subgraphs does                                             */
+
+void  print_member_edges( uint32_t a, ADJ *adj, size_t n )
+   {
+    size_t    i, j;
+    uint32_t  b, x, y;
+    char     *ab, *ba;
+    EDGE     *e;
+
+    for ( i = 0; i < n; i = j )
+       {
+        b = adj[i].to;
+        ab = ba = NULL;
+        for ( j = i; j < n && adj[j].to == b; j++ )
+           {
+            e = &edges[ adj[j].edge ];
+            if ( e->comment && e->a == a )
+                ab = e->comment;
+            if ( e->comment && e->a == b )
+                ba = e->comment;
+           }
+        if ( place[b] < place[a] )
+            continue;                     /* printed already, from b */
+        x = a;
+        y = b;
+        if ( ( edge_comments || dotty ) && ! ab && ba )
+           {
+            x = b;
+            y = a;
+            ab = ba;
+           }
+        fputs( "   ", stdout );
+        print_node( x );
+        fputs( dotty ? " -- " : " ", stdout );
+        print_node( y );
+        if ( dotty )
+            putchar( ';' );
+        if ( ( edge_comments || dotty ) && ab )
+           {
+            fputs( "  # ", stdout );
+            fputs( ab, stdout );
+           }
+        putchar( '\n' );
+       }
+   }
+
+
+/* put the subgraph w[0..] in the order a depth first search from w[0] */
+/* finds its members, taking neighbours in name order as               */
+/* connected_subgraphs does, and number them so in place[]; stack and  */
+/* at are room for the search                                           */
+
+void  search_order( uint32_t *w, ADJ *adj, size_t *first, uint32_t *stack,
+                    size_t *at )
+   {
+    uint32_t  m, x, y;
+    size_t    d;
+
+    x = w[0];
+    place[x] = 0;
+    m = 1;
+    stack[0] = x;
+    at[0] = first[x];
+    for ( d = 1; d > 0; )
+       {
+        x = stack[d-1];
+        if ( at[d-1] == first[x+1] )
+           {
+            d--;
+            continue;
+           }
+        y = adj[ at[d-1]++ ].to;
+        if ( place[y] != UNSEEN )
+            continue;
+        place[y] = m;
+        w[m++] = y;
+        stack[d] = y;
+        at[d] = first[y];
+        d++;
+       }
+   }
+
+
+/* sort out the subgraphs and print those big enough */
+
+void  report( void )
+   {
+    uint32_t  *order, *members, *start;
+    uint32_t   n = n_nodes, i, j, k, m, r;
+    size_t    *first = NULL, *at = NULL;
+    ADJ       *adj = NULL;
+    size_t     e;
+    int        with_edges = print_edges || dotty;
+
+    free( slots );
+    order = malloc_safely( (size_t) n * sizeof( uint32_t ) );
+    for ( i = 0; i < n; i++ )
+        order[i] = i;
+    qsort( order, n, sizeof( uint32_t ), by_name );
+    for ( i = 0; i < n; i++ )                 /* forest now holds roots */
+        forest[i] = find( i );
+    start = malloc_safely( (size_t) n * sizeof( uint32_t ) );
+    memset( start, 0, (size_t) n * sizeof( uint32_t ) );
+    for ( i = 0; i < n; i++ )                 /* sizes, at the roots */
+        start[ forest[i] ]++;
+    members = malloc_safely( (size_t) n * sizeof( uint32_t ) );
+    for ( m = 0, i = 0; i < n; i++ )
+       {      /* subgraphs by first member, members in name order; the */
+        r = forest[ order[i] ];        /* top bit marks a size turned */
+        if ( ! ( start[r] & 0x80000000U ) )          /* into a start */
+           {
+            k = start[r];
+            start[r] = m | 0x80000000U;
+            m += k;
+           }
+        members[ start[r] & 0x7fffffffU ] = order[i];
+        start[r]++;
+       }
+    free( start );
+    if ( with_edges )
+       {
+        place = malloc_safely( (size_t) n * sizeof( uint32_t ) );
+        for ( i = 0; i < n; i++ )
+            place[ order[i] ] = i;
+        first = malloc_safely( ( (size_t) n + 1 ) * sizeof( size_t ) );
+        memset( first, 0, ( (size_t) n + 1 ) * sizeof( size_t ) );
+        for ( e = 0; e < n_edges; e++ )       /* both ends list an edge */
+           {
+            first[ edges[e].a + 1 ]++;
+            if ( edges[e].b != edges[e].a )
+                first[ edges[e].b + 1 ]++;
+           }
+        for ( i = 0; i < n; i++ )
+            first[i+1] += first[i];
+        adj = malloc_safely( ( first[n] + 1 ) * sizeof( ADJ ) );
+        for ( e = 0; e < n_edges; e++ )       /* first[x] is x's cursor */
+           {
+            adj[ first[ edges[e].a ] ].to = edges[e].b;
+            adj[ first[ edges[e].a ]++ ].edge = e;
+            if ( edges[e].b != edges[e].a )
+               {
+                adj[ first[ edges[e].b ] ].to = edges[e].a;
+                adj[ first[ edges[e].b ]++ ].edge = e;
+               }
+           }
+        for ( i = n; i > 0; i-- )             /* and back to the start */
+            first[i] = first[i-1];
+        first[0] = 0;
+        for ( i = 0; i < n; i++ )
+            qsort( adj + first[i], first[i+1] - first[i], sizeof( ADJ ),
+                   by_place );
+        for ( i = 0; i < n; i++ )             /* place is free for the */
+            place[i] = UNSEEN;                /* depth first searches */
+        at = malloc_safely( (size_t) n * sizeof( size_t ) );
+       }                                      /* and order is its stack */
+    else
+        free( order );
+    for ( i = 0; i < n; i = j )
+       {
+        r = forest[ members[i] ];
+        for ( j = i + 1; j < n && forest[ members[j] ] == r; j++ )
+            ;
+        if ( j - i < min_members )
+            continue;
+        if ( dotty )
+            fputs( "graph {\n", stdout );
+        for ( k = i; k < j; k++ )
+           {
+            if ( k > i )
+                fputs( dotty ? " ; " : " ", stdout );
+            print_node( members[k] );
+           }
+        fputs( dotty ? ";\n" : "\n", stdout );
+        if ( with_edges )
+           {
+            search_order( members + i, adj, first, order, at );
+            for ( k = i; k < j; k++ )
+                print_member_edges( members[k], adj + first[ members[k] ],
+                                    first[ members[k] + 1 ]
+                                        - first[ members[k] ] );
+           }
+        if ( dotty )
+            fputs( "}\n", stdout );
+       }
+    if ( fflush( stdout ) != 0 )
+       {
+        perror( "subgraphs: write" );
+        exit( errno );
+       }
+   }
+
+
+                                /****************/
+                                /* Main Program */
+                                /****************/
+
+
+int main ( int argc, char **argv )
+   {
+    int            nfiles;
+    int            i;
+    static char  **filenames;
+    FILE          *f;
+
+    parse_args( argc, argv, &nfiles, &filenames );
+    for ( i = 0; i < 256; i++ )
+        is_space[i] = isspace( i ) != 0;
+    for ( i = 0; i < nfiles; i++ )
+       {
+        f = open_file( filenames[i] );
+        read_edges( f );
+        close_file( f );
+       }
+    report();
+    exit( 0 );
+   }
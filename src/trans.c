@@ -0,0 +1,535 @@
+/* Program:     trans.c                                                      */
+/* Programmer:  Sean R. McCorkle                                             */
+/*              Biology Dept. Brookhaven National Laboratory                 */
+/* Language:    C                                                            */
+/*                                                                           */
+/* Description: translates DNA sequences into protein sequences, in any of   */
+/*              the six reading frames (a compiled trans.pl)                 */
+/*                                                                           */
+/* Notes:       Each base is coded in 3 bits (A->0, C->1, G->2, T->3, and    */
+/*              anything else ->4), so a codon is a 9 bit index into a table */
+/*              made from the 64 entry genetic code, in which every codon    */
+/*              with a bit 4 code is 'X', as in trans.pl.  The complement of */
+/*              a code is code ^ 3 (which leaves the 4 bit set).             */
+/*                                                                           */
+/*              The codon indices at every position are computed in one pass */
+/*              over the coded sequence for the top strand, and one for the  */
+/*              bottom (reverse complement) strand; each frame then reads    */
+/*              every third.  These passes carry nothing from one position   */
+/*              to the next, so the compiler can vectorize them.             */
+/*                                                                           */
+/*              Sequences are read a batch at a time and translated by -t    */
+/*              threads, each into its own output buffer, then written out   */
+/*              in input order.                                              */
+/*                                                                           */
+/* Compiling:   cc -O3 -o trans trans.c -lpthread                            */
+/*                                                                           */
+/*****************************************************************************/
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char rcsvers[] = "$Revision: 1.1 $";
+
+#define  MAX_FRAMES       16     /* in a -f list */
+#define  MAX_THREADS     256
+#define  LINE_LEN         50     /* for fasta output */
+
+/* globals set by command line options */
+
+char  frames[MAX_FRAMES][3] = { "F1" };  /* set by -f */
+int   n_frames           = 1;
+int   n_threads          = 1;            /* set by -t */
+
+/* the genetic code, for codons AAA, AAC, AAG, AAT, ACA, ... TTT */
+
+static const char  genetic_code[] =
+              "KNKNTTTTRSRSIIMIQHQHPPPPRRRRLLLLEDEDAAAAGGGGVVVV*Y*YSSSS*CWCLFLF";
+
+#define  BAD_BASE    4
+
+unsigned char  base_code[256];        /* char -> 3 bit code */
+unsigned char  is_space[256];         /* 1 if whitespace */
+char           amino[512];            /* 9 bit codon index -> amino acid */
+
+
+/* version() - print program name and version */
+
+void  version( void )
+   {
+    char *v;
+    for ( v = rcsvers; *v && *v != ' '; v++ )
+        ;
+    v++;
+    v[strlen(v)-1] = '\0';
+    fprintf( stderr, "\ntrans        version %s\n", v );
+   }
+
+
+/* usage() - print help */
+
+void usage( void )
+   {
+    fprintf( stderr, " \n\
+Usage:       trans [-f<frame>] [-t<n>] [-hV] [seq-file ... ]              \n\
+                                                                          \n\
+             where [seq-files] are in FASTA format.  The name \"-\" means \n\
+             stdin.  stdin is scanned it no filemames are specified.      \n\
+                                                                          \n\
+Options:     -f<frame>  translate frame <frame> which is one of F1, F2,   \n\
+                        F3, R1, R2, R3 or a comma-separated list of these \n\
+                        for more than one, or \"all\" which stands for     \n\
+                        \"F1,F2,F3,R1,R2,R3\" (defaults to F1)             \n\
+             -t<n>      translate with <n> threads                        \n\
+             -V         print version                                     \n\
+             -h         print help message                                \n\
+                                                                          \n\
+Output:      fasta format protein sequences, named by the DNA header with \n\
+             -<frame> appended.  * indicates a stop codon, X indicates a  \n\
+             non-translatable codon (one with a letter other than A, C,   \n\
+             G or T, in either case).  A short codon at the end is        \n\
+             dropped.                                                     \n\
+                                                                          \n\
+" );
+
+   }
+
+
+/* check_frame() verifies that f is F1, F2, F3, R1, R2 or R3 (either   */
+/* case) or a comma-separated list of these, or "all", and fills in    */
+/* frames[].  Error exits otherwise                                    */
+
+void  check_frame( char *f )
+   {
+    char  *p;
+    int    i;
+
+    for ( p = f; *p; p++ )
+        *p = toupper( (unsigned char) *p );
+    if ( strcmp( f, "ALL" ) == 0 )
+        f = "F1,F2,F3,R1,R2,R3";
+    for ( n_frames = 0, p = f; ; p += 3 )
+       {
+        if ( ( p[0] != 'F' && p[0] != 'R' ) || p[1] < '1' || p[1] > '3'
+                || ( p[2] != ',' && p[2] != '\0' ) || n_frames >= MAX_FRAMES )
+           {
+            fprintf( stderr, "bad frame specifier \"%s\"; must be one of "
+                             "F1, F2, F3, R1, R2 or R3, or a comma-separated "
+                             "list of these\n", f );
+            exit( 1 );
+           }
+        for ( i = 0; i < 2; i++ )
+            frames[n_frames][i] = p[i];
+        frames[n_frames++][2] = '\0';
+        if ( p[2] == '\0' )
+            break;
+       }
+   }
+
+
+/* extract command line arguments and options */
+
+void parse_args ( int argc, char **argv, int *nfiles, char ***filenames )
+   {
+    static char *stand_in[] = { "-", (char *) 0 };
+    int    c;
+
+    while ( (c = getopt( argc, argv, "f:ht:V")) != -1 )
+        switch ( c )
+           {
+            case 'f':  check_frame( optarg );   break;
+            case 't':  n_threads = atoi( optarg );
+                       if ( n_threads < 1 || n_threads > MAX_THREADS )
+                          {
+                           fprintf( stderr, "-t must be in range 1-%d\n",
+                                            MAX_THREADS );
+                           exit( 1 );
+                          }
+                       break;
+            case 'V':  version();               exit(0);
+            case 'h':  version();
+                       usage();
+                       exit(0);
+            default:   usage();                 exit(1);
+           }
+    argc -= optind;
+    argv += optind;
+    if ( argc > 0 )
+       {
+        *nfiles = argc;
+        *filenames = argv;
+       }
+    else
+       {
+        *nfiles = 1;
+        *filenames = stand_in;
+       }
+   }
+
+
+/*********************************************************************/
+/* open_file() opens a file or returns stdin if name is "-", or does */
+/* error exit if file can't be opened                                */
+/*********************************************************************/
+
+FILE *open_file( char *name )
+   {
+    FILE *f;
+
+    if ( strcmp( name, "-" ) == 0 )
+        return( stdin );
+    else
+        if ( (f = fopen( name, "r" ) ) )
+            return( f );
+        else
+           {
+            perror( name );
+            exit( errno );
+           }
+   }
+
+
+/* close_file() closes the file unless its stdin */
+
+void  close_file( FILE *f )
+   {
+    if ( f != stdin )
+        fclose( f );
+   }
+
+
+void  *malloc_safely( size_t n_bytes )   /* malloc() or error exit */
+   {
+    void  *p;
+
+    if ( !(p = malloc( n_bytes )) )
+       {
+        fprintf( stderr, "failed to malloc %lu bytes\n",
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+void  *realloc_safely( void *p, size_t n_bytes )   /* same for realloc() */
+   {
+    if ( !(p = realloc( p, n_bytes )) )
+       {
+        fprintf( stderr, "failed to realloc %lu bytes\n",
+                         (unsigned long) n_bytes );
+        exit( errno );
+       }
+    return( p );
+   }
+
+
+/* set up the code tables */
+
+void  init( void )
+   {
+    static const char  bases[] = "ACGT";
+    int                i, c0, c1, c2;
+
+    memset( base_code, BAD_BASE, sizeof( base_code ) );
+    for ( i = 0; i < 4; i++ )
+        base_code[ (int) bases[i] ] = base_code[ tolower( bases[i] ) ] = i;
+    for ( i = 0; i < 256; i++ )
+        is_space[i] = isspace( i ) != 0;
+    for ( i = 0; i < 512; i++ )
+       {
+        c0 = i >> 6;
+        c1 = ( i >> 3 ) & 7;
+        c2 = i & 7;
+        amino[i] = ( c0 | c1 | c2 ) & BAD_BASE
+                        ? 'X' : genetic_code[ (c0 << 4) | (c1 << 2) | c2 ];
+       }
+   }
+
+
+                      /*******************************/
+                      /* Batches of sequences, and   */
+                      /* the threads translating them */
+                      /*******************************/
+
+#define  BATCH_SEQS        65536      /* max sequences in one batch */
+#define  BATCH_BYTES       (64 << 20) /* stop filling a batch after this */
+
+typedef struct buffer {                       /* growable byte buffer */
+                        char    *p;
+                        size_t   n;
+                        size_t   size;
+                      } BUFFER;
+
+typedef struct record {
+                        size_t   hdr;         /* offsets into batch data */
+                        size_t   hdr_len;
+                        size_t   seq;
+                        size_t   seq_len;
+                        size_t   out;         /* offset and length of the */
+                        size_t   out_len;     /* translations in its      */
+                      } RECORD;               /* thread's out             */
+
+typedef struct batch {
+                       BUFFER   data;         /* headers and sequences */
+                       RECORD  *recs;
+                       int      n;
+                     } BATCH;
+
+typedef struct worker {
+                        pthread_t   thread;
+                        int         id;
+                        BATCH      *batch;
+                        uint8_t    *code;     /* the coded sequence      */
+                        uint16_t   *top;      /* codon indices, top and  */
+                        uint16_t   *bottom;   /* bottom strands, by      */
+                        size_t      size;     /* position on top strand  */
+                        BUFFER      out;      /* translations go here    */
+                      } WORKER;
+
+WORKER  workers[MAX_THREADS];
+
+
+void  buf_need( BUFFER *b, size_t n )          /* make room for n more */
+   {
+    if ( b->n + n <= b->size )
+        return;
+    if ( b->size == 0 )
+        b->size = 65536;
+    while ( b->n + n > b->size )
+        b->size *= 2;
+    b->p = realloc_safely( b->p, b->size );
+   }
+
+
+/* input is read a line at a time; line holds the next one to look at, */
+/* len its length (or -1 at end of file)                               */
+
+typedef struct reader {
+                        FILE     *f;
+                        char     *line;
+                        size_t    size;
+                        ssize_t   len;
+                      } READER;
+
+/* read up to BATCH_SEQS sequences (or about BATCH_BYTES) from rd; header */
+/* and sequence (with whitespace removed) go into b->data.  Returns the   */
+/* number read.  Anything before the first header is skipped.             */
+
+int  read_batch( READER *rd, BATCH *b )
+   {
+    RECORD  *r;
+    char    *d;
+    ssize_t  i, n;
+
+    b->n = 0;
+    b->data.n = 0;
+    while ( rd->len >= 0 && rd->line[0] != '>' )    /* find a header */
+        rd->len = getline( &rd->line, &rd->size, rd->f );
+    while ( rd->len >= 0 && b->n < BATCH_SEQS && b->data.n < BATCH_BYTES )
+       {
+        r = &b->recs[b->n++];
+        n = rd->len;
+        if ( n > 0 && rd->line[n-1] == '\n' )
+            n--;
+        buf_need( &b->data, n );
+        memcpy( b->data.p + b->data.n, rd->line + 1, n - 1 );
+        r->hdr = b->data.n;
+        r->hdr_len = n - 1;
+        b->data.n += n - 1;
+        r->seq = b->data.n;
+        while ( (rd->len = getline( &rd->line, &rd->size, rd->f )) >= 0
+                    && rd->line[0] != '>' )
+           {
+            buf_need( &b->data, rd->len );
+            d = b->data.p + b->data.n;
+            for ( i = 0; i < rd->len; i++ )
+               {
+                *d = rd->line[i];
+                d += ! is_space[ (unsigned char) rd->line[i] ];
+               }
+            b->data.n = d - b->data.p;
+           }
+        r->seq_len = b->data.n - r->seq;
+       }
+    return( b->n );
+   }
+
+
+/* compute the codon index at each position of sequence s (length n) of */
+/* the top strand, and of the bottom strand codon covering the same 3   */
+/* bases, into w->top[] and w->bottom[]                                 */
+
+void  index_codons( WORKER *w, const unsigned char *s, size_t n )
+   {
+    uint8_t   *restrict c;
+    uint16_t  *restrict top;
+    uint16_t  *restrict bottom;
+    size_t     i;
+
+    if ( n > w->size )
+       {
+        w->size = n + n / 2;
+        w->code = realloc_safely( w->code, w->size );
+        w->top = realloc_safely( w->top, w->size * sizeof( uint16_t ) );
+        w->bottom = realloc_safely( w->bottom, w->size * sizeof( uint16_t ) );
+       }
+    c = w->code;
+    top = w->top;
+    bottom = w->bottom;
+    for ( i = 0; i < n; i++ )
+        c[i] = base_code[ s[i] ];
+    for ( i = 0; i + 2 < n; i++ )
+       {
+        top[i] = ( c[i] << 6 ) | ( c[i+1] << 3 ) | c[i+2];
+        bottom[i] = ( (c[i+2] ^ 3) << 6 ) | ( (c[i+1] ^ 3) << 3 ) | (c[i] ^ 3);
+       }
+   }
+
+
+/* append a fasta header line for record r in frame fr to w->out */
+
+void  add_header( WORKER *w, RECORD *r, const char *fr )
+   {
+    BUFFER  *o = &w->out;
+
+    buf_need( o, r->hdr_len + 5 );
+    o->p[o->n++] = '>';
+    memcpy( o->p + o->n, w->batch->data.p + r->hdr, r->hdr_len );
+    o->n += r->hdr_len;
+    o->p[o->n++] = '-';
+    o->p[o->n++] = fr[0];
+    o->p[o->n++] = fr[1];
+    o->p[o->n++] = '\n';
+   }
+
+
+/* translate record r in each of the frames, into w->out */
+
+void  translate( WORKER *w, RECORD *r )
+   {
+    BUFFER    *o = &w->out;
+    uint16_t  *codons;
+    size_t     n = r->seq_len;
+    size_t     n_aa, i, k;
+    long       p, step;
+    int        f, off;
+
+    r->out = o->n;
+    index_codons( w, (unsigned char *) w->batch->data.p + r->seq, n );
+    for ( f = 0; f < n_frames; f++ )
+       {
+        add_header( w, r, frames[f] );
+        off = frames[f][1] - '1';
+        n_aa = n >= (size_t) off + 3 ? ( n - off ) / 3 : 0;
+        if ( frames[f][0] == 'F' )
+           {
+            codons = w->top;
+            p = off;
+            step = 3;
+           }
+        else
+           {                /* bottom strand frames count from the end */
+            codons = w->bottom;
+            p = (long) n - 3 - off;
+            step = -3;
+           }
+        buf_need( o, n_aa + n_aa / LINE_LEN + 1 );
+        for ( i = 0; i < n_aa; i += k )
+           {
+            for ( k = 0; k < LINE_LEN && i + k < n_aa; k++, p += step )
+                o->p[o->n++] = amino[ codons[p] ];
+            o->p[o->n++] = '\n';
+           }
+       }
+    r->out_len = o->n - r->out;
+   }
+
+
+void  *worker( void *arg )
+   {
+    WORKER  *w = (WORKER *) arg;
+    BATCH   *b = w->batch;
+    int      i;
+
+    w->out.n = 0;
+    for ( i = w->id; i < b->n; i += n_threads )
+        translate( w, &b->recs[i] );
+    return( NULL );
+   }
+
+
+/* translate and write every sequence in file f */
+
+void  translate_file( FILE *f, BATCH *b )
+   {
+    static READER  rd;
+    int            i, n;
+
+    rd.f = f;
+    rd.len = getline( &rd.line, &rd.size, f );
+    while ( (n = read_batch( &rd, b )) > 0 )
+       {
+        for ( i = 0; i < n_threads; i++ )
+            workers[i].batch = b;
+        if ( n_threads == 1 )
+            worker( &workers[0] );
+        else
+           {
+            for ( i = 0; i < n_threads; i++ )
+                if ( pthread_create( &workers[i].thread, NULL, worker,
+                                     &workers[i] ) != 0 )
+                   {
+                    perror( "can't create thread" );
+                    exit( 1 );
+                   }
+            for ( i = 0; i < n_threads; i++ )
+                pthread_join( workers[i].thread, NULL );
+           }
+        for ( i = 0; i < n; i++ )            /* out in input order */
+            if ( fwrite( workers[i % n_threads].out.p + b->recs[i].out, 1,
+                         b->recs[i].out_len, stdout ) != b->recs[i].out_len )
+               {
+                perror( "trans: write" );
+                exit( errno );
+               }
+       }
+    if ( ferror( f ) )
+       {
+        perror( "trans: read" );
+        exit( errno );
+       }
+   }
+
+
+                                /****************/
+                                /* Main Program */
+                                /****************/
+
+
+int main ( int argc, char **argv )
+   {
+    static BATCH   batch;
+    int            nfiles;
+    int            i;
+    static char  **filenames;
+    FILE          *f;
+
+    parse_args( argc, argv, &nfiles, &filenames );
+    init();
+    batch.recs = malloc_safely( BATCH_SEQS * sizeof( RECORD ) );
+    for ( i = 0; i < n_threads; i++ )
+        workers[i].id = i;
+    for ( i = 0; i < nfiles; i++ )
+       {
+        f = open_file( filenames[i] );
+        translate_file( f, &batch );
+        close_file( f );
+       }
+    exit( 0 );
+   }